@@ -1,6 +1,8 @@
 ﻿#include "AudioPluginFactory.h"
 
 #include "ClapHost.h"
+#include "Eap2Config.h"
+#include "SandboxHost.h"
 #include "VstHost.h"
 #include "public.sdk/source/vst/hosting/hostclasses.h"
 #include "public.sdk/source/vst/hosting/plugprovider.h"
@@ -67,6 +69,13 @@ void AudioPluginFactory::Uninitialize() {
 }
 
 std::unique_ptr<IAudioPluginHost> AudioPluginFactory::Create(PluginType type, HINSTANCE hInst) {
+    if (settings.vst.sandbox && (type == PluginType::VST3 || type == PluginType::CLAP)) {
+        return std::make_unique<SandboxHost>(type, hInst);
+    }
+    return CreateInProcess(type, hInst);
+}
+
+std::unique_ptr<IAudioPluginHost> AudioPluginFactory::CreateInProcess(PluginType type, HINSTANCE hInst) {
     switch (type) {
         case PluginType::VST3:
             return std::make_unique<VstHost>(hInst);
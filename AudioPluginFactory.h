@@ -9,5 +9,8 @@ class AudioPluginFactory {
   public:
     static bool Initialize(HINSTANCE hInst);
     static void Uninitialize();
+    // settings.vst.sandbox が有効なら子プロセス経由の SandboxHost を返す
     static std::unique_ptr<IAudioPluginHost> Create(PluginType type, HINSTANCE hInst);
+    // 常にこのプロセス内でプラグインを読み込むホストを返す (子プロセス側もこれを使う)
+    static std::unique_ptr<IAudioPluginHost> CreateInProcess(PluginType type, HINSTANCE hInst);
 };
\ No newline at end of file
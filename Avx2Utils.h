@@ -1,248 +1,163 @@
 ﻿#pragma once
 #include <algorithm>
+#include <atomic>
 #include <cmath>
-#include <immintrin.h>
+#include <cstdint>
+#include <string>
 #include <vector>
 
+// 各カーネルの実体は SimdKernels*.cpp にあり、起動時に CPU に合わせて選んだものを呼び出す。
+// 関数名は互換のため *AVX2 のまま残しているが、実際に使う命令セットは GetSimdLevel() で決まる。
 namespace Avx2Utils {
+enum class SimdLevel : int32_t {
+    Scalar = 0,
+    SSE2,
+    AVX2,
+    AVX512,
+};
+
+struct ParticleBatchParams {
+    int32_t start_idx;
+    int32_t countPerStep;
+    int32_t k_min;
+    float emissionInterval;
+    float timeSinceStart;
+    uint32_t baseSeed;
+    float cx, cy;
+    int32_t scrollMode;
+    float gravity;
+    float particleLife;
+};
+
+// FusedPipeline の各段。src を読む段では src[i] を、それ以外は a/b/c の定数を使う
+enum class FusedOp : int32_t {
+    Scale,          // v *= a
+    Add,            // v += src[i]
+    Multiply,       // v *= src[i]
+    Mix,            // v = (v * a + src[i] * b) * c (MixAudio と同じ)
+    Clip,           // v = clamp(v, a, b)
+    Abs,            // v = |v|
+    Max,            // v = max(v, src[i])
+    Threshold,      // v = v > a ? 1 : 0
+    FollowEnvelope, // env = src ? src[i] : c。v > env ? env * a + v * (1 - a) : env * b + v * (1 - b) (EnvelopeFollower と同じ)
+    SoftClipTanh,   // v = tanh(v * a) (SoftClipTanh と同じ)
+};
+
+struct FusedStage {
+    FusedOp op;
+    const float* src;
+    float a, b, c;
+};
+
+struct KernelTable {
+    void (*CopyBuffer)(float* dst, const float* src, size_t count);
+    void (*FillBuffer)(float* out, size_t count, float value);
+    void (*ScaleBuffer)(float* out, const float* in, size_t count, float scale);
+    void (*Accumulate)(float* dst, const float* src, size_t count);
+    void (*AccumulateScaled)(float* dst, const float* src, size_t count, float scale);
+    void (*MultiplyBuffer)(float* dst, const float* src, size_t count);
+    void (*MultiplyBuffers)(float* out, const float* src1, const float* src2, size_t count);
+    void (*MixAudio)(float* out, const float* in, size_t count, float wet, float dry, float vol);
+    void (*HardClip)(float* buf, size_t count, float min_val, float max_val);
+    void (*SwapChannels)(float* bufL, float* bufR, size_t count);
+    void (*InvertBuffer)(float* buf, size_t count);
+    void (*MatrixMixStereo)(float* outL, float* outR, const float* inL, const float* inR, size_t count, float cLL, float cRL, float cLR, float cRR);
+    void (*SoftClipTanh)(float* buf, size_t count, float drive_gain);
+    void (*FuzzShape)(float* buf, size_t count, float drive);
+    void (*Quantize)(float* buf, size_t count, float step_size);
+    float (*GetPeakAbs)(const float* src, size_t count);
+    void (*EnvelopeFollower)(float* envelope, const float* input, size_t count, float attack_coeff, float release_coeff);
+    void (*Abs)(float* out, const float* in, size_t count);
+    void (*MaxBuffer)(float* out, const float* src1, const float* src2, size_t count);
+    void (*Threshold)(float* out, const float* in, size_t count, float threshold);
+    void (*PeakDetectStereo)(float* out_peak, const float* inL, const float* inR, size_t count);
+    void (*AllpassDiffuse)(float* io, const float* delayed, float* s_out, size_t count, float g);
+    void (*Log2)(float* out, const float* in, size_t count);
+    void (*Exp2)(float* out, const float* in, size_t count);
+    void (*LinearToDb)(float* out, const float* in, size_t count);
+    void (*DbToLinear)(float* out, const float* in, size_t count);
+    void (*Tanh)(float* out, const float* in, size_t count);
+    void (*CompressorGain)(float* gain, const float* envelope, size_t count, float threshold_db, float slope, float makeup_db, float floor_lin);
+    void (*ToPolar)(float* mag, float* phase, const float* re, const float* im, size_t count);
+    void (*FromPolar)(float* re, float* im, const float* mag, const float* phase, size_t count);
+    void (*FftPass)(float* re, float* im, size_t n, size_t half, const float* wr, const float* wi);
+    void (*ZeroUpper)();
+    void (*RunFused)(float* out, const float* in, size_t count, const FusedStage* stages, size_t stage_count);
+
+    int32_t (*ComputeParticleBatch)(const ParticleBatchParams& p, float* out_x, float* out_y, float* out_age);
+    void (*FillBufferRGBA)(PIXEL_RGBA* buf, size_t pixelCount, PIXEL_RGBA color);
+    void (*BlendPixelBatch)(PIXEL_RGBA* buf, const int32_t* xs, const int32_t* ys, int32_t count, int32_t imgW, int32_t imgH, PIXEL_RGBA col);
+    void (*BlendPoints)(PIXEL_RGBA* img, int32_t imgW, int32_t imgH, const float* px, const float* py, const float* ages, int32_t count, PIXEL_RGBA color, float particleLife);
+    void (*ComputeRingAlphaMask)(float* outAlpha, int32_t rectX, int32_t rectY, int32_t rectW, int32_t rectH, int32_t imgW, int32_t imgH, float cx, float cy, float radius, float thickness);
+    void (*FillLineRGBA)(PIXEL_RGBA* buf, int32_t startX, int32_t y, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color);
+    void (*BlendLineRGBA)(PIXEL_RGBA* buf, int32_t startX, int32_t y, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color);
+    void (*FillVerticalLineRGBA)(PIXEL_RGBA* buf, int32_t x, int32_t startY, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color);
+    void (*BlendVerticalLineRGBA)(PIXEL_RGBA* buf, int32_t x, int32_t startY, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color);
+};
+
+// CPU が対応している最上位の命令セット
+SimdLevel DetectSimdLevel();
+// 使用する命令セットを切り替える。CPU が対応していない場合は対応している最上位に落とす。
+SimdLevel SetSimdLevel(SimdLevel level);
+SimdLevel GetSimdLevel();
+const KernelTable& InitKernels();
+// "Auto" / "Scalar" / "SSE2" / "AVX2" / "AVX512" (大文字小文字は区別しない)。Auto は DetectSimdLevel() の結果
+bool ParseSimdLevel(const std::wstring& name, SimdLevel& out);
+const wchar_t* SimdLevelName(SimdLevel level);
+
+extern std::atomic<const KernelTable*> g_kernels;
+
+inline const KernelTable& Kernels() {
+    const KernelTable* table = g_kernels.load(std::memory_order_acquire);
+    return table ? *table : InitKernels();
+}
+
 inline void CopyBufferAVX2(float* dst, const float* src, size_t count) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    for (; i < aligned_count; i += 32) {
-        __m256 r0 = _mm256_loadu_ps(src + i);
-        __m256 r1 = _mm256_loadu_ps(src + i + 8);
-        __m256 r2 = _mm256_loadu_ps(src + i + 16);
-        __m256 r3 = _mm256_loadu_ps(src + i + 24);
-        _mm256_storeu_ps(dst + i, r0);
-        _mm256_storeu_ps(dst + i + 8, r1);
-        _mm256_storeu_ps(dst + i + 16, r2);
-        _mm256_storeu_ps(dst + i + 24, r3);
-    }
-    for (; i < (count - (count % 8)); i += 8) _mm256_storeu_ps(dst + i, _mm256_loadu_ps(src + i));
-    for (; i < count; ++i) dst[i] = src[i];
-    _mm256_zeroupper();
+    Kernels().CopyBuffer(dst, src, count);
 }
 
 inline void FillBufferAVX2(float* out, size_t count, float value) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    __m256 v_val = _mm256_set1_ps(value);
-    for (; i < aligned_count; i += 32) {
-        _mm256_storeu_ps(out + i, v_val);
-        _mm256_storeu_ps(out + i + 8, v_val);
-        _mm256_storeu_ps(out + i + 16, v_val);
-        _mm256_storeu_ps(out + i + 24, v_val);
-    }
-    for (; i < (count - (count % 8)); i += 8) _mm256_storeu_ps(out + i, v_val);
-    for (; i < count; ++i) out[i] = value;
-    _mm256_zeroupper();
+    Kernels().FillBuffer(out, count, value);
 }
 
 inline void ScaleBufferAVX2(float* out, const float* in, size_t count, float scale) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    __m256 v_scale = _mm256_set1_ps(scale);
-    for (; i < aligned_count; i += 32) {
-        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(in + i), v_scale));
-        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), v_scale));
-        _mm256_storeu_ps(out + i + 16, _mm256_mul_ps(_mm256_loadu_ps(in + i + 16), v_scale));
-        _mm256_storeu_ps(out + i + 24, _mm256_mul_ps(_mm256_loadu_ps(in + i + 24), v_scale));
-    }
-    for (; i < (count - (count % 8)); i += 8) _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(in + i), v_scale));
-    for (; i < count; ++i) out[i] = in[i] * scale;
-    _mm256_zeroupper();
+    Kernels().ScaleBuffer(out, in, count, scale);
 }
 
 inline void AccumulateAVX2(float* dst, const float* src, size_t count) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    for (; i < aligned_count; i += 32) {
-        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
-        _mm256_storeu_ps(dst + i + 8, _mm256_add_ps(_mm256_loadu_ps(dst + i + 8), _mm256_loadu_ps(src + i + 8)));
-        _mm256_storeu_ps(dst + i + 16, _mm256_add_ps(_mm256_loadu_ps(dst + i + 16), _mm256_loadu_ps(src + i + 16)));
-        _mm256_storeu_ps(dst + i + 24, _mm256_add_ps(_mm256_loadu_ps(dst + i + 24), _mm256_loadu_ps(src + i + 24)));
-    }
-    for (; i < (count - (count % 8)); i += 8) _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
-    for (; i < count; ++i) dst[i] += src[i];
-    _mm256_zeroupper();
+    Kernels().Accumulate(dst, src, count);
 }
 
 inline void AccumulateScaledAVX2(float* dst, const float* src, size_t count, float scale) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    __m256 v_scale = _mm256_set1_ps(scale);
-    for (; i < aligned_count; i += 32) {
-        _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(_mm256_loadu_ps(src + i), v_scale, _mm256_loadu_ps(dst + i)));
-        _mm256_storeu_ps(dst + i + 8, _mm256_fmadd_ps(_mm256_loadu_ps(src + i + 8), v_scale, _mm256_loadu_ps(dst + i + 8)));
-        _mm256_storeu_ps(dst + i + 16, _mm256_fmadd_ps(_mm256_loadu_ps(src + i + 16), v_scale, _mm256_loadu_ps(dst + i + 16)));
-        _mm256_storeu_ps(dst + i + 24, _mm256_fmadd_ps(_mm256_loadu_ps(src + i + 24), v_scale, _mm256_loadu_ps(dst + i + 24)));
-    }
-    for (; i < (count - (count % 8)); i += 8) _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(_mm256_loadu_ps(src + i), v_scale, _mm256_loadu_ps(dst + i)));
-    for (; i < count; ++i) dst[i] += src[i] * scale;
-    _mm256_zeroupper();
+    Kernels().AccumulateScaled(dst, src, count, scale);
 }
 
 inline void MultiplyBufferAVX2(float* dst, const float* src, size_t count) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    for (; i < aligned_count; i += 32) {
-        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
-        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_loadu_ps(dst + i + 8), _mm256_loadu_ps(src + i + 8)));
-        _mm256_storeu_ps(dst + i + 16, _mm256_mul_ps(_mm256_loadu_ps(dst + i + 16), _mm256_loadu_ps(src + i + 16)));
-        _mm256_storeu_ps(dst + i + 24, _mm256_mul_ps(_mm256_loadu_ps(dst + i + 24), _mm256_loadu_ps(src + i + 24)));
-    }
-    for (; i < (count - (count % 8)); i += 8) _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
-    for (; i < count; ++i) dst[i] *= src[i];
-    _mm256_zeroupper();
+    Kernels().MultiplyBuffer(dst, src, count);
 }
 
 inline void MultiplyBufferAVX2(float* out, const float* src1, const float* src2, size_t count) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    for (; i < aligned_count; i += 32) {
-        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(src1 + i), _mm256_loadu_ps(src2 + i)));
-        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_loadu_ps(src1 + i + 8), _mm256_loadu_ps(src2 + i + 8)));
-        _mm256_storeu_ps(out + i + 16, _mm256_mul_ps(_mm256_loadu_ps(src1 + i + 16), _mm256_loadu_ps(src2 + i + 16)));
-        _mm256_storeu_ps(out + i + 24, _mm256_mul_ps(_mm256_loadu_ps(src1 + i + 24), _mm256_loadu_ps(src2 + i + 24)));
-    }
-    for (; i < (count - (count % 8)); i += 8) _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(src1 + i), _mm256_loadu_ps(src2 + i)));
-    for (; i < count; ++i) out[i] = src1[i] * src2[i];
-    _mm256_zeroupper();
+    Kernels().MultiplyBuffers(out, src1, src2, count);
 }
 
 inline void MixAudioAVX2(float* out, const float* in, size_t count, float wet, float dry, float vol) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    __m256 v_wet = _mm256_set1_ps(wet);
-    __m256 v_dry = _mm256_set1_ps(dry);
-    __m256 v_vol = _mm256_set1_ps(vol);
-
-    for (; i < aligned_count; i += 32) {
-        __m256 mix0 = _mm256_fmadd_ps(_mm256_loadu_ps(out + i), v_wet, _mm256_mul_ps(_mm256_loadu_ps(in + i), v_dry));
-        __m256 mix1 = _mm256_fmadd_ps(_mm256_loadu_ps(out + i + 8), v_wet, _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), v_dry));
-        __m256 mix2 = _mm256_fmadd_ps(_mm256_loadu_ps(out + i + 16), v_wet, _mm256_mul_ps(_mm256_loadu_ps(in + i + 16), v_dry));
-        __m256 mix3 = _mm256_fmadd_ps(_mm256_loadu_ps(out + i + 24), v_wet, _mm256_mul_ps(_mm256_loadu_ps(in + i + 24), v_dry));
-
-        _mm256_storeu_ps(out + i, _mm256_mul_ps(mix0, v_vol));
-        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(mix1, v_vol));
-        _mm256_storeu_ps(out + i + 16, _mm256_mul_ps(mix2, v_vol));
-        _mm256_storeu_ps(out + i + 24, _mm256_mul_ps(mix3, v_vol));
-    }
-    for (; i < (count - (count % 8)); i += 8) {
-        __m256 v_mix = _mm256_fmadd_ps(_mm256_loadu_ps(out + i), v_wet, _mm256_mul_ps(_mm256_loadu_ps(in + i), v_dry));
-        _mm256_storeu_ps(out + i, _mm256_mul_ps(v_mix, v_vol));
-    }
-    for (; i < count; ++i) out[i] = (out[i] * wet + in[i] * dry) * vol;
-    _mm256_zeroupper();
+    Kernels().MixAudio(out, in, count, wet, dry, vol);
 }
 
 inline void HardClipAVX2(float* buf, size_t count, float min_val, float max_val) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    __m256 v_min = _mm256_set1_ps(min_val);
-    __m256 v_max = _mm256_set1_ps(max_val);
-    for (; i < aligned_count; i += 32) {
-        __m256 v0 = _mm256_loadu_ps(buf + i);
-        __m256 v1 = _mm256_loadu_ps(buf + i + 8);
-        __m256 v2 = _mm256_loadu_ps(buf + i + 16);
-        __m256 v3 = _mm256_loadu_ps(buf + i + 24);
-
-        v0 = _mm256_min_ps(_mm256_max_ps(v0, v_min), v_max);
-        v1 = _mm256_min_ps(_mm256_max_ps(v1, v_min), v_max);
-        v2 = _mm256_min_ps(_mm256_max_ps(v2, v_min), v_max);
-        v3 = _mm256_min_ps(_mm256_max_ps(v3, v_min), v_max);
-
-        _mm256_storeu_ps(buf + i, v0);
-        _mm256_storeu_ps(buf + i + 8, v1);
-        _mm256_storeu_ps(buf + i + 16, v2);
-        _mm256_storeu_ps(buf + i + 24, v3);
-    }
-    for (; i < (count - (count % 8)); i += 8) {
-        __m256 v = _mm256_loadu_ps(buf + i);
-        _mm256_storeu_ps(buf + i, _mm256_min_ps(_mm256_max_ps(v, v_min), v_max));
-    }
-    for (; i < count; ++i) {
-        if (buf[i] < min_val) buf[i] = min_val;
-        else if (buf[i] > max_val) buf[i] = max_val;
-    }
-    _mm256_zeroupper();
+    Kernels().HardClip(buf, count, min_val, max_val);
 }
 
 inline void SwapChannelsAVX2(float* bufL, float* bufR, size_t count) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    for (; i < aligned_count; i += 32) {
-        __m256 l0 = _mm256_loadu_ps(bufL + i), r0 = _mm256_loadu_ps(bufR + i);
-        _mm256_storeu_ps(bufL + i, r0);
-        _mm256_storeu_ps(bufR + i, l0);
-
-        __m256 l1 = _mm256_loadu_ps(bufL + i + 8), r1 = _mm256_loadu_ps(bufR + i + 8);
-        _mm256_storeu_ps(bufL + i + 8, r1);
-        _mm256_storeu_ps(bufR + i + 8, l1);
-
-        __m256 l2 = _mm256_loadu_ps(bufL + i + 16), r2 = _mm256_loadu_ps(bufR + i + 16);
-        _mm256_storeu_ps(bufL + i + 16, r2);
-        _mm256_storeu_ps(bufR + i + 16, l2);
-
-        __m256 l3 = _mm256_loadu_ps(bufL + i + 24), r3 = _mm256_loadu_ps(bufR + i + 24);
-        _mm256_storeu_ps(bufL + i + 24, r3);
-        _mm256_storeu_ps(bufR + i + 24, l3);
-    }
-    for (; i < (count - (count % 8)); i += 8) {
-        __m256 v_l = _mm256_loadu_ps(bufL + i);
-        __m256 v_r = _mm256_loadu_ps(bufR + i);
-        _mm256_storeu_ps(bufL + i, v_r);
-        _mm256_storeu_ps(bufR + i, v_l);
-    }
-    for (; i < count; ++i) std::swap(bufL[i], bufR[i]);
-    _mm256_zeroupper();
+    Kernels().SwapChannels(bufL, bufR, count);
 }
 
 inline void InvertBufferAVX2(float* buf, size_t count) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    __m256 v_neg = _mm256_set1_ps(-1.0f);
-    for (; i < aligned_count; i += 32) {
-        _mm256_storeu_ps(buf + i, _mm256_mul_ps(_mm256_loadu_ps(buf + i), v_neg));
-        _mm256_storeu_ps(buf + i + 8, _mm256_mul_ps(_mm256_loadu_ps(buf + i + 8), v_neg));
-        _mm256_storeu_ps(buf + i + 16, _mm256_mul_ps(_mm256_loadu_ps(buf + i + 16), v_neg));
-        _mm256_storeu_ps(buf + i + 24, _mm256_mul_ps(_mm256_loadu_ps(buf + i + 24), v_neg));
-    }
-    for (; i < (count - (count % 8)); i += 8) _mm256_storeu_ps(buf + i, _mm256_mul_ps(_mm256_loadu_ps(buf + i), v_neg));
-    for (; i < count; ++i) buf[i] = -buf[i];
-    _mm256_zeroupper();
+    Kernels().InvertBuffer(buf, count);
 }
 
 inline void MatrixMixStereoAVX2(float* outL, float* outR, const float* inL, const float* inR, size_t count, float cLL, float cRL, float cLR, float cRR) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    __m256 v_cLL = _mm256_set1_ps(cLL), v_cRL = _mm256_set1_ps(cRL);
-    __m256 v_cLR = _mm256_set1_ps(cLR), v_cRR = _mm256_set1_ps(cRR);
-
-    for (; i < aligned_count; i += 32) {
-        auto mix_chunk = [&](int32_t offset) {
-            __m256 l = _mm256_loadu_ps(inL + i + offset);
-            __m256 r = _mm256_loadu_ps(inR + i + offset);
-            _mm256_storeu_ps(outL + i + offset, _mm256_fmadd_ps(l, v_cLL, _mm256_mul_ps(r, v_cRL)));
-            _mm256_storeu_ps(outR + i + offset, _mm256_fmadd_ps(l, v_cLR, _mm256_mul_ps(r, v_cRR)));
-        };
-        mix_chunk(0);
-        mix_chunk(8);
-        mix_chunk(16);
-        mix_chunk(24);
-    }
-    for (; i < (count - (count % 8)); i += 8) {
-        __m256 l = _mm256_loadu_ps(inL + i);
-        __m256 r = _mm256_loadu_ps(inR + i);
-        _mm256_storeu_ps(outL + i, _mm256_fmadd_ps(l, v_cLL, _mm256_mul_ps(r, v_cRL)));
-        _mm256_storeu_ps(outR + i, _mm256_fmadd_ps(l, v_cLR, _mm256_mul_ps(r, v_cRR)));
-    }
-    for (; i < count; ++i) {
-        float l = inL[i], r = inR[i];
-        outL[i] = l * cLL + r * cRL;
-        outR[i] = l * cLR + r * cRR;
-    }
-    _mm256_zeroupper();
+    Kernels().MatrixMixStereo(outL, outR, inL, inR, count, cLL, cRL, cLR, cRR);
 }
 
 inline void ReadRingBufferAVX2(float* dst, const std::vector<float>& buf, int32_t buf_size, int32_t read_pos, int32_t count) {
@@ -261,691 +176,172 @@ inline void WriteRingBufferAVX2(std::vector<float>& buf, const float* src, int32
     if (first_chunk < count) CopyBufferAVX2(buf.data(), src + first_chunk, count - first_chunk);
 }
 
+// buf = tanh(buf * drive_gain)。tanh は FastMath::FastTanh と同じ近似
 inline void SoftClipTanhAVX2(float* buf, size_t count, float drive_gain) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    __m256 v_gain = _mm256_set1_ps(drive_gain);
-
-    __m256 v_3 = _mm256_set1_ps(3.0f);
-    __m256 v_neg3 = _mm256_set1_ps(-3.0f);
-    __m256 v_1 = _mm256_set1_ps(1.0f);
-    __m256 v_neg0 = _mm256_set1_ps(-0.0f);
-
-    for (; i < aligned_count; i += 32) {
-        auto process_chunk = [&](int32_t offset) {
-            __m256 x = _mm256_loadu_ps(buf + i + offset);
-            x = _mm256_mul_ps(x, v_gain);
-            x = _mm256_max_ps(x, v_neg3);
-            x = _mm256_min_ps(x, v_3);
-
-            __m256 abs_x = _mm256_andnot_ps(v_neg0, x);
-            __m256 denom = _mm256_add_ps(v_1, abs_x);
-            __m256 res = _mm256_div_ps(x, denom);
-
-            _mm256_storeu_ps(buf + i + offset, res);
-        };
-        process_chunk(0);
-        process_chunk(8);
-        process_chunk(16);
-        process_chunk(24);
-    }
-
-    for (; i < (count - (count % 8)); i += 8) {
-        __m256 x = _mm256_loadu_ps(buf + i);
-        x = _mm256_mul_ps(x, v_gain);
-        x = _mm256_max_ps(x, v_neg3);
-        x = _mm256_min_ps(x, v_3);
-
-        __m256 abs_x = _mm256_andnot_ps(v_neg0, x);
-        __m256 denom = _mm256_add_ps(v_1, abs_x);
-        _mm256_storeu_ps(buf + i, _mm256_div_ps(x, denom));
-    }
-
-    for (; i < count; ++i) {
-        float x = buf[i] * drive_gain;
-        if (x < -3.0f) x = -3.0f;
-        else if (x > 3.0f) x = 3.0f;
-        buf[i] = x / (1.0f + std::abs(x));
-    }
-    _mm256_zeroupper();
+    Kernels().SoftClipTanh(buf, count, drive_gain);
 }
 
 inline void FuzzShapeAVX2(float* buf, size_t count, float drive) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    __m256 v_drive_scale = _mm256_set1_ps(1.0f + drive * 10.0f);
-    __m256 v_max = _mm256_set1_ps(0.8f);
-    __m256 v_min = _mm256_set1_ps(-0.8f);
-
-    for (; i < aligned_count; i += 32) {
-        auto process_chunk = [&](int32_t offset) {
-            __m256 x = _mm256_loadu_ps(buf + i + offset);
-            x = _mm256_mul_ps(x, v_drive_scale);
-            x = _mm256_min_ps(x, v_max);
-            x = _mm256_max_ps(x, v_min);
-            _mm256_storeu_ps(buf + i + offset, x);
-        };
-        process_chunk(0);
-        process_chunk(8);
-        process_chunk(16);
-        process_chunk(24);
-    }
-    for (; i < (count - (count % 8)); i += 8) {
-        __m256 x = _mm256_loadu_ps(buf + i);
-        x = _mm256_mul_ps(x, v_drive_scale);
-        x = _mm256_min_ps(x, v_max);
-        x = _mm256_max_ps(x, v_min);
-        _mm256_storeu_ps(buf + i, x);
-    }
-    for (; i < count; ++i) {
-        float val = buf[i] * (1.0f + drive * 10.0f);
-        if (val > 0.8f) val = 0.8f;
-        else if (val < -0.8f) val = -0.8f;
-        buf[i] = val;
-    }
-    _mm256_zeroupper();
+    Kernels().FuzzShape(buf, count, drive);
 }
 
 inline void QuantizeAVX2(float* buf, size_t count, float step_size) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    __m256 v_step = _mm256_set1_ps(step_size);
-    __m256 v_inv_step = _mm256_set1_ps(1.0f / step_size);
-
-    for (; i < aligned_count; i += 32) {
-        auto process_chunk = [&](int32_t offset) {
-            __m256 x = _mm256_loadu_ps(buf + i + offset);
-            x = _mm256_mul_ps(x, v_inv_step);
-            x = _mm256_floor_ps(x);
-            x = _mm256_mul_ps(x, v_step);
-            _mm256_storeu_ps(buf + i + offset, x);
-        };
-        process_chunk(0);
-        process_chunk(8);
-        process_chunk(16);
-        process_chunk(24);
-    }
-    for (; i < (count - (count % 8)); i += 8) {
-        __m256 x = _mm256_loadu_ps(buf + i);
-        x = _mm256_mul_ps(x, v_inv_step);
-        x = _mm256_floor_ps(x);
-        x = _mm256_mul_ps(x, v_step);
-        _mm256_storeu_ps(buf + i, x);
-    }
-    for (; i < count; ++i) buf[i] = std::floor(buf[i] / step_size) * step_size;
-    _mm256_zeroupper();
+    Kernels().Quantize(buf, count, step_size);
 }
 
 inline float GetPeakAbsAVX2(const float* src, size_t count) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    __m256 v_max0 = _mm256_setzero_ps();
-    __m256 v_max1 = _mm256_setzero_ps();
-    __m256 v_max2 = _mm256_setzero_ps();
-    __m256 v_max3 = _mm256_setzero_ps();
-    __m256 v_sign_mask = _mm256_set1_ps(-0.0f);
-
-    for (; i < aligned_count; i += 32) {
-        v_max0 = _mm256_max_ps(v_max0, _mm256_andnot_ps(v_sign_mask, _mm256_loadu_ps(src + i)));
-        v_max1 = _mm256_max_ps(v_max1, _mm256_andnot_ps(v_sign_mask, _mm256_loadu_ps(src + i + 8)));
-        v_max2 = _mm256_max_ps(v_max2, _mm256_andnot_ps(v_sign_mask, _mm256_loadu_ps(src + i + 16)));
-        v_max3 = _mm256_max_ps(v_max3, _mm256_andnot_ps(v_sign_mask, _mm256_loadu_ps(src + i + 24)));
-    }
+    return Kernels().GetPeakAbs(src, count);
+}
 
-    __m256 v_max = _mm256_max_ps(_mm256_max_ps(v_max0, v_max1), _mm256_max_ps(v_max2, v_max3));
+inline void EnvelopeFollowerAVX2(float* envelope, const float* input, size_t count, float attack_coeff, float release_coeff) {
+    Kernels().EnvelopeFollower(envelope, input, count, attack_coeff, release_coeff);
+}
 
-    for (; i < (count - (count % 8)); i += 8) {
-        __m256 v_val = _mm256_loadu_ps(src + i);
-        v_val = _mm256_andnot_ps(v_sign_mask, v_val);
-        v_max = _mm256_max_ps(v_max, v_val);
-    }
+inline void AbsAVX2(float* out, const float* in, size_t count) {
+    Kernels().Abs(out, in, count);
+}
 
-    alignas(32) float temp[8];
-    _mm256_store_ps(temp, v_max);
-    float max_val = 0.0f;
-    for (int32_t k = 0; k < 8; ++k)
-        if (temp[k] > max_val) max_val = temp[k];
+inline void MaxBufferAVX2(float* out, const float* src1, const float* src2, size_t count) {
+    Kernels().MaxBuffer(out, src1, src2, count);
+}
 
-    for (; i < count; ++i) max_val = (std::max)(max_val, std::abs(src[i]));
-    _mm256_zeroupper();
-    return max_val;
+inline void ThresholdAVX2(float* out, const float* in, size_t count, float threshold) {
+    Kernels().Threshold(out, in, count, threshold);
 }
 
-inline void EnvelopeFollowerAVX2(float* envelope, const float* input, size_t count, float attack_coeff, float release_coeff) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 8);
-    __m256 v_attack = _mm256_set1_ps(attack_coeff);
-    __m256 v_release = _mm256_set1_ps(release_coeff);
-    __m256 v_one = _mm256_set1_ps(1.0f);
-    __m256 v_one_m_attack = _mm256_set1_ps(1.0f - attack_coeff);
-    __m256 v_one_m_release = _mm256_set1_ps(1.0f - release_coeff);
-
-    for (; i < aligned_count; i += 8) {
-        __m256 v_env = _mm256_loadu_ps(envelope + i);
-        __m256 v_in = _mm256_loadu_ps(input + i);
-        __m256 v_cmp = _mm256_cmp_ps(v_in, v_env, _CMP_GT_OS);
-        __m256 v_attack_result = _mm256_fmadd_ps(v_env, v_attack, _mm256_mul_ps(v_in, v_one_m_attack));
-        __m256 v_release_result = _mm256_fmadd_ps(v_env, v_release, _mm256_mul_ps(v_in, v_one_m_release));
-        __m256 v_result = _mm256_blendv_ps(v_release_result, v_attack_result, v_cmp);
-        _mm256_storeu_ps(envelope + i, v_result);
-    }
+inline void PeakDetectStereoAVX2(float* out_peak, const float* inL, const float* inR, size_t count) {
+    Kernels().PeakDetectStereo(out_peak, inL, inR, count);
+}
 
-    for (; i < count; ++i) {
-        if (input[i] > envelope[i]) envelope[i] = attack_coeff * envelope[i] + (1.0f - attack_coeff) * input[i];
-        else envelope[i] = release_coeff * envelope[i] + (1.0f - release_coeff) * input[i];
-    }
-    _mm256_zeroupper();
+// s = io + g * delayed, io = delayed - g * s (Schroeder オールパスの1段分)
+inline void AllpassDiffuseAVX2(float* io, const float* delayed, float* s_out, size_t count, float g) {
+    Kernels().AllpassDiffuse(io, delayed, s_out, count, g);
 }
 
-inline void AbsAVX2(float* out, const float* in, size_t count) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    __m256 v_mask = _mm256_set1_ps(-0.0f);
-
-    for (; i < aligned_count; i += 32) {
-        __m256 v0 = _mm256_loadu_ps(in + i);
-        __m256 v1 = _mm256_loadu_ps(in + i + 8);
-        __m256 v2 = _mm256_loadu_ps(in + i + 16);
-        __m256 v3 = _mm256_loadu_ps(in + i + 24);
-        _mm256_storeu_ps(out + i, _mm256_andnot_ps(v_mask, v0));
-        _mm256_storeu_ps(out + i + 8, _mm256_andnot_ps(v_mask, v1));
-        _mm256_storeu_ps(out + i + 16, _mm256_andnot_ps(v_mask, v2));
-        _mm256_storeu_ps(out + i + 24, _mm256_andnot_ps(v_mask, v3));
-    }
+// 以下の近似の誤差は FastMath.h を参照。in と out は同じバッファでもよい
+inline void Log2AVX2(float* out, const float* in, size_t count) {
+    Kernels().Log2(out, in, count);
+}
 
-    for (; i < (count - (count % 8)); i += 8) {
-        __m256 v = _mm256_loadu_ps(in + i);
-        _mm256_storeu_ps(out + i, _mm256_andnot_ps(v_mask, v));
-    }
+inline void Exp2AVX2(float* out, const float* in, size_t count) {
+    Kernels().Exp2(out, in, count);
+}
 
-    for (; i < count; ++i) out[i] = std::abs(in[i]);
-    _mm256_zeroupper();
+inline void LinearToDbAVX2(float* out, const float* in, size_t count) {
+    Kernels().LinearToDb(out, in, count);
 }
 
-inline void MaxBufferAVX2(float* out, const float* src1, const float* src2, size_t count) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-
-    for (; i < aligned_count; i += 32) {
-        __m256 v0_a = _mm256_loadu_ps(src1 + i), v0_b = _mm256_loadu_ps(src2 + i);
-        __m256 v1_a = _mm256_loadu_ps(src1 + i + 8), v1_b = _mm256_loadu_ps(src2 + i + 8);
-        __m256 v2_a = _mm256_loadu_ps(src1 + i + 16), v2_b = _mm256_loadu_ps(src2 + i + 16);
-        __m256 v3_a = _mm256_loadu_ps(src1 + i + 24), v3_b = _mm256_loadu_ps(src2 + i + 24);
-        _mm256_storeu_ps(out + i, _mm256_max_ps(v0_a, v0_b));
-        _mm256_storeu_ps(out + i + 8, _mm256_max_ps(v1_a, v1_b));
-        _mm256_storeu_ps(out + i + 16, _mm256_max_ps(v2_a, v2_b));
-        _mm256_storeu_ps(out + i + 24, _mm256_max_ps(v3_a, v3_b));
-    }
+inline void DbToLinearAVX2(float* out, const float* in, size_t count) {
+    Kernels().DbToLinear(out, in, count);
+}
 
-    for (; i < (count - (count % 8)); i += 8) {
-        __m256 va = _mm256_loadu_ps(src1 + i);
-        __m256 vb = _mm256_loadu_ps(src2 + i);
-        _mm256_storeu_ps(out + i, _mm256_max_ps(va, vb));
-    }
+inline void TanhAVX2(float* out, const float* in, size_t count) {
+    Kernels().Tanh(out, in, count);
+}
 
-    for (; i < count; ++i) out[i] = (std::max)(src1[i], src2[i]);
-    _mm256_zeroupper();
+// コンプレッサーのゲインカーブ (ニーなし)。envelope は floor_lin 未満を floor_lin とみなす。
+// gain = 10^((max(env_db - threshold_db, 0) * slope + makeup_db) / 20)。slope はレシオ r に対して 1/r - 1
+inline void CompressorGainAVX2(float* gain, const float* envelope, size_t count, float threshold_db, float slope, float makeup_db, float floor_lin) {
+    Kernels().CompressorGain(gain, envelope, count, threshold_db, slope, makeup_db, floor_lin);
 }
 
-inline void ThresholdAVX2(float* out, const float* in, size_t count, float threshold) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 32);
-    __m256 v_threshold = _mm256_set1_ps(threshold);
-    __m256 v_one = _mm256_set1_ps(1.0f);
-    __m256 v_zero = _mm256_set1_ps(0.0f);
-
-    for (; i < aligned_count; i += 32) {
-        __m256 v0 = _mm256_loadu_ps(in + i);
-        __m256 v1 = _mm256_loadu_ps(in + i + 8);
-        __m256 v2 = _mm256_loadu_ps(in + i + 16);
-        __m256 v3 = _mm256_loadu_ps(in + i + 24);
-        __m256 cmp0 = _mm256_cmp_ps(v0, v_threshold, _CMP_GT_OS);
-        __m256 cmp1 = _mm256_cmp_ps(v1, v_threshold, _CMP_GT_OS);
-        __m256 cmp2 = _mm256_cmp_ps(v2, v_threshold, _CMP_GT_OS);
-        __m256 cmp3 = _mm256_cmp_ps(v3, v_threshold, _CMP_GT_OS);
-        _mm256_storeu_ps(out + i, _mm256_blendv_ps(v_zero, v_one, cmp0));
-        _mm256_storeu_ps(out + i + 8, _mm256_blendv_ps(v_zero, v_one, cmp1));
-        _mm256_storeu_ps(out + i + 16, _mm256_blendv_ps(v_zero, v_one, cmp2));
-        _mm256_storeu_ps(out + i + 24, _mm256_blendv_ps(v_zero, v_one, cmp3));
-    }
+// mag = |re + i im|, phase = atan2(im, re)
+inline void ToPolarAVX2(float* mag, float* phase, const float* re, const float* im, size_t count) {
+    Kernels().ToPolar(mag, phase, re, im, count);
+}
 
-    for (; i < (count - (count % 8)); i += 8) {
-        __m256 v = _mm256_loadu_ps(in + i);
-        __m256 cmp = _mm256_cmp_ps(v, v_threshold, _CMP_GT_OS);
-        _mm256_storeu_ps(out + i, _mm256_blendv_ps(v_zero, v_one, cmp));
-    }
+// re + i im = mag * e^(i phase)
+inline void FromPolarAVX2(float* re, float* im, const float* mag, const float* phase, size_t count) {
+    Kernels().FromPolar(re, im, mag, phase, count);
+}
 
-    for (; i < count; ++i) out[i] = in[i] > threshold ? 1.0f : 0.0f;
-    _mm256_zeroupper();
+// 複素 FFT (分割形式) の基数 2 の 1 段。RealFft から使う
+inline void FftPassAVX2(float* re, float* im, size_t n, size_t half, const float* wr, const float* wi) {
+    Kernels().FftPass(re, im, n, half, wr, wi);
 }
 
-inline void PeakDetectStereoAVX2(float* out_peak, const float* inL, const float* inR, size_t count) {
-    size_t i = 0;
-    size_t aligned_count = count - (count % 8);
-    __m256 v_sign_mask = _mm256_set1_ps(-0.0f);
-
-    for (; i < aligned_count; i += 8) {
-        __m256 vL = _mm256_loadu_ps(inL + i);
-        __m256 vR = _mm256_loadu_ps(inR + i);
-        vL = _mm256_andnot_ps(v_sign_mask, vL);
-        vR = _mm256_andnot_ps(v_sign_mask, vR);
-        _mm256_storeu_ps(out_peak + i, _mm256_max_ps(vL, vR));
+// AVX 以上で動作している場合のみ vzeroupper を発行する
+inline void ZeroUpper() {
+    Kernels().ZeroUpper();
+}
+
+// 要素ごとの処理を複数段つなげ、バッファを 1 回読んで 1 回書くだけで済ませる。
+// 例: FusedPipeline(gate).Threshold(th).Multiply(bufL).Mix(bufL, 1.0f - mix, mix, 1.0f).Run(bufL.data(), count);
+// in / out / 各段の src は同じバッファを指してよい (ずれた位置を指すのは不可)。
+class FusedPipeline {
+  public:
+    static constexpr size_t kMaxStages = 16;
+
+    explicit FusedPipeline(const float* in) : in_(in) {}
+
+    FusedPipeline& Scale(float k) { return Push(FusedOp::Scale, nullptr, k); }
+    FusedPipeline& Add(const float* src) { return Push(FusedOp::Add, src); }
+    FusedPipeline& Multiply(const float* src) { return Push(FusedOp::Multiply, src); }
+    FusedPipeline& Mix(const float* src, float wet, float dry, float vol) { return Push(FusedOp::Mix, src, wet, dry, vol); }
+    FusedPipeline& Clip(float min_val, float max_val) { return Push(FusedOp::Clip, nullptr, min_val, max_val); }
+    FusedPipeline& Abs() { return Push(FusedOp::Abs, nullptr); }
+    FusedPipeline& Max(const float* src) { return Push(FusedOp::Max, src); }
+    FusedPipeline& Threshold(float threshold) { return Push(FusedOp::Threshold, nullptr, threshold); }
+    FusedPipeline& FollowEnvelope(const float* envelope, float attack_coeff, float release_coeff) { return Push(FusedOp::FollowEnvelope, envelope, attack_coeff, release_coeff); }
+    FusedPipeline& FollowEnvelope(float envelope, float attack_coeff, float release_coeff) { return Push(FusedOp::FollowEnvelope, nullptr, attack_coeff, release_coeff, envelope); }
+    FusedPipeline& SoftClipTanh(float drive_gain) { return Push(FusedOp::SoftClipTanh, nullptr, drive_gain); }
+
+    // 段数が kMaxStages を超えていた場合は何もせず false を返す
+    bool Run(float* out, size_t count) const {
+        if (overflow_) return false;
+        Kernels().RunFused(out, in_, count, stages_, stage_count_);
+        return true;
     }
 
-    for (; i < count; ++i) out_peak[i] = (std::max)(std::abs(inL[i]), std::abs(inR[i]));
-    _mm256_zeroupper();
-}
+  private:
+    FusedPipeline& Push(FusedOp op, const float* src, float a = 0.0f, float b = 0.0f, float c = 0.0f) {
+        if (stage_count_ >= kMaxStages) {
+            overflow_ = true;
+            return *this;
+        }
+        stages_[stage_count_++] = FusedStage{ op, src, a, b, c };
+        return *this;
+    }
 
-struct ParticleBatchParams {
-    int32_t start_idx;
-    int32_t countPerStep;
-    int32_t k_min;
-    float emissionInterval;
-    float timeSinceStart;
-    uint32_t baseSeed;
-    float cx, cy;
-    int32_t scrollMode;
-    float gravity;
-    float particleLife;
+    const float* in_;
+    FusedStage stages_[kMaxStages] = {};
+    size_t stage_count_ = 0;
+    bool overflow_ = false;
 };
 
 inline int32_t ComputeParticleBatchAVX2(const ParticleBatchParams& p, float* out_x, float* out_y, float* out_age) {
-    __m256 v_gravity = _mm256_set1_ps(p.gravity);
-    __m256 v_life = _mm256_set1_ps(p.particleLife);
-    __m256 v_zero = _mm256_setzero_ps();
-    __m256 v_cx = _mm256_set1_ps(p.cx);
-    __m256 v_cy = _mm256_set1_ps(p.cy);
-    __m256i v_idx = _mm256_setr_epi32(p.start_idx, p.start_idx + 1, p.start_idx + 2, p.start_idx + 3, p.start_idx + 4, p.start_idx + 5, p.start_idx + 6, p.start_idx + 7);
-    __m256 v_idx_ps = _mm256_cvtepi32_ps(v_idx);
-    __m256 v_count_ps = _mm256_cvtepi32_ps(_mm256_set1_epi32(p.countPerStep));
-    __m256 v_k_rel_ps = _mm256_floor_ps(_mm256_div_ps(v_idx_ps, v_count_ps));
-    __m256i v_k_rel_i = _mm256_cvtps_epi32(v_k_rel_ps);
-    __m256i v_k_i = _mm256_add_epi32(_mm256_set1_epi32(p.k_min), v_k_rel_i);
-    __m256i v_count_i = _mm256_set1_epi32(p.countPerStep);
-    __m256i v_p_i = _mm256_sub_epi32(v_idx, _mm256_mullo_epi32(v_k_rel_i, v_count_i));
-    __m256 v_k_ps = _mm256_cvtepi32_ps(v_k_i);
-    __m256 v_emitTime = _mm256_mul_ps(v_k_ps, _mm256_set1_ps(p.emissionInterval));
-    __m256 v_age = _mm256_sub_ps(_mm256_set1_ps(p.timeSinceStart), v_emitTime);
-    __m256i v_baseSeed = _mm256_set1_epi32(p.baseSeed);
-    __m256i v_seed = _mm256_add_epi32(v_baseSeed, _mm256_mullo_epi32(v_k_i, _mm256_set1_epi32(7193)));
-    v_seed = _mm256_add_epi32(v_seed, _mm256_mullo_epi32(v_p_i, _mm256_set1_epi32(31337)));
-    v_seed = _mm256_xor_si256(v_seed, _mm256_slli_epi32(v_seed, 13));
-    v_seed = _mm256_xor_si256(v_seed, _mm256_srli_epi32(v_seed, 17));
-    v_seed = _mm256_xor_si256(v_seed, _mm256_slli_epi32(v_seed, 5));
-    __m256 v_rand1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(v_seed, _mm256_set1_epi32(0xFFFFFF))), _mm256_set1_ps(1.0f / 16777215.0f));
-    v_seed = _mm256_xor_si256(v_seed, _mm256_slli_epi32(v_seed, 13));
-    v_seed = _mm256_xor_si256(v_seed, _mm256_srli_epi32(v_seed, 17));
-    v_seed = _mm256_xor_si256(v_seed, _mm256_slli_epi32(v_seed, 5));
-    __m256 v_rand2 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(v_seed, _mm256_set1_epi32(0xFFFFFF))), _mm256_set1_ps(1.0f / 16777215.0f));
-    v_seed = _mm256_xor_si256(v_seed, _mm256_slli_epi32(v_seed, 13));
-    v_seed = _mm256_xor_si256(v_seed, _mm256_srli_epi32(v_seed, 17));
-    v_seed = _mm256_xor_si256(v_seed, _mm256_slli_epi32(v_seed, 5));
-    __m256 v_rand3 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(v_seed, _mm256_set1_epi32(0xFFFFFF))), _mm256_set1_ps(1.0f / 16777215.0f));
-    __m256 v_one = _mm256_set1_ps(1.0f);
-    __m256 v_two = _mm256_set1_ps(2.0f);
-    __m256 v_rx = _mm256_sub_ps(_mm256_mul_ps(v_rand1, v_two), v_one);
-    __m256 v_ry = _mm256_sub_ps(_mm256_mul_ps(v_rand2, v_two), v_one);
-    __m256 v_lenSq = _mm256_add_ps(_mm256_mul_ps(v_rx, v_rx), _mm256_mul_ps(v_ry, v_ry));
-    __m256 v_invLen = _mm256_rsqrt_ps(_mm256_add_ps(v_lenSq, _mm256_set1_ps(1e-6f)));
-    __m256 v_speed = _mm256_add_ps(_mm256_set1_ps(50.0f), _mm256_mul_ps(v_rand3, _mm256_set1_ps(250.0f)));
-    __m256 v_vx = _mm256_mul_ps(v_rx, _mm256_mul_ps(v_invLen, v_speed));
-    __m256 v_vy = _mm256_mul_ps(v_ry, _mm256_mul_ps(v_invLen, v_speed));
-    __m256 v_px = _mm256_add_ps(v_cx, _mm256_mul_ps(v_vx, v_age));
-    __m256 v_py = _mm256_add_ps(v_cy, _mm256_mul_ps(v_vy, v_age));
-    __m256 v_g_delta = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(v_gravity, _mm256_mul_ps(v_age, v_age)));
-    if (p.scrollMode == 3) v_py = _mm256_sub_ps(v_py, v_g_delta);
-    else v_py = _mm256_add_ps(v_py, v_g_delta);
-    __m256 v_mask = _mm256_and_ps(
-        _mm256_cmp_ps(v_age, v_zero, _CMP_GT_OQ),
-        _mm256_cmp_ps(v_age, v_life, _CMP_LT_OQ));
-    _mm256_storeu_ps(out_x, v_px);
-    _mm256_storeu_ps(out_y, v_py);
-    _mm256_storeu_ps(out_age, v_age);
-    _mm256_zeroupper();
-    return _mm256_movemask_ps(v_mask);
+    return Kernels().ComputeParticleBatch(p, out_x, out_y, out_age);
 }
 
 inline void FillBufferRGBAx8(PIXEL_RGBA* buf, size_t pixelCount, PIXEL_RGBA color) {
-    if (pixelCount <= 0) return;
-    uint32_t colorU32 = *reinterpret_cast<uint32_t*>(&color);
-    __m256i v_color = _mm256_setr_epi32(colorU32, colorU32, colorU32, colorU32, colorU32, colorU32, colorU32, colorU32);
-
-    size_t i = 0;
-    size_t aligned = pixelCount - (pixelCount % 8);
-    uint32_t* buf32 = reinterpret_cast<uint32_t*>(buf);
-
-    for (; i < aligned; i += 8) _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf32 + i), v_color);
-    for (; i < pixelCount; ++i) buf[i] = color;
+    Kernels().FillBufferRGBA(buf, pixelCount, color);
 }
 
 inline void BlendPixelBatchAVX2(PIXEL_RGBA* buf, const int32_t* xs, const int32_t* ys, int32_t count, int32_t imgW, int32_t imgH, PIXEL_RGBA col) {
-    if (count <= 0 || col.a == 0) return;
-    __m256 v_alpha = _mm256_set1_ps(col.a / 255.0f);
-    __m256 v_invAlpha = _mm256_set1_ps(1.0f - col.a / 255.0f);
-    __m256 v_cr = _mm256_set1_ps(static_cast<float>(col.r));
-    __m256 v_cg = _mm256_set1_ps(static_cast<float>(col.g));
-    __m256 v_cb = _mm256_set1_ps(static_cast<float>(col.b));
-    __m256 v_ca = _mm256_set1_ps(static_cast<float>(col.a));
-
-    for (int32_t k = 0; k < count; ++k) {
-        int32_t x = xs[k];
-        int32_t y = ys[k];
-        if (x < 0 || y < 0 || x >= imgW || y >= imgH) continue;
-        int32_t idx = y * imgW + x;
-        if (col.a == 255) {
-            buf[idx] = col;
-        } else {
-            PIXEL_RGBA bg = buf[idx];
-            __m256 v_bgr = _mm256_set1_ps(static_cast<float>(bg.r));
-            __m256 v_bgg = _mm256_set1_ps(static_cast<float>(bg.g));
-            __m256 v_bgb = _mm256_set1_ps(static_cast<float>(bg.b));
-            __m256 v_bga = _mm256_set1_ps(static_cast<float>(bg.a));
-            __m256 v_outr = _mm256_add_ps(_mm256_mul_ps(v_cr, v_alpha), _mm256_mul_ps(v_bgr, v_invAlpha));
-            __m256 v_outg = _mm256_add_ps(_mm256_mul_ps(v_cg, v_alpha), _mm256_mul_ps(v_bgg, v_invAlpha));
-            __m256 v_outb = _mm256_add_ps(_mm256_mul_ps(v_cb, v_alpha), _mm256_mul_ps(v_bgb, v_invAlpha));
-            __m256 v_outa = _mm256_min_ps(_mm256_set1_ps(255.0f), _mm256_add_ps(v_bga, v_ca));
-            alignas(32) float outr[8], outg[8], outb[8], outa[8];
-            _mm256_store_ps(outr, v_outr);
-            _mm256_store_ps(outg, v_outg);
-            _mm256_store_ps(outb, v_outb);
-            _mm256_store_ps(outa, v_outa);
-            buf[idx].r = static_cast<uint8_t>(outr[0]);
-            buf[idx].g = static_cast<uint8_t>(outg[0]);
-            buf[idx].b = static_cast<uint8_t>(outb[0]);
-            buf[idx].a = static_cast<uint8_t>(outa[0]);
-        }
-    }
-    _mm256_zeroupper();
+    Kernels().BlendPixelBatch(buf, xs, ys, count, imgW, imgH, col);
 }
 
 inline void BlendPointsAVX2(PIXEL_RGBA* img, int32_t imgW, int32_t imgH, const float* px, const float* py, const float* ages, int32_t count, PIXEL_RGBA color, float particleLife) {
-    if (count <= 0) return;
-    __m256 v_life = _mm256_set1_ps(particleLife);
-    __m256 v_zero = _mm256_setzero_ps();
-    __m256 v_one = _mm256_set1_ps(1.0f);
-    __m256 v_alpha_scale = _mm256_set1_ps(color.a / 255.0f);
-    __m256 v_px = _mm256_loadu_ps(px);
-    __m256 v_py = _mm256_loadu_ps(py);
-    __m256 v_age = _mm256_loadu_ps(ages);
-    __m256 v_valid_lo = _mm256_cmp_ps(v_age, v_zero, _CMP_GT_OQ);
-    __m256 v_valid_hi = _mm256_cmp_ps(v_age, v_life, _CMP_LT_OQ);
-    __m256 v_valid = _mm256_and_ps(v_valid_lo, v_valid_hi);
-    int32_t valid_mask = _mm256_movemask_ps(v_valid);
-    __m256 v_age_norm = _mm256_div_ps(v_age, v_life);
-    __m256 v_alpha = _mm256_mul_ps(_mm256_sub_ps(v_one, v_age_norm), v_alpha_scale);
-    __m256 v_cr = _mm256_set1_ps(static_cast<float>(color.r));
-    __m256 v_cg = _mm256_set1_ps(static_cast<float>(color.g));
-    __m256 v_cb = _mm256_set1_ps(static_cast<float>(color.b));
-    __m256 v_r = _mm256_mul_ps(v_cr, v_alpha);
-    __m256 v_g = _mm256_mul_ps(v_cg, v_alpha);
-    __m256 v_b = _mm256_mul_ps(v_cb, v_alpha);
-
-    alignas(32) float pxs[8], pys[8], rx[8], gx[8], bx[8], ax[8];
-    _mm256_store_ps(pxs, v_px);
-    _mm256_store_ps(pys, v_py);
-    _mm256_store_ps(rx, v_r);
-    _mm256_store_ps(gx, v_g);
-    _mm256_store_ps(bx, v_b);
-    _mm256_store_ps(ax, v_alpha);
-
-    for (int32_t k = 0; k < count; ++k) {
-        if (!((valid_mask >> k) & 1)) continue;
-        int32_t ix = static_cast<int32_t>(pxs[k]);
-        int32_t iy = static_cast<int32_t>(pys[k]);
-        if (ix < 0 || iy < 0 || ix >= imgW || iy >= imgH) continue;
-        float alpha = ax[k];
-        float lifeRatio = ages[k] / particleLife;
-        int32_t pSize = static_cast<int32_t>(3.0f * (1.0f - lifeRatio) + 1.0f);
-        if (pSize < 1) pSize = 1;
-        float invA = 1.0f - alpha;
-        for (int32_t dy = 0; dy < pSize; ++dy) {
-            int32_t yy = iy + dy;
-            if (yy >= imgH) break;
-            int32_t base = yy * imgW;
-            for (int32_t dx = 0; dx < pSize; ++dx) {
-                int32_t xx = ix + dx;
-                if (xx >= imgW) break;
-                int32_t idx = base + xx;
-                PIXEL_RGBA src = img[idx];
-                PIXEL_RGBA out;
-                out.r = static_cast<uint8_t>(rx[k] + src.r * invA);
-                out.g = static_cast<uint8_t>(gx[k] + src.g * invA);
-                out.b = static_cast<uint8_t>(bx[k] + src.b * invA);
-                out.a = static_cast<uint8_t>((std::min)(255, static_cast<int32_t>(src.a + color.a * alpha)));
-                img[idx] = out;
-            }
-        }
-    }
-    _mm256_zeroupper();
+    Kernels().BlendPoints(img, imgW, imgH, px, py, ages, count, color, particleLife);
 }
 
 inline void ComputeRingAlphaMaskAVX2(float* outAlpha, int32_t rectX, int32_t rectY, int32_t rectW, int32_t rectH, int32_t imgW, int32_t imgH, float cx, float cy, float radius, float thickness) {
-    if (rectW <= 0 || rectH <= 0) return;
-    float rOut = radius;
-    float rIn = (radius - thickness);
-    if (rIn < 0.0f) rIn = 0.0f;
-    float rOut2 = rOut * rOut;
-    float rIn2 = rIn * rIn;
-
-    const int32_t simdWidth = 8;
-    __m256 v_cx = _mm256_set1_ps(cx);
-    __m256 v_cy = _mm256_set1_ps(cy);
-    __m256 v_rOut2 = _mm256_set1_ps(rOut2);
-    __m256 v_rIn2 = _mm256_set1_ps(rIn2);
-    __m256 v_one = _mm256_set1_ps(1.0f);
-
-    for (int32_t yy = 0; yy < rectH; ++yy) {
-        int32_t y = rectY + yy;
-        float dy = static_cast<float>(y) - cy;
-        __m256 v_dy = _mm256_set1_ps(dy);
-        __m256 v_dy2 = _mm256_mul_ps(v_dy, v_dy);
-
-        int32_t xx = 0;
-        for (; xx <= rectW - simdWidth; xx += simdWidth) {
-            alignas(32) float xs[8];
-            for (int32_t k = 0; k < 8; ++k) xs[k] = static_cast<float>(rectX + xx + k);
-            __m256 v_x = _mm256_load_ps(xs);
-            __m256 v_dx = _mm256_sub_ps(v_x, v_cx);
-            __m256 v_dx2 = _mm256_mul_ps(v_dx, v_dx);
-            __m256 v_d2 = _mm256_add_ps(v_dx2, v_dy2);
-            __m256 v_ge_in = _mm256_cmp_ps(v_d2, v_rIn2, _CMP_GE_OS);
-            __m256 v_le_out = _mm256_cmp_ps(v_d2, v_rOut2, _CMP_LE_OS);
-            __m256 v_mask = _mm256_and_ps(v_ge_in, v_le_out);
-            __m256 v_distOut = _mm256_sub_ps(v_rOut2, v_d2);
-            __m256 v_distIn = _mm256_sub_ps(v_d2, v_rIn2);
-            __m256 v_alphaOut = _mm256_min_ps(v_one, _mm256_mul_ps(v_distOut, _mm256_set1_ps(0.25f)));
-            __m256 v_alphaIn = _mm256_min_ps(v_one, _mm256_mul_ps(v_distIn, _mm256_set1_ps(0.25f)));
-            __m256 v_alpha = _mm256_min_ps(v_alphaIn, v_alphaOut);
-            v_alpha = _mm256_and_ps(v_alpha, v_mask);
-
-            alignas(32) float outVals[8];
-            _mm256_store_ps(outVals, v_alpha);
-            for (int32_t k = 0; k < 8; ++k) outAlpha[yy * rectW + xx + k] = outVals[k];
-        }
-        for (; xx < rectW; ++xx) {
-            int32_t x = rectX + xx;
-            float dx = static_cast<float>(x) - cx;
-            float d2 = dx * dx + dy * dy;
-            float a = 0.0f;
-            if (d2 >= rIn2 && d2 <= rOut2) {
-                float distOut = rOut2 - d2;
-                float distIn = d2 - rIn2;
-                float ao = (std::min)(1.0f, distOut * 0.25f);
-                float ai = (std::min)(1.0f, distIn * 0.25f);
-                a = (std::min)(ao, ai);
-            }
-            outAlpha[yy * rectW + xx] = a;
-        }
-    }
-    _mm256_zeroupper();
+    Kernels().ComputeRingAlphaMask(outAlpha, rectX, rectY, rectW, rectH, imgW, imgH, cx, cy, radius, thickness);
 }
 
 inline void FillLineRGBAx8(PIXEL_RGBA* buf, int32_t startX, int32_t y, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color) {
-    if (lineLen <= 0 || y < 0 || y >= imgH) return;
-    int32_t endX = (std::min)(startX + lineLen, imgW);
-    if (startX >= imgW || endX <= 0) return;
-    if (startX < 0) startX = 0;
-
-    int32_t pixIdx = y * imgW + startX;
-    int32_t remaining = endX - startX;
-    uint32_t colorU32 = *reinterpret_cast<uint32_t*>(&color);
-    __m256i v_color = _mm256_setr_epi32(colorU32, colorU32, colorU32, colorU32, colorU32, colorU32, colorU32, colorU32);
-
-    uint32_t* buf32 = reinterpret_cast<uint32_t*>(buf + pixIdx);
-    int32_t aligned = remaining - (remaining % 8);
-
-    for (int32_t i = 0; i < aligned; i += 8) _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf32 + i), v_color);
-    for (int32_t i = aligned; i < remaining; ++i) buf[pixIdx + i] = color;
+    Kernels().FillLineRGBA(buf, startX, y, lineLen, imgW, imgH, color);
 }
 
 inline void BlendLineRGBAx8(PIXEL_RGBA* buf, int32_t startX, int32_t y, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color) {
-    if (lineLen <= 0 || y < 0 || y >= imgH || color.a == 0) return;
-    if (color.a == 255) {
-        FillLineRGBAx8(buf, startX, y, lineLen, imgW, imgH, color);
-        return;
-    }
-
-    int32_t endX = (std::min)(startX + lineLen, imgW);
-    if (startX >= imgW || endX <= 0) return;
-    if (startX < 0) startX = 0;
-
-    int32_t pixIdx = y * imgW + startX;
-    int32_t remaining = endX - startX;
-
-    __m256 v_alpha = _mm256_set1_ps(color.a / 255.0f);
-    __m256 v_invAlpha = _mm256_set1_ps(1.0f - color.a / 255.0f);
-    __m256 v_cr = _mm256_set1_ps(static_cast<float>(color.r));
-    __m256 v_cg = _mm256_set1_ps(static_cast<float>(color.g));
-    __m256 v_cb = _mm256_set1_ps(static_cast<float>(color.b));
-    __m256 v_ca = _mm256_set1_ps(static_cast<float>(color.a));
-    __m256 v_255 = _mm256_set1_ps(255.0f);
-
-    for (int32_t i = 0; i < remaining - 7; i += 8) {
-        __m256i bg_packed = _mm256_loadu_si256(reinterpret_cast<__m256i*>(buf + pixIdx + i));
-        alignas(32) uint32_t bgPackedArr[8];
-        _mm256_store_si256((__m256i*)bgPackedArr, bg_packed);
-
-        alignas(32) float bgr[8], bgg[8], bgb[8], bga[8];
-        for (int32_t j = 0; j < 8; ++j) {
-            uint32_t px = bgPackedArr[j];
-            bgr[j] = static_cast<float>(static_cast<uint8_t>(px & 0xFF));
-            bgg[j] = static_cast<float>(static_cast<uint8_t>((px >> 8) & 0xFF));
-            bgb[j] = static_cast<float>(static_cast<uint8_t>((px >> 16) & 0xFF));
-            bga[j] = static_cast<float>(static_cast<uint8_t>((px >> 24) & 0xFF));
-        }
-
-        __m256 v_bgr = _mm256_load_ps(bgr);
-        __m256 v_bgg = _mm256_load_ps(bgg);
-        __m256 v_bgb = _mm256_load_ps(bgb);
-        __m256 v_bga = _mm256_load_ps(bga);
-        __m256 v_outr = _mm256_add_ps(_mm256_mul_ps(v_cr, v_alpha), _mm256_mul_ps(v_bgr, v_invAlpha));
-        __m256 v_outg = _mm256_add_ps(_mm256_mul_ps(v_cg, v_alpha), _mm256_mul_ps(v_bgg, v_invAlpha));
-        __m256 v_outb = _mm256_add_ps(_mm256_mul_ps(v_cb, v_alpha), _mm256_mul_ps(v_bgb, v_invAlpha));
-        __m256 v_outa = _mm256_min_ps(v_255, _mm256_add_ps(v_bga, v_ca));
-
-        alignas(32) float outr[8], outg[8], outb[8], outa[8];
-        _mm256_store_ps(outr, v_outr);
-        _mm256_store_ps(outg, v_outg);
-        _mm256_store_ps(outb, v_outb);
-        _mm256_store_ps(outa, v_outa);
-
-        for (int32_t j = 0; j < 8; ++j) {
-            buf[pixIdx + i + j].r = static_cast<uint8_t>(outr[j]);
-            buf[pixIdx + i + j].g = static_cast<uint8_t>(outg[j]);
-            buf[pixIdx + i + j].b = static_cast<uint8_t>(outb[j]);
-            buf[pixIdx + i + j].a = static_cast<uint8_t>(outa[j]);
-        }
-    }
-
-    int32_t aligned = remaining - (remaining % 8);
-    for (int32_t i = aligned; i < remaining; ++i) {
-        PIXEL_RGBA bg = buf[pixIdx + i];
-        float alpha = color.a / 255.0f;
-        float invAlpha = 1.0f - alpha;
-        buf[pixIdx + i].r = static_cast<uint8_t>(color.r * alpha + bg.r * invAlpha);
-        buf[pixIdx + i].g = static_cast<uint8_t>(color.g * alpha + bg.g * invAlpha);
-        buf[pixIdx + i].b = static_cast<uint8_t>(color.b * alpha + bg.b * invAlpha);
-        buf[pixIdx + i].a = static_cast<uint8_t>((std::min)(255, static_cast<int32_t>(bg.a + color.a)));
-    }
-    _mm256_zeroupper();
+    Kernels().BlendLineRGBA(buf, startX, y, lineLen, imgW, imgH, color);
 }
 
 inline void FillVerticalLineRGBAx8(PIXEL_RGBA* buf, int32_t x, int32_t startY, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color) {
-    if (lineLen <= 0 || x < 0 || x >= imgW) return;
-    int32_t endY = (std::min)(startY + lineLen, imgH);
-    if (startY >= imgH || endY <= 0) return;
-    if (startY < 0) startY = 0;
-
-    int32_t remaining = endY - startY;
-    for (int32_t i = 0; i < remaining; ++i) buf[(startY + i) * imgW + x] = color;
+    Kernels().FillVerticalLineRGBA(buf, x, startY, lineLen, imgW, imgH, color);
 }
 
 inline void BlendVerticalLineRGBAx8(PIXEL_RGBA* buf, int32_t x, int32_t startY, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color) {
-    if (lineLen <= 0 || x < 0 || x >= imgW || color.a == 0) return;
-    if (color.a == 255) {
-        FillVerticalLineRGBAx8(buf, x, startY, lineLen, imgW, imgH, color);
-        return;
-    }
-
-    int32_t endY = (std::min)(startY + lineLen, imgH);
-    if (startY >= imgH || endY <= 0) return;
-    if (startY < 0) startY = 0;
-
-    int32_t remaining = endY - startY;
-    float alpha = color.a / 255.0f;
-    float invAlpha = 1.0f - alpha;
-
-    for (int32_t i = 0; i < remaining - 7; i += 8) {
-        alignas(32) float pixr[8], pixg[8], pixb[8], pixa[8];
-
-        for (int32_t j = 0; j < 8; ++j) {
-            PIXEL_RGBA bg = buf[(startY + i + j) * imgW + x];
-            pixr[j] = static_cast<float>(bg.r);
-            pixg[j] = static_cast<float>(bg.g);
-            pixb[j] = static_cast<float>(bg.b);
-            pixa[j] = static_cast<float>(bg.a);
-        }
-
-        __m256 v_bgr = _mm256_load_ps(pixr);
-        __m256 v_bgg = _mm256_load_ps(pixg);
-        __m256 v_bgb = _mm256_load_ps(pixb);
-        __m256 v_bga = _mm256_load_ps(pixa);
-        __m256 v_alpha = _mm256_set1_ps(alpha);
-        __m256 v_invAlpha = _mm256_set1_ps(invAlpha);
-        __m256 v_cr = _mm256_set1_ps(static_cast<float>(color.r));
-        __m256 v_cg = _mm256_set1_ps(static_cast<float>(color.g));
-        __m256 v_cb = _mm256_set1_ps(static_cast<float>(color.b));
-        __m256 v_ca = _mm256_set1_ps(static_cast<float>(color.a));
-        __m256 v_255 = _mm256_set1_ps(255.0f);
-        __m256 v_outr = _mm256_add_ps(_mm256_mul_ps(v_cr, v_alpha), _mm256_mul_ps(v_bgr, v_invAlpha));
-        __m256 v_outg = _mm256_add_ps(_mm256_mul_ps(v_cg, v_alpha), _mm256_mul_ps(v_bgg, v_invAlpha));
-        __m256 v_outb = _mm256_add_ps(_mm256_mul_ps(v_cb, v_alpha), _mm256_mul_ps(v_bgb, v_invAlpha));
-        __m256 v_outa = _mm256_min_ps(v_255, _mm256_add_ps(v_bga, v_ca));
-
-        alignas(32) float outr[8], outg[8], outb[8], outa[8];
-        _mm256_store_ps(outr, v_outr);
-        _mm256_store_ps(outg, v_outg);
-        _mm256_store_ps(outb, v_outb);
-        _mm256_store_ps(outa, v_outa);
-
-        for (int32_t j = 0; j < 8; ++j) {
-            int32_t idx = (startY + i + j) * imgW + x;
-            buf[idx].r = static_cast<uint8_t>(outr[j]);
-            buf[idx].g = static_cast<uint8_t>(outg[j]);
-            buf[idx].b = static_cast<uint8_t>(outb[j]);
-            buf[idx].a = static_cast<uint8_t>(outa[j]);
-        }
-    }
-
-    int32_t aligned = remaining - (remaining % 8);
-    for (int32_t i = aligned; i < remaining; ++i) {
-        int32_t idx = (startY + i) * imgW + x;
-        PIXEL_RGBA bg = buf[idx];
-        buf[idx].r = static_cast<uint8_t>(color.r * alpha + bg.r * invAlpha);
-        buf[idx].g = static_cast<uint8_t>(color.g * alpha + bg.g * invAlpha);
-        buf[idx].b = static_cast<uint8_t>(color.b * alpha + bg.b * invAlpha);
-        buf[idx].a = static_cast<uint8_t>((std::min)(255, static_cast<int32_t>(bg.a + color.a)));
-    }
-    _mm256_zeroupper();
+    Kernels().BlendVerticalLineRGBA(buf, x, startY, lineLen, imgW, imgH, color);
 }
-} // namespace Avx2Utils
\ No newline at end of file
+} // namespace Avx2Utils
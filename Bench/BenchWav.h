@@ -0,0 +1,91 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct BenchWav {
+    int32_t sample_rate = 0;
+    int32_t channels = 0;
+    std::vector<float> left;
+    std::vector<float> right;
+};
+
+inline bool LoadBenchWav(const std::wstring& path, BenchWav& out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    char riff[12];
+    if (!file.read(riff, 12) || std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0) return false;
+
+    uint16_t format = 0;
+    uint16_t channels = 0;
+    uint32_t sample_rate = 0;
+    uint16_t bits = 0;
+    std::vector<uint8_t> data;
+
+    char chunk_id[4];
+    uint32_t chunk_size = 0;
+    while (file.read(chunk_id, 4) && file.read(reinterpret_cast<char*>(&chunk_size), 4)) {
+        if (std::memcmp(chunk_id, "fmt ", 4) == 0) {
+            std::vector<uint8_t> fmt(chunk_size);
+            if (chunk_size < 16 || !file.read(reinterpret_cast<char*>(fmt.data()), chunk_size)) return false;
+            std::memcpy(&format, fmt.data(), 2);
+            std::memcpy(&channels, fmt.data() + 2, 2);
+            std::memcpy(&sample_rate, fmt.data() + 4, 4);
+            std::memcpy(&bits, fmt.data() + 14, 2);
+            if (format == 0xFFFE && chunk_size >= 26) std::memcpy(&format, fmt.data() + 24, 2);
+        } else if (std::memcmp(chunk_id, "data", 4) == 0) {
+            data.resize(chunk_size);
+            if (!file.read(reinterpret_cast<char*>(data.data()), chunk_size)) return false;
+        } else {
+            file.seekg(chunk_size, std::ios::cur);
+        }
+        if (chunk_size & 1) file.seekg(1, std::ios::cur);
+    }
+
+    if (channels == 0 || data.empty()) return false;
+    const bool is_float = (format == 3 && bits == 32);
+    const bool is_pcm = (format == 1 && (bits == 16 || bits == 24 || bits == 32));
+    if (!is_float && !is_pcm) return false;
+
+    const size_t bytes_per_sample = bits / 8;
+    const size_t frames = data.size() / (bytes_per_sample * channels);
+    out.sample_rate = static_cast<int32_t>(sample_rate);
+    out.channels = (std::min)(2, static_cast<int32_t>(channels));
+    out.left.resize(frames);
+    out.right.resize(frames);
+
+    auto read_sample = [&](const uint8_t* p) -> float {
+        if (is_float) {
+            float v;
+            std::memcpy(&v, p, 4);
+            return v;
+        }
+        switch (bits) {
+            case 16: {
+                int16_t v;
+                std::memcpy(&v, p, 2);
+                return v / 32768.0f;
+            }
+            case 24: {
+                const uint32_t u = (static_cast<uint32_t>(p[0]) << 8) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 24);
+                return (static_cast<int32_t>(u) >> 8) / 8388608.0f;
+            }
+            default: {
+                int32_t v;
+                std::memcpy(&v, p, 4);
+                return static_cast<float>(v / 2147483648.0);
+            }
+        }
+    };
+
+    for (size_t i = 0; i < frames; ++i) {
+        const uint8_t* frame = data.data() + i * bytes_per_sample * channels;
+        out.left[i] = read_sample(frame);
+        out.right[i] = (channels >= 2) ? read_sample(frame + bytes_per_sample) : out.left[i];
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,571 @@
+﻿#include "BenchWav.h"
+#include "Eap2Common.h"
+#include "RealFft.h"
+#include "StateCodec.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <malloc.h>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+const wchar_t filter_name[] = L"External Audio Processing 2";
+const wchar_t filter_name_media[] = L"External Audio Processing 2 (Media)";
+const wchar_t tool_name[] = L"External Audio Processing 2 tool_name";
+const wchar_t filter_info[] = L"External Audio Processing 2 filter_name Bench";
+const wchar_t regex_info_name[] = L"filter_name";
+const wchar_t regex_tool_name[] = L"tool_name";
+const wchar_t label[] = L"EAP2";
+const wchar_t plugin_version[] = PLUGIN_VERSION;
+
+HINSTANCE g_hinstance = nullptr;
+EDIT_HANDLE* g_edit_handle = nullptr;
+LOG_HANDLE* g_log_handle = nullptr;
+CONFIG_HANDLE* g_config_handle = nullptr;
+CACHE_HANDLE* g_cache_handle = nullptr;
+HWND g_host_hwnd = nullptr;
+
+std::mutex g_task_queue_mutex;
+std::vector<std::function<void()>> g_main_thread_tasks;
+std::atomic<double> g_shared_bpm{ 120.0 };
+std::atomic<int32_t> g_shared_ts_num{ 4 };
+std::atomic<int32_t> g_shared_ts_denom{ 4 };
+
+static std::atomic<uint64_t> g_alloc_count{ 0 };
+
+void* operator new(size_t size) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// ScratchArena などの 64 バイト境界の確保も数える
+void* operator new(size_t size, std::align_val_t align) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = _aligned_malloc(size ? size : 1, static_cast<size_t>(align))) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    _aligned_free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    _aligned_free(p);
+}
+
+struct BenchTool {
+    const char* name;
+    FILTER_PLUGIN_TABLE* table;
+    void (*cleanup)();
+};
+
+static void CleanupNothing() {}
+
+static const BenchTool g_bench_tools[] = {
+    { "utility", &filter_plugin_table_utility, CleanupNothing },
+    { "eq", &filter_plugin_table_eq, CleanupEQResources },
+    { "stereo", &filter_plugin_table_stereo, CleanupNothing },
+    { "dynamics", &filter_plugin_table_dynamics, CleanupDynamicsResources },
+    { "spatial", &filter_plugin_table_spatial, CleanupSpatialResources },
+    { "modulation", &filter_plugin_table_modulation, CleanupModulationResources },
+    { "distortion", &filter_plugin_table_distortion, CleanupDistortionResources },
+    { "maximizer", &filter_plugin_table_maximizer, CleanupMaximizerResources },
+    { "chain_send", &filter_plugin_table_chain_send, CleanupNothing },
+    { "chain_comp", &filter_plugin_table_chain_comp, CleanupChainCompResources },
+    { "chain_gate", &filter_plugin_table_chain_gate, CleanupChainGateResources },
+    { "chain_dyn_eq", &filter_plugin_table_chain_dyn_eq, CleanupChainDynEQResources },
+    { "chain_filter", &filter_plugin_table_chain_filter, CleanupChainFilterResources },
+    { "reverb", &filter_plugin_table_reverb, CleanupReverbResources },
+    { "reverb2", &filter_plugin_table_reverb2, CleanupReverbResources2 },
+    { "phaser", &filter_plugin_table_phaser, CleanupPhaserResources },
+    { "pitch_shift", &filter_plugin_table_pitch_shift, CleanupPitchShiftResources },
+    { "autowah", &filter_plugin_table_autowah, CleanupAutoWahResources },
+    { "deesser", &filter_plugin_table_deesser, CleanupDeEsserResources },
+    { "spectral_gate", &filter_plugin_table_spectral_gate, CleanupSpectralGateResources },
+    { "generator", &filter_plugin_table_generator, CleanupGeneratorResources },
+    { "generator2", &filter_plugin_table_generator2, CleanupGeneratorResources2 },
+    { "midi", &filter_plugin_table_midi_gen, CleanupMidiGeneratorResources },
+    { "notes_send", &filter_plugin_table_notes_send_media, CleanupNothing },
+};
+
+struct BenchOptions {
+    std::vector<std::string> tools;
+    std::vector<int32_t> block_sizes = { 64, 256, 1024, 4096 };
+    std::vector<std::pair<std::wstring, double>> params;
+    std::wstring wav_path;
+    double seconds = 10.0;
+    // 入力の後ろに足す無音の秒数。リバーブなどの残響が非正規化数まで減衰する区間を別に計る
+    double tail_seconds = 0.0;
+    bool keep_denormals = false;
+    int32_t sample_rate = 48000;
+    int32_t channels = 2;
+    bool csv = false;
+    std::wstring simd = L"Auto";
+    std::wstring trace_path;
+    bool fft = false;
+    bool codec = false;
+    std::vector<std::wstring> state_paths;
+};
+
+struct BenchIO {
+    float* left = nullptr;
+    float* right = nullptr;
+};
+
+static BenchIO g_io;
+static int32_t g_bench_block = 0;
+
+static void BenchGetSampleData(float* buffer, int32_t channel) {
+    const float* src = (channel == 0) ? g_io.left : g_io.right;
+    std::memcpy(buffer, src, sizeof(float) * g_bench_block);
+}
+
+static void BenchSetSampleData(float* buffer, int32_t channel) {
+    float* dst = (channel == 0) ? g_io.left : g_io.right;
+    std::memcpy(dst, buffer, sizeof(float) * g_bench_block);
+}
+
+static std::vector<std::string> SplitList(const std::string& s) {
+    std::vector<std::string> out;
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos) end = s.size();
+        if (end > start) out.push_back(s.substr(start, end - start));
+        start = end + 1;
+    }
+    return out;
+}
+
+static bool ApplyParam(FILTER_PLUGIN_TABLE* table, const std::wstring& name, double value) {
+    if (!table->items) return false;
+    for (void** item = table->items; *item; ++item) {
+        LPCWSTR type = *static_cast<LPCWSTR*>(*item);
+        if (wcscmp(type, L"track") == 0) {
+            auto* track = static_cast<FILTER_ITEM_TRACK*>(*item);
+            if (name == track->name) {
+                track->value = value;
+                return true;
+            }
+        } else if (wcscmp(type, L"check") == 0) {
+            auto* check = static_cast<FILTER_ITEM_CHECK*>(*item);
+            if (name == check->name) {
+                check->value = value != 0.0;
+                return true;
+            }
+        } else if (wcscmp(type, L"select") == 0) {
+            auto* select = static_cast<FILTER_ITEM_SELECT*>(*item);
+            if (name == select->name) {
+                select->value = static_cast<int32_t>(value);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void MakeSyntheticInput(std::vector<float>& left, std::vector<float>& right, int32_t sample_rate, int64_t frames) {
+    left.resize(frames);
+    right.resize(frames);
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    const double two_pi = 2.0 * M_PI;
+    for (int64_t i = 0; i < frames; ++i) {
+        double t = static_cast<double>(i) / sample_rate;
+        double env = 0.5 + 0.5 * std::sin(two_pi * 0.5 * t);
+        double tone = 0.3 * std::sin(two_pi * 110.0 * t) + 0.2 * std::sin(two_pi * 440.0 * t) + 0.1 * std::sin(two_pi * 3520.0 * t);
+        left[i] = static_cast<float>(env * tone) + 0.05f * noise(rng);
+        right[i] = static_cast<float>(env * tone * 0.8) + 0.05f * noise(rng);
+    }
+}
+
+// 比較用に残している旧 ToolPitchShift の複素 FFT
+static void LegacyFftInplace(std::complex<float>* data, int32_t n, bool inverse) {
+    for (int32_t i = 1, j = 0; i < n; ++i) {
+        int32_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(data[i], data[j]);
+    }
+    for (int32_t len = 2; len <= n; len <<= 1) {
+        const float ang = static_cast<float>((inverse ? M_PI * 2 : M_PI * -2) / len);
+        const std::complex<float> wlen(std::cos(ang), std::sin(ang));
+        for (int32_t i = 0; i < n; i += len) {
+            std::complex<float> w(1.0f, 0.0f);
+            for (int32_t j = 0; j < (len >> 1); ++j) {
+                auto u = data[i + j];
+                auto v = data[i + j + (len >> 1)] * w;
+                data[i + j] = u + v;
+                data[i + j + (len >> 1)] = u - v;
+                w *= wlen;
+            }
+        }
+    }
+    if (inverse) {
+        const float inv_n = 1.0f / static_cast<float>(n);
+        for (int32_t i = 0; i < n; ++i) data[i] *= inv_n;
+    }
+}
+
+// 順変換と逆変換の往復 1 回あたりの時間を旧実装と比べる。誤差は往復後の入力との差の最大値
+static void RunFftBench(bool csv) {
+    if (csv) {
+        std::printf("size,legacy_ns,realfft_ns,speedup,legacy_max_err,realfft_max_err\n");
+    } else {
+        std::printf("%6s %14s %14s %8s %14s %14s\n", "size", "legacy ns", "realfft ns", "speedup", "legacy err", "realfft err");
+    }
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    for (int32_t n = RealFft::MIN_SIZE; n <= RealFft::MAX_SIZE; n <<= 1) {
+        const RealFft* fft = RealFft::Get(n);
+        std::vector<float> input(n), output(n), re(fft->bins()), im(fft->bins()), work(fft->work_size());
+        std::vector<std::complex<float>> legacy(n);
+        for (auto& v : input) v = dist(rng);
+        // 1 サイズあたりおよそ 2^24 サンプル分を回す
+        const int32_t iterations = (std::max)(4, (1 << 24) / n);
+
+        auto t0 = std::chrono::steady_clock::now();
+        for (int32_t it = 0; it < iterations; ++it) {
+            for (int32_t j = 0; j < n; ++j) legacy[j] = { input[j], 0.0f };
+            LegacyFftInplace(legacy.data(), n, false);
+            LegacyFftInplace(legacy.data(), n, true);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        for (int32_t it = 0; it < iterations; ++it) {
+            fft->Forward(input.data(), re.data(), im.data(), work.data());
+            fft->Inverse(re.data(), im.data(), output.data(), work.data());
+        }
+        auto t2 = std::chrono::steady_clock::now();
+
+        float legacy_err = 0.0f, fft_err = 0.0f;
+        for (int32_t j = 0; j < n; ++j) {
+            legacy_err = (std::max)(legacy_err, std::fabs(legacy[j].real() - input[j]));
+            fft_err = (std::max)(fft_err, std::fabs(output[j] - input[j]));
+        }
+        const double legacy_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+        const double fft_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / iterations;
+        if (csv) {
+            std::printf("%d,%.1f,%.1f,%.2f,%.3g,%.3g\n", n, legacy_ns, fft_ns, legacy_ns / fft_ns, legacy_err, fft_err);
+        } else {
+            std::printf("%6d %14.1f %14.1f %8.2f %14.3g %14.3g\n", n, legacy_ns, fft_ns, legacy_ns / fft_ns, legacy_err, fft_err);
+        }
+    }
+}
+
+struct BenchState {
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+// 典型的なプラグインの状態を模したデータ。実際の状態は --state で渡す
+static std::vector<BenchState> MakeSyntheticStates() {
+    std::vector<BenchState> states;
+    std::mt19937 rng(7);
+
+    // XML で保存するシンセのパッチ (テキスト、繰り返しが多い)
+    BenchState xml{ "xml_patch", {} };
+    std::string text = "<?xml version=\"1.0\"?>\n<patch>\n";
+    for (int32_t i = 0; i < 20000; ++i) {
+        text += "  <param id=\"" + std::to_string(i % 1024) + "\" name=\"Osc" + std::to_string(i % 4) + " Param " + std::to_string(i % 97) +
+                "\" value=\"" + std::to_string(static_cast<double>(rng() % 100000) / 100000.0) + "\"/>\n";
+    }
+    text += "</patch>\n";
+    xml.data.assign(text.begin(), text.end());
+    states.push_back(std::move(xml));
+
+    // float のパラメータ配列 (既定値のままの値が多い)
+    BenchState params{ "float_params", {} };
+    std::vector<float> values(262144);
+    for (auto& v : values) v = (rng() % 8 == 0) ? static_cast<float>(rng() % 1000) / 1000.0f : 0.5f;
+    params.data.resize(values.size() * sizeof(float));
+    std::memcpy(params.data.data(), values.data(), params.data.size());
+    states.push_back(std::move(params));
+
+    // 読み込んだサンプルを埋め込むサンプラー (16bit PCM、圧縮しにくい)
+    BenchState sampler{ "sampler_pcm", {} };
+    std::vector<float> left, right;
+    MakeSyntheticInput(left, right, 48000, 48000 * 20);
+    sampler.data.resize(left.size() * 2 * sizeof(int16_t));
+    int16_t* pcm = reinterpret_cast<int16_t*>(sampler.data.data());
+    for (size_t i = 0; i < left.size(); ++i) {
+        pcm[i * 2] = static_cast<int16_t>(std::clamp(left[i], -1.0f, 1.0f) * 32767.0f);
+        pcm[i * 2 + 1] = static_cast<int16_t>(std::clamp(right[i], -1.0f, 1.0f) * 32767.0f);
+    }
+    states.push_back(std::move(sampler));
+    return states;
+}
+
+// 比較用に残している以前の圧縮 (compressapi の XPRESS_HUFF)
+static bool LegacyCompress(const uint8_t* data, size_t len, std::vector<uint8_t>& out) {
+    COMPRESSOR_HANDLE compressor = nullptr;
+    if (!CreateCompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, nullptr, &compressor)) return false;
+    size_t size = 0;
+    Compress(compressor, data, len, nullptr, 0, &size);
+    out.resize(sizeof(StringUtils::CompressedBlobHeader) + size);
+    StringUtils::CompressedBlobHeader header{};
+    std::memcpy(header.magic, StringUtils::kCompressedBlobMagic, sizeof(header.magic));
+    header.originalSize = len;
+    std::memcpy(out.data(), &header, sizeof(header));
+    const BOOL ok = Compress(compressor, data, len, out.data() + sizeof(header), size, &size);
+    CloseCompressor(compressor);
+    out.resize(sizeof(header) + size);
+    return ok != FALSE;
+}
+
+// 状態ごとに圧縮・展開の速度 (元のサイズ基準の MB/s) と圧縮率を比べる。展開結果が元と一致しなければ失敗にする
+static bool RunCodecBench(const std::vector<std::wstring>& paths, bool csv) {
+    std::vector<BenchState> states;
+    if (paths.empty()) {
+        states = MakeSyntheticStates();
+    } else {
+        for (const auto& path : paths) {
+            std::ifstream file(path, std::ios::binary);
+            BenchState state{ StringUtils::WideToUtf8(std::filesystem::path(path).filename().c_str()), {} };
+            state.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            if (state.data.empty()) {
+                std::fprintf(stderr, "failed to read state: %s\n", StringUtils::WideToUtf8(path.c_str()).c_str());
+                return false;
+            }
+            states.push_back(std::move(state));
+        }
+    }
+
+    if (csv) {
+        std::printf("state,codec,bytes,packed,ratio,compress_mb_s,decompress_mb_s\n");
+    } else {
+        std::printf("%-16s %-8s %12s %12s %7s %14s %14s\n", "state", "codec", "bytes", "packed", "ratio", "compress MB/s", "decompress MB/s");
+    }
+    struct Codec {
+        const char* name;
+        StateCodec::Mode mode;
+    };
+    static const Codec codecs[] = { { "legacy", StateCodec::Mode::None }, { "fast", StateCodec::Mode::Fast }, { "high", StateCodec::Mode::High } };
+    bool ok = true;
+    for (const auto& state : states) {
+        const double mb = static_cast<double>(state.data.size()) / (1024.0 * 1024.0);
+        // 1 つの組み合わせあたり 64MB 程度を処理する
+        const int32_t iterations = (std::max)(1, static_cast<int32_t>(64.0 / (std::max)(mb, 1e-3)));
+        for (const auto& codec : codecs) {
+            std::vector<uint8_t> packed, unpacked;
+            auto t0 = std::chrono::steady_clock::now();
+            for (int32_t it = 0; it < iterations; ++it) {
+                if (codec.mode == StateCodec::Mode::None) LegacyCompress(state.data.data(), state.data.size(), packed);
+                else StateCodec::Compress(state.data.data(), state.data.size(), codec.mode, packed);
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            bool decoded = true;
+            for (int32_t it = 0; it < iterations; ++it) decoded = StringUtils::DecompressBlob(packed.data(), packed.size(), unpacked) && decoded;
+            auto t2 = std::chrono::steady_clock::now();
+            if (!decoded || unpacked != state.data) {
+                std::fprintf(stderr, "round trip failed: %s / %s\n", state.name.c_str(), codec.name);
+                ok = false;
+            }
+            const double compress_mb_s = mb * iterations / (std::max)(1e-9, std::chrono::duration<double>(t1 - t0).count());
+            const double decompress_mb_s = mb * iterations / (std::max)(1e-9, std::chrono::duration<double>(t2 - t1).count());
+            const double ratio = static_cast<double>(packed.size()) / static_cast<double>(state.data.size());
+            if (csv) {
+                std::printf("%s,%s,%zu,%zu,%.4f,%.1f,%.1f\n", state.name.c_str(), codec.name, state.data.size(), packed.size(), ratio, compress_mb_s, decompress_mb_s);
+            } else {
+                std::printf("%-16s %-8s %12zu %12zu %7.3f %14.1f %14.1f\n", state.name.c_str(), codec.name, state.data.size(), packed.size(), ratio, compress_mb_s, decompress_mb_s);
+            }
+        }
+    }
+    return ok;
+}
+
+static void PrintUsage() {
+    std::printf("usage: EAP2Bench [--tool a,b,...] [--block 64,256,...] [--seconds N] [--rate HZ]\n");
+    std::printf("                 [--mono] [--wav FILE] [--set NAME=VALUE]... [--csv] [--list]\n");
+    std::printf("                 [--simd auto|scalar|sse2|avx2|avx512] [--trace FILE.json]\n");
+    std::printf("                 [--tail SECONDS] [--keep-denormals]\n");
+    std::printf("       EAP2Bench --fft [--csv] [--simd ...]\n");
+    std::printf("       EAP2Bench --codec [--state FILE]... [--csv]\n");
+}
+
+int wmain(int argc, wchar_t** argv) {
+    BenchOptions opt;
+    for (int i = 1; i < argc; ++i) {
+        std::wstring arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) return {};
+            return StringUtils::WideToUtf8(argv[++i]);
+        };
+        if (arg == L"--tool") {
+            opt.tools = SplitList(next());
+        } else if (arg == L"--block") {
+            opt.block_sizes.clear();
+            for (const auto& s : SplitList(next())) opt.block_sizes.push_back((std::max)(1, std::atoi(s.c_str())));
+        } else if (arg == L"--seconds") {
+            opt.seconds = (std::max)(0.1, std::atof(next().c_str()));
+        } else if (arg == L"--rate") {
+            opt.sample_rate = (std::max)(8000, std::atoi(next().c_str()));
+        } else if (arg == L"--tail") {
+            opt.tail_seconds = (std::max)(0.0, std::atof(next().c_str()));
+        } else if (arg == L"--keep-denormals") {
+            opt.keep_denormals = true;
+        } else if (arg == L"--mono") {
+            opt.channels = 1;
+        } else if (arg == L"--wav" && i + 1 < argc) {
+            opt.wav_path = argv[++i];
+        } else if (arg == L"--set" && i + 1 < argc) {
+            std::wstring kv = argv[++i];
+            size_t eq = kv.find(L'=');
+            if (eq != std::wstring::npos) opt.params.emplace_back(kv.substr(0, eq), _wtof(kv.substr(eq + 1).c_str()));
+        } else if (arg == L"--simd" && i + 1 < argc) {
+            opt.simd = argv[++i];
+        } else if (arg == L"--trace" && i + 1 < argc) {
+            opt.trace_path = argv[++i];
+        } else if (arg == L"--fft") {
+            opt.fft = true;
+        } else if (arg == L"--codec") {
+            opt.codec = true;
+        } else if (arg == L"--state" && i + 1 < argc) {
+            opt.state_paths.push_back(argv[++i]);
+        } else if (arg == L"--csv") {
+            opt.csv = true;
+        } else if (arg == L"--list") {
+            for (const auto& tool : g_bench_tools) std::printf("%s\n", tool.name);
+            return 0;
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    Avx2Utils::SimdLevel simd_level;
+    if (!Avx2Utils::ParseSimdLevel(opt.simd, simd_level)) {
+        PrintUsage();
+        return 1;
+    }
+    simd_level = Avx2Utils::SetSimdLevel(simd_level);
+    std::fprintf(stderr, "simd: %ls (cpu: %ls)\n", Avx2Utils::SimdLevelName(simd_level), Avx2Utils::SimdLevelName(Avx2Utils::DetectSimdLevel()));
+    if (opt.fft) {
+        RunFftBench(opt.csv);
+        return 0;
+    }
+    if (opt.codec) return RunCodecBench(opt.state_paths, opt.csv) ? 0 : 1;
+    // 計測区間の記録分だけ ns/sample が増えるため、比較時は --trace なしの結果を使う
+    Profiler::SetEnabled(!opt.trace_path.empty());
+    DenormalGuard::SetEnabled(!opt.keep_denormals);
+
+    std::vector<float> srcL, srcR;
+    if (!opt.wav_path.empty()) {
+        BenchWav wav;
+        if (!LoadBenchWav(opt.wav_path, wav)) {
+            std::fprintf(stderr, "failed to load wav: %s\n", StringUtils::WideToUtf8(opt.wav_path.c_str()).c_str());
+            return 1;
+        }
+        opt.sample_rate = wav.sample_rate;
+        opt.channels = wav.channels;
+        srcL = std::move(wav.left);
+        srcR = std::move(wav.right);
+    } else {
+        MakeSyntheticInput(srcL, srcR, opt.sample_rate, static_cast<int64_t>(opt.seconds * opt.sample_rate));
+    }
+    const int64_t tail_start = static_cast<int64_t>(srcL.size());
+    if (tail_start == 0) return 1;
+    const bool has_tail = opt.tail_seconds > 0.0;
+    srcL.resize(tail_start + static_cast<int64_t>(opt.tail_seconds * opt.sample_rate), 0.0f);
+    srcR.resize(srcL.size(), 0.0f);
+    const int64_t total_frames = static_cast<int64_t>(srcL.size());
+
+    // 無音の尾の ns/sample が本体と変わらなければ、非正規化数による遅れは出ていない
+    if (opt.csv) {
+        std::printf("tool,block,channels,frames,seconds,realtime_factor,ns_per_sample,allocs_per_call%s\n", has_tail ? ",tail_ns_per_sample" : "");
+    } else {
+        std::printf("%-14s %6s %3s %12s %12s %14s%s\n", "tool", "block", "ch", "x realtime", "ns/sample", "allocs/call", has_tail ? "  tail ns/sample" : "");
+    }
+
+    std::vector<float> workL(total_frames), workR(total_frames);
+    for (const auto& tool : g_bench_tools) {
+        if (!opt.tools.empty() && std::find(opt.tools.begin(), opt.tools.end(), tool.name) == opt.tools.end()) continue;
+        for (const auto& [name, value] : opt.params) ApplyParam(tool.table, name, value);
+
+        for (int32_t block : opt.block_sizes) {
+            tool.cleanup();
+            std::memcpy(workL.data(), srcL.data(), sizeof(float) * total_frames);
+            std::memcpy(workR.data(), srcR.data(), sizeof(float) * total_frames);
+
+            SCENE_INFO scene = {};
+            scene.sample_rate = opt.sample_rate;
+            OBJECT_INFO object = {};
+            object.effect_id = 1;
+            object.channel_num = opt.channels;
+            object.sample_total = total_frames;
+            FILTER_PROC_AUDIO audio = {};
+            audio.scene = &scene;
+            audio.object = &object;
+            audio.get_sample_data = BenchGetSampleData;
+            audio.set_sample_data = BenchSetSampleData;
+
+            uint64_t calls = 0;
+            uint64_t allocs_begin = 0;
+            std::chrono::nanoseconds elapsed{ 0 };
+            std::chrono::nanoseconds tail_elapsed{ 0 };
+            int64_t tail_frames = 0;
+            for (int64_t pos = 0; pos < total_frames; pos += block) {
+                g_bench_block = static_cast<int32_t>((std::min)(static_cast<int64_t>(block), total_frames - pos));
+                g_io.left = workL.data() + pos;
+                g_io.right = workR.data() + pos;
+                object.sample_index = pos;
+                object.sample_num = g_bench_block;
+                object.time = static_cast<double>(pos) / opt.sample_rate;
+
+                // 初回呼び出しの状態確保はカウントしない
+                if (calls == 1) allocs_begin = g_alloc_count.load(std::memory_order_relaxed);
+                auto t0 = std::chrono::steady_clock::now();
+                tool.table->func_proc_audio(&audio);
+                const auto call_elapsed = std::chrono::steady_clock::now() - t0;
+                elapsed += call_elapsed;
+                // 尾に入った呼び出しだけを数える (ブロックの途中から始まる尾は含めない)
+                if (pos >= tail_start) {
+                    tail_elapsed += call_elapsed;
+                    tail_frames += g_bench_block;
+                }
+                ++calls;
+            }
+            uint64_t allocs = (calls > 1) ? g_alloc_count.load(std::memory_order_relaxed) - allocs_begin : 0;
+
+            double audio_sec = static_cast<double>(total_frames) / opt.sample_rate;
+            double wall_sec = (std::max)(1e-9, std::chrono::duration<double>(elapsed).count());
+            double rtf = audio_sec / wall_sec;
+            double ns_per_sample = static_cast<double>(elapsed.count()) / (static_cast<double>(total_frames) * opt.channels);
+            double allocs_per_call = (calls > 1) ? static_cast<double>(allocs) / (calls - 1) : 0.0;
+            double tail_ns_per_sample = (tail_frames > 0) ? static_cast<double>(tail_elapsed.count()) / (static_cast<double>(tail_frames) * opt.channels) : 0.0;
+
+            if (opt.csv) {
+                std::printf("%s,%d,%d,%lld,%.6f,%.3f,%.3f,%.3f", tool.name, block, opt.channels, static_cast<long long>(total_frames), wall_sec, rtf, ns_per_sample, allocs_per_call);
+                if (has_tail) std::printf(",%.3f", tail_ns_per_sample);
+            } else {
+                std::printf("%-14s %6d %3d %12.1f %12.3f %14.3f", tool.name, block, opt.channels, rtf, ns_per_sample, allocs_per_call);
+                if (has_tail) std::printf(" %16.3f", tail_ns_per_sample);
+            }
+            std::printf("\n");
+        }
+        tool.cleanup();
+    }
+    if (!opt.trace_path.empty() && !Profiler::WriteChromeTrace(opt.trace_path)) {
+        std::fprintf(stderr, "failed to write trace: %s\n", StringUtils::WideToUtf8(opt.trace_path.c_str()).c_str());
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
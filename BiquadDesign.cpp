@@ -0,0 +1,123 @@
+﻿#include "BiquadDesign.h"
+#include "FastMath.h"
+
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace BiquadDesign {
+namespace {
+    constexpr size_t CACHE_SIZE = 64;
+
+    struct CacheEntry {
+        Params params;
+        Coeffs coeffs;
+        bool used = false;
+    };
+
+    uint64_t HashBits(uint64_t h, double v) {
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        h ^= bits + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        return h;
+    }
+
+    size_t Slot(const Params& p) {
+        uint64_t h = static_cast<uint64_t>(p.type);
+        h = HashBits(h, p.sample_rate);
+        h = HashBits(h, p.freq);
+        h = HashBits(h, p.q);
+        h = HashBits(h, p.gain_db);
+        return static_cast<size_t>(h ^ (h >> 32)) % CACHE_SIZE;
+    }
+
+    // 音声スレッド間でロックを取らないようスレッドごとに持つ。衝突したら上書きする
+    std::array<CacheEntry, CACHE_SIZE>& LocalCache() {
+        thread_local std::array<CacheEntry, CACHE_SIZE> cache;
+        return cache;
+    }
+
+    Coeffs Normalize(double b0, double b1, double b2, double a0, double a1, double a2) {
+        const double inv = 1.0 / a0;
+        return { b0 * inv, b1 * inv, b2 * inv, a1 * inv, a2 * inv };
+    }
+
+    Coeffs PeakingFrom(double cosw0, double alpha, double A) {
+        return Normalize(1.0 + alpha * A, -2.0 * cosw0, 1.0 - alpha * A, 1.0 + alpha / A, -2.0 * cosw0, 1.0 - alpha / A);
+    }
+}
+
+Coeffs Compute(const Params& p) {
+    const double Fs = p.sample_rate;
+    const double f0 = p.freq;
+    switch (p.type) {
+    case Type::HighPass: {
+        if (f0 <= 0.0) return {};
+        const double w0 = 2.0 * M_PI * f0 / Fs;
+        const double alpha = std::sin(w0) / (2.0 * p.q);
+        const double cosw0 = std::cos(w0);
+        return Normalize((1.0 + cosw0) / 2.0, -(1.0 + cosw0), (1.0 + cosw0) / 2.0, 1.0 + alpha, -2.0 * cosw0, 1.0 - alpha);
+    }
+    case Type::LowPass: {
+        if (f0 >= Fs * 0.49) return {};
+        const double w0 = 2.0 * M_PI * f0 / Fs;
+        const double alpha = std::sin(w0) / (2.0 * p.q);
+        const double cosw0 = std::cos(w0);
+        return Normalize((1.0 - cosw0) / 2.0, 1.0 - cosw0, (1.0 - cosw0) / 2.0, 1.0 + alpha, -2.0 * cosw0, 1.0 - alpha);
+    }
+    case Type::LowShelf:
+    case Type::HighShelf: {
+        if (std::fabs(p.gain_db) < 0.001) return {};
+        const double A = std::pow(10.0, p.gain_db / 40.0);
+        const double w0 = 2.0 * M_PI * f0 / Fs;
+        const double alpha = std::sin(w0) / 2.0 * std::sqrt((A + 1 / A) * (1 / p.q - 1) + 2);
+        const double cosw0 = std::cos(w0);
+        const double sqA2alpha = 2 * std::sqrt(A) * alpha;
+        if (p.type == Type::LowShelf) {
+            return Normalize(A * ((A + 1) - (A - 1) * cosw0 + sqA2alpha), 2 * A * ((A - 1) - (A + 1) * cosw0),
+                             A * ((A + 1) - (A - 1) * cosw0 - sqA2alpha), (A + 1) + (A - 1) * cosw0 + sqA2alpha,
+                             -2 * ((A - 1) + (A + 1) * cosw0), (A + 1) + (A - 1) * cosw0 - sqA2alpha);
+        }
+        return Normalize(A * ((A + 1) + (A - 1) * cosw0 + sqA2alpha), -2 * A * ((A - 1) + (A + 1) * cosw0),
+                         A * ((A + 1) + (A - 1) * cosw0 - sqA2alpha), (A + 1) - (A - 1) * cosw0 + sqA2alpha,
+                         2 * ((A - 1) - (A + 1) * cosw0), (A + 1) - (A - 1) * cosw0 - sqA2alpha);
+    }
+    case Type::Peaking: {
+        if (std::fabs(p.gain_db) < 0.001) return {};
+        const double w0 = 2.0 * M_PI * f0 / Fs;
+        return PeakingFrom(std::cos(w0), std::sin(w0) / (2.0 * p.q), std::pow(10.0, p.gain_db / 40.0));
+    }
+    }
+    return {};
+}
+
+Coeffs Design(const Params& p) {
+    CacheEntry& entry = LocalCache()[Slot(p)];
+    if (!entry.used || entry.params != p) {
+        entry.params = p;
+        entry.coeffs = Compute(p);
+        entry.used = true;
+    }
+    return entry.coeffs;
+}
+
+void PeakingGain::Prepare(double sample_rate, double freq, double q) {
+    if (sample_rate == sample_rate_ && freq == freq_ && q == q_) return;
+    sample_rate_ = sample_rate;
+    freq_ = freq;
+    q_ = q;
+    const double w0 = 2.0 * M_PI * freq / sample_rate;
+    cos_w0_ = std::cos(w0);
+    alpha_ = std::sin(w0) / (2.0 * q);
+    has_last_ = false;
+}
+
+const Coeffs& PeakingGain::At(double gain_db) {
+    if (has_last_ && gain_db == last_gain_db_) return last_;
+    // 制御レートで毎回呼ばれるので、A = 10^(gain/40) は高速近似で求める
+    last_ = (std::fabs(gain_db) < 0.001) ? Coeffs{} : PeakingFrom(cos_w0_, alpha_, FastMath::DbToLinear(static_cast<float>(gain_db * 0.5)));
+    last_gain_db_ = gain_db;
+    has_last_ = true;
+    return last_;
+}
+} // namespace BiquadDesign
@@ -0,0 +1,93 @@
+﻿#pragma once
+#include <cstdint>
+
+// RBJ Audio EQ Cookbook に基づく双二次フィルタの係数設計。
+// 同じパラメータでの再設計はスレッドごとの小さなハッシュキャッシュで省き、
+// Band はパラメータが動いたときだけ設計し直して、ブロック単位で旧係数から補間する。
+namespace BiquadDesign {
+enum class Type : uint8_t {
+    HighPass,
+    LowPass,
+    LowShelf,
+    HighShelf,
+    Peaking,
+};
+
+// q はシェルフでは傾き (S) として扱う
+struct Params {
+    Type type = Type::Peaking;
+    double sample_rate = 44100.0;
+    double freq = 1000.0;
+    double q = 0.7071;
+    double gain_db = 0.0;
+
+    bool operator==(const Params& other) const {
+        return type == other.type && sample_rate == other.sample_rate && freq == other.freq &&
+               q == other.q && gain_db == other.gain_db;
+    }
+    bool operator!=(const Params& other) const { return !(*this == other); }
+};
+
+// a0 で正規化済みの係数
+struct Coeffs {
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+
+    // (a1, a2) の安定領域は凸なので、安定な係数同士の線形補間も安定になる
+    static Coeffs Lerp(const Coeffs& from, const Coeffs& to, double t) {
+        return { from.b0 + (to.b0 - from.b0) * t, from.b1 + (to.b1 - from.b1) * t,
+                 from.b2 + (to.b2 - from.b2) * t, from.a1 + (to.a1 - from.a1) * t,
+                 from.a2 + (to.a2 - from.a2) * t };
+    }
+};
+
+// キャッシュを介さずに計算する。効果のない設定 (ゲイン 0dB, 範囲外のカットオフ) は素通しを返す
+Coeffs Compute(const Params& p);
+// 呼び出しスレッドのキャッシュを引き、無ければ計算して登録する
+Coeffs Design(const Params& p);
+
+// EQ の 1 バンド分。コールバックごとに SetTarget でパラメータを渡し、At でブロックごとの係数を得る
+class Band {
+  public:
+    // パラメータが前回と同じなら設計せず false を返す。変わった場合は直前の係数から補間を始める
+    bool SetTarget(const Params& p) {
+        if (valid_ && p == params_) {
+            from_ = to_;
+            return false;
+        }
+        const Coeffs next = Design(p);
+        from_ = valid_ ? to_ : next;
+        to_ = next;
+        params_ = p;
+        valid_ = true;
+        return true;
+    }
+
+    // シーク直後など補間すべきでないときに目標へ揃える
+    void Snap() { from_ = to_; }
+    bool IsMoving() const { return from_.b0 != to_.b0 || from_.b1 != to_.b1 || from_.b2 != to_.b2 || from_.a1 != to_.a1 || from_.a2 != to_.a2; }
+
+    // t = 0 で直前の係数、t = 1 で目標の係数
+    Coeffs At(double t) const { return Coeffs::Lerp(from_, to_, t); }
+    const Coeffs& Target() const { return to_; }
+
+  private:
+    Params params_;
+    Coeffs from_, to_;
+    bool valid_ = false;
+};
+
+// ゲインだけがサンプル単位で動くピーキング (ダイナミック EQ, ディエッサー) 用。
+// 周波数と Q に依存する三角関数は変化時だけ計算し、ゲインは直前と同じなら前回の係数を返す
+class PeakingGain {
+  public:
+    void Prepare(double sample_rate, double freq, double q);
+    const Coeffs& At(double gain_db);
+
+  private:
+    double sample_rate_ = 0.0, freq_ = 0.0, q_ = 0.0;
+    double cos_w0_ = 1.0, alpha_ = 0.0;
+    double last_gain_db_ = 0.0;
+    bool has_last_ = false;
+    Coeffs last_;
+};
+} // namespace BiquadDesign
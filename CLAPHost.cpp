@@ -1,12 +1,17 @@
 ﻿#include "ClapHost.h"
 
+#include "Avx2Utils.h"
 #include "Eap2Config.h"
+#include "PluginModuleCache.h"
 #include "StringUtils.h"
 #include "clap/all.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <filesystem>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <windows.h>
@@ -32,6 +37,74 @@ void ClapLog(LOG_TYPE log_type) {
     DbgPrint(message, log_type);
 }
 
+// process() に渡すイベント列。容量を固定して構築時に確保し、音声スレッドでは確保しない。
+// clap_input_events / clap_output_events の両方として使え、Push は時刻順を保って挿入する
+class ClapEventBuffer {
+  public:
+    static constexpr uint32_t CAPACITY = 1024;
+
+    ClapEventBuffer() {
+        input_.ctx = this;
+        input_.size = [](const clap_input_events_t* list) -> uint32_t {
+            return static_cast<const ClapEventBuffer*>(list->ctx)->count_;
+        };
+        input_.get = [](const clap_input_events_t* list, uint32_t index) -> const clap_event_header_t* {
+            return static_cast<const ClapEventBuffer*>(list->ctx)->Get(index);
+        };
+        output_.ctx = this;
+        output_.try_push = [](const clap_output_events_t* list, const clap_event_header_t* event) -> bool {
+            return static_cast<ClapEventBuffer*>(list->ctx)->Push(event);
+        };
+    }
+
+    ClapEventBuffer(const ClapEventBuffer&) = delete;
+    ClapEventBuffer& operator=(const ClapEventBuffer&) = delete;
+
+    const clap_input_events_t* Input() const { return &input_; }
+    const clap_output_events_t* Output() const { return &output_; }
+
+    void Clear() { count_ = 0; }
+    uint32_t Count() const { return count_; }
+
+    const clap_event_header_t* Get(uint32_t index) const {
+        if (index >= count_) return nullptr;
+        return &slots_[order_[index]].header;
+    }
+
+    // 満杯のとき、または収まらない大きさのイベントは捨てて false を返す
+    bool Push(const clap_event_header_t* event) {
+        if (!event || count_ >= CAPACITY || event->size < sizeof(clap_event_header_t) || event->size > sizeof(Slot)) return false;
+        const uint16_t slot = static_cast<uint16_t>(count_);
+        memcpy(&slots_[slot], event, event->size);
+        uint32_t pos = count_;
+        while (pos > 0 && slots_[order_[pos - 1]].header.time > event->time) {
+            order_[pos] = order_[pos - 1];
+            --pos;
+        }
+        order_[pos] = slot;
+        ++count_;
+        return true;
+    }
+
+  private:
+    union Slot {
+        clap_event_header_t header;
+        clap_event_note_t note;
+        clap_event_note_expression_t note_expression;
+        clap_event_param_value_t param_value;
+        clap_event_param_mod_t param_mod;
+        clap_event_param_gesture_t param_gesture;
+        clap_event_transport_t transport;
+        clap_event_midi_t midi;
+    };
+
+    std::array<Slot, CAPACITY> slots_;
+    std::array<uint16_t, CAPACITY> order_;
+    uint32_t count_ = 0;
+    clap_input_events_t input_ = {};
+    clap_output_events_t output_ = {};
+};
+
 struct ClapHost::Impl {
     Impl(HINSTANCE hInst);
     ~Impl();
@@ -50,27 +123,112 @@ struct ClapHost::Impl {
     bool GetParameterInfo(int32_t index, IAudioPluginHost::ParameterInfo& info) const;
     uint32_t GetParameterID(int32_t index) const;
     int32_t GetLatencySamples() const;
+    int32_t GetTailSamples() const;
     int32_t GetLastTouchedParamID();
-    void SetParameter(uint32_t paramId, float value) const;
+    void SetParameter(uint32_t paramId, float value);
+    void CacheParamRanges();
+    void FillInputEvents(int32_t numSamples, const std::vector<MidiEvent>& midiEvents);
+    void DrainOutputEvents();
+    uint64_t GetStateRevision() const;
     std::filesystem::path m_pluginPath;
     bool m_isGuiVisible = false;
+    // 保存される状態の変更回数。ホストからの SetParameter は AviUtl のトラック値を毎回送り直すものなので数えない
+    std::atomic<uint64_t> stateRevision{ 1 };
 
     clap_host host = {};
     HINSTANCE hInstance;
-    HMODULE hModule = nullptr;
-    const clap_plugin_entry* entry = nullptr;
+    // 同じプラグインのインスタンス間で共有する DLL と factory
+    std::shared_ptr<const PluginModuleCache::ClapModule> module;
     const clap_plugin* plugin = nullptr;
     const clap_plugin_state* extState = nullptr;
     const clap_plugin_gui* extGui = nullptr;
     const clap_plugin_params* extParams = nullptr;
     const clap_plugin_latency* extLatency = nullptr;
+    const clap_plugin_tail* extTail = nullptr;
+    const clap_plugin_audio_ports* extAudioPorts = nullptr;
+    const clap_plugin_audio_ports_config* extPortsConfig = nullptr;
+    const clap_plugin_render* extRender = nullptr;
     bool isReady = false;
     std::atomic<int32_t> lastTouchedParamID{ -1 };
     HWND guiWindow = nullptr;
     double currentSampleRate = 44100.0;
     int32_t currentBlockSize = 1024;
 
+    // 音声スレッドから get_info を呼ばないよう、正規化値を実値に戻すための範囲を読み込み時に取っておく
+    struct ParamRange {
+        clap_id id;
+        double min_value;
+        double max_value;
+        void* cookie;
+    };
+    std::vector<ParamRange> paramRanges;
+
+    struct PendingParamChange {
+        clap_id id;
+        double value;
+        void* cookie;
+    };
+    static constexpr size_t MAX_PENDING_PARAMS = 256;
+    std::vector<PendingParamChange> paramQueue;
+    std::mutex paramQueueMutex;
+    // 先読みのワーカーと音声スレッド、メインスレッドから同じインスタンスを呼ぶので、プラグインへの呼び出しをまとめて直列化する
+    mutable std::recursive_mutex lifecycleMutex;
+
+    // ノートを CLAP_EVENT_MIDI で送るか。note_ports で MIDI 方言を優先するプラグイン用
+    bool notesAsMidi = false;
+    ClapEventBuffer inEvents;
+    ClapEventBuffer outEvents;
+
+    // 主ポートのチャンネル数。audio-ports がなければ 0 で、ProcessAudio の numChannels をそのまま渡す
+    int32_t mainInChannels = 0;
+    int32_t mainOutChannels = 0;
+    // 最後に要求した主ポートのチャンネル数。合う構成がなかった場合も同じ数では探し直さない
+    std::atomic<int32_t> busChannels{ 2 };
+    // モノラルの入力をステレオのポートで処理したときの R の出力先
+    std::vector<float> discardBuffer;
+
+    void QueryMainPorts() {
+        mainInChannels = 0;
+        mainOutChannels = 0;
+        if (!extAudioPorts) return;
+        clap_audio_port_info_t info = {};
+        if (extAudioPorts->count(plugin, true) > 0 && extAudioPorts->get(plugin, 0, true, &info)) mainInChannels = static_cast<int32_t>(info.channel_count);
+        info = {};
+        if (extAudioPorts->count(plugin, false) > 0 && extAudioPorts->get(plugin, 0, false, &info)) mainOutChannels = static_cast<int32_t>(info.channel_count);
+    }
+
+    // モノラルのオブジェクトでは主ポートが 1ch の構成を選び、プラグインに 1ch 分だけ処理させる。
+    // 構成は止めている間しか選べないので、メインスレッドで止めて選んでから動かし直す
+    void SelectPortsConfig(int32_t channels) {
+        std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
+        if (busChannels.exchange(channels) == channels) return;
+        if (!isReady || !plugin || !extPortsConfig) return;
+        const uint32_t count = extPortsConfig->count(plugin);
+        for (uint32_t i = 0; i < count; ++i) {
+            clap_audio_ports_config_t config = {};
+            if (!extPortsConfig->get(plugin, i, &config)) continue;
+            if (!config.has_main_input && !config.has_main_output) continue;
+            if (config.has_main_input && static_cast<int32_t>(config.main_input_channel_count) != channels) continue;
+            if (config.has_main_output && static_cast<int32_t>(config.main_output_channel_count) != channels) continue;
+            if ((!config.has_main_input || mainInChannels == channels) && (!config.has_main_output || mainOutChannels == channels)) return;
+
+            if (plugin->stop_processing) plugin->stop_processing(plugin);
+            plugin->deactivate(plugin);
+            if (!extPortsConfig->select(plugin, config.id)) DbgPrint(L"[CLAP] audio ports config rejected for channels: " + std::to_wstring(channels), LOG_VERBOSE);
+            QueryMainPorts();
+            if (!plugin->activate(plugin, currentSampleRate, currentBlockSize, currentBlockSize)) {
+                ClapLog(LOG_WARN);
+                DbgPrint(L"[CLAP] failed to reactivate plugin after audio ports change", LOG_VERBOSE);
+                isReady = false;
+                return;
+            }
+            if (plugin->start_processing) plugin->start_processing(plugin);
+            return;
+        }
+    }
+
     void SetSampleRate(double newRate) {
+        std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
         if (std::abs(currentSampleRate - newRate) < 0.1) return;
         currentSampleRate = newRate;
         if (!isReady || !plugin) return;
@@ -80,6 +238,21 @@ struct ClapHost::Impl {
         if (plugin->activate(plugin, currentSampleRate, currentBlockSize, currentBlockSize))
             if (plugin->start_processing) plugin->start_processing(plugin);
     }
+
+    // render 拡張は有効化したまま切り替えられる (set はメインスレッドから呼ぶ)。実時間での処理が必須と答えたプラグインはリアルタイムのままにする
+    std::atomic<bool> offlineMode{ false };
+    void ApplyRenderMode() const {
+        if (!extRender || !plugin) return;
+        const bool offline = offlineMode.load();
+        if (offline && extRender->has_hard_realtime_requirement && extRender->has_hard_realtime_requirement(plugin)) return;
+        if (!extRender->set(plugin, offline ? CLAP_RENDER_OFFLINE : CLAP_RENDER_REALTIME))
+            DbgPrint(std::wstring(L"[CLAP] render mode rejected: ") + (offline ? L"offline" : L"realtime"), LOG_VERBOSE);
+    }
+    void SetOfflineMode(bool offline) {
+        std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
+        if (offlineMode.exchange(offline) == offline) return;
+        if (isReady) ApplyRenderMode();
+    }
 };
 
 static void clap_log_callback(const clap_host_t* host, clap_log_severity severity, const char* msg) {
@@ -149,9 +322,16 @@ static const clap_host_gui s_clap_gui = {
     }
 };
 
+static const clap_host_state s_clap_state = {
+    [](const clap_host_t* h) {
+        static_cast<ClapHost::Impl*>(h->host_data)->stateRevision.fetch_add(1);
+    }
+};
+
 static const void* ClapHost_GetExtension(const clap_host_t* host, const char* id) {
     if (strcmp(id, CLAP_EXT_LOG) == 0) return &s_clap_log;
     if (strcmp(id, CLAP_EXT_GUI) == 0) return &s_clap_gui;
+    if (strcmp(id, CLAP_EXT_STATE) == 0) return &s_clap_state;
     return nullptr;
 }
 
@@ -169,45 +349,24 @@ ClapHost::Impl::Impl(HINSTANCE hInst)
     host.request_callback = [](const clap_host_t*) {};
 }
 
-static uint32_t dummy_events_size(const clap_input_events_t*) {
-    return 0;
-}
-static const clap_event_header_t* dummy_events_get(const clap_input_events_t*, uint32_t) {
-    return nullptr;
-}
-static bool dummy_events_push(const clap_output_events_t*, const clap_event_header_t*) {
-    return false;
-}
-static const clap_input_events_t g_dummy_in = { nullptr, dummy_events_size, dummy_events_get };
-static const clap_output_events_t g_dummy_out = { nullptr, dummy_events_push };
-
 bool ClapHost::Impl::LoadPlugin(const std::filesystem::path& path, double sampleRate, int32_t blockSize) {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     ReleasePlugin();
+    stateRevision.fetch_add(1);
     currentSampleRate = sampleRate;
     currentBlockSize = blockSize;
 
-    std::wstring wpath = path.wstring();
-
-    hModule = LoadLibrary(wpath.c_str());
-    if (!hModule) return false;
+    module = PluginModuleCache::AcquireClap(path);
+    if (!module) return false;
 
-    clap_plugin_entry_t* entry_proc = reinterpret_cast<clap_plugin_entry_t*>(GetProcAddress(hModule, "clap_plugin_entry"));
-    if (!entry_proc) entry_proc = reinterpret_cast<clap_plugin_entry_t*>(GetProcAddress(hModule, "clap_entry"));
-    if (!entry_proc || !entry_proc->init(path.string().c_str())) {
-        ReleasePlugin();
-        return false;
-    }
-
-    entry = entry_proc;
-    const clap_plugin_factory_t* factory = reinterpret_cast<const clap_plugin_factory_t*>(entry->get_factory(CLAP_PLUGIN_FACTORY_ID));
-    if (!factory || factory->get_plugin_count(factory) == 0) {
-        ReleasePlugin();
+    const clap_plugin_factory_t* factory = module->factory;
+    const clap_plugin_descriptor_t* desc = factory->get_plugin_descriptor(factory, 0);
+    plugin = desc ? factory->create_plugin(factory, &host, desc->id) : nullptr;
+    if (!plugin) {
+        module.reset();
         return false;
     }
-
-    const clap_plugin_descriptor_t* desc = factory->get_plugin_descriptor(factory, 0);
-    plugin = factory->create_plugin(factory, &host, desc->id);
-    if (!plugin || !plugin->init(plugin)) {
+    if (!plugin->init(plugin)) {
         ReleasePlugin();
         return false;
     }
@@ -216,10 +375,28 @@ bool ClapHost::Impl::LoadPlugin(const std::filesystem::path& path, double sample
     extGui = reinterpret_cast<const clap_plugin_gui*>(plugin->get_extension(plugin, CLAP_EXT_GUI));
     extParams = reinterpret_cast<const clap_plugin_params*>(plugin->get_extension(plugin, CLAP_EXT_PARAMS));
     extLatency = reinterpret_cast<const clap_plugin_latency*>(plugin->get_extension(plugin, CLAP_EXT_LATENCY));
+    extTail = reinterpret_cast<const clap_plugin_tail*>(plugin->get_extension(plugin, CLAP_EXT_TAIL));
+    extAudioPorts = reinterpret_cast<const clap_plugin_audio_ports*>(plugin->get_extension(plugin, CLAP_EXT_AUDIO_PORTS));
+    extPortsConfig = reinterpret_cast<const clap_plugin_audio_ports_config*>(plugin->get_extension(plugin, CLAP_EXT_AUDIO_PORTS_CONFIG));
+    extRender = reinterpret_cast<const clap_plugin_render*>(plugin->get_extension(plugin, CLAP_EXT_RENDER));
+    if (offlineMode.load()) ApplyRenderMode();
+    QueryMainPorts();
+    busChannels = 2;
+    discardBuffer.assign(static_cast<size_t>((std::max)(blockSize, 0)), 0.0f);
 
     if (extParams) DbgPrint(L"[CLAP] params extension available", LOG_VERBOSE);
     if (extLatency) DbgPrint(L"[CLAP] latency extension available", LOG_VERBOSE);
 
+    CacheParamRanges();
+    notesAsMidi = false;
+    auto extNotePorts = reinterpret_cast<const clap_plugin_note_ports*>(plugin->get_extension(plugin, CLAP_EXT_NOTE_PORTS));
+    if (extNotePorts && extNotePorts->count(plugin, true) > 0) {
+        clap_note_port_info_t portInfo = {};
+        if (extNotePorts->get(plugin, 0, true, &portInfo)) {
+            notesAsMidi = portInfo.preferred_dialect == CLAP_NOTE_DIALECT_MIDI || (portInfo.supported_dialects & CLAP_NOTE_DIALECT_CLAP) == 0;
+        }
+    }
+
     if (!plugin->activate(plugin, sampleRate, blockSize, blockSize)) {
         ReleasePlugin();
         return false;
@@ -231,6 +408,7 @@ bool ClapHost::Impl::LoadPlugin(const std::filesystem::path& path, double sample
 }
 
 void ClapHost::Impl::ReleasePlugin() {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     if (!plugin) return;
     if (plugin->stop_processing) plugin->stop_processing(plugin);
     plugin->deactivate(plugin);
@@ -240,17 +418,119 @@ void ClapHost::Impl::ReleasePlugin() {
     extGui = nullptr;
     extParams = nullptr;
     extLatency = nullptr;
-    if (entry) entry->deinit();
-    entry = nullptr;
-    if (hModule) FreeLibrary(hModule);
-    hModule = nullptr;
+    extTail = nullptr;
+    extAudioPorts = nullptr;
+    extPortsConfig = nullptr;
+    extRender = nullptr;
+    module.reset();
     isReady = false;
     m_pluginPath.clear();
     m_isGuiVisible = false;
     lastTouchedParamID = -1;
+    paramRanges.clear();
+    {
+        std::lock_guard<std::mutex> lock(paramQueueMutex);
+        paramQueue.clear();
+    }
+    inEvents.Clear();
+    outEvents.Clear();
+}
+
+void ClapHost::Impl::CacheParamRanges() {
+    paramRanges.clear();
+    {
+        std::lock_guard<std::mutex> lock(paramQueueMutex);
+        paramQueue.clear();
+        paramQueue.reserve(MAX_PENDING_PARAMS);
+    }
+    if (!extParams) return;
+    const uint32_t count = extParams->count(plugin);
+    paramRanges.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        clap_param_info_t info = {};
+        if (!extParams->get_info(plugin, i, &info)) continue;
+        paramRanges.push_back({ info.id, info.min_value, info.max_value, info.cookie });
+    }
+    std::sort(paramRanges.begin(), paramRanges.end(), [](const ParamRange& a, const ParamRange& b) { return a.id < b.id; });
+}
+
+void ClapHost::Impl::FillInputEvents(int32_t numSamples, const std::vector<MidiEvent>& midiEvents) {
+    inEvents.Clear();
+    {
+        std::lock_guard<std::mutex> lock(paramQueueMutex);
+        for (const auto& change : paramQueue) {
+            clap_event_param_value_t ev = {};
+            ev.header.size = sizeof(ev);
+            ev.header.time = 0;
+            ev.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+            ev.header.type = CLAP_EVENT_PARAM_VALUE;
+            ev.param_id = change.id;
+            ev.cookie = change.cookie;
+            ev.note_id = -1;
+            ev.port_index = -1;
+            ev.channel = -1;
+            ev.key = -1;
+            ev.value = change.value;
+            inEvents.Push(&ev.header);
+        }
+        paramQueue.clear();
+    }
+
+    const uint32_t lastFrame = static_cast<uint32_t>((std::max)(0, numSamples - 1));
+    for (const auto& me : midiEvents) {
+        const uint32_t time = (std::min)(static_cast<uint32_t>((std::max)(0, me.deltaFrames)), lastFrame);
+        const uint8_t kind = me.status & 0xF0;
+        const bool noteOn = kind == 0x90 && me.data2 > 0;
+        const bool noteOff = kind == 0x80 || (kind == 0x90 && me.data2 == 0);
+        if ((noteOn || noteOff) && !notesAsMidi) {
+            clap_event_note_t ev = {};
+            ev.header.size = sizeof(ev);
+            ev.header.time = time;
+            ev.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+            ev.header.type = noteOn ? CLAP_EVENT_NOTE_ON : CLAP_EVENT_NOTE_OFF;
+            ev.note_id = -1;
+            ev.port_index = 0;
+            ev.channel = static_cast<int16_t>(me.status & 0x0F);
+            ev.key = static_cast<int16_t>(me.data1 & 0x7F);
+            ev.velocity = me.data2 / 127.0;
+            inEvents.Push(&ev.header);
+        } else {
+            clap_event_midi_t ev = {};
+            ev.header.size = sizeof(ev);
+            ev.header.time = time;
+            ev.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+            ev.header.type = CLAP_EVENT_MIDI;
+            ev.port_index = 0;
+            ev.data[0] = me.status;
+            ev.data[1] = me.data1;
+            ev.data[2] = me.data2;
+            inEvents.Push(&ev.header);
+        }
+    }
+}
+
+// プラグインが出したイベントのうち、パラメータ操作だけをマッピング学習用に拾う
+void ClapHost::Impl::DrainOutputEvents() {
+    for (uint32_t i = 0; i < outEvents.Count(); ++i) {
+        const clap_event_header_t* header = outEvents.Get(i);
+        if (header->space_id != CLAP_CORE_EVENT_SPACE_ID) continue;
+        if (header->type == CLAP_EVENT_PARAM_GESTURE_BEGIN) {
+            lastTouchedParamID.store(static_cast<int32_t>(reinterpret_cast<const clap_event_param_gesture_t*>(header)->param_id));
+        } else if (header->type == CLAP_EVENT_PARAM_VALUE) {
+            lastTouchedParamID.store(static_cast<int32_t>(reinterpret_cast<const clap_event_param_value_t*>(header)->param_id));
+            stateRevision.fetch_add(1);
+        }
+    }
+    outEvents.Clear();
+}
+
+// 音声スレッドからも読むので、問い合わせでは増やさない。GUI の開閉とプラグインからの通知で増える
+uint64_t ClapHost::Impl::GetStateRevision() const {
+    return stateRevision.load();
 }
 
 void ClapHost::Impl::ProcessAudio(const float* inL, const float* inR, float* outL, float* outR, int32_t numSamples, int32_t numChannels, const std::vector<MidiEvent>& midiEvents) {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     if (!isReady || !plugin) {
         memcpy(outL, inL, numSamples * sizeof(float));
         if (numChannels > 1) memcpy(outR, inR, numSamples * sizeof(float));
@@ -260,19 +540,31 @@ void ClapHost::Impl::ProcessAudio(const float* inL, const float* inR, float* out
     clap_process process = {};
     process.steady_time = 0;
     process.frames_count = numSamples;
-    process.in_events = &g_dummy_in;
-    process.out_events = &g_dummy_out;
-
-    const float* inputs[2] = { inL, inR };
-    float* outputs[2] = { outL, outR };
+    FillInputEvents(numSamples, midiEvents);
+    outEvents.Clear();
+    process.in_events = inEvents.Input();
+    process.out_events = outEvents.Output();
+
+    // 主ポートのチャンネル数に合わせて渡す。モノラルの入力をステレオのポートへ渡すときは同じ信号を両方に入れ、R の出力は捨てる。
+    // ステレオの入力をモノラルのポートへ渡すとき (構成し直す前) は L だけを処理し、出力を R にも使う
+    const int32_t inChannels = mainInChannels > 0 ? (std::min)(mainInChannels, 2) : numChannels;
+    const int32_t outChannels = mainOutChannels > 0 ? (std::min)(mainOutChannels, 2) : numChannels;
+    if (numChannels < 2 && discardBuffer.size() < static_cast<size_t>(numSamples)) discardBuffer.resize(numSamples);
+    const float* inputs[2] = { inL, numChannels >= 2 ? inR : inL };
+    float* outputs[2] = { outL, numChannels >= 2 ? outR : discardBuffer.data() };
 
     clap_audio_buffer in_buf = {};
     in_buf.data32 = const_cast<float**>(inputs);
-    in_buf.channel_count = numChannels;
+    in_buf.channel_count = inChannels;
+    // 入力がすべて 0 なら全チャンネルを定数として渡し、プラグイン側で処理を省けるようにする
+    if (inChannels > 0 && Avx2Utils::GetPeakAbsAVX2(inL, numSamples) == 0.0f &&
+        (numChannels < 2 || Avx2Utils::GetPeakAbsAVX2(inR, numSamples) == 0.0f)) {
+        in_buf.constant_mask = (inChannels >= 2) ? 0x3 : 0x1;
+    }
 
     clap_audio_buffer out_buf = {};
     out_buf.data32 = outputs;
-    out_buf.channel_count = numChannels;
+    out_buf.channel_count = outChannels;
 
     process.audio_inputs_count = (numChannels > 0) ? 1 : 0;
     process.audio_outputs_count = (numChannels > 0) ? 1 : 0;
@@ -280,9 +572,12 @@ void ClapHost::Impl::ProcessAudio(const float* inL, const float* inR, float* out
     process.audio_outputs = &out_buf;
 
     plugin->process(plugin, &process);
+    if (numChannels > 1 && outChannels == 1) Avx2Utils::CopyBufferAVX2(outR, outL, numSamples);
+    DrainOutputEvents();
 }
 
 void ClapHost::Impl::Reset(int64_t currentSampleIndex, double bpm, int32_t timeSigNum, int32_t timeSigDenom) const {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     if (isReady && plugin && plugin->reset) plugin->reset(plugin);
 }
 
@@ -308,6 +603,7 @@ LRESULT CALLBACK ClapHostGuiProc(HWND hWnd, uint32_t msg, WPARAM wp, LPARAM lp)
 }
 
 void ClapHost::Impl::ShowGui() {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     if (guiWindow && IsWindow(guiWindow)) {
         ShowWindow(guiWindow, SW_SHOW);
         SetForegroundWindow(guiWindow);
@@ -348,6 +644,7 @@ void ClapHost::Impl::ShowGui() {
 }
 
 void ClapHost::Impl::HideGui() {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     if (guiWindow) DestroyWindow(guiWindow);
     m_isGuiVisible = false;
 }
@@ -361,23 +658,20 @@ bool ClapHost::Impl::GuiResize(uint32_t width, uint32_t height) const {
 }
 
 std::string ClapHost::Impl::GetState() const {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     if (!plugin || !extState) return "";
-    struct Ctx {
-        std::vector<BYTE> data;
-    };
-    Ctx ctx;
-    clap_ostream stream = { &ctx, [](const clap_ostream* s, const void* buf, uint64_t size) -> int64_t {
-                               auto c = reinterpret_cast<Ctx*>(s->ctx);
-                               c->data.insert(c->data.end(), reinterpret_cast<const BYTE*>(buf), reinterpret_cast<const BYTE*>(buf) + size);
+    // プラグインが書き出すそばから圧縮する
+    StringUtils::StatePayloadWriter writer("CLAP:", "CLAPZ:", settings.general.StateCompressionMode());
+    clap_ostream stream = { &writer, [](const clap_ostream* s, const void* buf, uint64_t size) -> int64_t {
+                               reinterpret_cast<StringUtils::StatePayloadWriter*>(s->ctx)->Write(buf, static_cast<size_t>(size));
                                return static_cast<int64_t>(size);
                            } };
-    if (extState->save(plugin, &stream)) {
-        return StringUtils::EncodeCompressedStatePayload("CLAP:", "CLAPZ:", ctx.data.data(), ctx.data.size(), settings.general.compress_plugin_state);
-    }
+    if (extState->save(plugin, &stream)) return writer.Finish();
     return "";
 }
 
 bool ClapHost::Impl::SetState(const std::string& state_b64) const {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     if (!plugin || !extState) return false;
     std::vector<BYTE> data;
     if (!StringUtils::DecodeStatePayload(state_b64, "CLAP:", "CLAPZ:", data)) return false;
@@ -403,6 +697,7 @@ void ClapHost::Impl::Cleanup() {
 }
 
 int32_t ClapHost::Impl::GetParameterCount() const {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     if (!extParams) {
         DbgPrint(L"[CLAP] params extension not available", LOG_VERBOSE);
         return 0;
@@ -411,6 +706,7 @@ int32_t ClapHost::Impl::GetParameterCount() const {
 }
 
 bool ClapHost::Impl::GetParameterInfo(int32_t index, IAudioPluginHost::ParameterInfo& info) const {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     if (!extParams) {
         DbgPrint(L"[CLAP] params extension not available", LOG_VERBOSE);
         return false;
@@ -432,6 +728,7 @@ bool ClapHost::Impl::GetParameterInfo(int32_t index, IAudioPluginHost::Parameter
 }
 
 uint32_t ClapHost::Impl::GetParameterID(int32_t index) const {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     if (!extParams) {
         DbgPrint(L"[CLAP] params extension not available", LOG_VERBOSE);
         return 0;
@@ -447,6 +744,7 @@ uint32_t ClapHost::Impl::GetParameterID(int32_t index) const {
 }
 
 int32_t ClapHost::Impl::GetLatencySamples() const {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     if (!extLatency) {
         DbgPrint(L"[CLAP] latency extension not available", LOG_VERBOSE);
         return 0;
@@ -461,17 +759,39 @@ int32_t ClapHost::Impl::GetLatencySamples() const {
     return static_cast<int32_t>(extLatency->get(plugin));
 }
 
+int32_t ClapHost::Impl::GetTailSamples() const {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
+    if (!extTail || !isReady || !plugin) return IAudioPluginHost::INFINITE_TAIL;
+    const uint32_t tail = extTail->get(plugin);
+    if (tail >= static_cast<uint32_t>(IAudioPluginHost::INFINITE_TAIL)) return IAudioPluginHost::INFINITE_TAIL;
+    return static_cast<int32_t>(tail);
+}
+
 int32_t ClapHost::Impl::GetLastTouchedParamID() {
     return lastTouchedParamID.exchange(-1);
 }
 
-void ClapHost::Impl::SetParameter(uint32_t paramId, float value) const {
+// value は 0 ～ 1 の正規化値。次の ProcessAudio で CLAP_EVENT_PARAM_VALUE としてブロック先頭に送る
+void ClapHost::Impl::SetParameter(uint32_t paramId, float value) {
+    std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     if (!extParams) {
         DbgPrint(L"[CLAP] params extension not available", LOG_VERBOSE);
         return;
     }
 
-    DbgPrint(L"[CLAP] SetParameter id=" + std::to_wstring(paramId) + L", value=" + std::to_wstring(value) + L" (not fully implemented)", LOG_VERBOSE);
+    auto it = std::lower_bound(paramRanges.begin(), paramRanges.end(), paramId, [](const ParamRange& r, uint32_t id) { return r.id < id; });
+    if (it == paramRanges.end() || it->id != paramId) return;
+    const double normalized = (std::max)(0.0, (std::min)(1.0, static_cast<double>(value)));
+    const double plain = it->min_value + (it->max_value - it->min_value) * normalized;
+
+    std::lock_guard<std::mutex> lock(paramQueueMutex);
+    for (auto& pending : paramQueue) {
+        if (pending.id == paramId) {
+            pending.value = plain;
+            return;
+        }
+    }
+    if (paramQueue.size() < MAX_PENDING_PARAMS) paramQueue.push_back({ it->id, plain, it->cookie });
 }
 
 ClapHost::Impl::~Impl() {
@@ -488,8 +808,21 @@ void ClapHost::SetSampleRate(double sampleRate) {
     m_impl->SetSampleRate(sampleRate);
 }
 double ClapHost::GetSampleRate() const {
+    std::lock_guard<std::recursive_mutex> lock(m_impl->lifecycleMutex);
     return m_impl->currentSampleRate;
 }
+void ClapHost::SetOfflineMode(bool offline) {
+    m_impl->SetOfflineMode(offline);
+}
+bool ClapHost::IsOfflineMode() const {
+    return m_impl->offlineMode.load();
+}
+void ClapHost::SetMainBusChannels(int32_t channels) {
+    m_impl->SelectPortsConfig(channels);
+}
+int32_t ClapHost::GetMainBusChannels() const {
+    return m_impl->busChannels.load();
+}
 void ClapHost::ProcessAudio(const float* inL, const float* inR, float* outL, float* outR, int32_t numSamples, int32_t numChannels, int64_t currentSampleIndex, double bpm, int32_t tsNum, int32_t tsDenom, const std::vector<MidiEvent>& midiEvents) {
     m_impl->ProcessAudio(inL, inR, outL, outR, numSamples, numChannels, midiEvents);
 }
@@ -498,20 +831,24 @@ void ClapHost::Reset(int64_t currentSampleIndex, double bpm, int32_t timeSigNum,
 }
 void ClapHost::ShowGui() {
     m_impl->ShowGui();
+    m_impl->stateRevision.fetch_add(1);
 }
 void ClapHost::HideGui() {
     m_impl->HideGui();
+    m_impl->stateRevision.fetch_add(1);
 }
 std::string ClapHost::GetState() {
     return m_impl->GetState();
 }
 bool ClapHost::SetState(const std::string& state_b64) {
+    m_impl->stateRevision.fetch_add(1);
     return m_impl->SetState(state_b64);
 }
 void ClapHost::Cleanup() {
     m_impl->Cleanup();
 }
 bool ClapHost::IsGuiVisible() const {
+    std::lock_guard<std::recursive_mutex> lock(m_impl->lifecycleMutex);
     return m_impl->m_isGuiVisible;
 }
 
@@ -531,6 +868,10 @@ int32_t ClapHost::GetLatencySamples() {
     return m_impl->GetLatencySamples();
 }
 
+int32_t ClapHost::GetTailSamples() {
+    return m_impl->GetTailSamples();
+}
+
 int32_t ClapHost::GetParameterCount() {
     return m_impl->GetParameterCount();
 }
@@ -541,4 +882,8 @@ bool ClapHost::GetParameterInfo(int32_t index, ParameterInfo& info) {
 
 uint32_t ClapHost::GetParameterID(int32_t index) {
     return m_impl->GetParameterID(index);
+}
+
+uint64_t ClapHost::GetStateRevision() {
+    return m_impl->GetStateRevision();
 }
\ No newline at end of file
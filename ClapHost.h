@@ -23,11 +23,17 @@ class ClapHost : public IAudioPluginHost {
     void SetParameter(uint32_t paramId, float value) override;
     int32_t GetLastTouchedParamID() override;
     int32_t GetLatencySamples() override;
+    int32_t GetTailSamples() override;
     int32_t GetParameterCount() override;
     bool GetParameterInfo(int32_t index, ParameterInfo& info) override;
     uint32_t GetParameterID(int32_t index) override;
+    uint64_t GetStateRevision() override;
     void SetSampleRate(double sampleRate) override;
     double GetSampleRate() const override;
+    void SetOfflineMode(bool offline) override;
+    bool IsOfflineMode() const override;
+    void SetMainBusChannels(int32_t channels) override;
+    int32_t GetMainBusChannels() const override;
     struct Impl;
     std::unique_ptr<Impl> m_impl;
 };
\ No newline at end of file
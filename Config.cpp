@@ -86,7 +86,7 @@ void EnsureCategoryDefaults(const std::wstring& categoryName, const std::vector<
 
 template <typename Func>
 void ApplyToAllCategories(Func func, AppSettings& setting, const std::filesystem::path& path) {
-    auto categories = std::tie(setting.info, setting.general, setting.module, setting.compat, setting.vst, setting.analyzer, setting.exp);
+    auto categories = std::tie(setting.info, setting.general, setting.module, setting.compat, setting.vst, setting.analyzer, setting.performance, setting.exp);
     std::apply([&](auto&... cat) {
         (func(cat.categoryName, cat.getEntries(), path), ...);
     },
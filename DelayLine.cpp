@@ -0,0 +1,106 @@
+﻿#include "DelayLine.h"
+#include "Avx2Utils.h"
+
+#include <algorithm>
+
+namespace {
+    size_t NextPowerOfTwo(size_t v) {
+        size_t p = 1;
+        while (p < v) p <<= 1;
+        return p;
+    }
+}
+
+void MirroredRingBuffer::Reserve(size_t min_capacity) {
+    const size_t capacity = NextPowerOfTwo((std::max)(min_capacity, static_cast<size_t>(1)));
+    if (capacity <= mask_ + 1) return;
+
+    MirroredRingBuffer grown;
+    grown.data_.assign(capacity * 2, 0.0f);
+    grown.mask_ = capacity - 1;
+    const size_t old_capacity = mask_ + 1;
+    grown.Write(Read(0, old_capacity), old_capacity);
+    *this = std::move(grown);
+}
+
+void MirroredRingBuffer::Clear() {
+    std::fill(data_.begin(), data_.end(), 0.0f);
+    write_pos_ = 0;
+}
+
+void MirroredRingBuffer::Write(const float* src, size_t count) {
+    const size_t capacity = mask_ + 1;
+    if (count > capacity) {
+        src += count - capacity;
+        count = capacity;
+    }
+    float* base = data_.data();
+    const size_t first = (std::min)(count, capacity - write_pos_);
+    Avx2Utils::CopyBufferAVX2(base + write_pos_, src, first);
+    Avx2Utils::CopyBufferAVX2(base + write_pos_ + capacity, src, first);
+    const size_t rest = count - first;
+    if (rest > 0) {
+        Avx2Utils::CopyBufferAVX2(base, src + first, rest);
+        Avx2Utils::CopyBufferAVX2(base + capacity, src + first, rest);
+    }
+    write_pos_ = (write_pos_ + count) & mask_;
+}
+
+void LatencyCompensator::Process(const float* const* in, float* const* out, int32_t channels, int32_t count, int32_t latency) {
+    latency = (std::max)(latency, 0);
+    if (!primed_) {
+        // 履歴がないうちは切り替える元がないので、そのまま新しい遅延で始める
+        current_ = previous_ = latency;
+        fade_remaining_ = 0;
+        primed_ = true;
+    }
+    // フェード中に変わった場合は途中で切り替えると出力が飛ぶので、今のフェードを終えてから次の遅延へフェードする
+    pending_ = latency;
+
+    const size_t needed = static_cast<size_t>((std::max)({ current_, previous_, pending_ })) + CHUNK;
+    if (buffers_.size() < static_cast<size_t>(channels)) buffers_.resize(channels);
+    for (auto& buffer : buffers_) buffer.Reserve(needed);
+
+    for (int32_t offset = 0; offset < count; offset += CHUNK) {
+        const int32_t n = (std::min)(CHUNK, count - offset);
+        for (int32_t ch = 0; ch < channels; ++ch) buffers_[ch].Write(in[ch] + offset, n);
+
+        if (fade_remaining_ == 0 && pending_ != current_) {
+            previous_ = current_;
+            current_ = pending_;
+            fade_remaining_ = CROSSFADE_SAMPLES;
+        }
+        if (fade_remaining_ == 0) {
+            for (int32_t ch = 0; ch < channels; ++ch) Avx2Utils::CopyBufferAVX2(out[ch] + offset, buffers_[ch].Read(current_, n), n);
+            continue;
+        }
+
+        const int32_t fade_n = (std::min)(n, fade_remaining_);
+        const int32_t faded = CROSSFADE_SAMPLES - fade_remaining_;
+        const float step = 1.0f / CROSSFADE_SAMPLES;
+        for (int32_t ch = 0; ch < channels; ++ch) {
+            const float* from = buffers_[ch].Read(previous_, n);
+            const float* to = buffers_[ch].Read(current_, n);
+            float* dst = out[ch] + offset;
+            for (int32_t i = 0; i < fade_n; ++i) {
+                const float t = static_cast<float>(faded + i + 1) * step;
+                dst[i] = from[i] + (to[i] - from[i]) * t;
+            }
+            Avx2Utils::CopyBufferAVX2(dst + fade_n, to + fade_n, n - fade_n);
+        }
+        fade_remaining_ -= fade_n;
+    }
+}
+
+void LatencyCompensator::Reset() {
+    for (auto& buffer : buffers_) buffer.Clear();
+    current_ = previous_ = pending_ = 0;
+    fade_remaining_ = 0;
+    primed_ = false;
+}
+
+size_t LatencyCompensator::memory_usage() const {
+    size_t bytes = sizeof(*this);
+    for (const auto& buffer : buffers_) bytes += buffer.memory_usage();
+    return bytes;
+}
@@ -0,0 +1,52 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 容量が 2 の冪のリングバッファ。各サンプルを [i] と [i + capacity] の 2 か所に書くので、
+// capacity 以下の長さなら、どの位置からでも折り返しのない連続した領域として読み出せる。
+// 書き込みも読み出しも SIMD のコピーで済み、サンプルごとの折り返し判定がない。
+class MirroredRingBuffer {
+  public:
+    // min_capacity 以上の 2 の冪に広げる。広げるときは新しい側から古い容量分の履歴を引き継ぐ
+    void Reserve(size_t min_capacity);
+    void Clear();
+    // count が容量を超える場合は末尾の容量分だけが残る
+    void Write(const float* src, size_t count);
+    // 最後に書いたサンプルより delay サンプル前で終わる count サンプル。delay + count <= capacity() であること
+    const float* Read(size_t delay, size_t count) const {
+        return data_.data() + ((write_pos_ - delay - count) & mask_);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+    size_t memory_usage() const { return sizeof(*this) + data_.capacity() * sizeof(float); }
+
+  private:
+    std::vector<float> data_ = std::vector<float>(2, 0.0f);
+    size_t mask_ = 0;
+    size_t write_pos_ = 0;
+};
+
+// 遅延を報告するプロセッサに合わせて、ドライ信号を同じだけ遅らせる。
+// 遅延量が変わったら CROSSFADE_SAMPLES かけて新しい遅延へ移る。フェード中に変わった場合は、そのフェードを終えてから次へ移る。
+// 容量は遅延量 + CHUNK まで広げたら、遅延量が増えない限りヒープ確保をしない。
+class LatencyCompensator {
+  public:
+    static constexpr int32_t CHUNK = 2048;
+    static constexpr int32_t CROSSFADE_SAMPLES = 512;
+
+    // in[ch] を書き込み、latency サンプル遅らせた同じ長さを out[ch] に書く。in と out は同じ配列でもよい
+    void Process(const float* const* in, float* const* out, int32_t channels, int32_t count, int32_t latency);
+    void Reset();
+
+    int32_t latency() const { return current_; }
+    size_t memory_usage() const;
+
+  private:
+    std::vector<MirroredRingBuffer> buffers_;
+    int32_t current_ = 0;
+    int32_t previous_ = 0;
+    int32_t pending_ = 0; // フェード中に指定された次の遅延
+    int32_t fade_remaining_ = 0;
+    bool primed_ = false;
+};
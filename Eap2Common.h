@@ -1,6 +1,8 @@
 ﻿#pragma once
 #define _USE_MATH_DEFINES
+#include "DenormalGuard.h"
 #include "Eap2Info.h"
+#include "Profiler.h"
 #include "cache2.h"
 #include "config2.h"
 #include "filter2.h"
@@ -9,10 +11,12 @@
 #include "plugin2.h"
 
 #include <array>
+#include <filesystem>
 #include <functional>
 #include <mutex>
 #include <optional>
 #include <regex>
+#include <set>
 #include <string>
 #include <tchar.h>
 #include <variant>
@@ -34,6 +38,11 @@ extern CONFIG_HANDLE* g_config_handle;
 extern CACHE_HANDLE* g_cache_handle;
 extern HWND g_host_hwnd;
 
+// ファイル出力中か。出力中は音声がリアルタイムより速く要求されるので、プラグインをオフライン処理に切り替える
+inline bool IsSavingOutput() {
+    return g_edit_handle && g_edit_handle->get_edit_state() == g_edit_handle->EDIT_STATE_SAVE;
+}
+
 enum LOG_TYPE {
     LOG_NONE,
     LOG_VERBOSE,
@@ -172,6 +181,7 @@ extern std::vector<std::function<void()>> g_main_thread_tasks;
 
 extern FILTER_PLUGIN_TABLE filter_plugin_table_host;
 extern FILTER_PLUGIN_TABLE filter_plugin_table_host_media;
+extern FILTER_PLUGIN_TABLE filter_plugin_table_host_rack;
 extern FILTER_PLUGIN_TABLE filter_plugin_table_utility;
 extern FILTER_PLUGIN_TABLE filter_plugin_table_eq;
 extern FILTER_PLUGIN_TABLE filter_plugin_table_stereo;
@@ -199,6 +209,7 @@ extern FILTER_PLUGIN_TABLE filter_plugin_table_midi_gen;
 extern FILTER_PLUGIN_TABLE filter_plugin_table_reverb2;
 extern SCRIPT_MODULE_FUNCTION module_funcs[];
 
+std::filesystem::path GetConfigPath();
 void LoadConfig();
 void ReloadConfig();
 void SaveConfig();
@@ -229,6 +240,9 @@ void CleanupMidiGeneratorResources();
 
 void ToolCleanupResources();
 void CleanupMainFilterResources();
+void CleanupHostRackResources();
+// Host Rack のインスタンスIDとスロットのインスタンスIDを ids に積む
+void CollectHostRackInstanceIds(EDIT_SECTION* edit, OBJECT_HANDLE obj, std::set<std::string>& ids);
 void func_project_save(PROJECT_FILE* pf);
 void func_project_load(PROJECT_FILE* pf);
 
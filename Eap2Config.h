@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include "Eap2Info.h"
+#include "StateCodec.h"
 
 #include <cwctype>
 #include <functional>
@@ -83,7 +84,12 @@ struct ConfigEntry {
                     return true;
                 } else if constexpr (std::is_same_v<T, int32_t>) {
                     int32_t value = 0;
-                    if (!TryParseInt32(s, value, (std::numeric_limits<int32_t>::min)(), (std::numeric_limits<int32_t>::max)())) return false;
+                    if (!TryParseInt32(s, value, (std::numeric_limits<int32_t>::min)(), (std::numeric_limits<int32_t>::max)())) {
+                        // 以前 bool だった項目 (CompressPluginState など) の true / false は 1 / 0 として読む
+                        bool flag = false;
+                        if (!TryParseBool(s, flag)) return false;
+                        value = flag ? 1 : 0;
+                    }
                     *target = value;
                     return true;
                 } else if constexpr (std::is_same_v<T, double>) {
@@ -135,7 +141,8 @@ struct GeneralConfig {
     std::wstring categoryName = L"General";
     bool auto_rename_disable = false;
     bool enable_experimental = false;
-    bool compress_plugin_state = true;
+    // 0: 無圧縮 / 1: 高速 (LZ4 形式) / 2: 高圧縮 (DEFLATE)。以前の 0 / 1 や true / false の設定はそのまま読める
+    int32_t compress_plugin_state = 1;
     bool notify_save_warn = false;
     std::vector<ConfigEntry> getEntries() {
         return {
@@ -145,6 +152,10 @@ struct GeneralConfig {
             ConfigEntry::Create(L"NotifySaveWarn", L"0", &notify_save_warn, true)
         };
     }
+    StateCodec::Mode StateCompressionMode() const {
+        if (compress_plugin_state <= 0) return StateCodec::Mode::None;
+        return compress_plugin_state >= 2 ? StateCodec::Mode::High : StateCodec::Mode::Fast;
+    }
 };
 
 struct ModuleConfig {
@@ -154,6 +165,7 @@ struct ModuleConfig {
     bool chain_tool_disable = false;
     bool host_filter_disable = false;
     bool host_media_disable = false;
+    bool host_rack_disable = false;
     bool auto_wah_disable = false;
     bool chain_comp_disable = false;
     bool chain_dynamic_eq_disable = false;
@@ -184,6 +196,7 @@ struct ModuleConfig {
             ConfigEntry::Create(L"ChainToolDisable", L"0", &chain_tool_disable, false),
             ConfigEntry::Create(L"HostFilterDisable", L"0", &host_filter_disable, false),
             ConfigEntry::Create(L"HostMediaDisable", L"0", &host_media_disable, false),
+            ConfigEntry::Create(L"HostRackDisable", L"0", &host_rack_disable, false),
             ConfigEntry::Create(L"AutoWahDisable", L"0", &auto_wah_disable, false),
             ConfigEntry::Create(L"ChainCompDisable", L"0", &chain_comp_disable, false),
             ConfigEntry::Create(L"ChainDynamicEQDisable", L"0", &chain_dynamic_eq_disable, false),
@@ -228,9 +241,17 @@ struct CompatConfig {
 struct VstConfig {
     std::wstring categoryName = L"VST";
     bool forceResize = false;
+    bool sandbox = false;                // プラグインを子プロセス (EAP2PluginWorker.exe) で動かす
+    int32_t sandbox_timeout_ms = 2000;   // 子プロセスが 1 ブロックを返すまでの待ち時間 [ms]。超えたら無音ではなく素通しにする
+    int32_t render_ahead_blocks = 8;     // Host (Media) の先読み処理で先に用意しておくブロック数 (1 ブロック 2048 サンプル)
+    int32_t seek_checkpoint_ms = 0;      // シーク後に空回しする長さの目安 [ms]。この間隔でチェックポイントを残す。0 で無効
     std::vector<ConfigEntry> getEntries() {
         return {
-            ConfigEntry::Create(L"ForceResize", L"0", &forceResize, true)
+            ConfigEntry::Create(L"ForceResize", L"0", &forceResize, true),
+            ConfigEntry::Create(L"Sandbox", L"0", &sandbox, false),
+            ConfigEntry::Create(L"SandboxTimeoutMs", L"2000", &sandbox_timeout_ms, true),
+            ConfigEntry::Create(L"RenderAheadBlocks", L"8", &render_ahead_blocks, true),
+            ConfigEntry::Create(L"SeekCheckpointMs", L"0", &seek_checkpoint_ms, true)
         };
     }
 };
@@ -259,6 +280,22 @@ struct AnalyzerConfig {
     }
 };
 
+struct PerformanceConfig {
+    std::wstring categoryName = L"Performance";
+    int32_t state_idle_timeout_sec = 600; // この秒数使われていないエフェクトの状態を解放 (0で無効)
+    int32_t state_memory_limit_mb = 512;  // エフェクト状態の推定使用量の上限 [MB] (0で無制限)
+    std::wstring simd_level = L"Auto";     // 使用する命令セット (Auto/Scalar/SSE2/AVX2/AVX512)
+    bool enable_profiler = false;          // 音声処理の所要時間を記録する
+    std::vector<ConfigEntry> getEntries() {
+        return {
+            ConfigEntry::Create(L"StateIdleTimeoutSec", L"600", &state_idle_timeout_sec, true),
+            ConfigEntry::Create(L"StateMemoryLimitMB", L"512", &state_memory_limit_mb, true),
+            ConfigEntry::Create(L"SimdLevel", L"Auto", &simd_level, false),
+            ConfigEntry::Create(L"EnableProfiler", L"0", &enable_profiler, true)
+        };
+    }
+};
+
 struct ExperimentalConfig {
     std::wstring categoryName = L"Experimental";
     bool use_experimental_script_module = false;
@@ -276,6 +313,7 @@ struct AppSettings {
     CompatConfig compat;
     VstConfig vst;
     AnalyzerConfig analyzer;
+    PerformanceConfig performance;
     ExperimentalConfig exp;
 };
 
@@ -0,0 +1,92 @@
+﻿#include "EffectStateRegistry.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace {
+    // 各ツールの静的レジストリより先に構築されるよう関数内 static にする
+    std::mutex& RegistryListMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    std::vector<EffectStateRegistryBase*>& RegistryList() {
+        static std::vector<EffectStateRegistryBase*> list;
+        return list;
+    }
+
+    struct PendingMeasure {
+        void (*measure)(void*);
+        void* node;
+    };
+
+    // スレッドごとの ReadScope の深さと、閉じるときに測る状態
+    struct ReadState {
+        uint32_t depth = 0;
+        std::vector<PendingMeasure> pending;
+    };
+    thread_local ReadState t_read;
+}
+
+std::atomic<uint64_t> EffectStateRegistryBase::s_epoch{ 0 };
+std::atomic<uint32_t> EffectStateRegistryBase::s_active[2]{};
+
+EffectStateRegistryBase::EffectStateRegistryBase() {
+    std::lock_guard<std::mutex> lock(RegistryListMutex());
+    RegistryList().push_back(this);
+}
+
+EffectStateRegistryBase::~EffectStateRegistryBase() {
+    std::lock_guard<std::mutex> lock(RegistryListMutex());
+    auto& list = RegistryList();
+    list.erase(std::remove(list.begin(), list.end(), this), list.end());
+}
+
+EffectStateRegistryBase::ReadScope::ReadScope() : m_slot(s_epoch.load() & 1) {
+    s_active[m_slot].fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    ++t_read.depth;
+}
+
+EffectStateRegistryBase::ReadScope::~ReadScope() {
+    // 区間内で外されたノードもまだ解放されないので、s_active を戻す前に測る
+    if (--t_read.depth == 0) {
+        for (const auto& p : t_read.pending) p.measure(p.node);
+        t_read.pending.clear();
+    }
+    s_active[m_slot].fetch_sub(1, std::memory_order_release);
+}
+
+void EffectStateRegistryBase::MeasureAfterRead(void (*measure)(void*), void* node) {
+    if (t_read.depth == 0) measure(node);
+    else t_read.pending.push_back({ measure, node });
+}
+
+// 読み手は開いた時点のエポックの偶奇で s_active を選ぶ。現在 e なら、e - 1 で開いた読み手が
+// 残っていない ((e + 1) & 1 が 0) ときだけ e + 1 に進める。書き手は Run を回すメインスレッドのみ
+void EffectStateRegistryBase::TryAdvanceEpoch() {
+    const uint64_t epoch = s_epoch.load();
+    if (s_active[(epoch + 1) & 1].load() == 0) s_epoch.store(epoch + 1);
+}
+
+namespace EffectStateReclaimer {
+    size_t Run(uint64_t idle_timeout_ms, size_t memory_limit) {
+        const uint64_t now = EffectStateRegistryBase::NowMs();
+        std::vector<EffectStateRegistryBase::Candidate> candidates;
+        size_t total = 0;
+
+        std::lock_guard<std::mutex> lock(RegistryListMutex());
+        EffectStateRegistryBase::TryAdvanceEpoch();
+        for (auto* registry : RegistryList()) total += registry->Sweep(now, idle_timeout_ms, candidates);
+        if (memory_limit == 0 || total <= memory_limit) return total;
+
+        // 上限を超えた分だけ、最後に使われたのが古い順に退避する
+        std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.last_touched < b.last_touched; });
+        for (const auto& candidate : candidates) {
+            if (total <= memory_limit) break;
+            if (candidate.owner->Evict(candidate)) total -= (std::min)(total, candidate.bytes);
+        }
+        return total;
+    }
+}
\ No newline at end of file
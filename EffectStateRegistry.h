@@ -0,0 +1,371 @@
+﻿#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace EffectStateMemory {
+    template <typename T, typename = void>
+    struct HasMemoryUsage : std::false_type {};
+    template <typename T>
+    struct HasMemoryUsage<T, std::void_t<decltype(std::declval<const T&>().memory_usage())>> : std::true_type {};
+
+    // 状態が memory_usage() を持っていればそれを、無ければ sizeof を使う
+    template <typename T>
+    size_t Estimate(const T& value) {
+        if constexpr (HasMemoryUsage<T>::value) return value.memory_usage();
+        else return sizeof(T);
+    }
+
+    template <typename T>
+    size_t Estimate(const std::shared_ptr<T>& value) {
+        return sizeof(value) + (value ? Estimate(*value) : 0);
+    }
+
+    template <typename... V>
+    size_t VectorBytes(const V&... v) {
+        return (size_t{ 0 } + ... + (v.capacity() * sizeof(typename V::value_type)));
+    }
+}
+
+// 長く使われていない状態を EffectStateReclaimer に回収させるか。
+// 作り直しても残響などが途切れるだけで済む DSP のバッファに限って Allowed にする。
+// ノートや再生位置、スレッドを持つ状態は回収すると動作が変わるので Never のままにする
+enum class EffectStateReclaim {
+    Never,
+    Allowed,
+};
+
+class EffectStateRegistryBase {
+  public:
+    struct Candidate {
+        EffectStateRegistryBase* owner;
+        const void* node;
+        uint64_t hash;
+        uint64_t last_touched;
+        size_t bytes;
+    };
+
+    // 排他なしの参照を使う区間 (func_proc_audio_* など) を囲む。
+    // 外したノード/テーブルは、外した時点で開いていた ReadScope がすべて閉じるまで解放しない。
+    // 区間内で触った状態の使用量は、一番外側の ReadScope を閉じるときにそのスレッドで測る
+    class ReadScope {
+      public:
+        ReadScope();
+        ~ReadScope();
+        ReadScope(const ReadScope&) = delete;
+        ReadScope& operator=(const ReadScope&) = delete;
+
+      private:
+        const size_t m_slot;
+    };
+
+    EffectStateRegistryBase();
+    virtual ~EffectStateRegistryBase();
+    EffectStateRegistryBase(const EffectStateRegistryBase&) = delete;
+    EffectStateRegistryBase& operator=(const EffectStateRegistryBase&) = delete;
+
+    // 読み手の居なくなった退避ノードを解放し、回収してよいレジストリでは idle_timeout_ms 以上触られていない状態を退避する。
+    // 回収対象の残った状態の推定使用量を返し、LRU 退避の候補を candidates に積む。
+    virtual size_t Sweep(uint64_t now, uint64_t idle_timeout_ms, std::vector<Candidate>& candidates) = 0;
+    virtual bool Evict(const Candidate& candidate) = 0;
+
+    // 一つ前のエポックで開いた ReadScope がすべて閉じていればエポックを進める。EffectStateReclaimer::Run から呼ぶ
+    static void TryAdvanceEpoch();
+
+    static uint64_t NowMs() {
+        using namespace std::chrono;
+        return static_cast<uint64_t>(duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count());
+    }
+
+  protected:
+    // 外した直後のエポックを返す。エポックがこれより 2 進めば、その時点の読み手はすべて抜けている
+    static uint64_t RetireEpoch() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return s_epoch.load();
+    }
+    static uint64_t CurrentEpoch() { return s_epoch.load(); }
+
+    // 使用量は値を書き換えるスレッド自身が測り、Sweep は公開された値だけを読む。
+    // ReadScope の中なら区間を閉じるとき (バッファを確保し直した後)、外ならその場で measure(node) を呼ぶ
+    static void MeasureAfterRead(void (*measure)(void*), void* node);
+
+    // 同じ状態の使用量を測り直す間隔
+    static constexpr uint64_t MEASURE_INTERVAL_MS = 1000;
+    // メモリ上限による LRU 退避はこの時間以上止まっているものに限る
+    static constexpr uint64_t LRU_MIN_IDLE_MS = 5000;
+
+  private:
+    static std::atomic<uint64_t> s_epoch;
+    static std::atomic<uint32_t> s_active[2];
+};
+
+namespace EffectStateReclaimer {
+    // メインスレッドから定期的に呼ぶ。memory_limit が 0 なら上限なし。戻り値は退避後の推定使用量
+    size_t Run(uint64_t idle_timeout_ms, size_t memory_limit);
+}
+
+// effect_id ごとの状態を保持する。参照は排他なし、追加/削除のみシャード単位でロックする。
+// 返したアドレスは ReadScope の中でのみ使い、Erase/Clear されるか、EffectStateReclaim::Allowed のレジストリで長時間使われず
+// EffectStateReclaimer に回収されるまで変わらない。
+template <typename T, typename Key = int64_t, typename Hash = std::hash<Key>>
+class EffectStateRegistry : public EffectStateRegistryBase {
+  public:
+    explicit EffectStateRegistry(EffectStateReclaim reclaim = EffectStateReclaim::Never) : m_reclaim(reclaim) {
+        for (auto& shard : m_shards) shard.Publish(INITIAL_CAPACITY);
+    }
+    ~EffectStateRegistry() override = default;
+
+    T& Get(const Key& key) {
+        const uint64_t hash = HashKey(key);
+        const uint64_t now = NowMs();
+        Shard& shard = ShardFor(hash);
+        if (Node* node = shard.Find(key, hash)) return Touch(node, now);
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (Node* node = shard.Find(key, hash)) return Touch(node, now);
+        return Touch(shard.Insert(key, hash, now), now);
+    }
+
+    T* Find(const Key& key) {
+        const uint64_t hash = HashKey(key);
+        Node* node = ShardFor(hash).Find(key, hash);
+        return node ? &Touch(node, NowMs()) : nullptr;
+    }
+
+    bool Erase(const Key& key) {
+        const uint64_t hash = HashKey(key);
+        Shard& shard = ShardFor(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Node* node = shard.Find(key, hash);
+        return node && shard.Retire(node, hash);
+    }
+
+    // 外したノードは Erase と同じく読み手が抜けてから解放する
+    void Clear() {
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.Clear();
+        }
+    }
+
+    template <typename Func>
+    void ForEach(Func&& func) {
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (auto& node : shard.nodes) func(node->key, node->value);
+        }
+    }
+
+    size_t Size() {
+        size_t total = 0;
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.nodes.size();
+        }
+        return total;
+    }
+
+    size_t Sweep(uint64_t now, uint64_t idle_timeout_ms, std::vector<Candidate>& candidates) override {
+        size_t total = 0;
+        const uint64_t epoch = CurrentEpoch();
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.FreeRetired(epoch);
+            if (m_reclaim != EffectStateReclaim::Allowed) continue;
+            for (size_t i = shard.nodes.size(); i-- > 0;) {
+                Node* node = shard.nodes[i].get();
+                const uint64_t touched = node->last_touched.load(std::memory_order_relaxed);
+                const uint64_t idle = (now > touched) ? now - touched : 0;
+                if (idle_timeout_ms > 0 && idle >= idle_timeout_ms) {
+                    shard.Retire(node, node->hash);
+                    continue;
+                }
+                const size_t bytes = node->bytes.load(std::memory_order_relaxed);
+                if (idle >= LRU_MIN_IDLE_MS) candidates.push_back({ this, node, node->hash, touched, bytes });
+                total += bytes;
+            }
+        }
+        return total;
+    }
+
+    bool Evict(const Candidate& candidate) override {
+        if (m_reclaim != EffectStateReclaim::Allowed) return false;
+        Shard& shard = ShardFor(candidate.hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // Sweep で候補にした後に触られていれば使用中なので退避しない
+        return shard.Retire(static_cast<const Node*>(candidate.node), candidate.hash, candidate.last_touched);
+    }
+
+  private:
+    static constexpr size_t SHARD_COUNT = 16;
+    static constexpr size_t INITIAL_CAPACITY = 16;
+
+    struct Node {
+        Node(const Key& k, uint64_t h, uint64_t now) : key(k), hash(h), last_touched(now) {}
+        const Key key;
+        const uint64_t hash;
+        size_t owner_index = 0;
+        std::atomic<uint64_t> last_touched;
+        std::atomic<uint64_t> measured_at{ 0 };
+        std::atomic<size_t> bytes{ sizeof(Node) + sizeof(T) };
+        T value{};
+
+        static void Measure(void* p) {
+            Node* node = static_cast<Node*>(p);
+            node->bytes.store(sizeof(Node) + EffectStateMemory::Estimate(node->value), std::memory_order_relaxed);
+        }
+    };
+
+    T& Touch(Node* node, uint64_t now) {
+        if (node->last_touched.load(std::memory_order_relaxed) != now) node->last_touched.store(now, std::memory_order_relaxed);
+        if (m_reclaim == EffectStateReclaim::Allowed && now - node->measured_at.load(std::memory_order_relaxed) >= MEASURE_INTERVAL_MS) {
+            node->measured_at.store(now, std::memory_order_relaxed);
+            MeasureAfterRead(&Node::Measure, node);
+        }
+        return node->value;
+    }
+
+    struct Table {
+        explicit Table(size_t capacity) : mask(capacity - 1), slots(new std::atomic<Node*>[capacity]) {
+            for (size_t i = 0; i < capacity; ++i) slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+        const size_t mask;
+        std::unique_ptr<std::atomic<Node*>[]> slots;
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        std::unique_ptr<Node> node;
+        std::unique_ptr<Table> table;
+    };
+
+    static Node* Tombstone() {
+        static char tombstone;
+        return reinterpret_cast<Node*>(&tombstone);
+    }
+
+    struct Shard {
+        std::mutex mutex;
+        std::atomic<Table*> table{ nullptr };
+        std::unique_ptr<Table> owned_table;
+        std::vector<std::unique_ptr<Node>> nodes;
+        std::vector<Retired> retired;
+        size_t used_slots = 0;
+
+        Node* Find(const Key& key, uint64_t hash) const {
+            const Table* t = table.load(std::memory_order_acquire);
+            for (size_t i = hash & t->mask;; i = (i + 1) & t->mask) {
+                Node* node = t->slots[i].load(std::memory_order_acquire);
+                if (!node) return nullptr;
+                if (node != Tombstone() && node->hash == hash && node->key == key) return node;
+            }
+        }
+
+        void Publish(size_t capacity) {
+            auto next = std::make_unique<Table>(capacity);
+            Table* t = next.get();
+            for (auto& node : nodes) {
+                size_t i = node->hash & t->mask;
+                while (t->slots[i].load(std::memory_order_relaxed)) i = (i + 1) & t->mask;
+                t->slots[i].store(node.get(), std::memory_order_relaxed);
+            }
+            used_slots = nodes.size();
+            table.store(t, std::memory_order_release);
+            // 読み手が古いテーブルを参照している可能性があるため、旧テーブルは読み手が抜けてから破棄する
+            if (owned_table) retired.push_back({ RetireEpoch(), nullptr, std::move(owned_table) });
+            owned_table = std::move(next);
+        }
+
+        Node* Insert(const Key& key, uint64_t hash, uint64_t now) {
+            Table* t = table.load(std::memory_order_relaxed);
+            if ((used_slots + 1) * 4 > (t->mask + 1) * 3) {
+                size_t capacity = t->mask + 1;
+                while ((nodes.size() + 1) * 2 > capacity) capacity *= 2;
+                Publish(capacity);
+                t = table.load(std::memory_order_relaxed);
+            }
+
+            auto owned = std::make_unique<Node>(key, hash, now);
+            Node* node = owned.get();
+            node->owner_index = nodes.size();
+            nodes.push_back(std::move(owned));
+
+            size_t i = hash & t->mask;
+            for (;; i = (i + 1) & t->mask) {
+                Node* slot = t->slots[i].load(std::memory_order_relaxed);
+                if (!slot) {
+                    ++used_slots;
+                    break;
+                }
+                if (slot == Tombstone()) break;
+            }
+            t->slots[i].store(node, std::memory_order_release);
+            return node;
+        }
+
+        // node はテーブル上で見つかるまで参照しない (既に解放済みの可能性がある)。
+        // touched_before を渡すと、それより後に触られたノードは退避しない
+        bool Retire(const Node* node, uint64_t hash, uint64_t touched_before = UINT64_MAX) {
+            Table* t = table.load(std::memory_order_relaxed);
+            for (size_t i = hash & t->mask;; i = (i + 1) & t->mask) {
+                Node* slot = t->slots[i].load(std::memory_order_relaxed);
+                if (!slot) return false;
+                if (slot != node) continue;
+                if (node->last_touched.load(std::memory_order_relaxed) > touched_before) return false;
+
+                t->slots[i].store(Tombstone(), std::memory_order_release);
+                const size_t index = node->owner_index;
+                retired.push_back({ RetireEpoch(), std::move(nodes[index]), nullptr });
+                if (index + 1 != nodes.size()) {
+                    nodes[index] = std::move(nodes.back());
+                    nodes[index]->owner_index = index;
+                }
+                nodes.pop_back();
+                return true;
+            }
+        }
+
+        void FreeRetired(uint64_t epoch) {
+            size_t keep = 0;
+            for (size_t i = 0; i < retired.size(); ++i) {
+                if (epoch < retired[i].epoch + 2) {
+                    if (keep != i) retired[keep] = std::move(retired[i]);
+                    ++keep;
+                }
+            }
+            retired.erase(retired.begin() + keep, retired.end());
+        }
+
+        void Clear() {
+            Table* t = table.load(std::memory_order_relaxed);
+            for (size_t i = 0; i <= t->mask; ++i) t->slots[i].store(nullptr, std::memory_order_release);
+            const uint64_t epoch = RetireEpoch();
+            for (auto& node : nodes) retired.push_back({ epoch, std::move(node), nullptr });
+            nodes.clear();
+            used_slots = 0;
+        }
+    };
+
+    static uint64_t HashKey(const Key& key) {
+        uint64_t h = static_cast<uint64_t>(Hash{}(key));
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    Shard& ShardFor(uint64_t hash) {
+        return m_shards[(hash >> 56) & (SHARD_COUNT - 1)];
+    }
+
+    const EffectStateReclaim m_reclaim;
+    std::array<Shard, SHARD_COUNT> m_shards;
+};
\ No newline at end of file
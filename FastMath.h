@@ -0,0 +1,178 @@
+﻿#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// log2 / exp2 / dB 変換 / tanh / atan2 / sin・cos の多項式近似。SimdKernels.h のベクトル版 (Avx2Utils::Log2AVX2 など) と同じ係数を使う。
+// float で評価したときの誤差 (各 SIMD レベルで倍精度の標準関数と比較した実測値):
+//   FastLog2   : 絶対誤差 2e-6 以下 (結果の float 丸めを含む)。入力は FLT_MIN 以上に丸める
+//   FastExp2   : 相対誤差 2e-7 以下。入力は [-126, 126] に丸める
+//   LinearToDb : -140dB ～ +24dB で絶対誤差 2e-5 dB 以下。0 は約 -759dB になる
+//   DbToLinear : -140dB ～ +24dB で相対誤差 1e-6 以下
+//   FastTanh   : 絶対誤差 2e-7 以下。|x| >= 9 は ±1
+//   FastAtan2  : 絶対誤差 6e-7 rad 以下。(0, 0) は 0
+//   FastSinCos : |x| <= 1000 で絶対誤差 3e-7 以下 (範囲を広げると 2π への還元誤差が増える)
+namespace FastMath {
+constexpr float LOG2_C0 = 1.442700982e+00f;
+constexpr float LOG2_C1 = -7.213683724e-01f;
+constexpr float LOG2_C2 = 4.804023802e-01f;
+constexpr float LOG2_C3 = -3.592039347e-01f;
+constexpr float LOG2_C4 = 2.982603908e-01f;
+constexpr float LOG2_C5 = -2.709267139e-01f;
+constexpr float LOG2_C6 = 1.651753485e-01f;
+
+constexpr float EXP2_C1 = 6.931525469e-01f;
+constexpr float EXP2_C2 = 2.401524484e-01f;
+constexpr float EXP2_C3 = 5.583659932e-02f;
+constexpr float EXP2_C4 = 8.972899057e-03f;
+constexpr float EXP2_C5 = 1.885403763e-03f;
+
+constexpr float ATAN_C0 = 9.999961257e-01f;
+constexpr float ATAN_C1 = -3.331736922e-01f;
+constexpr float ATAN_C2 = 1.980781704e-01f;
+constexpr float ATAN_C3 = -1.323334128e-01f;
+constexpr float ATAN_C4 = 7.962361723e-02f;
+constexpr float ATAN_C5 = -3.360414878e-02f;
+constexpr float ATAN_C6 = 6.811765488e-03f;
+
+// [-π/2, π/2] での sin(x) / x と cos(x) (いずれも x^2 の多項式)
+constexpr float SIN_C1 = -1.666664779e-01f;
+constexpr float SIN_C2 = 8.332899772e-03f;
+constexpr float SIN_C3 = -1.980089728e-04f;
+constexpr float SIN_C4 = 2.590488521e-06f;
+constexpr float COS_C1 = -5.000000000e-01f;
+constexpr float COS_C2 = 4.166663811e-02f;
+constexpr float COS_C3 = -1.388836186e-03f;
+constexpr float COS_C4 = 2.476016198e-05f;
+constexpr float COS_C5 = -2.605149518e-07f;
+
+constexpr float PI = 3.14159265f;
+constexpr float HALF_PI = 1.57079633f;
+constexpr float INV_TWO_PI = 0.159154943f;
+// 2π を上位と下位に分け、還元時の桁落ちを抑える
+constexpr float TWO_PI_HI = 6.28125f;
+constexpr float TWO_PI_LO = 1.93530717e-3f;
+
+constexpr float SQRT2 = 1.41421356f;
+constexpr float MIN_NORMAL = 1.17549435e-38f;
+constexpr float EXP2_LIMIT = 126.0f;
+constexpr float TANH_LIMIT = 9.0f;
+// 20 * log10(2) と、その逆数
+constexpr float LOG2_TO_DB = 6.02059991f;
+constexpr float DB_TO_LOG2 = 0.166096405f;
+// 2 * log2(e)
+constexpr float TANH_TO_LOG2 = 2.88539008f;
+
+// log2(m) を m の仮数部 f = m - 1 (m は [sqrt(0.5), sqrt(2)) に正規化済み) から求める
+inline float Log2Poly(float f) {
+    float p = LOG2_C6;
+    p = p * f + LOG2_C5;
+    p = p * f + LOG2_C4;
+    p = p * f + LOG2_C3;
+    p = p * f + LOG2_C2;
+    p = p * f + LOG2_C1;
+    p = p * f + LOG2_C0;
+    return p * f;
+}
+
+// 2^f (f は [0, 1))
+inline float Exp2Poly(float f) {
+    float p = EXP2_C5;
+    p = p * f + EXP2_C4;
+    p = p * f + EXP2_C3;
+    p = p * f + EXP2_C2;
+    p = p * f + EXP2_C1;
+    return p * f + 1.0f;
+}
+
+// atan(a) (a は [0, 1])
+inline float AtanPoly(float a) {
+    const float s = a * a;
+    float p = ATAN_C6;
+    p = p * s + ATAN_C5;
+    p = p * s + ATAN_C4;
+    p = p * s + ATAN_C3;
+    p = p * s + ATAN_C2;
+    p = p * s + ATAN_C1;
+    p = p * s + ATAN_C0;
+    return p * a;
+}
+
+inline float FastLog2(float x) {
+    if (!(x >= MIN_NORMAL)) x = MIN_NORMAL;
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    float e = static_cast<float>(static_cast<int32_t>(bits >> 23) - 127);
+    bits = (bits & 0x007fffffu) | 0x3f800000u;
+    float m;
+    std::memcpy(&m, &bits, sizeof(m));
+    if (m > SQRT2) {
+        m *= 0.5f;
+        e += 1.0f;
+    }
+    return e + Log2Poly(m - 1.0f);
+}
+
+inline float FastExp2(float x) {
+    if (!(x > -EXP2_LIMIT)) x = -EXP2_LIMIT;
+    if (x > EXP2_LIMIT) x = EXP2_LIMIT;
+    int32_t n = static_cast<int32_t>(x);
+    if (static_cast<float>(n) > x) n -= 1;
+    const uint32_t bits = static_cast<uint32_t>(n + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return Exp2Poly(x - static_cast<float>(n)) * scale;
+}
+
+inline float LinearToDb(float x) {
+    return FastLog2(x) * LOG2_TO_DB;
+}
+
+inline float DbToLinear(float db) {
+    return FastExp2(db * DB_TO_LOG2);
+}
+
+inline float FastTanh(float x) {
+    if (x > TANH_LIMIT) x = TANH_LIMIT;
+    if (x < -TANH_LIMIT) x = -TANH_LIMIT;
+    const float t = FastExp2(x * TANH_TO_LOG2);
+    return (t - 1.0f) / (t + 1.0f);
+}
+
+inline float FastAtan2(float y, float x) {
+    const float ax = x < 0.0f ? -x : x;
+    const float ay = y < 0.0f ? -y : y;
+    const float mx = ax > ay ? ax : ay;
+    const float mn = ax > ay ? ay : ax;
+    float r = AtanPoly(mx > 0.0f ? mn / mx : 0.0f);
+    if (ay > ax) r = HALF_PI - r;
+    if (x < 0.0f) r = PI - r;
+    return std::signbit(y) ? -r : r;
+}
+
+inline void FastSinCos(float x, float& sin_out, float& cos_out) {
+    const float k = std::floor(x * INV_TWO_PI + 0.5f);
+    float r = (x - k * TWO_PI_HI) - k * TWO_PI_LO;
+    // [-π, π] を [-π/2, π/2] に畳む。sin はそのまま、cos は符号が反転する
+    float cos_sign = 1.0f;
+    if (r > HALF_PI) {
+        r = PI - r;
+        cos_sign = -1.0f;
+    } else if (r < -HALF_PI) {
+        r = -PI - r;
+        cos_sign = -1.0f;
+    }
+    const float s = r * r;
+    float ps = SIN_C4;
+    ps = ps * s + SIN_C3;
+    ps = ps * s + SIN_C2;
+    ps = ps * s + SIN_C1;
+    sin_out = (ps * s + 1.0f) * r;
+    float pc = COS_C5;
+    pc = pc * s + COS_C4;
+    pc = pc * s + COS_C3;
+    pc = pc * s + COS_C2;
+    pc = pc * s + COS_C1;
+    cos_out = (pc * s + 1.0f) * cos_sign;
+}
+} // namespace FastMath
@@ -1,12 +1,16 @@
-﻿#include "AudioPluginFactory.h"
-#include "Avx2Utils.h"
+﻿#include "Avx2Utils.h"
+#include "DelayLine.h"
 #include "Eap2Common.h"
 #include "Eap2Config.h"
+#include "EffectStateRegistry.h"
 #include "IAudioPluginHost.h"
 #include "MidiParser.h"
 #include "NotesManager.h"
+#include "PluginLoader.h"
 #include "PluginManager.h"
-#include "PluginType.h"
+#include "RenderAhead.h"
+#include "ScratchArena.h"
+#include "SeekCheckpoint.h"
 #include "StringUtils.h"
 #include "ToolParamListWindow.h"
 
@@ -27,24 +31,35 @@ struct ParamCache {
     double prev_val[4] = { -1.0, -1.0, -1.0, -1.0 };
     bool prev_show_list = false;
 };
-static std::map<std::string, ParamCache> g_param_cache;
-static std::mutex g_param_cache_mutex;
+static EffectStateRegistry<ParamCache, std::string> g_param_cache;
 
-struct DelayBuffer {
-    std::vector<float> bufferL;
-    std::vector<float> bufferR;
-    int32_t writePos = 0;
+static EffectStateRegistry<LatencyCompensator, std::string> g_delay_buffers{ EffectStateReclaim::Allowed };
+
+static EffectStateRegistry<RenderAhead, std::string> g_render_ahead;
+
+static EffectStateRegistry<SeekCheckpoints, std::string> g_checkpoints{ EffectStateReclaim::Allowed };
+
+// 無音の入力が続いた長さと、最後に処理したときの出力が無音だったか。
+// 無音がテール + レイテンシより長く続き、出力も消えていればプラグインの処理を省く
+struct SilenceState {
+    int64_t silent_samples = 0;
+    bool output_silent = false;
 };
-static std::map<std::string, DelayBuffer> g_delay_buffers;
-static std::mutex g_delay_buffers_mutex;
+static EffectStateRegistry<SilenceState, std::string> g_silence_states;
+constexpr float SILENCE_THRESHOLD = 1.0e-8f;
+
+static bool IsSilent(const float* l, const float* r, int32_t channels, int32_t count) {
+    if (Avx2Utils::GetPeakAbsAVX2(l, count) > SILENCE_THRESHOLD) return false;
+    return channels < 2 || Avx2Utils::GetPeakAbsAVX2(r, count) <= SILENCE_THRESHOLD;
+}
 
 struct MidiState {
     std::filesystem::path prev_path;
     MidiParser parser;
     std::map<uint8_t, int64_t> last_active_note_owners;
+    std::mutex mutex;
 };
-static std::map<std::string, MidiState> g_midi_state;
-static std::mutex g_midi_state_mutex;
+static EffectStateRegistry<MidiState, std::string> g_midi_state;
 
 TCHAR filter_ext[] =
     L"Audio Plugins (*.vst3;*.clap)\0*.vst3;*.clap\0"
@@ -62,6 +77,7 @@ FILTER_ITEM_TRACK track_bpm(L"BPM", 120.0, 1.0, 999.0, 0.01, nullptr, 1.0);
 FILTER_ITEM_TRACK track_ts_num(L"分子", 4.0, 1.0, 32.0, 1.0, nullptr, 1.0);
 FILTER_ITEM_TRACK track_ts_denom(L"分母", 4.0, 1.0, 32.0, 1.0, nullptr, 1.0);
 FILTER_ITEM_CHECK toggle_gui_check(L"プラグインGUIを表示", false);
+FILTER_ITEM_CHECK check_render_ahead(L"先読み処理", false);
 FILTER_ITEM_SEPARATOR sep_all_lr(L"Apply All section (Deprecated)");
 FILTER_ITEM_CHECK check_apply_l(L"Apply to L", true);
 FILTER_ITEM_CHECK check_apply_r(L"Apply to R", true);
@@ -174,6 +190,7 @@ void* filter_items_host_media[] = {
     &track_ts_num,
     &track_ts_denom,
     &toggle_gui_check,
+    &check_render_ahead,
     &param_group,
     &check_show_param_list,
     &check_param_learn,
@@ -208,27 +225,19 @@ struct NotesState {
 };
 
 static std::set<std::string>* g_active_ids_collector = nullptr;
-static std::mutex g_notes_state_mutex;
-static std::map<int64_t, NotesState> g_notes_states;
+static EffectStateRegistry<NotesState> g_notes_states;
 
 void CleanupMainFilterResources() {
+    PluginLoader::CancelAll();
+    g_render_ahead.Clear();
     PluginManager::GetInstance().CleanupResources();
-    {
-        std::lock_guard<std::mutex> lock(g_notes_state_mutex);
-        g_notes_states.clear();
-    }
-    {
-        std::lock_guard<std::mutex> lock(g_midi_state_mutex);
-        g_midi_state.clear();
-    }
-    {
-        std::lock_guard<std::mutex> lock(g_param_cache_mutex);
-        g_param_cache.clear();
-    }
-    {
-        std::lock_guard<std::mutex> lock(g_delay_buffers_mutex);
-        g_delay_buffers.clear();
-    }
+    g_notes_states.Clear();
+    g_midi_state.Clear();
+    g_param_cache.Clear();
+    g_delay_buffers.Clear();
+    g_checkpoints.Clear();
+    g_silence_states.Clear();
+    CleanupHostRackResources();
     ToolParamListWindow::GetInstance().Close();
     ToolCleanupResources();
 }
@@ -253,6 +262,7 @@ void collect_active_ids_proc(EDIT_SECTION* edit) {
                     }
                 }
             }
+            CollectHostRackInstanceIds(edit, obj, *g_active_ids_collector);
             int32_t end_frame = edit->get_object_layer_frame(obj).end;
             obj = edit->find_object(layer, end_frame + 1);
         }
@@ -376,13 +386,103 @@ static void func_proc_check_and_rename(void* param, EDIT_SECTION* edit) {
     if (doRename) edit->set_object_name(obj, p->newName.c_str());
 }
 
+// MIDI ファイルのうち [block_pos, block_pos + block_size) に入るイベントを out に積む
+static void CollectMidiFileEvents(const MidiParser& parser, int32_t sync_bpm, double bpm, double sample_rate, int64_t block_pos, int32_t block_size, std::vector<IAudioPluginHost::MidiEvent>& out) {
+    if (parser.GetTPQN() == 0) return;
+
+    int64_t start_tick = 0;
+    int64_t end_tick = 0;
+    if (sync_bpm == 1) {
+        start_tick = parser.GetTickAtTime(static_cast<double>(block_pos) / sample_rate);
+        end_tick = parser.GetTickAtTime(static_cast<double>(block_pos + block_size) / sample_rate);
+    } else {
+        double samplesPerTick = (60.0 * sample_rate) / (bpm * parser.GetTPQN());
+        if (samplesPerTick < 0.001) samplesPerTick = 0.001;
+        start_tick = static_cast<int64_t>(block_pos / samplesPerTick);
+        end_tick = static_cast<int64_t>((block_pos + block_size) / samplesPerTick);
+    }
+
+    const auto& all_events = parser.GetEvents();
+    auto it = std::lower_bound(all_events.begin(), all_events.end(), start_tick,
+                               [](const RawMidiEvent& e, int64_t tick) { return e.absoluteTick < tick; });
+
+    for (; it != all_events.end(); ++it) {
+        if (it->absoluteTick >= end_tick) break;
+
+        int32_t delta_samples = 0;
+
+        if (sync_bpm == 1) {
+            int64_t tick_diff = it->absoluteTick - start_tick;
+            int64_t total_tick_diff = end_tick - start_tick;
+            if (total_tick_diff > 0) delta_samples = static_cast<int32_t>(static_cast<double>(tick_diff) / total_tick_diff * block_size);
+        } else {
+            double samplesPerTick = (60.0 * sample_rate) / (bpm * parser.GetTPQN());
+            double raw_delta = (it->absoluteTick * samplesPerTick) - block_pos;
+            if (raw_delta > block_size) raw_delta = block_size;
+            delta_samples = static_cast<int32_t>(raw_delta);
+        }
+
+        if (delta_samples < 0) delta_samples = 0;
+        if (delta_samples >= block_size) delta_samples = block_size - 1;
+
+        out.push_back({ delta_samples, it->status, it->data1, it->data2 });
+    }
+}
+
+// pos より手前のチェックポイントに戻し、記録した入力で pos まで空回しする。戻せるチェックポイントが無ければ false
+static bool RestoreFromCheckpoint(const SeekCheckpoints& checkpoints, IAudioPluginHost& host, const std::string& instance_id, int64_t effect_id, const MidiParser& parser,
+                                  int32_t sync_bpm, double bpm, int32_t ts_num, int32_t ts_denom, double sample_rate, int32_t channels, bool is_object, int64_t pos, int64_t min_preroll) {
+    const SeekCheckpoints::Checkpoint* checkpoint = checkpoints.FindRestorePoint(pos, min_preroll);
+    if (!checkpoint) return false;
+
+    const int64_t start = checkpoint->start;
+    host.Reset(start, bpm, ts_num, ts_denom);
+    LatencyCompensator* compensator = g_delay_buffers.Find(instance_id);
+    if (checkpoint->compensator) {
+        compensator = &g_delay_buffers.Get(instance_id);
+        *compensator = *checkpoint->compensator;
+    } else if (compensator) {
+        compensator->Reset();
+    }
+
+    Profiler::Scope profile_preroll(L"SeekPreroll", effect_id, static_cast<int32_t>(pos - start), static_cast<int32_t>(sample_rate));
+    ScratchScope scratch;
+    auto inL = scratch.Alloc(MAX_BLOCK_SIZE);
+    auto inR = scratch.Alloc(MAX_BLOCK_SIZE);
+    auto outL = scratch.Alloc(MAX_BLOCK_SIZE);
+    auto outR = scratch.Alloc(MAX_BLOCK_SIZE);
+    if (is_object) {
+        Avx2Utils::FillBufferAVX2(inL.data(), MAX_BLOCK_SIZE, 0.0f);
+        Avx2Utils::FillBufferAVX2(inR.data(), MAX_BLOCK_SIZE, 0.0f);
+    }
+
+    std::vector<IAudioPluginHost::MidiEvent> midi_events;
+    const int32_t latency = host.GetLatencySamples();
+    for (int64_t block_start = start; block_start < pos;) {
+        const int32_t block_size = static_cast<int32_t>((std::min)(static_cast<int64_t>(MAX_BLOCK_SIZE), pos - block_start));
+        if (!is_object) checkpoints.CopyInput(block_start, block_size, inL.data(), inR.data());
+
+        const int64_t block_pos = block_start + latency;
+        midi_events.clear();
+        CollectMidiFileEvents(parser, sync_bpm, bpm, sample_rate, block_pos, block_size, midi_events);
+        host.ProcessAudio(inL.data(), inR.data(), outL.data(), outR.data(), block_size, channels, block_pos, bpm, ts_num, ts_denom, midi_events);
+
+        // 遅延補正の履歴も pos まで進めておく。出力は捨てる
+        if (compensator) {
+            const float* dry_in[2] = { inL.data(), inR.data() };
+            float* dry_out[2] = { outL.data(), outR.data() };
+            compensator->Process(dry_in, dry_out, channels, block_size, latency);
+        }
+        block_start += block_size;
+    }
+    return true;
+}
+
 bool func_proc_audio_host_common(FILTER_PROC_AUDIO* audio, bool is_object) {
+    EAP2_PROFILE_AUDIO(is_object ? L"Host (Media)" : L"Host", audio);
+    DenormalGuard denormal_guard;
     std::string instance_id;
-    NotesState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_notes_state_mutex);
-        state = &g_notes_states[audio->object->effect_id];
-    }
+    NotesState* state = &g_notes_states.Get(audio->object->effect_id);
 
     if (instance_data_param.value->uuid[0] != '\0') {
         instance_id = instance_data_param.value->uuid;
@@ -484,31 +584,14 @@ bool func_proc_audio_host_common(FILTER_PROC_AUDIO* audio, bool is_object) {
             DbgPrint(L"Plugin path changed. Mappings cleared for " + StringUtils::Utf8ToWide(instance_id), LOG_VERBOSE);
         }
 
-        std::lock_guard<std::mutex> task_lock(g_task_queue_mutex);
-        g_main_thread_tasks.push_back([effect_id, instance_id, plugin_path, sampleRate, path_changed]() {
-            std::shared_ptr<IAudioPluginHost> new_host = nullptr;
-
-            if (!plugin_path.empty()) {
-                auto plugin_type = GetPluginTypeFromPath(plugin_path.wstring());
-                if (plugin_type != PluginType::Unknown) {
-                    new_host = AudioPluginFactory::Create(plugin_type, g_hinstance);
-                    if (new_host) {
-                        if (sampleRate > 0) {
-                            if (new_host->LoadPlugin(plugin_path, sampleRate, MAX_BLOCK_SIZE)) {
-                                std::string state_to_restore;
-                                if (!path_changed) state_to_restore = PluginManager::GetInstance().GetSavedState(instance_id);
-                                if (!state_to_restore.empty()) new_host->SetState(state_to_restore);
-                            } else {
-                                new_host = nullptr;
-                            }
-                        }
-                    }
-                }
-            }
-
-            PluginManager::GetInstance().SetHost(effect_id, new_host);
-            PluginManager::GetInstance().SetPendingReinitialization(effect_id, false);
-        });
+        PluginLoader::Request request;
+        request.effect_id = effect_id;
+        request.instance_id = instance_id;
+        request.plugin_path = plugin_path;
+        request.sample_rate = sampleRate;
+        request.block_size = MAX_BLOCK_SIZE;
+        request.restore_state = !path_changed;
+        PluginLoader::Submit(std::move(request));
 
         return true;
     }
@@ -534,12 +617,7 @@ bool func_proc_audio_host_common(FILTER_PROC_AUDIO* audio, bool is_object) {
         bool is_learning = check_param_learn.value;
         int32_t lastTouched = host->GetLastTouchedParamID();
 
-        ParamCache* pCache = nullptr;
-        {
-            std::lock_guard<std::mutex> lock(g_param_cache_mutex);
-            pCache = &g_param_cache[instance_id];
-        }
-        ParamCache& cache = *pCache;
+        ParamCache& cache = g_param_cache.Get(instance_id);
 
         for (int32_t i = 0; i < 4; ++i) {
             int32_t mapIndex = static_cast<int32_t>(map_vals[i]);
@@ -577,18 +655,20 @@ bool func_proc_audio_host_common(FILTER_PROC_AUDIO* audio, bool is_object) {
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
 
-    thread_local std::vector<float> inL, inR, outL, outR;
-    if (inL.size() < total_samples) {
-        inL.resize(total_samples);
-        outL.resize(total_samples);
-        inR.resize(total_samples);
-        outR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto inL = scratch.Alloc(total_samples);
+    auto inR = scratch.Alloc(total_samples);
+    auto outL = scratch.Alloc(total_samples);
+    auto outR = scratch.Alloc(total_samples);
 
     if (!is_object) {
         if (channels >= 1) audio->get_sample_data(inL.data(), 0);
         if (channels >= 2) audio->get_sample_data(inR.data(), 1);
         else if (channels == 1) Avx2Utils::CopyBufferAVX2(inR.data(), inL.data(), total_samples);
+    } else {
+        // 作業領域には直前の処理の音が残っているので、メディアオブジェクトでは無音を入力にする
+        Avx2Utils::FillBufferAVX2(inL.data(), total_samples, 0.0f);
+        Avx2Utils::FillBufferAVX2(inR.data(), total_samples, 0.0f);
     }
 
     std::shared_ptr<IAudioPluginHost> host_for_audio = host;
@@ -614,12 +694,9 @@ bool func_proc_audio_host_common(FILTER_PROC_AUDIO* audio, bool is_object) {
     }
 
     bool show_list_current = check_show_param_list.value;
-    bool show_list_prev = false;
-    {
-        std::lock_guard<std::mutex> lock(g_param_cache_mutex);
-        show_list_prev = g_param_cache[instance_id].prev_show_list;
-        g_param_cache[instance_id].prev_show_list = show_list_current;
-    }
+    ParamCache& list_cache = g_param_cache.Get(instance_id);
+    bool show_list_prev = list_cache.prev_show_list;
+    list_cache.prev_show_list = show_list_current;
 
     if (show_list_current && !show_list_prev) {
         ToolParamListWindow::GetInstance().SetOwner(instance_id);
@@ -664,8 +741,8 @@ bool func_proc_audio_host_common(FILTER_PROC_AUDIO* audio, bool is_object) {
     if (host_for_audio) {
         should_reset = PluginManager::GetInstance().ShouldReset(effect_id, current_pos, audio->object->sample_num);
         int32_t recv_id_val = static_cast<int32_t>(track_recv_id.value);
-        std::lock_guard<std::mutex> midi_lock(g_midi_state_mutex);
-        MidiState& ms = g_midi_state[instance_id];
+        MidiState& ms = g_midi_state.Get(instance_id);
+        std::lock_guard<std::mutex> midi_lock(ms.mutex);
         int32_t current_recv_id = static_cast<int32_t>(track_recv_id.value);
         if (is_object) {
             std::filesystem::path old_midi_path = last_midi_data.value->last_midi_path;
@@ -742,30 +819,74 @@ bool func_proc_audio_host_common(FILTER_PROC_AUDIO* audio, bool is_object) {
         }
         if (bpm < 0.1) bpm = 0.1;
 
+        // 処理モードと主バスの切り替えはメインスレッドで行う。先読みのワーカーがプラグインを処理している間に
+        // 切り替わらないよう、先読みを止めてから積み、反映されるまでは先読みせずに今の設定のまま処理する
+        RenderAhead* ahead = g_render_ahead.Find(instance_id);
+        PluginManager::HostConfig host_config;
+        host_config.offline = IsSavingOutput();
+        host_config.bus_channels = channels >= 2 ? 2 : 1;
+        const bool host_config_applied = host_config.AppliedTo(*host_for_audio);
+        if (!host_config_applied) {
+            if (ahead && ahead->Stop()) should_reset = true;
+            PluginManager::GetInstance().RequestHostConfig(effect_id, host_for_audio, host_config);
+        }
+
+        // 先読みは入力が無音と MIDI ファイルだけで、GUI や学習から直接操作されていないときに限る
+        bool ahead_allowed = host_config_applied && is_object && check_render_ahead.value && recv_id_val <= 0 && sync_bpm != 2 &&
+                             !toggle_gui_check.value && !host_for_audio->IsGuiVisible() && !check_param_learn.value && !show_list_current;
+        uint64_t ahead_signature = 0;
+        bool served_ahead = false;
+        if (ahead_allowed) {
+            ahead = &g_render_ahead.Get(instance_id);
+            RenderSignature signature;
+            signature.Add(host_for_audio.get()).Add(audio->scene->sample_rate).Add(channels).Add(sync_bpm);
+            signature.Add(std::filesystem::hash_value(midi_path)).Add(track_ts_num.value).Add(track_ts_denom.value);
+            if (sync_bpm == 0) signature.Add(track_bpm.value);
+            const double param_values[4] = { track_param1.value, track_param2.value, track_param3.value, track_param4.value };
+            for (int32_t i = 0; i < 4; ++i) signature.Add(PluginManager::GetInstance().GetMappedParamID(instance_id, i)).Add(param_values[i]);
+            ahead_signature = signature.value();
+            served_ahead = !should_reset && ahead->Take(current_pos, total_samples, ahead_signature, outL.data(), outR.data());
+        }
+        // 使わなかった先読みは捨てる。プラグインは現在位置より先まで処理しているので位置を戻す
+        if (!served_ahead && ahead && ahead->Stop()) should_reset = true;
+
+        // チェックポイントは入力を記録して再現できるときに限る。前提が変わったら記録を捨てる
+        SeekCheckpoints* checkpoints = nullptr;
+        int64_t checkpoint_interval = static_cast<int64_t>(std::clamp(settings.vst.seek_checkpoint_ms, 0, 10000)) * audio->scene->sample_rate / 1000;
+        if (checkpoint_interval > 0 && recv_id_val <= 0 && sync_bpm != 2) {
+            checkpoints = &g_checkpoints.Get(instance_id);
+            RenderSignature signature;
+            signature.Add(host_for_audio.get()).Add(host_for_audio->GetStateRevision()).Add(host_for_audio->GetLatencySamples());
+            signature.Add(audio->scene->sample_rate).Add(channels).Add(sync_bpm).Add(std::filesystem::hash_value(midi_path));
+            signature.Add(track_ts_num.value).Add(track_ts_denom.value);
+            if (sync_bpm == 0) signature.Add(track_bpm.value);
+            checkpoints->Validate(signature.value());
+        } else if (SeekCheckpoints* stale = g_checkpoints.Find(instance_id)) {
+            stale->Clear();
+        }
+
         if (should_reset) {
-            host_for_audio->Reset(current_pos, bpm, ts_num, ts_denom);
+            bool restored = checkpoints && RestoreFromCheckpoint(*checkpoints, *host_for_audio, instance_id, effect_id, ms.parser, sync_bpm, bpm, ts_num, ts_denom,
+                                                                 audio->scene->sample_rate, channels, is_object, current_pos, checkpoint_interval);
+            if (!restored) host_for_audio->Reset(current_pos, bpm, ts_num, ts_denom);
             ms.last_active_note_owners.clear();
 
-            {
-                std::lock_guard<std::mutex> lock(g_notes_state_mutex);
-                state = &g_notes_states[audio->object->effect_id];
-
-                if (recv_id_val > 0) {
-                    int32_t id_idx = std::clamp(recv_id_val - 1, 0, NotesManager::MAX_ID - 1);
-                    std::lock_guard<std::mutex> note_lock(NotesManager::notes_mutexes[id_idx]);
-                    const auto& note_data = NotesManager::notes[id_idx];
+            if (recv_id_val > 0) {
+                int32_t id_idx = std::clamp(recv_id_val - 1, 0, NotesManager::MAX_ID - 1);
+                std::lock_guard<std::mutex> note_lock(NotesManager::notes_mutexes[id_idx]);
+                const auto& note_data = NotesManager::notes[id_idx];
 
-                    for (int32_t i = 0; i < NotesManager::MAX_PER_ID; i++) {
-                        state->last_update_count[i] = note_data.update_count[i];
-                        state->missed_count[i] = 0;
-                        state->waiting_for_update[i] = true;
-                    }
-                } else {
-                    *state = NotesState();
+                for (int32_t i = 0; i < NotesManager::MAX_PER_ID; i++) {
+                    state->last_update_count[i] = note_data.update_count[i];
+                    state->missed_count[i] = 0;
+                    state->waiting_for_update[i] = true;
                 }
+            } else {
+                *state = NotesState();
             }
         }
         PluginManager::GetInstance().UpdateLastAudioState(effect_id, current_pos, audio->object->sample_num);
+        if (checkpoints) checkpoints->Record(current_pos, total_samples, inL.data(), inR.data(), !is_object, checkpoint_interval, g_delay_buffers.Find(instance_id));
 
         std::vector<IAudioPluginHost::MidiEvent> realtime_midi_events;
 
@@ -822,10 +943,28 @@ bool func_proc_audio_host_common(FILTER_PROC_AUDIO* audio, bool is_object) {
             ms.last_active_note_owners = current_note_owners;
         }
 
+        // 無音での省略はエフェクトとして使い、MIDI を受けないときに限る
+        SilenceState* silence_state = nullptr;
+        bool input_silent = false;
+        bool skip_plugin = false;
+        if (!is_object && recv_id_val <= 0 && midi_path.empty() && !host_for_audio->IsGuiVisible()) {
+            silence_state = &g_silence_states.Get(instance_id);
+            if (should_reset) *silence_state = SilenceState();
+            input_silent = IsSilent(inL.data(), inR.data(), channels, total_samples);
+            const int32_t tail = host_for_audio->GetTailSamples();
+            if (input_silent && silence_state->output_silent && tail != IAudioPluginHost::INFINITE_TAIL) {
+                skip_plugin = silence_state->silent_samples >= static_cast<int64_t>(tail) + host_for_audio->GetLatencySamples();
+            }
+        }
+        if (skip_plugin) {
+            Avx2Utils::FillBufferAVX2(outL.data(), total_samples, 0.0f);
+            if (channels >= 2) Avx2Utils::FillBufferAVX2(outR.data(), total_samples, 0.0f);
+        }
+
         int32_t processed = 0;
         bool realtime_events_sent = false;
 
-        while (processed < total_samples) {
+        while (!served_ahead && !skip_plugin && processed < total_samples) {
             int32_t block_size = (std::min)(MAX_BLOCK_SIZE, total_samples - processed);
             int64_t current_block_pos = current_pos + processed;
             if (host_for_audio) {
@@ -833,56 +972,15 @@ bool func_proc_audio_host_common(FILTER_PROC_AUDIO* audio, bool is_object) {
                 current_block_pos += lat;
             }
 
-            double time_start = static_cast<double>(current_block_pos) / audio->scene->sample_rate;
-            double time_end = static_cast<double>(current_block_pos + block_size) / audio->scene->sample_rate;
-
             std::vector<IAudioPluginHost::MidiEvent> midi_events_for_block;
             if (!realtime_events_sent && !realtime_midi_events.empty()) {
                 for (auto& evt : realtime_midi_events) midi_events_for_block.push_back(evt);
                 realtime_events_sent = true;
             }
 
-            int64_t start_tick = 0;
-            int64_t end_tick = 0;
-
-            if (ms.parser.GetTPQN() > 0) {
-                if (sync_bpm == 1) {
-                    start_tick = ms.parser.GetTickAtTime(time_start);
-                    end_tick = ms.parser.GetTickAtTime(time_end);
-                } else {
-                    double samplesPerTick = (60.0 * audio->scene->sample_rate) / (bpm * ms.parser.GetTPQN());
-                    if (samplesPerTick < 0.001) samplesPerTick = 0.001;
-                    start_tick = static_cast<int64_t>(current_block_pos / samplesPerTick);
-                    end_tick = static_cast<int64_t>((current_block_pos + block_size) / samplesPerTick);
-                }
-
-                const auto& all_events = ms.parser.GetEvents();
-                auto it = std::lower_bound(all_events.begin(), all_events.end(), start_tick,
-                                           [](const RawMidiEvent& e, int64_t tick) { return e.absoluteTick < tick; });
-
-                for (; it != all_events.end(); ++it) {
-                    if (it->absoluteTick >= end_tick) break;
-
-                    int32_t delta_samples = 0;
-
-                    if (sync_bpm == 1) {
-                        int64_t tick_diff = it->absoluteTick - start_tick;
-                        int64_t total_tick_diff = end_tick - start_tick;
-                        if (total_tick_diff > 0) delta_samples = static_cast<int32_t>(static_cast<double>(tick_diff) / total_tick_diff * block_size);
-                    } else {
-                        double samplesPerTick = (60.0 * audio->scene->sample_rate) / (bpm * ms.parser.GetTPQN());
-                        double raw_delta = (it->absoluteTick * samplesPerTick) - current_block_pos;
-                        if (raw_delta > block_size) raw_delta = block_size;
-                        delta_samples = static_cast<int32_t>(raw_delta);
-                    }
-
-                    if (delta_samples < 0) delta_samples = 0;
-                    if (delta_samples >= block_size) delta_samples = block_size - 1;
-
-                    midi_events_for_block.push_back({ delta_samples, it->status, it->data1, it->data2 });
-                }
-            }
+            CollectMidiFileEvents(ms.parser, sync_bpm, bpm, audio->scene->sample_rate, current_block_pos, block_size, midi_events_for_block);
 
+            Profiler::Scope profile_block(L"ProcessAudio", effect_id, block_size, audio->scene->sample_rate);
             host_for_audio->ProcessAudio(
                 inL.data() + processed,
                 inR.data() + processed,
@@ -898,6 +996,47 @@ bool func_proc_audio_host_common(FILTER_PROC_AUDIO* audio, bool is_object) {
 
             processed += block_size;
         }
+
+        if (silence_state) {
+            silence_state->silent_samples = input_silent ? silence_state->silent_samples + total_samples : 0;
+            if (!skip_plugin) silence_state->output_silent = IsSilent(outL.data(), outR.data(), channels, total_samples);
+        }
+
+        if (ahead_allowed && !served_ahead && ahead->ShouldStart(ahead_signature)) {
+            std::weak_ptr<IAudioPluginHost> weak_host = host_for_audio;
+            auto parser = std::make_shared<const MidiParser>(ms.parser);
+            double sample_rate = audio->scene->sample_rate;
+            int32_t track_num = static_cast<int32_t>(track_ts_num.value);
+            int32_t track_denom = static_cast<int32_t>(track_ts_denom.value);
+            // 1 回の要求より短いと受け取れないので、要求の 2 倍は確保する
+            int32_t ahead_samples = (std::max)(std::clamp(settings.vst.render_ahead_blocks, 1, 64) * RenderAhead::CHUNK, total_samples * 2);
+            ahead->Start(current_pos + total_samples, ahead_samples, ahead_signature,
+                         [weak_host, parser, sync_bpm, bpm, track_num, track_denom, sample_rate, channels, effect_id](int64_t pos, int32_t frames, const float* silence, float* dstL, float* dstR) {
+                             std::shared_ptr<IAudioPluginHost> plugin = weak_host.lock();
+                             if (!plugin) return false;
+
+                             double block_bpm = bpm;
+                             int32_t block_num = track_num;
+                             int32_t block_denom = track_denom;
+                             if (sync_bpm == 1) {
+                                 double time_sec = static_cast<double>(pos) / sample_rate;
+                                 block_bpm = (std::max)(parser->GetBpmAtTime(time_sec), 0.1);
+                                 auto ts_evt = parser->GetTimeSignatureAt(static_cast<uint32_t>(parser->GetTickAtTime(time_sec)));
+                                 if (ts_evt.numerator > 0 && ts_evt.denominator > 0) {
+                                     block_num = ts_evt.numerator;
+                                     block_denom = ts_evt.denominator;
+                                 }
+                             }
+
+                             int64_t block_pos = pos + plugin->GetLatencySamples();
+                             std::vector<IAudioPluginHost::MidiEvent> midi_events;
+                             CollectMidiFileEvents(*parser, sync_bpm, block_bpm, sample_rate, block_pos, frames, midi_events);
+
+                             Profiler::Scope profile_block(L"RenderAhead", effect_id, frames, static_cast<int32_t>(sample_rate));
+                             plugin->ProcessAudio(silence, silence, dstL, dstR, frames, channels, block_pos, block_bpm, block_num, block_denom, midi_events);
+                             return true;
+                         });
+        }
         processed_by_host = true;
     }
 
@@ -906,44 +1045,14 @@ bool func_proc_audio_host_common(FILTER_PROC_AUDIO* audio, bool is_object) {
 
     float* dryL = inL.data();
     float* dryR = inR.data();
-    std::vector<float> delayedL, delayedR;
-
-    if (latency > 0) {
-        DelayBuffer* db = nullptr;
-        {
-            std::lock_guard<std::mutex> lock(g_delay_buffers_mutex);
-            db = &g_delay_buffers[instance_id];
-        }
-
-        int32_t reqSize = latency + MAX_BLOCK_SIZE * 2;
-        if (db->bufferL.size() < reqSize) {
-            db->bufferL.resize(reqSize, 0.0f);
-            db->bufferR.resize(reqSize, 0.0f);
-        }
-
-        int32_t writeP = db->writePos;
-        int32_t bufSize = static_cast<int32_t>(db->bufferL.size());
-
-        for (int32_t i = 0; i < total_samples; ++i) {
-            db->bufferL[writeP] = inL[i];
-            if (channels >= 2) db->bufferR[writeP] = inR[i];
-            writeP++;
-            if (writeP >= bufSize) writeP = 0;
-        }
-        db->writePos = writeP;
-
-        int32_t readP = db->writePos - total_samples - latency;
-        while (readP < 0) readP += bufSize;
-
-        delayedL.resize(total_samples);
-        if (channels >= 2) delayedR.resize(total_samples);
-
-        for (int32_t i = 0; i < total_samples; ++i) {
-            delayedL[i] = db->bufferL[readP];
-            if (channels >= 2) delayedR[i] = db->bufferR[readP];
-            readP++;
-            if (readP >= bufSize) readP = 0;
-        }
+    // 一度遅延を補正したインスタンスは、遅延が 0 に戻ってもクロスフェードのために履歴を書き続ける
+    LatencyCompensator* compensator = (latency > 0) ? &g_delay_buffers.Get(instance_id) : g_delay_buffers.Find(instance_id);
+    if (compensator) {
+        auto delayedL = scratch.Alloc(total_samples);
+        auto delayedR = scratch.Alloc(channels >= 2 ? total_samples : 0);
+        const float* dry_in[2] = { inL.data(), inR.data() };
+        float* dry_out[2] = { delayedL.data(), delayedR.data() };
+        compensator->Process(dry_in, dry_out, channels, total_samples, latency);
 
         dryL = delayedL.data();
         if (channels >= 2) dryR = delayedR.data();
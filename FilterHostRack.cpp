@@ -0,0 +1,439 @@
+﻿#include "Avx2Utils.h"
+#include "DelayLine.h"
+#include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "IAudioPluginHost.h"
+#include "PluginLoader.h"
+#include "PluginManager.h"
+#include "ScratchArena.h"
+#include "StringUtils.h"
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+
+// 1 つのフィルタの中で複数のプラグインを直列・並列につなぐ Host Rack。
+// 接続は段の並びで表し、各段は並列の枝、各枝は直列のスロットの並び。
+// 段の中の枝は TaskPool で同時に処理し、枝ごとの遅延の差は段の出口で揃えてから足し合わせる。
+// スロットのホストは PluginManager / PluginLoader で Host と同じように扱い、
+// スロットごとに合成した effect_id と "<インスタンスID>#<番号>" のインスタンスIDを使う。
+constexpr auto TOOL_NAME = L"Host Rack";
+constexpr int32_t RACK_SLOTS = 4;
+constexpr int32_t MAX_BLOCK_SIZE = 2048;
+
+extern TCHAR filter_ext[];
+
+FILTER_ITEM_GROUP rack_general_group(L"General Settings", true);
+FILTER_ITEM_SELECT::ITEM rack_route_list[] = {
+    { L"直列 1→2→3→4", 0 },
+    { L"並列 1|2|3|4", 1 },
+    { L"(1|2|3)→4", 2 },
+    { L"(1→2)|(3→4)", 3 },
+    { L"1→(2|3|4)", 4 },
+    { nullptr }
+};
+FILTER_ITEM_SELECT rack_route(L"接続", 0, rack_route_list);
+FILTER_ITEM_TRACK rack_wet(L"Wet", 100.0, 0.0, 100.0, 0.1, nullptr, 1.0);
+FILTER_ITEM_TRACK rack_volume(L"Gain", 100.0, 0.0, 500.0, 0.1, nullptr, 1.0);
+FILTER_ITEM_TRACK rack_bpm(L"BPM", 120.0, 1.0, 999.0, 0.01, nullptr, 1.0);
+FILTER_ITEM_TRACK rack_ts_num(L"分子", 4.0, 1.0, 32.0, 1.0, nullptr, 1.0);
+FILTER_ITEM_TRACK rack_ts_denom(L"分母", 4.0, 1.0, 32.0, 1.0, nullptr, 1.0);
+FILTER_ITEM_GROUP rack_slot1_group(L"Slot 1", true);
+FILTER_ITEM_FILE rack_plugin1(L"プラグイン 1", L"", filter_ext);
+FILTER_ITEM_TRACK rack_level1(L"Level 1", 100.0, 0.0, 200.0, 0.1, nullptr, 1.0);
+FILTER_ITEM_CHECK rack_gui1(L"GUI 1", false);
+FILTER_ITEM_GROUP rack_slot2_group(L"Slot 2", true);
+FILTER_ITEM_FILE rack_plugin2(L"プラグイン 2", L"", filter_ext);
+FILTER_ITEM_TRACK rack_level2(L"Level 2", 100.0, 0.0, 200.0, 0.1, nullptr, 1.0);
+FILTER_ITEM_CHECK rack_gui2(L"GUI 2", false);
+FILTER_ITEM_GROUP rack_slot3_group(L"Slot 3", true);
+FILTER_ITEM_FILE rack_plugin3(L"プラグイン 3", L"", filter_ext);
+FILTER_ITEM_TRACK rack_level3(L"Level 3", 100.0, 0.0, 200.0, 0.1, nullptr, 1.0);
+FILTER_ITEM_CHECK rack_gui3(L"GUI 3", false);
+FILTER_ITEM_GROUP rack_slot4_group(L"Slot 4", true);
+FILTER_ITEM_FILE rack_plugin4(L"プラグイン 4", L"", filter_ext);
+FILTER_ITEM_TRACK rack_level4(L"Level 4", 100.0, 0.0, 200.0, 0.1, nullptr, 1.0);
+FILTER_ITEM_CHECK rack_gui4(L"GUI 4", false);
+struct RackInstanceID {
+    char uuid[40] = { 0 };
+};
+FILTER_ITEM_DATA<RackInstanceID> rack_instance_data(L"INSTANCE_ID");
+
+void* filter_items_host_rack[] = {
+    &rack_general_group,
+    &rack_route,
+    &rack_wet,
+    &rack_volume,
+    &rack_bpm,
+    &rack_ts_num,
+    &rack_ts_denom,
+    &rack_slot1_group,
+    &rack_plugin1,
+    &rack_level1,
+    &rack_gui1,
+    &rack_slot2_group,
+    &rack_plugin2,
+    &rack_level2,
+    &rack_gui2,
+    &rack_slot3_group,
+    &rack_plugin3,
+    &rack_level3,
+    &rack_gui3,
+    &rack_slot4_group,
+    &rack_plugin4,
+    &rack_level4,
+    &rack_gui4,
+    &rack_instance_data,
+    nullptr
+};
+
+namespace {
+using Branch = std::vector<int32_t>;
+using Stage = std::vector<Branch>;
+using Route = std::vector<Stage>;
+
+const Route& GetRoute(int32_t index) {
+    static const Route routes[] = {
+        { { { 0, 1, 2, 3 } } },
+        { { { 0 }, { 1 }, { 2 }, { 3 } } },
+        { { { 0 }, { 1 }, { 2 } }, { { 3 } } },
+        { { { 0, 1 }, { 2, 3 } } },
+        { { { 0 } }, { { 1 }, { 2 }, { 3 } } },
+    };
+    return routes[std::clamp(index, 0, static_cast<int32_t>(std::size(routes)) - 1)];
+}
+
+// 段ごと・枝ごとの遅延合わせと、ドライ信号の遅延補正
+struct RackState {
+    std::array<std::array<LatencyCompensator, RACK_SLOTS>, RACK_SLOTS> align;
+    LatencyCompensator dry;
+    int32_t route = -1;
+
+    void Reset() {
+        for (auto& stage : align)
+            for (auto& branch : stage) branch.Reset();
+        dry.Reset();
+    }
+    size_t memory_usage() const {
+        size_t bytes = sizeof(*this) + dry.memory_usage();
+        for (const auto& stage : align)
+            for (const auto& branch : stage) bytes += branch.memory_usage();
+        return bytes;
+    }
+};
+
+EffectStateRegistry<RackState, std::string> g_rack_states{ EffectStateReclaim::Allowed };
+
+int64_t SlotEffectId(int64_t effect_id, int32_t slot) {
+    // AviUtl の effect_id と重ならないように負の値を使う
+    return -(effect_id * RACK_SLOTS + slot + 1);
+}
+
+std::string SlotInstanceId(const std::string& instance_id, int32_t slot) {
+    return instance_id + "#" + std::to_string(slot + 1);
+}
+
+struct Slot {
+    std::shared_ptr<IAudioPluginHost> host;
+    float level = 1.0f;
+    int32_t latency = 0;
+};
+
+struct BranchWork {
+    const Branch* slots = nullptr;
+    LatencyCompensator* align = nullptr;
+    int32_t latency = 0;
+    float* L = nullptr;
+    float* R = nullptr;
+    float* tmpL = nullptr;
+    float* tmpR = nullptr;
+};
+} // namespace
+
+void CleanupHostRackResources() {
+    g_rack_states.Clear();
+}
+
+void CollectHostRackInstanceIds(EDIT_SECTION* edit, OBJECT_HANDLE obj, std::set<std::string>& ids) {
+    const std::wstring rack_name = GEN_TOOL_NAME(TOOL_NAME);
+    int32_t effect_count = edit->count_object_effect(obj, rack_name.c_str());
+    for (int32_t i = 0; i < effect_count; ++i) {
+        std::wstring indexed_filter_name = rack_name;
+        if (i > 0) indexed_filter_name += L":" + std::to_wstring(i);
+        LPCSTR hex_encoded_id_str = edit->get_object_item_value(obj, indexed_filter_name.c_str(), rack_instance_data.name);
+        if (hex_encoded_id_str && hex_encoded_id_str[0] != '\0') {
+            std::string instance_id = StringUtils::HexToString(hex_encoded_id_str).c_str();
+            ids.insert(instance_id);
+            for (int32_t slot = 0; slot < RACK_SLOTS; ++slot) ids.insert(SlotInstanceId(instance_id, slot));
+        }
+    }
+}
+
+bool func_proc_audio_host_rack(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(L"Host Rack", audio);
+    DenormalGuard denormal_guard;
+    std::string instance_id;
+    if (rack_instance_data.value->uuid[0] != '\0') {
+        instance_id = rack_instance_data.value->uuid;
+    } else {
+        instance_id = StringUtils::GenerateUUID();
+        strcpy_s(rack_instance_data.value->uuid, sizeof(rack_instance_data.value->uuid), instance_id.c_str());
+    }
+    if (instance_id.empty()) return true;
+
+    int64_t effect_id = audio->object->effect_id;
+    const std::string old_instance_id = instance_id;
+    bool is_copy = false;
+    PluginManager::GetInstance().RegisterOrUpdateInstance(instance_id, effect_id, is_copy);
+    if (is_copy) {
+        DbgPrint(L"Rack copy detected! New instance_id: " + StringUtils::Utf8ToWide(instance_id), LOG_VERBOSE);
+        strcpy_s(rack_instance_data.value->uuid, sizeof(rack_instance_data.value->uuid), instance_id.c_str());
+        // スロットの状態は別のIDで持っているので、コピー元から引き継ぐ
+        for (int32_t slot = 0; slot < RACK_SLOTS; ++slot) {
+            std::string state = PluginManager::GetInstance().GetSavedState(SlotInstanceId(old_instance_id, slot));
+            if (!state.empty()) PluginManager::GetInstance().SaveState(SlotInstanceId(instance_id, slot), state);
+        }
+    }
+
+    float wet_val = static_cast<float>(rack_wet.value);
+    float vol_val = static_cast<float>(rack_volume.value);
+    if (wet_val == 0.0f && vol_val == 100.0f) return true;
+
+    const LPCWSTR plugin_paths[RACK_SLOTS] = { rack_plugin1.value, rack_plugin2.value, rack_plugin3.value, rack_plugin4.value };
+    const double levels[RACK_SLOTS] = { rack_level1.value, rack_level2.value, rack_level3.value, rack_level4.value };
+    const bool gui_checks[RACK_SLOTS] = { rack_gui1.value, rack_gui2.value, rack_gui3.value, rack_gui4.value };
+
+    Slot slots[RACK_SLOTS];
+    bool pending = false;
+    bool any_host = false;
+    for (int32_t slot = 0; slot < RACK_SLOTS; ++slot) {
+        const int64_t slot_effect_id = SlotEffectId(effect_id, slot);
+        std::string slot_instance_id = SlotInstanceId(instance_id, slot);
+        bool slot_copy = false;
+        PluginManager::GetInstance().RegisterOrUpdateInstance(slot_instance_id, slot_effect_id, slot_copy);
+
+        if (PluginManager::GetInstance().IsPendingReinitialization(slot_effect_id)) {
+            pending = true;
+            continue;
+        }
+
+        std::filesystem::path plugin_path = plugin_paths[slot];
+        std::shared_ptr<IAudioPluginHost> host = PluginManager::GetInstance().GetHost(slot_effect_id);
+        if (host && audio->scene->sample_rate > 0) {
+            double targetRate = static_cast<double>(audio->scene->sample_rate);
+            if (std::abs(host->GetSampleRate() - targetRate) > 0.1) host->SetSampleRate(targetRate);
+        }
+
+        bool needs_reinitialization = false;
+        bool path_changed = false;
+        if (plugin_path.empty()) {
+            if (host) needs_reinitialization = true;
+        } else if (!host) {
+            needs_reinitialization = true;
+        } else if (host->GetPluginPath() != plugin_path) {
+            needs_reinitialization = true;
+            path_changed = true;
+        }
+
+        if (needs_reinitialization) {
+            PluginManager::GetInstance().SetPendingReinitialization(slot_effect_id, true);
+            PluginLoader::Request request;
+            request.effect_id = slot_effect_id;
+            request.instance_id = slot_instance_id;
+            request.plugin_path = plugin_path;
+            request.sample_rate = audio->scene->sample_rate;
+            request.block_size = MAX_BLOCK_SIZE;
+            request.restore_state = !path_changed;
+            PluginLoader::Submit(std::move(request));
+            pending = true;
+            continue;
+        }
+        if (!host) continue;
+
+        // 処理モードと主バスの切り替えはメインスレッドで行う。反映されるまでは今の設定のまま処理する
+        PluginManager::HostConfig host_config;
+        host_config.offline = IsSavingOutput();
+        host_config.bus_channels = audio->object->channel_num >= 2 ? 2 : 1;
+        PluginManager::GetInstance().RequestHostConfig(slot_effect_id, host, host_config);
+
+        bool gui_should_show = gui_checks[slot];
+        if (host->IsGuiVisible() != gui_should_show) {
+            std::lock_guard<std::mutex> task_lock(g_task_queue_mutex);
+            g_main_thread_tasks.push_back([slot_effect_id, slot_instance_id, gui_should_show]() {
+                auto host = PluginManager::GetInstance().GetHost(slot_effect_id);
+                if (host) {
+                    if (gui_should_show) {
+                        host->ShowGui();
+                    } else {
+                        host->HideGui();
+                        std::string state = host->GetState();
+                        if (!state.empty()) PluginManager::GetInstance().SaveState(slot_instance_id, state);
+                    }
+                }
+            });
+        }
+
+        slots[slot].host = std::move(host);
+        slots[slot].level = static_cast<float>(levels[slot] / 100.0);
+        slots[slot].latency = slots[slot].host->GetLatencySamples();
+        any_host = true;
+    }
+    // 一部のスロットだけで処理すると音が変わるので、読み込みが揃うまでは素通しにする
+    if (pending) return true;
+
+    int32_t total_samples = audio->object->sample_num;
+    if (total_samples <= 0) return true;
+    int32_t channels = (std::min)(2, audio->object->channel_num);
+
+    ScratchScope scratch;
+    auto inL = scratch.Alloc(total_samples);
+    auto inR = scratch.Alloc(total_samples);
+    auto outL = scratch.Alloc(total_samples);
+    auto outR = scratch.Alloc(total_samples);
+    if (channels >= 1) audio->get_sample_data(inL.data(), 0);
+    if (channels >= 2) audio->get_sample_data(inR.data(), 1);
+    else if (channels == 1) Avx2Utils::CopyBufferAVX2(inR.data(), inL.data(), total_samples);
+
+    float vol_ratio = vol_val / 100.0f;
+    if (!any_host || wet_val == 0.0f) {
+        Avx2Utils::ScaleBufferAVX2(outL.data(), inL.data(), total_samples, vol_ratio);
+        if (channels >= 2) Avx2Utils::ScaleBufferAVX2(outR.data(), inR.data(), total_samples, vol_ratio);
+        if (channels >= 1) audio->set_sample_data(outL.data(), 0);
+        if (channels >= 2) audio->set_sample_data(outR.data(), 1);
+        return true;
+    }
+
+    int64_t current_pos = static_cast<int64_t>(audio->object->sample_index + 0.5);
+    double bpm = (std::max)(rack_bpm.value, 0.1);
+    int32_t ts_num = static_cast<int32_t>(rack_ts_num.value);
+    int32_t ts_denom = static_cast<int32_t>(rack_ts_denom.value);
+    double sample_rate = audio->scene->sample_rate;
+
+    RackState& state = g_rack_states.Get(instance_id);
+    const int32_t route_index = rack_route.value;
+    bool should_reset = PluginManager::GetInstance().ShouldReset(effect_id, current_pos, total_samples);
+    // 接続を変えたらプラグインの履歴も遅延合わせの履歴も前の接続のものなので捨てる
+    if (state.route != route_index) {
+        should_reset = true;
+        state.route = route_index;
+    }
+    if (should_reset) {
+        for (auto& slot : slots)
+            if (slot.host) slot.host->Reset(current_pos, bpm, ts_num, ts_denom);
+        state.Reset();
+    }
+    PluginManager::GetInstance().UpdateLastAudioState(effect_id, current_pos, total_samples);
+
+    // 段の入出力は outL / outR に置いたまま、段ごとに枝の結果で書き換える
+    Avx2Utils::CopyBufferAVX2(outL.data(), inL.data(), total_samples);
+    Avx2Utils::CopyBufferAVX2(outR.data(), inR.data(), total_samples);
+
+    const Route& route = GetRoute(route_index);
+    const std::vector<IAudioPluginHost::MidiEvent> no_midi_events;
+    int32_t total_latency = 0;
+    BranchWork works[RACK_SLOTS];
+    for (size_t s = 0; s < route.size(); ++s) {
+        const Stage& stage = route[s];
+        // 空のスロットだけの枝は使わない
+        int32_t work_count = 0;
+        int32_t stage_latency = 0;
+        for (size_t b = 0; b < stage.size(); ++b) {
+            int32_t latency = 0;
+            bool active = false;
+            for (int32_t slot : stage[b]) {
+                if (!slots[slot].host) continue;
+                latency += slots[slot].latency;
+                active = true;
+            }
+            if (!active) continue;
+            BranchWork& work = works[work_count++];
+            work.slots = &stage[b];
+            work.align = &state.align[s][b];
+            work.latency = latency;
+            stage_latency = (std::max)(stage_latency, latency);
+        }
+        if (work_count == 0) continue;
+        // この段に入る音は、前の段までの遅延の分だけ遅れている
+        const int32_t stage_offset = total_latency;
+        total_latency += stage_latency;
+
+        // 作業領域の確保は ScratchArena の持ち主であるこのスレッドで済ませておく
+        for (int32_t w = 0; w < work_count; ++w) {
+            works[w].L = scratch.Alloc(total_samples).data();
+            works[w].R = scratch.Alloc(total_samples).data();
+            works[w].tmpL = scratch.Alloc(total_samples).data();
+            works[w].tmpR = scratch.Alloc(total_samples).data();
+        }
+
+        const float* stageL = outL.data();
+        const float* stageR = outR.data();
+        TaskPool::ParallelFor(work_count, [&](int32_t w) {
+            // ワーカースレッドの MXCSR は呼び出し元と別なので、枝ごとに立て直す
+            DenormalGuard branch_denormal_guard;
+            BranchWork& work = works[w];
+            Avx2Utils::CopyBufferAVX2(work.L, stageL, total_samples);
+            Avx2Utils::CopyBufferAVX2(work.R, stageR, total_samples);
+            // 枝の中では、手前のスロットの遅延も足した位置を渡す
+            int32_t upstream_latency = stage_offset;
+            for (int32_t slot_index : *work.slots) {
+                const Slot& slot = slots[slot_index];
+                if (!slot.host) continue;
+                Profiler::Scope profile_slot(L"RackSlot", effect_id, total_samples, static_cast<int32_t>(sample_rate));
+                const int64_t slot_pos = current_pos + upstream_latency + slot.latency;
+                for (int32_t processed = 0; processed < total_samples;) {
+                    int32_t block_size = (std::min)(MAX_BLOCK_SIZE, total_samples - processed);
+                    slot.host->ProcessAudio(work.L + processed, work.R + processed, work.tmpL + processed, work.tmpR + processed,
+                                            block_size, channels, slot_pos + processed, bpm, ts_num, ts_denom, no_midi_events);
+                    processed += block_size;
+                }
+                upstream_latency += slot.latency;
+                std::swap(work.L, work.tmpL);
+                std::swap(work.R, work.tmpR);
+                if (slot.level != 1.0f) {
+                    Avx2Utils::ScaleBufferAVX2(work.L, work.L, total_samples, slot.level);
+                    Avx2Utils::ScaleBufferAVX2(work.R, work.R, total_samples, slot.level);
+                }
+            }
+            // 段の中で一番遅い枝に合わせる。遅延が揃っていても、一度合わせた枝は履歴を書き続ける
+            int32_t delay = stage_latency - work.latency;
+            if (delay > 0 || work.align->latency() > 0) {
+                float* io[2] = { work.L, work.R };
+                work.align->Process(io, io, channels, total_samples, delay);
+            }
+        });
+
+        Avx2Utils::CopyBufferAVX2(outL.data(), works[0].L, total_samples);
+        Avx2Utils::CopyBufferAVX2(outR.data(), works[0].R, total_samples);
+        for (int32_t w = 1; w < work_count; ++w) {
+            Avx2Utils::AccumulateAVX2(outL.data(), works[w].L, total_samples);
+            Avx2Utils::AccumulateAVX2(outR.data(), works[w].R, total_samples);
+        }
+    }
+
+    if (total_latency > 0 || state.dry.latency() > 0) {
+        float* io[2] = { inL.data(), inR.data() };
+        state.dry.Process(io, io, channels, total_samples, total_latency);
+    }
+
+    float wet_ratio = wet_val / 100.0f;
+    float dry_ratio = 1.0f - wet_ratio;
+    Avx2Utils::MixAudioAVX2(outL.data(), inL.data(), total_samples, wet_ratio, dry_ratio, vol_ratio);
+    if (channels >= 2) Avx2Utils::MixAudioAVX2(outR.data(), inR.data(), total_samples, wet_ratio, dry_ratio, vol_ratio);
+
+    if (channels >= 1) audio->set_sample_data(outL.data(), 0);
+    if (channels >= 2) audio->set_sample_data(outR.data(), 1);
+    return true;
+}
+
+FILTER_PLUGIN_TABLE filter_plugin_table_host_rack = {
+    TYPE_AUDIO_FILTER_OBJECT,
+    GEN_TOOL_NAME(TOOL_NAME),
+    label,
+    GEN_FILTER_INFO(TOOL_NAME),
+    filter_items_host_rack,
+    nullptr,
+    func_proc_audio_host_rack
+};
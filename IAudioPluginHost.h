@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include <cstdint>
 #include <filesystem>
 #include <string>
 #include <vector>
@@ -44,8 +45,32 @@ class IAudioPluginHost {
     virtual void SetSampleRate(double sampleRate) = 0;
     virtual double GetSampleRate() const = 0;
 
+    // 書き出し中はオフライン処理 (VST3 の kOffline / CLAP の render 拡張) に切り替え、
+    // リアルタイムより速く呼ばれても品質を落としたり無音を返したりしないようにする。プラグインは作り直さない。
+    // SetOfflineMode はプラグインを止めて設定し直すことがあるのでメインスレッドから呼ぶ
+    virtual void SetOfflineMode(bool offline) {}
+    virtual bool IsOfflineMode() const { return false; }
+
+    // 主バスのチャンネル数 (1 か 2)。モノラルのオブジェクトではプラグインに 1ch 分だけ処理させる。
+    // プラグインを止めて構成し直すのでメインスレッドから呼ぶ。GetMainBusChannels は最後に要求した値を返す。
+    // 構成し直すまでの間も ProcessAudio は numChannels に合わせて入出力を受け渡す
+    virtual void SetMainBusChannels(int32_t channels) {}
+    virtual int32_t GetMainBusChannels() const { return 2; }
+
     virtual int32_t GetLatencySamples() = 0;
 
+    // 入力が無音になってから出力が消えるまでのサンプル数 (リバーブの残響など)。
+    // INFINITE_TAIL は分からない・無限を表し、FilterHost は無音入力でも処理を省かない
+    static constexpr int32_t INFINITE_TAIL = INT32_MAX;
+    virtual int32_t GetTailSamples() { return INFINITE_TAIL; }
+
+    // 保存される状態が変わりうる操作のたびに増える値。PluginManager は値が前回の保存時と同じなら GetState を省く。
+    // 0 は追跡していないことを表し、保存のたびに GetState する
+    virtual uint64_t GetStateRevision() { return 0; }
+
+    // LoadPlugin / SetState をメインスレッド以外から呼んでよいか (PluginLoader が参照する)
+    virtual bool CanLoadOffMainThread() const { return false; }
+
     struct ParameterInfo {
         char name[128];
         char unit[32];
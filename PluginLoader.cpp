@@ -0,0 +1,159 @@
+﻿#include "PluginLoader.h"
+
+#include "AudioPluginFactory.h"
+#include "Eap2Common.h"
+#include "PluginManager.h"
+#include "PluginModuleCache.h"
+#include "PluginType.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace PluginLoader {
+namespace {
+// 要求ごとの世代。effect_id ごとに最新の世代だけを覚え、一致しない結果は公開しない
+std::mutex g_generation_mutex;
+std::map<int64_t, uint64_t> g_latest_generation;
+uint64_t g_next_generation = 0;
+
+uint64_t BeginGeneration(int64_t effect_id) {
+    std::lock_guard<std::mutex> lock(g_generation_mutex);
+    return g_latest_generation[effect_id] = ++g_next_generation;
+}
+
+bool IsLatest(int64_t effect_id, uint64_t generation) {
+    std::lock_guard<std::mutex> lock(g_generation_mutex);
+    auto it = g_latest_generation.find(effect_id);
+    return it != g_latest_generation.end() && it->second == generation;
+}
+
+void Publish(const Request& request, uint64_t generation, std::shared_ptr<IAudioPluginHost> host) {
+    if (!IsLatest(request.effect_id, generation)) return;
+    PluginManager::GetInstance().PublishHost(request.effect_id, std::move(host));
+    std::lock_guard<std::mutex> lock(g_generation_mutex);
+    auto it = g_latest_generation.find(request.effect_id);
+    if (it != g_latest_generation.end() && it->second == generation) g_latest_generation.erase(it);
+}
+
+// 生成・読み込み・状態の復元。SandboxHost ならプールから、それ以外はメインスレッドから呼ぶ
+std::shared_ptr<IAudioPluginHost> LoadHost(std::shared_ptr<IAudioPluginHost> host, const Request& request) {
+    if (!host || request.sample_rate <= 0) return host;
+    if (!host->LoadPlugin(request.plugin_path, request.sample_rate, request.block_size)) return nullptr;
+    std::string state_to_restore;
+    if (request.restore_state) state_to_restore = PluginManager::GetInstance().GetSavedState(request.instance_id);
+    if (!state_to_restore.empty()) host->SetState(state_to_restore);
+    return host;
+}
+
+class Pool {
+  public:
+    ~Pool() { Stop(); }
+
+    void Enqueue(std::function<void()> job) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (threads_.empty()) {
+            stopping_ = false;
+            const int32_t count = std::clamp(static_cast<int32_t>(std::thread::hardware_concurrency()) / 2, 1, 4);
+            for (int32_t i = 0; i < count; ++i) threads_.emplace_back([this] { Run(); });
+        }
+        jobs_.push_back(std::move(job));
+        cv_.notify_one();
+    }
+
+    void Stop() {
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            jobs_.clear();
+            threads.swap(threads_);
+        }
+        cv_.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+  private:
+    void Run() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                if (stopping_) return;
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> jobs_;
+    std::vector<std::thread> threads_;
+    bool stopping_ = false;
+};
+
+Pool g_pool;
+
+void RunRequest(const Request& request, uint64_t generation) {
+    if (!IsLatest(request.effect_id, generation)) return;
+
+    const PluginType type = request.plugin_path.empty() ? PluginType::Unknown : GetPluginTypeFromPath(request.plugin_path.wstring());
+    if (type == PluginType::Unknown) {
+        Publish(request, generation, nullptr);
+        return;
+    }
+
+    std::shared_ptr<IAudioPluginHost> host = AudioPluginFactory::Create(type, g_hinstance);
+    if (host && host->CanLoadOffMainThread()) {
+        try {
+            host = LoadHost(std::move(host), request);
+        } catch (...) {
+            DbgPrint(L"[PluginLoader] exception while loading " + request.plugin_path.wstring(), LOG_ERROR);
+            host = nullptr;
+        }
+        Publish(request, generation, std::move(host));
+        return;
+    }
+
+    // DLL の読み込みと factory の取得だけを先に済ませる。メインスレッドの LoadPlugin はキャッシュから受け取る
+    std::shared_ptr<const void> module;
+    if (type == PluginType::VST3) {
+        std::string error;
+        module = PluginModuleCache::AcquireVst3(request.plugin_path, error);
+    } else if (type == PluginType::CLAP) {
+        module = PluginModuleCache::AcquireClap(request.plugin_path);
+    }
+
+    std::lock_guard<std::mutex> task_lock(g_task_queue_mutex);
+    g_main_thread_tasks.push_back([request, generation, host, module]() mutable {
+        if (!IsLatest(request.effect_id, generation)) return;
+        Publish(request, generation, LoadHost(std::move(host), request));
+        module.reset();
+    });
+}
+} // namespace
+
+void Submit(Request request) {
+    const uint64_t generation = BeginGeneration(request.effect_id);
+    g_pool.Enqueue([request = std::move(request), generation] { RunRequest(request, generation); });
+}
+
+void CancelAll() {
+    std::lock_guard<std::mutex> lock(g_generation_mutex);
+    g_latest_generation.clear();
+}
+
+void Shutdown() {
+    CancelAll();
+    g_pool.Stop();
+}
+} // namespace PluginLoader
@@ -0,0 +1,28 @@
+﻿#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Host フィルタのプラグイン生成と状態の復元を UI スレッドの外で進める読み込みプール。
+// 子プロセスで動く SandboxHost は生成から SetState までプールで行う。
+// VST3 / CLAP を直接読み込む場合は、生成・初期化・activate がメインスレッドを要求するので、
+// プールではモジュール (DLL と factory) の読み込みだけを先に済ませ、残りを g_main_thread_tasks に回す。
+// 完成したホストは PluginManager::PublishHost で差し替えと保留解除をまとめて行う。
+namespace PluginLoader {
+struct Request {
+    int64_t effect_id = 0;
+    std::string instance_id;
+    std::filesystem::path plugin_path;
+    double sample_rate = 0.0;
+    int32_t block_size = 0;
+    // プラグインを変えたときは以前の状態を復元しない
+    bool restore_state = true;
+};
+
+// 同じ effect_id に新しい要求が来たら、古い要求の結果は捨てる
+void Submit(Request request);
+// 進行中の要求の結果をすべて捨てる (プロジェクトの読み直しなど)
+void CancelAll();
+// プールのスレッドを止める。UninitializePlugin から呼ぶ
+void Shutdown();
+} // namespace PluginLoader
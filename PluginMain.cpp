@@ -1,6 +1,9 @@
 ﻿#include "AudioPluginFactory.h"
 #include "Eap2Common.h"
 #include "Eap2Config.h"
+#include "EffectStateRegistry.h"
+#include "PluginLoader.h"
+#include "TaskPool.h"
 
 #include <unordered_set>
 
@@ -63,6 +66,7 @@ SCRIPT_MODULE_TABLE script_module_table = {
 static constexpr std::array all_plugins{
     &filter_plugin_table_host,
     &filter_plugin_table_host_media,
+    &filter_plugin_table_host_rack,
     &filter_plugin_table_utility,
     &filter_plugin_table_eq,
     &filter_plugin_table_stereo,
@@ -116,7 +120,8 @@ static constexpr std::array tool_plugins{
 
 static constexpr std::array host_plugins{
     &filter_plugin_table_host,
-    &filter_plugin_table_host_media
+    &filter_plugin_table_host_media,
+    &filter_plugin_table_host_rack
 };
 
 static constexpr std::array chain_plugins{
@@ -142,6 +147,7 @@ std::atomic<int32_t> g_shared_ts_num{ 4 };
 std::atomic<int32_t> g_shared_ts_denom{ 4 };
 
 UINT_PTR g_timer_id = 87655;
+uint32_t g_reclaim_tick = 0;
 HWND g_hMessageWindow = nullptr;
 const uint32_t WM_APP_EXECUTE_TASKS = WM_APP + 100;
 
@@ -168,6 +174,13 @@ void CALLBACK TimerProc(HWND, UINT, UINT_PTR, DWORD) {
             g_shared_ts_denom.store(4);
         }
     }
+    // 約1秒ごとに使われていないエフェクト状態を回収する
+    if (++g_reclaim_tick >= 20) {
+        g_reclaim_tick = 0;
+        const uint64_t idle_ms = static_cast<uint64_t>((std::max)(0, settings.performance.state_idle_timeout_sec)) * 1000;
+        const size_t limit = static_cast<size_t>((std::max)(0, settings.performance.state_memory_limit_mb)) * 1024 * 1024;
+        EffectStateReclaimer::Run(idle_ms, limit);
+    }
     std::lock_guard<std::mutex> lock(g_task_queue_mutex);
     if (g_main_thread_tasks.empty()) return;
 
@@ -194,6 +207,7 @@ std::vector<T> GetModule(const std::array<T, N>& plugins, AppSettings setting) {
     add_if(setting.module.chain_tool_disable, chain_plugins);
     add_if(setting.module.host_filter_disable, &filter_plugin_table_host);
     add_if(setting.module.host_media_disable, &filter_plugin_table_host_media);
+    add_if(setting.module.host_rack_disable, &filter_plugin_table_host_rack);
     add_if(setting.module.auto_wah_disable, &filter_plugin_table_autowah);
     add_if(setting.module.chain_comp_disable, &filter_plugin_table_chain_comp);
     add_if(setting.module.chain_dynamic_eq_disable, &filter_plugin_table_chain_dyn_eq);
@@ -245,6 +259,13 @@ EXTERN_C __declspec(dllexport) bool InitializePlugin(DWORD version) {
     }
 
     LoadConfig();
+    Profiler::SetEnabled(settings.performance.enable_profiler);
+
+    Avx2Utils::SimdLevel simd_level = Avx2Utils::DetectSimdLevel();
+    if (!Avx2Utils::ParseSimdLevel(settings.performance.simd_level, simd_level))
+        DbgPrint(TrText(L"SimdLevelの値が不正なため自動選択します。"), LOG_WARN);
+    simd_level = Avx2Utils::SetSimdLevel(simd_level);
+    DbgPrint(std::wstring(L"SIMD: ") + Avx2Utils::SimdLevelName(simd_level) + L" (CPU: " + Avx2Utils::SimdLevelName(Avx2Utils::DetectSimdLevel()) + L")", LOG_INFO);
 
     if (FAILED(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED))) {
         DbgMessage(TrText(L"COM 初期化に失敗しました。"), LOG_ERROR);
@@ -313,6 +334,8 @@ EXTERN_C __declspec(dllexport) void UninitializePlugin() {
         g_hMessageWindow = nullptr;
     }
     UnregisterClass(EAP2_MW_CLASS, g_hinstance);
+    PluginLoader::Shutdown();
+    TaskPool::Shutdown();
     CleanupMainFilterResources();
     AudioPluginFactory::Uninitialize();
     CoUninitialize();
@@ -340,12 +363,16 @@ EXTERN_C __declspec(dllexport) COMMON_PLUGIN_TABLE* GetCommonPluginTable(void) {
 
 EXTERN_C __declspec(dllexport) void RegisterPlugin(HOST_APP_TABLE* host) {
     host->register_config_menu(TrText(L"EAP2の設定を再読込"), [](HWND hwnd, HINSTANCE dllhinst) {
-        if (MessageBox(hwnd, TrText(L"EAP2の設定を再読込しますか？(一部は再起動後に反映)"), TrText(L"EAP2 設定再読込"), MB_OKCANCEL | MB_ICONINFORMATION | MB_DEFBUTTON2) == IDOK) ReloadConfig();
+        if (MessageBox(hwnd, TrText(L"EAP2の設定を再読込しますか？(一部は再起動後に反映)"), TrText(L"EAP2 設定再読込"), MB_OKCANCEL | MB_ICONINFORMATION | MB_DEFBUTTON2) == IDOK) {
+            ReloadConfig();
+            Profiler::SetEnabled(settings.performance.enable_profiler);
+        }
     });
     host->register_config_menu(TrText(L"EAP2の設定をリセット"), [](HWND hwnd, HINSTANCE dllhinst) {
         if (MessageBox(hwnd, TrText(L"EAP2の設定をリセットしますか？(再起動後に反映)"), TrText(L"EAP2 設定リセット"), MB_OKCANCEL | MB_ICONWARNING | MB_DEFBUTTON2) == IDOK) ResetConfig();
     });
     host->register_config_menu(TrText(L"EAP2の設定を開く"), [](HWND hwnd, HINSTANCE dllhinst) { OpenConfig(); });
+    host->register_config_menu(TrText(L"EAP2のプロファイル結果を出力"), [](HWND hwnd, HINSTANCE dllhinst) { Profiler::Dump(GetConfigPath().parent_path()); });
     for (auto& plugin : GetModule(all_plugins, settings)) host->register_filter_plugin(plugin);
     if (settings.exp.use_experimental_script_module) host->register_script_module_name(&script_module_table, L"EAP2_module");
     host->register_project_save_handler(func_project_save);
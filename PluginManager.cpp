@@ -51,7 +51,12 @@ void PluginManager::CleanupResources() {
         std::lock_guard<std::mutex> lock(m_states_mutex);
         m_hosts.clear();
         m_plugin_state_database.clear();
+        m_state_pool.clear();
+        m_state_snapshots.clear();
         m_pending_reinitialization.clear();
+        m_pending_host_configs.clear();
+        m_state_db_dirty = true;
+        m_encoded_state_db.clear();
     }
     {
         std::lock_guard<std::mutex> lock(m_instance_ownership_mutex);
@@ -63,11 +68,39 @@ void PluginManager::CleanupResources() {
     }
 }
 
+PluginManager::StateEntry PluginManager::InternState(std::string state) {
+    StateEntry entry;
+    entry.hash = ProjectStateDb::Hash(state);
+    auto it = m_state_pool.find(entry.hash);
+    if (it != m_state_pool.end()) {
+        auto pooled = it->second.lock();
+        if (pooled && *pooled == state) {
+            entry.state = std::move(pooled);
+            return entry;
+        }
+    }
+    auto shared = std::make_shared<const std::string>(std::move(state));
+    m_state_pool[entry.hash] = shared;
+    entry.state = std::move(shared);
+    return entry;
+}
+
+void PluginManager::StoreState(const std::string& instance_id, StateEntry entry) {
+    auto& current = m_plugin_state_database[instance_id];
+    if (current.state && current.hash == entry.hash && *current.state == *entry.state) return;
+    current = std::move(entry);
+    m_state_db_dirty = true;
+}
+
 std::string PluginManager::PrepareProjectState(const std::set<std::string>& active_ids) {
     std::scoped_lock lock(m_states_mutex, m_instance_ownership_mutex);
     for (auto it = m_plugin_state_database.begin(); it != m_plugin_state_database.end();) {
-        if (active_ids.find(it->first) == active_ids.end()) it = m_plugin_state_database.erase(it);
-        else ++it;
+        if (active_ids.find(it->first) == active_ids.end()) {
+            it = m_plugin_state_database.erase(it);
+            m_state_db_dirty = true;
+        } else {
+            ++it;
+        }
     }
     for (auto it = m_instance_id_to_effect_id_map.begin(); it != m_instance_id_to_effect_id_map.end();) {
         if (active_ids.find(it->first) == active_ids.end()) it = m_instance_id_to_effect_id_map.erase(it);
@@ -79,87 +112,79 @@ std::string PluginManager::PrepareProjectState(const std::set<std::string>& acti
         int64_t effect_id = ownership_it->second;
         auto host_it = m_hosts.find(effect_id);
         if (host_it == m_hosts.end()) continue;
-        if (!host_it->second) continue;
+        const auto& host = host_it->second;
+        if (!host) continue;
+
+        // 前回の保存から状態が変わっていないホストは GetState (シリアライズと圧縮) を省く。
+        // GUI が開いている間は通知のない編集 (読み込んだサンプルなど) もありうるので省かない。閉じたときにリビジョンが増える
+        const uint64_t revision = host->GetStateRevision();
+        auto& snapshot = m_state_snapshots[effect_id];
+        if (revision != 0 && !host->IsGuiVisible() && snapshot.revision == revision && snapshot.host.lock() == host && m_plugin_state_database.count(instance_id)) continue;
         try {
-            std::string live_state = host_it->second->GetState();
+            std::string live_state = host->GetState();
             if (!live_state.empty()) {
-                m_plugin_state_database[instance_id] = live_state;
+                StoreState(instance_id, InternState(std::move(live_state)));
+                snapshot.host = host;
+                snapshot.revision = revision;
             }
         } catch (...) {
             DbgPrint(std::wstring(TrText(L"インスタンスの状態の保存に失敗しました。")) + L": " + StringUtils::Utf8ToWide(instance_id), LOG_WARN);
         }
     }
 
-    std::string all_data_str;
-    for (const auto& [id, state] : m_plugin_state_database) {
-        all_data_str += id + ":" + state;
-
-        if (m_param_mappings.count(id)) {
-            all_data_str += "|";
-            const auto& mapping = m_param_mappings[id];
-            for (int32_t i = 0; i < 4; ++i) {
-                if (mapping[i] != -1) {
-                    all_data_str += std::to_string(i) + "=" + std::to_string(mapping[i]) + ",";
-                }
+    if (!m_state_db_dirty) return m_encoded_state_db;
+
+    for (auto it = m_state_pool.begin(); it != m_state_pool.end();) {
+        if (it->second.expired()) it = m_state_pool.erase(it);
+        else ++it;
+    }
+
+    m_encoded_state_db.clear();
+    if (!m_plugin_state_database.empty()) {
+        std::vector<ProjectStateDb::Record> records;
+        records.reserve(m_plugin_state_database.size());
+        for (const auto& [id, entry] : m_plugin_state_database) {
+            ProjectStateDb::Record record;
+            record.id = id;
+            record.state = entry.state;
+            record.hash = entry.hash;
+            auto mapping_it = m_param_mappings.find(id);
+            if (mapping_it != m_param_mappings.end()) {
+                record.has_mapping = true;
+                record.mapping = mapping_it->second;
             }
+            records.push_back(std::move(record));
         }
-        all_data_str += ";";
+        m_encoded_state_db = ProjectStateDb::Encode(records);
     }
-    return all_data_str;
+    m_state_db_dirty = false;
+    return m_encoded_state_db;
 }
 
 void PluginManager::LoadProjectState(const std::string& data) {
     std::lock_guard<std::mutex> lock(m_states_mutex);
     m_plugin_state_database.clear();
     m_param_mappings.clear();
+    m_state_pool.clear();
+    m_state_snapshots.clear();
+    m_state_db_dirty = true;
     if (data.empty()) return;
-    std::string_view sv(data);
-    size_t start = 0;
-    while (start < sv.length()) {
-        size_t end = sv.find(';', start);
-        if (end == std::string_view::npos) break;
-
-        std::string_view entry = sv.substr(start, end - start);
-
-        size_t pipe_pos = entry.find('|');
-
-        std::string_view id_state_part = (pipe_pos == std::string_view::npos) ? entry : entry.substr(0, pipe_pos);
-
-        size_t colon_pos = id_state_part.find(':');
-        if (colon_pos != std::string_view::npos) {
-            std::string key(id_state_part.substr(0, colon_pos));
-            std::string val(id_state_part.substr(colon_pos + 1));
-            if (IsValidStateData(val)) {
-                m_plugin_state_database[key] = val;
-
-                if (pipe_pos != std::string_view::npos) {
-                    std::string_view map_part = entry.substr(pipe_pos + 1);
-                    ParamMapping mapping = { -1, -1, -1, -1 };
-
-                    size_t map_start = 0;
-                    while (map_start < map_part.length()) {
-                        size_t map_end = map_part.find(',', map_start);
-                        if (map_end == std::string_view::npos) map_end = map_part.length();
-
-                        std::string_view kv = map_part.substr(map_start, map_end - map_start);
-                        size_t eq = kv.find('=');
-                        if (eq != std::string_view::npos) {
-                            try {
-                                int32_t idx = std::stoi(std::string(kv.substr(0, eq)));
-                                int32_t pid = std::stol(std::string(kv.substr(eq + 1)));
-                                if (idx >= 0 && idx < 4) mapping[idx] = pid;
-                            } catch (...) {}
-                        }
-                        if (map_end == map_part.length()) break;
-                        map_start = map_end + 1;
-                    }
-                    m_param_mappings[key] = mapping;
-                }
-            } else {
-                DbgPrint(std::wstring(TrText(L"破損した状態データが検出され、破棄されました。")) + L" ID: " + StringUtils::Utf8ToWide(key), LOG_WARN);
-            }
+
+    std::vector<ProjectStateDb::Record> records;
+    if (!ProjectStateDb::Decode(data, records)) {
+        DbgPrint(TrText(L"破損した状態データが検出され、破棄されました。"), LOG_WARN);
+    }
+    for (auto& record : records) {
+        if (!record.state || !IsValidStateData(*record.state)) {
+            DbgPrint(std::wstring(TrText(L"破損した状態データが検出され、破棄されました。")) + L" ID: " + StringUtils::Utf8ToWide(record.id), LOG_WARN);
+            continue;
         }
-        start = end + 1;
+        StateEntry entry;
+        entry.hash = record.hash;
+        entry.state = record.state;
+        m_state_pool.emplace(entry.hash, entry.state);
+        m_plugin_state_database[record.id] = std::move(entry);
+        if (record.has_mapping) m_param_mappings[record.id] = record.mapping;
     }
 }
 
@@ -178,8 +203,10 @@ void PluginManager::RegisterOrUpdateInstance(std::string& instance_id, int64_t e
 
         {
             std::lock_guard<std::mutex> state_lock(m_states_mutex);
-            if (m_plugin_state_database.count(old_instance_id)) {
-                m_plugin_state_database[new_instance_id] = m_plugin_state_database[old_instance_id];
+            auto state_it = m_plugin_state_database.find(old_instance_id);
+            if (state_it != m_plugin_state_database.end()) {
+                m_plugin_state_database[new_instance_id] = state_it->second;
+                m_state_db_dirty = true;
             }
         }
 
@@ -209,20 +236,35 @@ void PluginManager::SetHost(int64_t effect_id, std::shared_ptr<IAudioPluginHost>
 void PluginManager::RemoveHost(int64_t effect_id) {
     std::lock_guard<std::mutex> lock(m_states_mutex);
     m_hosts.erase(effect_id);
+    m_state_snapshots.erase(effect_id);
 }
 
 std::string PluginManager::GetSavedState(const std::string& instance_id) {
     std::lock_guard<std::mutex> lock(m_states_mutex);
     auto it = m_plugin_state_database.find(instance_id);
-    if (it != m_plugin_state_database.end()) {
-        return it->second;
+    if (it != m_plugin_state_database.end() && it->second.state) {
+        return *it->second.state;
     }
     return "";
 }
 
 void PluginManager::SaveState(const std::string& instance_id, const std::string& state) {
     std::lock_guard<std::mutex> lock(m_states_mutex);
-    m_plugin_state_database[instance_id] = state;
+    StoreState(instance_id, InternState(state));
+}
+
+void PluginManager::PublishHost(int64_t effect_id, std::shared_ptr<IAudioPluginHost> host) {
+    std::shared_ptr<IAudioPluginHost> old_host;
+    {
+        std::lock_guard<std::mutex> lock(m_states_mutex);
+        auto it = m_hosts.find(effect_id);
+        if (it != m_hosts.end()) old_host = std::move(it->second);
+        if (host) m_hosts[effect_id] = std::move(host);
+        else m_hosts.erase(effect_id);
+        m_pending_reinitialization[effect_id] = false;
+    }
+    // 古いホストの解放 (プラグインの破棄) はロックの外で行う
+    old_host.reset();
 }
 
 bool PluginManager::IsPendingReinitialization(int64_t effect_id) {
@@ -238,6 +280,29 @@ void PluginManager::SetPendingReinitialization(int64_t effect_id, bool pending)
     m_pending_reinitialization[effect_id] = pending;
 }
 
+bool PluginManager::RequestHostConfig(int64_t effect_id, const std::shared_ptr<IAudioPluginHost>& host, const HostConfig& config) {
+    if (config.AppliedTo(*host)) return true;
+    {
+        std::lock_guard<std::mutex> lock(m_states_mutex);
+        auto& pending = m_pending_host_configs[effect_id];
+        if (pending.host.lock() == host && pending.config == config) return false;
+        pending = { host, config };
+    }
+    std::weak_ptr<IAudioPluginHost> weak_host = host;
+    std::lock_guard<std::mutex> task_lock(g_task_queue_mutex);
+    g_main_thread_tasks.push_back([effect_id, weak_host, config] {
+        if (auto target = weak_host.lock()) {
+            target->SetOfflineMode(config.offline);
+            target->SetMainBusChannels(config.bus_channels);
+        }
+        PluginManager& manager = PluginManager::GetInstance();
+        std::lock_guard<std::mutex> lock(manager.m_states_mutex);
+        auto it = manager.m_pending_host_configs.find(effect_id);
+        if (it != manager.m_pending_host_configs.end() && it->second.config == config) manager.m_pending_host_configs.erase(it);
+    });
+    return false;
+}
+
 bool PluginManager::ShouldReset(int64_t effect_id, int64_t current_sample_index, int32_t current_sample_num) {
     std::lock_guard<std::mutex> lock(m_last_audio_state_mutex);
     auto it = m_last_audio_states.find(effect_id);
@@ -264,7 +329,11 @@ void PluginManager::UpdateMapping(const std::string& instance_id, int32_t slider
         m_param_mappings[instance_id] = { -1, -1, -1, -1 };
     }
     if (sliderInfoIndex >= 0 && sliderInfoIndex < 4) {
-        m_param_mappings[instance_id][sliderInfoIndex] = vstParamID;
+        int32_t& mapped = m_param_mappings[instance_id][sliderInfoIndex];
+        if (mapped != vstParamID) {
+            mapped = vstParamID;
+            m_state_db_dirty = true;
+        }
     }
 }
 
@@ -282,5 +351,6 @@ void PluginManager::ClearMapping(const std::string& instance_id) {
     std::lock_guard<std::mutex> lock(m_states_mutex);
     if (m_param_mappings.count(instance_id)) {
         m_param_mappings[instance_id] = { -1, -1, -1, -1 };
+        m_state_db_dirty = true;
     }
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 ﻿#pragma once
 #include "Eap2Common.h"
 #include "IAudioPluginHost.h"
+#include "ProjectStateDb.h"
 
 #include <array>
 #include <map>
@@ -8,9 +9,18 @@
 #include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
 
 class PluginManager {
   public:
+    // プラグインを止めて構成し直す設定。音声スレッドでは変えず、メインスレッドで反映する
+    struct HostConfig {
+        bool offline = false;
+        int32_t bus_channels = 2;
+        bool operator==(const HostConfig& other) const { return offline == other.offline && bus_channels == other.bus_channels; }
+        bool AppliedTo(const IAudioPluginHost& host) const { return host.IsOfflineMode() == offline && host.GetMainBusChannels() == bus_channels; }
+    };
+
     static PluginManager& GetInstance();
 
     void CleanupResources();
@@ -19,11 +29,15 @@ class PluginManager {
     void RegisterOrUpdateInstance(std::string& instance_id, int64_t effect_id, bool& is_copy);
     std::shared_ptr<IAudioPluginHost> GetHost(int64_t effect_id);
     void SetHost(int64_t effect_id, std::shared_ptr<IAudioPluginHost> host);
+    // ホストの差し替えと再初期化待ちの解除を 1 回のロックで行う
+    void PublishHost(int64_t effect_id, std::shared_ptr<IAudioPluginHost> host);
     void RemoveHost(int64_t effect_id);
     std::string GetSavedState(const std::string& instance_id);
     void SaveState(const std::string& instance_id, const std::string& state);
     bool IsPendingReinitialization(int64_t effect_id);
     void SetPendingReinitialization(int64_t effect_id, bool pending);
+    // 音声スレッドから呼ぶ。host の設定が config と違えば反映するタスクをメインスレッドに積み (同じ要求は積み直さない)、false を返す
+    bool RequestHostConfig(int64_t effect_id, const std::shared_ptr<IAudioPluginHost>& host, const HostConfig& config);
     bool ShouldReset(int64_t effect_id, int64_t current_sample_index, int32_t current_sample_num);
     void UpdateLastAudioState(int64_t effect_id, int64_t current_sample_index, int32_t current_sample_num);
     void UpdateMapping(const std::string& instance_id, int32_t sliderInfoIndex, int32_t vstParamID);
@@ -40,10 +54,34 @@ class PluginManager {
         int64_t sample_end;
     };
 
+    struct StateEntry {
+        std::shared_ptr<const std::string> state;
+        uint64_t hash = 0;
+    };
+    // 最後に GetState したときのホストと状態リビジョン。変わっていなければ次の保存で GetState しない
+    struct StateSnapshot {
+        std::weak_ptr<IAudioPluginHost> host;
+        uint64_t revision = 0;
+    };
+
+    // m_states_mutex を取った状態で呼ぶ。内容が同じ状態は 1 つの文字列を共有する
+    StateEntry InternState(std::string state);
+    void StoreState(const std::string& instance_id, StateEntry entry);
+
     std::mutex m_states_mutex;
     std::map<int64_t, std::shared_ptr<IAudioPluginHost>> m_hosts;
-    std::map<std::string, std::string> m_plugin_state_database;
+    std::map<std::string, StateEntry> m_plugin_state_database;
+    std::unordered_map<uint64_t, std::weak_ptr<const std::string>> m_state_pool;
+    std::map<int64_t, StateSnapshot> m_state_snapshots;
     std::map<int64_t, bool> m_pending_reinitialization;
+    struct PendingHostConfig {
+        std::weak_ptr<IAudioPluginHost> host;
+        HostConfig config;
+    };
+    std::map<int64_t, PendingHostConfig> m_pending_host_configs;
+    // 前回の保存結果。データベースが変わっていなければそのまま返す
+    bool m_state_db_dirty = true;
+    std::string m_encoded_state_db;
 
     std::mutex m_last_audio_state_mutex;
     std::map<int64_t, LastAudioState> m_last_audio_states;
@@ -51,6 +89,6 @@ class PluginManager {
     std::mutex m_instance_ownership_mutex;
     std::map<std::string, int64_t> m_instance_id_to_effect_id_map;
 
-    using ParamMapping = std::array<int32_t, 4>;
+    using ParamMapping = ProjectStateDb::ParamMapping;
     std::map<std::string, ParamMapping> m_param_mappings;
 };
\ No newline at end of file
@@ -0,0 +1,112 @@
+﻿#include "PluginModuleCache.h"
+
+#include "Eap2Common.h"
+#include "clap/all.h"
+#include "public.sdk/source/vst/hosting/module.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <utility>
+
+namespace PluginModuleCache {
+namespace {
+struct Key {
+    std::wstring path;
+    int64_t timestamp = 0;
+    bool operator<(const Key& other) const {
+        return std::tie(path, timestamp) < std::tie(other.path, other.timestamp);
+    }
+};
+
+// パスは大文字小文字を区別しないので小文字にそろえる。更新時刻を含めるので、差し替えたプラグインは別のモジュールになる
+Key MakeKey(const std::filesystem::path& path) {
+    std::error_code ec;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, ec);
+    if (ec) canonical = path;
+    Key key;
+    key.path = canonical.wstring();
+    std::transform(key.path.begin(), key.path.end(), key.path.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+    const auto time = std::filesystem::last_write_time(canonical, ec);
+    if (!ec) key.timestamp = static_cast<int64_t>(time.time_since_epoch().count());
+    return key;
+}
+
+// 解放 (ExitDll / deinit と FreeLibrary) も読み込みと同じロックで直列化する
+std::mutex& CacheMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::map<Key, std::weak_ptr<VST3::Hosting::Module>> g_vst3_modules;
+std::map<Key, std::weak_ptr<const ClapModule>> g_clap_modules;
+
+template <typename T>
+void EraseExpired(std::map<Key, std::weak_ptr<T>>& modules) {
+    for (auto it = modules.begin(); it != modules.end();) {
+        if (it->second.expired()) it = modules.erase(it);
+        else ++it;
+    }
+}
+} // namespace
+
+std::shared_ptr<VST3::Hosting::Module> AcquireVst3(const std::filesystem::path& path, std::string& error) {
+    const Key key = MakeKey(path);
+    std::lock_guard<std::mutex> lock(CacheMutex());
+    EraseExpired(g_vst3_modules);
+    auto it = g_vst3_modules.find(key);
+    if (it != g_vst3_modules.end()) {
+        if (auto module = it->second.lock()) return module;
+    }
+
+    VST3::Hosting::Module::Ptr loaded = VST3::Hosting::Module::create(path.string(), error);
+    if (!loaded) return nullptr;
+    VST3::Hosting::Module* raw = loaded.get();
+    std::shared_ptr<VST3::Hosting::Module> shared(raw, [owner = std::move(loaded)](VST3::Hosting::Module*) mutable {
+        std::lock_guard<std::mutex> lock(CacheMutex());
+        owner.reset();
+    });
+    g_vst3_modules[key] = shared;
+    DbgPrint(L"[ModuleCache] loaded VST3 module: " + key.path, LOG_VERBOSE);
+    return shared;
+}
+
+std::shared_ptr<const ClapModule> AcquireClap(const std::filesystem::path& path) {
+    const Key key = MakeKey(path);
+    std::lock_guard<std::mutex> lock(CacheMutex());
+    EraseExpired(g_clap_modules);
+    auto it = g_clap_modules.find(key);
+    if (it != g_clap_modules.end()) {
+        if (auto module = it->second.lock()) return module;
+    }
+
+    HMODULE hModule = LoadLibrary(path.wstring().c_str());
+    if (!hModule) return nullptr;
+    auto entry = reinterpret_cast<const clap_plugin_entry_t*>(GetProcAddress(hModule, "clap_plugin_entry"));
+    if (!entry) entry = reinterpret_cast<const clap_plugin_entry_t*>(GetProcAddress(hModule, "clap_entry"));
+    if (!entry || !entry->init(path.string().c_str())) {
+        FreeLibrary(hModule);
+        return nullptr;
+    }
+    auto factory = reinterpret_cast<const clap_plugin_factory_t*>(entry->get_factory(CLAP_PLUGIN_FACTORY_ID));
+    if (!factory || factory->get_plugin_count(factory) == 0) {
+        entry->deinit();
+        FreeLibrary(hModule);
+        return nullptr;
+    }
+
+    std::shared_ptr<const ClapModule> shared(new ClapModule{ hModule, entry, factory }, [](const ClapModule* module) {
+        {
+            std::lock_guard<std::mutex> lock(CacheMutex());
+            module->entry->deinit();
+            FreeLibrary(module->hModule);
+        }
+        delete module;
+    });
+    g_clap_modules[key] = shared;
+    DbgPrint(L"[ModuleCache] loaded CLAP module: " + key.path, LOG_VERBOSE);
+    return shared;
+}
+} // namespace PluginModuleCache
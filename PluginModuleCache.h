@@ -0,0 +1,27 @@
+﻿#pragma once
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <windows.h>
+
+namespace VST3::Hosting {
+class Module;
+}
+struct clap_plugin_entry;
+struct clap_plugin_factory;
+
+// VST3 / CLAP のモジュール (DLL と、その factory) をプロセス全体で共有するキャッシュ。
+// 正規化したパスと更新時刻をキーにし、同じプラグインの 2 つ目以降のインスタンスは読み込みと初期化を省く。
+// 返す shared_ptr が参照カウントになり、最後の参照が外れたときに解放する (キャッシュ自身は弱参照だけを持つ)。
+// 読み込みと解放はキャッシュのロックの下で行うので、別スレッドから同時に呼んでもよい。
+namespace PluginModuleCache {
+struct ClapModule {
+    HMODULE hModule = nullptr;
+    const clap_plugin_entry* entry = nullptr;
+    const clap_plugin_factory* factory = nullptr;
+};
+
+std::shared_ptr<VST3::Hosting::Module> AcquireVst3(const std::filesystem::path& path, std::string& error);
+// 読み込めないか、factory にプラグインが無ければ nullptr
+std::shared_ptr<const ClapModule> AcquireClap(const std::filesystem::path& path);
+} // namespace PluginModuleCache
@@ -0,0 +1,200 @@
+﻿#include "Profiler.h"
+#include "Eap2Common.h"
+#include "StringUtils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Profiler {
+std::atomic<bool> g_enabled{ false };
+
+namespace {
+    struct ThreadBuffer {
+        std::mutex mutex;
+        std::vector<Event> events;
+        size_t next = 0;
+        size_t count = 0;
+    };
+
+    // 各ツールの静的初期化より先に使われても良いよう関数内 static にする
+    std::mutex& BufferListMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    std::vector<std::shared_ptr<ThreadBuffer>>& BufferList() {
+        static std::vector<std::shared_ptr<ThreadBuffer>> list;
+        return list;
+    }
+
+    ThreadBuffer& LocalBuffer() {
+        // スレッド終了後もダンプできるよう、実体はリスト側が保持する
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer) {
+            auto created = std::make_shared<ThreadBuffer>();
+            created->events.resize(EVENTS_PER_THREAD);
+            std::lock_guard<std::mutex> lock(BufferListMutex());
+            BufferList().push_back(created);
+            buffer = created.get();
+        }
+        return *buffer;
+    }
+
+    double TicksPerSecond() {
+        static const double frequency = [] {
+            LARGE_INTEGER f;
+            QueryPerformanceFrequency(&f);
+            return static_cast<double>(f.QuadPart);
+        }();
+        return frequency;
+    }
+
+    std::vector<Event> Snapshot() {
+        std::vector<Event> out;
+        std::lock_guard<std::mutex> lock(BufferListMutex());
+        for (const auto& buffer : BufferList()) {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            const size_t begin = (buffer->next + EVENTS_PER_THREAD - buffer->count) % EVENTS_PER_THREAD;
+            for (size_t i = 0; i < buffer->count; ++i) out.push_back(buffer->events[(begin + i) % EVENTS_PER_THREAD]);
+        }
+        std::sort(out.begin(), out.end(), [](const Event& a, const Event& b) { return a.start_ticks < b.start_ticks; });
+        return out;
+    }
+
+    double Percentile(std::vector<double>& values, double p) {
+        if (values.empty()) return 0.0;
+        size_t index = static_cast<size_t>(p * static_cast<double>(values.size() - 1) + 0.5);
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+
+    std::string JsonEscape(const std::string& s) {
+        std::string out;
+        out.reserve(s.size());
+        for (char c : s) {
+            if (c == '"' || c == '\\') out.push_back('\\');
+            if (static_cast<unsigned char>(c) < 0x20) continue;
+            out.push_back(c);
+        }
+        return out;
+    }
+}
+
+void SetEnabled(bool enabled) {
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Record(const wchar_t* name, int64_t effect_id, int32_t sample_num, int32_t sample_rate, int64_t start_ticks, int64_t end_ticks) {
+    ThreadBuffer& buffer = LocalBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events[buffer.next] = Event{ name, effect_id, start_ticks, end_ticks - start_ticks, sample_num, sample_rate, GetCurrentThreadId() };
+    buffer.next = (buffer.next + 1) % EVENTS_PER_THREAD;
+    if (buffer.count < EVENTS_PER_THREAD) buffer.count++;
+}
+
+void Reset() {
+    std::lock_guard<std::mutex> lock(BufferListMutex());
+    for (const auto& buffer : BufferList()) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        buffer->next = 0;
+        buffer->count = 0;
+    }
+}
+
+std::vector<Stats> Collect() {
+    struct Accum {
+        Stats stats;
+        std::vector<double> ns_per_sample;
+        double audio_sec = 0.0;
+    };
+    const double ns_per_tick = 1e9 / TicksPerSecond();
+    std::map<std::pair<std::wstring, int64_t>, Accum> groups;
+    for (const Event& e : Snapshot()) {
+        Accum& acc = groups[{ e.name, e.effect_id }];
+        const double ns = static_cast<double>(e.duration_ticks) * ns_per_tick;
+        acc.stats.calls++;
+        acc.stats.samples += static_cast<uint64_t>((std::max)(0, e.sample_num));
+        acc.stats.total_ms += ns / 1e6;
+        if (e.sample_num > 0) acc.ns_per_sample.push_back(ns / e.sample_num);
+        if (e.sample_rate > 0) acc.audio_sec += static_cast<double>(e.sample_num) / e.sample_rate;
+    }
+
+    std::vector<Stats> out;
+    out.reserve(groups.size());
+    for (auto& [key, acc] : groups) {
+        acc.stats.name = key.first;
+        acc.stats.effect_id = key.second;
+        acc.stats.p50_ns_per_sample = Percentile(acc.ns_per_sample, 0.50);
+        acc.stats.p99_ns_per_sample = Percentile(acc.ns_per_sample, 0.99);
+        if (acc.stats.total_ms > 0.0) acc.stats.realtime_factor = acc.audio_sec / (acc.stats.total_ms / 1e3);
+        out.push_back(std::move(acc.stats));
+    }
+    std::sort(out.begin(), out.end(), [](const Stats& a, const Stats& b) { return a.total_ms > b.total_ms; });
+    return out;
+}
+
+bool WriteCsv(const std::filesystem::path& path) {
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    if (!ofs) return false;
+    ofs << "name,effect_id,calls,samples,total_ms,p50_ns_per_sample,p99_ns_per_sample,realtime_factor\n";
+    for (const Stats& s : Collect()) {
+        ofs << StringUtils::WideToUtf8(s.name.c_str()) << ',' << s.effect_id << ',' << s.calls << ',' << s.samples << ','
+            << s.total_ms << ',' << s.p50_ns_per_sample << ',' << s.p99_ns_per_sample << ',' << s.realtime_factor << '\n';
+    }
+    return static_cast<bool>(ofs);
+}
+
+bool WriteChromeTrace(const std::filesystem::path& path) {
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    if (!ofs) return false;
+    const std::vector<Event> events = Snapshot();
+    const double us_per_tick = 1e6 / TicksPerSecond();
+    const int64_t origin = events.empty() ? 0 : events.front().start_ticks;
+    const DWORD pid = GetCurrentProcessId();
+
+    ofs << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    for (const Event& e : events) {
+        if (!first) ofs << ',';
+        first = false;
+        ofs << "\n{\"name\":\"" << JsonEscape(StringUtils::WideToUtf8(e.name)) << "\",\"cat\":\"audio\",\"ph\":\"X\""
+            << ",\"ts\":" << static_cast<double>(e.start_ticks - origin) * us_per_tick
+            << ",\"dur\":" << static_cast<double>(e.duration_ticks) * us_per_tick
+            << ",\"pid\":" << pid << ",\"tid\":" << e.thread_id
+            << ",\"args\":{\"effect_id\":" << e.effect_id << ",\"sample_num\":" << e.sample_num << "}}";
+    }
+    ofs << "\n]}\n";
+    return static_cast<bool>(ofs);
+}
+
+bool Dump(const std::filesystem::path& dir) {
+    const std::vector<Stats> stats = Collect();
+    if (stats.empty()) {
+        DbgPrint(TrText(L"プロファイルの記録がありません。設定の EnableProfiler を有効にしてください。"), LOG_INFO);
+        return false;
+    }
+
+    // ログには処理時間の多い順に上位だけ出す
+    constexpr size_t max_lines = 20;
+    for (size_t i = 0; i < stats.size() && i < max_lines; ++i) {
+        const Stats& s = stats[i];
+        wchar_t line[256];
+        swprintf_s(line, L"[Profile] %ls #%lld calls=%llu total=%.2fms p50=%.1fns/sample p99=%.1fns/sample x%.1f realtime",
+                   s.name.c_str(), static_cast<long long>(s.effect_id), static_cast<unsigned long long>(s.calls),
+                   s.total_ms, s.p50_ns_per_sample, s.p99_ns_per_sample, s.realtime_factor);
+        DbgPrint(line, LOG_INFO);
+    }
+
+    const std::filesystem::path csv_path = dir / L"EAP2_profile.csv";
+    const std::filesystem::path json_path = dir / L"EAP2_profile.json";
+    const bool ok = WriteCsv(csv_path) && WriteChromeTrace(json_path);
+    if (ok) DbgPrint(L"[Profile] " + csv_path.wstring() + L", " + json_path.wstring(), LOG_INFO);
+    else DbgPrint(TrText(L"プロファイル結果の書き出しに失敗しました。"), LOG_WARN);
+    return ok;
+}
+} // namespace Profiler
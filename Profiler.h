@@ -0,0 +1,88 @@
+﻿#pragma once
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <windows.h>
+
+#include "EffectStateRegistry.h"
+
+// 音声処理の区間ごとの所要時間を記録する。無効時は Scope の生成が atomic の読み取り1回で済む。
+// 記録はスレッドごとのリングバッファに残り、Collect/Write* は直近 EVENTS_PER_THREAD 件を対象にする。
+namespace Profiler {
+    struct Event {
+        const wchar_t* name; // 文字列リテラルなど寿命の長いものに限る
+        int64_t effect_id;
+        int64_t start_ticks;
+        int64_t duration_ticks;
+        int32_t sample_num;
+        int32_t sample_rate;
+        uint32_t thread_id;
+    };
+
+    struct Stats {
+        std::wstring name;
+        int64_t effect_id = 0;
+        uint64_t calls = 0;
+        uint64_t samples = 0;
+        double total_ms = 0.0;
+        double p50_ns_per_sample = 0.0;
+        double p99_ns_per_sample = 0.0;
+        double realtime_factor = 0.0; // 音声の長さ / 処理時間 (1 未満なら実時間に間に合っていない)
+    };
+
+    constexpr size_t EVENTS_PER_THREAD = 8192;
+
+    extern std::atomic<bool> g_enabled;
+
+    inline bool IsEnabled() {
+        return g_enabled.load(std::memory_order_relaxed);
+    }
+
+    void SetEnabled(bool enabled);
+    void Record(const wchar_t* name, int64_t effect_id, int32_t sample_num, int32_t sample_rate, int64_t start_ticks, int64_t end_ticks);
+    void Reset();
+
+    // 合計処理時間の降順
+    std::vector<Stats> Collect();
+    bool WriteCsv(const std::filesystem::path& path);
+    // chrome://tracing や Perfetto で開ける Trace Event 形式
+    bool WriteChromeTrace(const std::filesystem::path& path);
+    // 集計結果をログに出し、dir に EAP2_profile.csv / EAP2_profile.json を書き出す
+    bool Dump(const std::filesystem::path& dir);
+
+    class Scope {
+      public:
+        Scope(const wchar_t* name, int64_t effect_id, int32_t sample_num, int32_t sample_rate) {
+            if (!IsEnabled()) return;
+            name_ = name;
+            effect_id_ = effect_id;
+            sample_num_ = sample_num;
+            sample_rate_ = sample_rate;
+            LARGE_INTEGER now;
+            QueryPerformanceCounter(&now);
+            start_ = now.QuadPart;
+        }
+        ~Scope() {
+            if (!name_) return;
+            LARGE_INTEGER now;
+            QueryPerformanceCounter(&now);
+            Record(name_, effect_id_, sample_num_, sample_rate_, start_, now.QuadPart);
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        const wchar_t* name_ = nullptr;
+        int64_t effect_id_ = 0;
+        int64_t start_ = 0;
+        int32_t sample_num_ = 0;
+        int32_t sample_rate_ = 0;
+    };
+}
+
+// func_proc_audio_* の先頭に置く。EffectStateRegistry の参照を守る ReadScope もここで開く
+#define EAP2_PROFILE_AUDIO(name, audio)                   \
+    EffectStateRegistryBase::ReadScope eap2_state_scope_; \
+    Profiler::Scope eap2_profile_scope_((name), (audio)->object->effect_id, (audio)->object->sample_num, (audio)->scene->sample_rate)
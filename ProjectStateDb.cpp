@@ -0,0 +1,232 @@
+﻿#include "ProjectStateDb.h"
+
+#include "StringUtils.h"
+
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+namespace ProjectStateDb {
+namespace {
+constexpr char kTextPrefix[] = "EAP2DB1:";
+constexpr char kMagic[8] = { 'E', 'A', 'P', '2', 'S', 'D', 'B', '1' };
+constexpr uint32_t kNoBlob = 0xFFFFFFFFu;
+// "VST3_DUALZ:" など、状態文字列の接頭辞として認める最大長
+constexpr size_t kMaxStatePrefix = 32;
+
+class Writer {
+  public:
+    explicit Writer(std::vector<BYTE>& out) : out_(out) {}
+    template <typename T>
+    void Put(const T& value) { Bytes(&value, sizeof(value)); }
+    void Bytes(const void* data, size_t size) {
+        const BYTE* p = static_cast<const BYTE*>(data);
+        out_.insert(out_.end(), p, p + size);
+    }
+
+  private:
+    std::vector<BYTE>& out_;
+};
+
+class Reader {
+  public:
+    Reader(const BYTE* data, size_t size) : p_(data), end_(data + size) {}
+    template <typename T>
+    bool Get(T& value) { return Bytes(&value, sizeof(value)); }
+    bool Bytes(void* out, size_t size) {
+        if (static_cast<size_t>(end_ - p_) < size) return false;
+        std::memcpy(out, p_, size);
+        p_ += size;
+        return true;
+    }
+    bool String(std::string& out, size_t size) {
+        if (static_cast<size_t>(end_ - p_) < size) return false;
+        out.assign(reinterpret_cast<const char*>(p_), size);
+        p_ += size;
+        return true;
+    }
+
+  private:
+    const BYTE* p_;
+    const BYTE* end_;
+};
+
+// "PREFIX:base64" を接頭辞と生のバイトに分ける。分けられなければ文字列全体を raw に入れ、prefix は空
+void SplitState(const std::string& state, std::string& prefix, std::vector<BYTE>& raw) {
+    prefix.clear();
+    const size_t colon = state.find(':');
+    if (colon != std::string::npos && colon < kMaxStatePrefix && colon + 1 < state.size()) {
+        raw = StringUtils::Base64Decode(state.substr(colon + 1));
+        if (!raw.empty()) {
+            prefix = state.substr(0, colon + 1);
+            return;
+        }
+    }
+    raw.assign(state.begin(), state.end());
+}
+
+// 旧形式 "id:state|0=123,1=456,;" の読み込み
+void DecodeLegacy(std::string_view sv, std::vector<Record>& records) {
+    size_t start = 0;
+    while (start < sv.length()) {
+        size_t end = sv.find(';', start);
+        if (end == std::string_view::npos) break;
+
+        std::string_view entry = sv.substr(start, end - start);
+        size_t pipe_pos = entry.find('|');
+        std::string_view id_state_part = (pipe_pos == std::string_view::npos) ? entry : entry.substr(0, pipe_pos);
+
+        size_t colon_pos = id_state_part.find(':');
+        if (colon_pos != std::string_view::npos) {
+            Record record;
+            record.id = std::string(id_state_part.substr(0, colon_pos));
+            auto state = std::make_shared<std::string>(id_state_part.substr(colon_pos + 1));
+            record.hash = Hash(*state);
+            record.state = std::move(state);
+
+            if (pipe_pos != std::string_view::npos) {
+                record.has_mapping = true;
+                std::string_view map_part = entry.substr(pipe_pos + 1);
+                size_t map_start = 0;
+                while (map_start < map_part.length()) {
+                    size_t map_end = map_part.find(',', map_start);
+                    if (map_end == std::string_view::npos) map_end = map_part.length();
+
+                    std::string_view kv = map_part.substr(map_start, map_end - map_start);
+                    size_t eq = kv.find('=');
+                    if (eq != std::string_view::npos) {
+                        try {
+                            int32_t idx = std::stoi(std::string(kv.substr(0, eq)));
+                            int32_t pid = std::stol(std::string(kv.substr(eq + 1)));
+                            if (idx >= 0 && idx < 4) record.mapping[idx] = pid;
+                        } catch (...) {}
+                    }
+                    if (map_end == map_part.length()) break;
+                    map_start = map_end + 1;
+                }
+            }
+            records.push_back(std::move(record));
+        }
+        start = end + 1;
+    }
+}
+} // namespace
+
+uint64_t Hash(const std::string& state) {
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : state) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+std::string Encode(const std::vector<Record>& records) {
+    // 同じ内容の状態は blob を 1 つにまとめる。ハッシュが一致しても中身が違えば別の blob にする
+    std::vector<const Record*> blobs;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> blobs_by_hash;
+    std::vector<uint32_t> blob_of_record(records.size(), kNoBlob);
+    for (size_t i = 0; i < records.size(); ++i) {
+        const Record& record = records[i];
+        if (!record.state) continue;
+        auto& candidates = blobs_by_hash[record.hash];
+        for (uint32_t index : candidates) {
+            const auto& other = blobs[index]->state;
+            if (other == record.state || *other == *record.state) {
+                blob_of_record[i] = index;
+                break;
+            }
+        }
+        if (blob_of_record[i] == kNoBlob) {
+            blob_of_record[i] = static_cast<uint32_t>(blobs.size());
+            candidates.push_back(blob_of_record[i]);
+            blobs.push_back(&record);
+        }
+    }
+
+    std::vector<BYTE> bin;
+    Writer w(bin);
+    w.Bytes(kMagic, sizeof(kMagic));
+    w.Put(static_cast<uint32_t>(blobs.size()));
+    w.Put(static_cast<uint32_t>(records.size()));
+
+    std::string prefix;
+    std::vector<BYTE> raw;
+    for (const Record* blob : blobs) {
+        SplitState(*blob->state, prefix, raw);
+        w.Put(blob->hash);
+        w.Put(static_cast<uint8_t>(prefix.size()));
+        w.Bytes(prefix.data(), prefix.size());
+        w.Put(static_cast<uint32_t>(raw.size()));
+        w.Bytes(raw.data(), raw.size());
+    }
+    for (size_t i = 0; i < records.size(); ++i) {
+        const Record& record = records[i];
+        w.Put(static_cast<uint16_t>(record.id.size()));
+        w.Bytes(record.id.data(), record.id.size());
+        w.Put(blob_of_record[i]);
+        w.Put(static_cast<uint8_t>(record.has_mapping ? 1 : 0));
+        if (record.has_mapping) w.Bytes(record.mapping.data(), sizeof(record.mapping));
+    }
+    return std::string(kTextPrefix) + StringUtils::Base64Encode(bin.data(), static_cast<DWORD>(bin.size()));
+}
+
+bool Decode(const std::string& text, std::vector<Record>& records) {
+    records.clear();
+    if (text.empty()) return true;
+    if (text.rfind(kTextPrefix, 0) != 0) {
+        DecodeLegacy(text, records);
+        return true;
+    }
+
+    const std::vector<BYTE> bin = StringUtils::Base64Decode(text.substr(sizeof(kTextPrefix) - 1));
+    Reader r(bin.data(), bin.size());
+    char magic[sizeof(kMagic)] = {};
+    uint32_t blob_count = 0;
+    uint32_t record_count = 0;
+    if (!r.Bytes(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) return false;
+    if (!r.Get(blob_count) || !r.Get(record_count)) return false;
+    if (blob_count > bin.size() || record_count > bin.size()) return false;
+
+    std::vector<std::shared_ptr<const std::string>> blobs;
+    std::vector<uint64_t> hashes;
+    blobs.reserve(blob_count);
+    hashes.reserve(blob_count);
+    std::string prefix;
+    std::string raw;
+    for (uint32_t i = 0; i < blob_count; ++i) {
+        uint64_t stored_hash = 0;
+        uint8_t prefix_size = 0;
+        uint32_t raw_size = 0;
+        if (!r.Get(stored_hash) || !r.Get(prefix_size) || !r.String(prefix, prefix_size)) return false;
+        if (!r.Get(raw_size) || !r.String(raw, raw_size)) return false;
+        auto state = std::make_shared<std::string>(prefix);
+        if (prefix.empty()) *state = raw;
+        else *state += StringUtils::Base64Encode(reinterpret_cast<const BYTE*>(raw.data()), static_cast<DWORD>(raw.size()));
+        // base64 を付け直した文字列で数え直す (保存時の文字列と同じなら stored_hash と一致する)
+        hashes.push_back(Hash(*state));
+        blobs.push_back(std::move(state));
+    }
+
+    records.reserve(record_count);
+    for (uint32_t i = 0; i < record_count; ++i) {
+        Record record;
+        uint16_t id_size = 0;
+        uint32_t blob_index = kNoBlob;
+        uint8_t has_mapping = 0;
+        if (!r.Get(id_size) || !r.String(record.id, id_size)) return false;
+        if (!r.Get(blob_index) || !r.Get(has_mapping)) return false;
+        if (has_mapping) {
+            if (!r.Bytes(record.mapping.data(), sizeof(record.mapping))) return false;
+            record.has_mapping = true;
+        }
+        if (blob_index != kNoBlob) {
+            if (blob_index >= blobs.size()) return false;
+            record.state = blobs[blob_index];
+            record.hash = hashes[blob_index];
+        }
+        records.push_back(std::move(record));
+    }
+    return true;
+}
+} // namespace ProjectStateDb
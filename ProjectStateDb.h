@@ -0,0 +1,30 @@
+﻿#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// プロジェクトに保存する Host フィルタの状態データベース (AudioHostStateDB) の形式。
+// インスタンスごとのレコードと、状態本体 (blob) の表を分けたバイナリで、同じ内容の状態は 1 つの blob を共有する。
+// 状態文字列 "PREFIX:base64" は base64 を外した生のバイトで持ち、読み込み時に元の文字列へ戻す。
+// プロジェクトには文字列しか書けないので、全体を "EAP2DB1:" + base64 にして渡す。
+// 先頭がこの接頭辞でなければ、以前の "id:state|map;" 形式として読む。
+namespace ProjectStateDb {
+using ParamMapping = std::array<int32_t, 4>;
+
+struct Record {
+    std::string id;
+    std::shared_ptr<const std::string> state;
+    uint64_t hash = 0;
+    bool has_mapping = false;
+    ParamMapping mapping = { -1, -1, -1, -1 };
+};
+
+// 状態文字列の内容ハッシュ (FNV-1a 64bit)。変更検出と重複排除に使う
+uint64_t Hash(const std::string& state);
+
+std::string Encode(const std::vector<Record>& records);
+// 新旧どちらの形式も読む。状態の中身の検証は呼び出し側で行う。バイナリ形式が壊れていれば false
+bool Decode(const std::string& text, std::vector<Record>& records);
+} // namespace ProjectStateDb
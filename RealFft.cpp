@@ -0,0 +1,132 @@
+﻿#include "RealFft.h"
+#include "Avx2Utils.h"
+
+#include <array>
+#include <cmath>
+#include <memory>
+#include <mutex>
+
+namespace {
+    constexpr int32_t MAX_LOG2 = 16;
+
+    int32_t Log2Of(int32_t size) {
+        int32_t bits = 0;
+        while ((1 << bits) < size) ++bits;
+        return bits;
+    }
+}
+
+const RealFft* RealFft::Get(int32_t size) {
+    if (size < MIN_SIZE || size > MAX_SIZE || (size & (size - 1)) != 0) return nullptr;
+    static std::mutex mutex;
+    static std::array<std::unique_ptr<RealFft>, MAX_LOG2 + 1> plans;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& plan = plans[Log2Of(size)];
+    if (!plan) plan.reset(new RealFft(size));
+    return plan.get();
+}
+
+RealFft::RealFft(int32_t size) : size_(size), half_(size / 2) {
+    const int32_t bits = Log2Of(half_);
+    bitrev_.resize(half_);
+    for (int32_t i = 0; i < half_; ++i) {
+        int32_t r = 0;
+        for (int32_t b = 0; b < bits; ++b) r |= ((i >> b) & 1) << (bits - 1 - b);
+        bitrev_[i] = r;
+    }
+
+    twiddle_re_.assign(half_, 1.0f);
+    twiddle_im_.assign(half_, 0.0f);
+    for (int32_t h = 1; h < half_; h <<= 1) {
+        for (int32_t j = 0; j < h; ++j) {
+            const double ang = -M_PI * j / h;
+            twiddle_re_[h + j] = static_cast<float>(std::cos(ang));
+            twiddle_im_[h + j] = static_cast<float>(std::sin(ang));
+        }
+    }
+
+    post_re_.resize(half_);
+    post_im_.resize(half_);
+    for (int32_t k = 0; k < half_; ++k) {
+        const double ang = -2.0 * M_PI * k / size_;
+        post_re_[k] = static_cast<float>(std::cos(ang));
+        post_im_[k] = static_cast<float>(std::sin(ang));
+    }
+}
+
+void RealFft::Transform(float* re, float* im) const {
+    // 回転因子が 1 と -i だけの最初の 2 段は基数 4 でまとめて行う
+    for (int32_t i = 0; i < half_; i += 4) {
+        const float b0r = re[i] + re[i + 1], b0i = im[i] + im[i + 1];
+        const float b1r = re[i] - re[i + 1], b1i = im[i] - im[i + 1];
+        const float b2r = re[i + 2] + re[i + 3], b2i = im[i + 2] + im[i + 3];
+        const float b3r = re[i + 2] - re[i + 3], b3i = im[i + 2] - im[i + 3];
+        re[i] = b0r + b2r;
+        im[i] = b0i + b2i;
+        re[i + 2] = b0r - b2r;
+        im[i + 2] = b0i - b2i;
+        re[i + 1] = b1r + b3i;
+        im[i + 1] = b1i - b3r;
+        re[i + 3] = b1r - b3i;
+        im[i + 3] = b1i + b3r;
+    }
+    for (int32_t h = 4; h < half_; h <<= 1) {
+        Avx2Utils::FftPassAVX2(re, im, half_, h, twiddle_re_.data() + h, twiddle_im_.data() + h);
+    }
+}
+
+void RealFft::Forward(const float* in, float* re, float* im, float* work) const {
+    float* zr = work;
+    float* zi = work + half_;
+    for (int32_t n = 0; n < half_; ++n) {
+        const int32_t j = bitrev_[n];
+        zr[n] = in[2 * j];
+        zi[n] = in[2 * j + 1];
+    }
+    Transform(zr, zi);
+
+    // Z[k] から偶数番目の FFT (Fe) と奇数番目の FFT (Fo) を取り出し、X[k] = Fe + W^k Fo とする
+    re[0] = zr[0] + zi[0];
+    im[0] = 0.0f;
+    re[half_] = zr[0] - zi[0];
+    im[half_] = 0.0f;
+    for (int32_t k = 1; k < half_; ++k) {
+        const int32_t m = half_ - k;
+        const float fe_r = 0.5f * (zr[k] + zr[m]);
+        const float fe_i = 0.5f * (zi[k] - zi[m]);
+        const float fo_r = 0.5f * (zi[k] + zi[m]);
+        const float fo_i = -0.5f * (zr[k] - zr[m]);
+        const float c = post_re_[k], s = post_im_[k];
+        re[k] = fe_r + c * fo_r - s * fo_i;
+        im[k] = fe_i + c * fo_i + s * fo_r;
+    }
+}
+
+void RealFft::Inverse(const float* re, const float* im, float* out, float* work) const {
+    float* zr = work;
+    float* zi = work + half_;
+    // Forward の組み直しを逆にたどり、逆変換の 1 / N もここで掛ける
+    const float scale = 1.0f / static_cast<float>(size_);
+    zr[0] = (re[0] + re[half_]) * scale;
+    zi[0] = (re[0] - re[half_]) * scale;
+    for (int32_t k = 1; k < half_; ++k) {
+        const int32_t m = half_ - k;
+        const float fe_r = re[k] + re[m];
+        const float fe_i = im[k] - im[m];
+        const float dr = re[k] - re[m];
+        const float di = im[k] + im[m];
+        const float c = post_re_[k], s = -post_im_[k];
+        const float fo_r = dr * c - di * s;
+        const float fo_i = dr * s + di * c;
+        const int32_t j = bitrev_[k];
+        zr[j] = (fe_r - fo_i) * scale;
+        zi[j] = (fe_i + fo_r) * scale;
+    }
+
+    // 実部と虚部を入れ替えて順変換すると、入れ替えた逆変換になる
+    Transform(zi, zr);
+    for (int32_t n = 0; n < half_; ++n) {
+        out[2 * n] = zr[n];
+        out[2 * n + 1] = zi[n];
+    }
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+
+// 2 の冪の長さの実数 FFT。長さ N / 2 の複素 FFT に偶数・奇数番目を詰めて計算する。
+// 回転因子とビット反転表は計画の生成時に作り、計画はサイズごとに 1 つを Get() で共有する。
+// スペクトルは実部・虚部を別の配列で持ち、0 ～ N / 2 の N / 2 + 1 ビンを扱う。
+class RealFft {
+  public:
+    static constexpr int32_t MIN_SIZE = 64;
+    static constexpr int32_t MAX_SIZE = 65536;
+
+    // 範囲外や 2 の冪でないサイズは nullptr。返した計画はプロセス終了まで有効
+    static const RealFft* Get(int32_t size);
+
+    RealFft(const RealFft&) = delete;
+    RealFft& operator=(const RealFft&) = delete;
+
+    int32_t size() const { return size_; }
+    int32_t bins() const { return half_ + 1; }
+    // Forward / Inverse に渡す作業領域の要素数
+    int32_t work_size() const { return size_; }
+
+    // in (size 個) から re / im (bins 個) を求める。正規化はしない
+    void Forward(const float* in, float* re, float* im, float* work) const;
+    // re / im (bins 個) から out (size 個) を求める。1 / size 倍するので Forward の逆になる。
+    // 実信号のスペクトルとして扱うため im[0] と im[bins - 1] は 0 とみなす
+    void Inverse(const float* re, const float* im, float* out, float* work) const;
+
+  private:
+    explicit RealFft(int32_t size);
+    // ビット反転済みの入力に対する複素 FFT (長さ half_)
+    void Transform(float* re, float* im) const;
+
+    int32_t size_;
+    int32_t half_;
+    std::vector<int32_t> bitrev_;
+    // 段ごとの回転因子。半分の長さ h の段は [h, 2h) に入る
+    std::vector<float> twiddle_re_, twiddle_im_;
+    // 実数 FFT への組み直しに使う e^(-2πik/N)
+    std::vector<float> post_re_, post_im_;
+};
@@ -0,0 +1,100 @@
+﻿#include "RenderAhead.h"
+#include "Avx2Utils.h"
+#include "DenormalGuard.h"
+
+#include <algorithm>
+
+bool RenderAhead::ShouldStart(uint64_t signature) {
+    if (running()) return false;
+    if (signature != pending_signature_) {
+        pending_signature_ = signature;
+        stable_calls_ = 0;
+        return false;
+    }
+    if (stable_calls_ < STABLE_CALLS) ++stable_calls_;
+    return stable_calls_ >= STABLE_CALLS;
+}
+
+void RenderAhead::Start(int64_t pos, int32_t ahead, uint64_t signature, RenderFunc render) {
+    Stop();
+    ahead_ = (std::max)(ahead, CHUNK);
+    for (auto& ring : ring_) {
+        ring.Reserve(static_cast<size_t>(ahead_) + CHUNK);
+        ring.Clear();
+    }
+    silence_.assign(CHUNK, 0.0f);
+    blockL_.resize(CHUNK);
+    blockR_.resize(CHUNK);
+    render_ = std::move(render);
+    consumer_pos_ = pos;
+    produced_end_ = pos;
+    signature_ = signature;
+    stop_ = false;
+    failed_ = false;
+    worker_ = std::thread([this] { Run(); });
+}
+
+bool RenderAhead::Stop() {
+    if (!worker_.joinable()) return false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+    render_ = nullptr;
+    stable_calls_ = 0;
+    return produced_end_ > consumer_pos_;
+}
+
+bool RenderAhead::Take(int64_t pos, int32_t frames, uint64_t signature, float* outL, float* outR) {
+    if (!running() || pos != consumer_pos_ || signature != signature_ || frames > ahead_) return false;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    const int64_t end = pos + frames;
+    cv_.wait(lock, [&] { return produced_end_ >= end || failed_; });
+    if (produced_end_ < end) return false;
+
+    const size_t delay = static_cast<size_t>(produced_end_ - end);
+    Avx2Utils::CopyBufferAVX2(outL, ring_[0].Read(delay, frames), frames);
+    Avx2Utils::CopyBufferAVX2(outR, ring_[1].Read(delay, frames), frames);
+    consumer_pos_ = end;
+    lock.unlock();
+    cv_.notify_all();
+    return true;
+}
+
+void RenderAhead::Run() {
+    DenormalGuard denormal_guard;
+    for (;;) {
+        int64_t pos = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || produced_end_ + CHUNK - consumer_pos_ <= ahead_; });
+            if (stop_) return;
+            pos = produced_end_;
+        }
+
+        // 処理中はロックを持たない。受け取り側は溜まっている分を先に読める
+        const bool ok = render_(pos, CHUNK, silence_.data(), blockL_.data(), blockR_.data());
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!ok) {
+                failed_ = true;
+            } else {
+                ring_[0].Write(blockL_.data(), CHUNK);
+                ring_[1].Write(blockR_.data(), CHUNK);
+                produced_end_ = pos + CHUNK;
+            }
+        }
+        cv_.notify_all();
+        if (!ok) return;
+    }
+}
+
+size_t RenderAhead::memory_usage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sizeof(*this) + ring_[0].memory_usage() + ring_[1].memory_usage() +
+           (silence_.capacity() + blockL_.capacity() + blockR_.capacity()) * sizeof(float);
+}
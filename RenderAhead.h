@@ -0,0 +1,78 @@
+﻿#pragma once
+#include "DelayLine.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Host (メディアオブジェクト) の先読み処理。
+// 入力が無音と MIDI ファイルだけのオブジェクトは、AviUtl に要求される前に続きを処理できるので、
+// ワーカースレッドが次の数ブロックを先に処理し、サンプル位置をキーにしたリングに溜めておく。
+// 音声処理側は続きの位置で設定が変わっていなければリングから受け取り、それ以外は先読みを止めて自分で処理する。
+class RenderAhead {
+  public:
+    static constexpr int32_t CHUNK = 2048;
+    // 設定がこの回数続けて変わらなかったら先読みを始める (オートメーション中に止めては始めるのを繰り返さないため)
+    static constexpr int32_t STABLE_CALLS = 4;
+
+    // pos から frames サンプルを outL / outR に処理する。入力は無音。プラグインが無くなっていれば false
+    using RenderFunc = std::function<bool(int64_t pos, int32_t frames, const float* silence, float* outL, float* outR)>;
+
+    RenderAhead() = default;
+    ~RenderAhead() { Stop(); }
+    RenderAhead(const RenderAhead&) = delete;
+    RenderAhead& operator=(const RenderAhead&) = delete;
+
+    // 止まっているときに、同じ signature が STABLE_CALLS 回続いたら true
+    bool ShouldStart(uint64_t signature);
+    // pos から ahead サンプル先まで先読みを始める
+    void Start(int64_t pos, int32_t ahead, uint64_t signature, RenderFunc render);
+    // 先読みを止めて溜めた分を捨てる。受け取られていない位置までプラグインが処理していたら true
+    bool Stop();
+    // [pos, pos + frames) を受け取る。続きの位置で signature が同じなら、ワーカーが追いつくまで待つ
+    bool Take(int64_t pos, int32_t frames, uint64_t signature, float* outL, float* outR);
+
+    bool running() const { return worker_.joinable(); }
+    size_t memory_usage() const;
+
+  private:
+    void Run();
+
+    std::thread worker_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    RenderFunc render_;
+    MirroredRingBuffer ring_[2];
+    std::vector<float> silence_;
+    std::vector<float> blockL_;
+    std::vector<float> blockR_;
+    int64_t consumer_pos_ = 0;
+    int64_t produced_end_ = 0;
+    int32_t ahead_ = 0;
+    uint64_t signature_ = 0;
+    uint64_t pending_signature_ = 0;
+    int32_t stable_calls_ = 0;
+    bool stop_ = false;
+    bool failed_ = false;
+};
+
+// 先読みの前提になる設定をまとめたハッシュ (FNV-1a)
+class RenderSignature {
+  public:
+    template <typename T>
+    RenderSignature& Add(const T& value) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(&value);
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            hash_ ^= p[i];
+            hash_ *= 1099511628211ull;
+        }
+        return *this;
+    }
+    uint64_t value() const { return hash_; }
+
+  private:
+    uint64_t hash_ = 14695981039346656037ull;
+};
@@ -0,0 +1,473 @@
+﻿#include "SandboxHost.h"
+
+#include "Avx2Utils.h"
+#include "Eap2Common.h"
+#include "Eap2Config.h"
+#include "SandboxProtocol.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <windows.h>
+
+using namespace SandboxProtocol;
+
+namespace {
+constexpr DWORD kStartTimeoutMs = 10000;
+constexpr DWORD kLoadTimeoutMs = 30000;
+constexpr DWORD kCommandTimeoutMs = 10000;
+
+std::atomic<uint32_t> g_sandbox_counter{ 0 };
+
+std::filesystem::path WorkerPath(HINSTANCE hInstance) {
+    std::wstring buffer(MAX_PATH, L'\0');
+    for (;;) {
+        DWORD len = GetModuleFileNameW(hInstance, buffer.data(), static_cast<DWORD>(buffer.size()));
+        if (len == 0) return {};
+        if (len < buffer.size()) {
+            buffer.resize(len);
+            break;
+        }
+        buffer.resize(buffer.size() * 2);
+    }
+    return std::filesystem::path(buffer).parent_path() / WORKER_EXE_NAME;
+}
+} // namespace
+
+struct SandboxHost::Impl {
+    Impl(PluginType pluginType, HINSTANCE hInst)
+        : type(pluginType), hInstance(hInst) {}
+    ~Impl() { StopWorker(true); }
+
+    PluginType type;
+    HINSTANCE hInstance;
+
+    HANDLE mapping = nullptr;
+    HANDLE workEvent = nullptr;
+    HANDLE doneEvent = nullptr;
+    HANDLE commandEvent = nullptr;
+    HANDLE replyEvent = nullptr;
+    HANDLE process = nullptr;
+    Shared* shared = nullptr;
+    std::atomic<bool> alive{ false };
+    // 子プロセスを起動した回数。起動し直すと子のリビジョンは振り出しに戻るので、上位ビットに混ぜて区別する
+    std::atomic<uint32_t> generation{ 0 };
+
+    // 制御コマンドと音声ブロックはそれぞれ呼び出し元を 1 つに絞る (リングの生産者を 1 つにするため)
+    std::mutex commandMutex;
+    std::mutex audioMutex;
+    std::mutex paramMutex;
+    // shared の張り替えと、上の 2 つを取らずに shared を読み書きする呼び出しを排他する。
+    // StopWorker が解放したビューを、音声スレッドの GetLatencySamples などが読まないようにする
+    mutable std::mutex viewMutex;
+
+    std::filesystem::path pluginPath;
+    double sampleRate = 44100.0;
+    int32_t blockSize = MAX_FRAMES;
+    std::atomic<bool> offline{ false };
+    std::atomic<int32_t> busChannels{ 2 };
+    std::vector<ParameterInfo> paramInfos;
+    std::vector<uint32_t> paramIds;
+
+    bool StartWorker();
+    void StopWorker(bool graceful);
+    void MarkDead(const wchar_t* reason);
+    template <typename Pred>
+    bool WaitFor(Pred done, HANDLE event, DWORD timeoutMs);
+    bool RunCommand(Command command, DWORD timeoutMs);
+    bool PutPayload(const void* data, size_t size);
+    void Passthrough(const float* inL, const float* inR, float* outL, float* outR, int32_t numSamples, int32_t numChannels) const;
+};
+
+bool SandboxHost::Impl::StartWorker() {
+    StopWorker(false);
+
+    const std::filesystem::path exe = WorkerPath(hInstance);
+    if (exe.empty() || !std::filesystem::exists(exe)) {
+        DbgPrint(L"[Sandbox] worker not found: " + exe.wstring(), LOG_ERROR);
+        return false;
+    }
+
+    const std::wstring base = L"EAP2Sandbox_" + std::to_wstring(GetCurrentProcessId()) + L"_" + std::to_wstring(g_sandbox_counter.fetch_add(1));
+    const uint64_t bytes = sizeof(Shared);
+    mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(bytes >> 32), static_cast<DWORD>(bytes), ObjectName(base, MAPPING_SUFFIX).c_str());
+    if (!mapping) {
+        StopWorker(false);
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(viewMutex);
+        shared = static_cast<Shared*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes));
+    }
+    workEvent = CreateEventW(nullptr, FALSE, FALSE, ObjectName(base, WORK_EVENT_SUFFIX).c_str());
+    doneEvent = CreateEventW(nullptr, FALSE, FALSE, ObjectName(base, DONE_EVENT_SUFFIX).c_str());
+    commandEvent = CreateEventW(nullptr, FALSE, FALSE, ObjectName(base, COMMAND_EVENT_SUFFIX).c_str());
+    replyEvent = CreateEventW(nullptr, FALSE, FALSE, ObjectName(base, REPLY_EVENT_SUFFIX).c_str());
+    if (!shared || !workEvent || !doneEvent || !commandEvent || !replyEvent) {
+        StopWorker(false);
+        return false;
+    }
+
+    // 新しく作ったマッピングは 0 で埋まっているので、0 以外の初期値だけ設定する
+    shared->magic = MAGIC;
+    shared->version = VERSION;
+    shared->last_touched_param.store(-1);
+    shared->tail_samples.store(IAudioPluginHost::INFINITE_TAIL);
+
+    std::wstring cmdline = L"\"" + exe.wstring() + L"\" " + base + L" " + std::to_wstring(GetCurrentProcessId()) + L" " +
+                           std::to_wstring(static_cast<int32_t>(type)) + L" " + std::to_wstring(settings.general.compress_plugin_state);
+    STARTUPINFOW si = {};
+    si.cb = sizeof(si);
+    PROCESS_INFORMATION pi = {};
+    if (!CreateProcessW(exe.c_str(), cmdline.data(), nullptr, nullptr, FALSE, 0, nullptr, exe.parent_path().c_str(), &si, &pi)) {
+        DbgPrint(L"[Sandbox] failed to start worker (error " + std::to_wstring(GetLastError()) + L")", LOG_ERROR);
+        StopWorker(false);
+        return false;
+    }
+    CloseHandle(pi.hThread);
+    process = pi.hProcess;
+    generation.fetch_add(1);
+    alive = true;
+
+    // 空のコマンドに応答が返れば準備完了
+    if (!RunCommand(Command::None, kStartTimeoutMs)) {
+        StopWorker(false);
+        return false;
+    }
+    return true;
+}
+
+void SandboxHost::Impl::StopWorker(bool graceful) {
+    if (process) {
+        if (graceful && alive) RunCommand(Command::Quit, kCommandTimeoutMs);
+        if (WaitForSingleObject(process, graceful ? kCommandTimeoutMs : 0) != WAIT_OBJECT_0) TerminateProcess(process, 1);
+        CloseHandle(process);
+        process = nullptr;
+    }
+    alive = false;
+    {
+        std::lock_guard<std::mutex> lock(viewMutex);
+        if (shared) UnmapViewOfFile(shared);
+        shared = nullptr;
+    }
+    for (HANDLE* h : { &mapping, &workEvent, &doneEvent, &commandEvent, &replyEvent }) {
+        if (*h) CloseHandle(*h);
+        *h = nullptr;
+    }
+}
+
+void SandboxHost::Impl::MarkDead(const wchar_t* reason) {
+    if (!alive.exchange(false)) return;
+    if (process) TerminateProcess(process, 1);
+    DbgPrint(L"[Sandbox] plugin worker " + std::wstring(reason) + L": " + pluginPath.wstring(), LOG_ERROR);
+}
+
+template <typename Pred>
+bool SandboxHost::Impl::WaitFor(Pred done, HANDLE event, DWORD timeoutMs) {
+    const ULONGLONG deadline = GetTickCount64() + timeoutMs;
+    while (!done()) {
+        if (!alive) return false;
+        const ULONGLONG now = GetTickCount64();
+        if (now >= deadline) {
+            MarkDead(L"timed out");
+            return false;
+        }
+        HANDLE waits[2] = { event, process };
+        const DWORD r = WaitForMultipleObjects(2, waits, FALSE, static_cast<DWORD>(deadline - now));
+        if (r == WAIT_OBJECT_0 + 1 || r == WAIT_FAILED) {
+            MarkDead(L"exited");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SandboxHost::Impl::RunCommand(Command command, DWORD timeoutMs) {
+    if (!alive || !shared) return false;
+    shared->command = command;
+    const uint32_t seq = shared->command_seq.load(std::memory_order_relaxed) + 1;
+    shared->command_seq.store(seq, std::memory_order_release);
+    SetEvent(commandEvent);
+    return WaitFor([&] { return shared->command_done.load(std::memory_order_acquire) == seq; }, replyEvent, timeoutMs);
+}
+
+bool SandboxHost::Impl::PutPayload(const void* data, size_t size) {
+    if (size > PAYLOAD_BYTES) return false;
+    if (size > 0) memcpy(shared->payload, data, size);
+    shared->payload_size = static_cast<uint32_t>(size);
+    return true;
+}
+
+void SandboxHost::Impl::Passthrough(const float* inL, const float* inR, float* outL, float* outR, int32_t numSamples, int32_t numChannels) const {
+    if (outL != inL) Avx2Utils::CopyBufferAVX2(outL, inL, numSamples);
+    if (numChannels > 1 && outR != inR) Avx2Utils::CopyBufferAVX2(outR, inR, numSamples);
+}
+
+SandboxHost::SandboxHost(PluginType type, HINSTANCE hInstance)
+    : m_impl(std::make_unique<Impl>(type, hInstance)) {}
+SandboxHost::~SandboxHost() = default;
+
+bool SandboxHost::LoadPlugin(const std::filesystem::path& path, double sampleRate, int32_t blockSize) {
+    Impl& d = *m_impl;
+    std::scoped_lock lock(d.commandMutex, d.audioMutex);
+    d.pluginPath = path;
+    d.paramInfos.clear();
+    d.paramIds.clear();
+    if (!d.StartWorker()) return false;
+
+    const std::wstring wpath = path.wstring();
+    if (!d.PutPayload(wpath.c_str(), (wpath.size() + 1) * sizeof(wchar_t))) return false;
+    d.shared->arg_double = sampleRate;
+    d.shared->arg_int[0] = (std::min)(blockSize, MAX_FRAMES);
+    if (!d.RunCommand(Command::Load, kLoadTimeoutMs) || d.shared->status == 0) {
+        d.StopWorker(false);
+        return false;
+    }
+
+    LoadReply reply = {};
+    memcpy(&reply, d.shared->payload, sizeof(reply));
+    const int32_t count = std::clamp(reply.param_count, 0, static_cast<int32_t>(MAX_PARAMS));
+    const uint8_t* p = d.shared->payload + sizeof(reply);
+    d.paramInfos.resize(count);
+    d.paramIds.resize(count);
+    if (count > 0) {
+        memcpy(d.paramInfos.data(), p, sizeof(ParameterInfo) * count);
+        memcpy(d.paramIds.data(), p + sizeof(ParameterInfo) * count, sizeof(uint32_t) * count);
+    }
+    // 文字列は終端されている保証がないので閉じておく
+    for (auto& info : d.paramInfos) {
+        info.name[sizeof(info.name) - 1] = '\0';
+        info.unit[sizeof(info.unit) - 1] = '\0';
+    }
+    d.sampleRate = sampleRate;
+    d.blockSize = blockSize;
+    if (d.offline.load()) {
+        d.shared->arg_int[0] = 1;
+        d.RunCommand(Command::SetOfflineMode, kCommandTimeoutMs);
+    }
+    if (d.busChannels.load() != 2) {
+        d.shared->arg_int[0] = d.busChannels.load();
+        d.RunCommand(Command::SetMainBusChannels, kCommandTimeoutMs);
+    }
+    return true;
+}
+
+void SandboxHost::ProcessAudio(const float* inL, const float* inR, float* outL, float* outR, int32_t numSamples, int32_t numChannels, int64_t currentSampleIndex, double bpm, int32_t tsNum, int32_t tsDenom, const std::vector<MidiEvent>& midiEvents) {
+    Impl& d = *m_impl;
+    std::lock_guard<std::mutex> lock(d.audioMutex);
+    if (!d.alive || numSamples <= 0) {
+        d.Passthrough(inL, inR, outL, outR, numSamples, numChannels);
+        return;
+    }
+
+    const int32_t channels = std::clamp(numChannels, 1, 2);
+    const DWORD timeout = static_cast<DWORD>((std::max)(1, settings.vst.sandbox_timeout_ms));
+    Shared& s = *d.shared;
+
+    // MAX_FRAMES ごとに区切り、空いているスロットの数までまとめて積んでから完了を待つ。
+    // 書き戻しに使う長さは共有メモリから読み戻さず、積んだときの値を手元に持っておく
+    int32_t pos = 0;
+    int32_t frames[BLOCK_SLOTS] = {};
+    while (pos < numSamples) {
+        const uint32_t first = s.submitted.load(std::memory_order_relaxed);
+        uint32_t seq = first;
+        int32_t batchEnd = pos;
+        while (batchEnd < numSamples && seq - first < BLOCK_SLOTS) {
+            const int32_t n = (std::min)(MAX_FRAMES, numSamples - batchEnd);
+            frames[seq - first] = n;
+            AudioBlock& block = s.blocks[seq % BLOCK_SLOTS];
+            block.num_samples = n;
+            block.num_channels = channels;
+            block.sample_index = currentSampleIndex + batchEnd;
+            block.bpm = bpm;
+            block.ts_num = tsNum;
+            block.ts_denom = tsDenom;
+            block.processed = 0;
+            memcpy(block.in[0], inL + batchEnd, sizeof(float) * n);
+            memcpy(block.in[1], (channels > 1 ? inR : inL) + batchEnd, sizeof(float) * n);
+            uint32_t midiCount = 0;
+            for (const auto& me : midiEvents) {
+                if (me.deltaFrames < batchEnd || me.deltaFrames >= batchEnd + n) continue;
+                if (midiCount >= MAX_MIDI_EVENTS) break;
+                block.midi[midiCount] = me;
+                block.midi[midiCount].deltaFrames -= batchEnd;
+                ++midiCount;
+            }
+            block.midi_count = midiCount;
+            ++seq;
+            s.submitted.store(seq, std::memory_order_release);
+            batchEnd += n;
+        }
+        SetEvent(d.workEvent);
+
+        if (!d.WaitFor([&] { return s.completed.load(std::memory_order_acquire) == seq; }, d.doneEvent, timeout)) {
+            d.Passthrough(inL + pos, inR ? inR + pos : nullptr, outL + pos, outR ? outR + pos : nullptr, numSamples - pos, numChannels);
+            return;
+        }
+        for (uint32_t i = first; i != seq; ++i) {
+            const AudioBlock& block = s.blocks[i % BLOCK_SLOTS];
+            const int32_t n = frames[i - first];
+            memcpy(outL + pos, block.out[0], sizeof(float) * n);
+            if (numChannels > 1) memcpy(outR + pos, block.out[1], sizeof(float) * n);
+            pos += n;
+        }
+    }
+}
+
+void SandboxHost::Reset(int64_t currentSampleIndex, double bpm, int32_t timeSigNum, int32_t timeSigDenom) {
+    Impl& d = *m_impl;
+    std::scoped_lock lock(d.commandMutex, d.audioMutex);
+    if (!d.alive) return;
+    d.shared->arg_int64 = currentSampleIndex;
+    d.shared->arg_double = bpm;
+    d.shared->arg_int[0] = timeSigNum;
+    d.shared->arg_int[1] = timeSigDenom;
+    d.RunCommand(Command::Reset, kCommandTimeoutMs);
+}
+
+void SandboxHost::ShowGui() {
+    Impl& d = *m_impl;
+    std::lock_guard<std::mutex> lock(d.commandMutex);
+    d.RunCommand(Command::ShowGui, kCommandTimeoutMs);
+}
+
+void SandboxHost::HideGui() {
+    Impl& d = *m_impl;
+    std::lock_guard<std::mutex> lock(d.commandMutex);
+    d.RunCommand(Command::HideGui, kCommandTimeoutMs);
+}
+
+std::string SandboxHost::GetState() {
+    Impl& d = *m_impl;
+    std::lock_guard<std::mutex> lock(d.commandMutex);
+    if (!d.RunCommand(Command::GetState, kCommandTimeoutMs) || d.shared->status == 0) return "";
+    const uint32_t size = (std::min)(d.shared->payload_size, PAYLOAD_BYTES);
+    return std::string(reinterpret_cast<const char*>(d.shared->payload), size);
+}
+
+bool SandboxHost::SetState(const std::string& state_b64) {
+    Impl& d = *m_impl;
+    std::lock_guard<std::mutex> lock(d.commandMutex);
+    if (!d.alive) return false;
+    if (!d.PutPayload(state_b64.data(), state_b64.size())) {
+        DbgPrint(L"[Sandbox] plugin state too large for worker payload", LOG_WARN);
+        return false;
+    }
+    return d.RunCommand(Command::SetState, kLoadTimeoutMs) && d.shared->status != 0;
+}
+
+void SandboxHost::Cleanup() {
+    Impl& d = *m_impl;
+    std::scoped_lock lock(d.commandMutex, d.audioMutex);
+    d.StopWorker(true);
+    d.pluginPath.clear();
+    d.paramInfos.clear();
+    d.paramIds.clear();
+}
+
+bool SandboxHost::IsGuiVisible() const {
+    const Impl& d = *m_impl;
+    std::lock_guard<std::mutex> lock(d.viewMutex);
+    return d.alive && d.shared && d.shared->gui_visible.load(std::memory_order_relaxed) != 0;
+}
+
+std::filesystem::path SandboxHost::GetPluginPath() const {
+    return m_impl->pluginPath;
+}
+
+void SandboxHost::SetParameter(uint32_t paramId, float value) {
+    Impl& d = *m_impl;
+    std::scoped_lock lock(d.paramMutex, d.viewMutex);
+    if (!d.alive || !d.shared) return;
+    d.shared->params.TryPush({ paramId, value });
+}
+
+int32_t SandboxHost::GetLastTouchedParamID() {
+    Impl& d = *m_impl;
+    std::lock_guard<std::mutex> lock(d.viewMutex);
+    if (!d.alive || !d.shared) return -1;
+    return (std::max)(d.shared->last_touched_param.exchange(-1), -1);
+}
+
+void SandboxHost::SetSampleRate(double sampleRate) {
+    Impl& d = *m_impl;
+    std::scoped_lock lock(d.commandMutex, d.audioMutex);
+    if (std::abs(d.sampleRate - sampleRate) < 0.1) return;
+    d.sampleRate = sampleRate;
+    if (!d.alive) return;
+    d.shared->arg_double = sampleRate;
+    d.RunCommand(Command::SetSampleRate, kCommandTimeoutMs);
+}
+
+double SandboxHost::GetSampleRate() const {
+    return m_impl->sampleRate;
+}
+
+void SandboxHost::SetOfflineMode(bool offline) {
+    Impl& d = *m_impl;
+    std::scoped_lock lock(d.commandMutex, d.audioMutex);
+    if (d.offline.exchange(offline) == offline) return;
+    if (!d.alive) return;
+    d.shared->arg_int[0] = offline ? 1 : 0;
+    d.RunCommand(Command::SetOfflineMode, kCommandTimeoutMs);
+}
+
+bool SandboxHost::IsOfflineMode() const {
+    return m_impl->offline.load();
+}
+
+void SandboxHost::SetMainBusChannels(int32_t channels) {
+    Impl& d = *m_impl;
+    std::scoped_lock lock(d.commandMutex, d.audioMutex);
+    if (d.busChannels.exchange(channels) == channels) return;
+    if (!d.alive) return;
+    d.shared->arg_int[0] = channels;
+    d.RunCommand(Command::SetMainBusChannels, kCommandTimeoutMs);
+}
+
+int32_t SandboxHost::GetMainBusChannels() const {
+    return m_impl->busChannels.load();
+}
+
+int32_t SandboxHost::GetLatencySamples() {
+    Impl& d = *m_impl;
+    std::lock_guard<std::mutex> lock(d.viewMutex);
+    if (!d.alive || !d.shared) return 0;
+    return std::clamp(d.shared->latency_samples.load(std::memory_order_relaxed), 0, MAX_LATENCY_SAMPLES);
+}
+
+int32_t SandboxHost::GetTailSamples() {
+    Impl& d = *m_impl;
+    std::lock_guard<std::mutex> lock(d.viewMutex);
+    if (!d.alive || !d.shared) return INFINITE_TAIL;
+    return (std::max)(d.shared->tail_samples.load(std::memory_order_relaxed), 0);
+}
+
+// 子プロセスの GUI で変えた状態もここに反映される。子プロセスが止まっていれば追跡できないので 0 を返す
+uint64_t SandboxHost::GetStateRevision() {
+    Impl& d = *m_impl;
+    std::lock_guard<std::mutex> lock(d.viewMutex);
+    if (!d.alive || !d.shared) return 0;
+    const uint64_t revision = d.shared->state_revision.load(std::memory_order_relaxed);
+    if (revision == 0) return 0;
+    return (static_cast<uint64_t>(d.generation.load()) << 40) | (revision & ((uint64_t{ 1 } << 40) - 1));
+}
+
+int32_t SandboxHost::GetParameterCount() {
+    return static_cast<int32_t>(m_impl->paramInfos.size());
+}
+
+bool SandboxHost::GetParameterInfo(int32_t index, ParameterInfo& info) {
+    if (index < 0 || index >= static_cast<int32_t>(m_impl->paramInfos.size())) return false;
+    info = m_impl->paramInfos[index];
+    return true;
+}
+
+uint32_t SandboxHost::GetParameterID(int32_t index) {
+    if (index < 0 || index >= static_cast<int32_t>(m_impl->paramIds.size())) return 0;
+    return m_impl->paramIds[index];
+}
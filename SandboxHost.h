@@ -0,0 +1,47 @@
+﻿#pragma once
+#include "IAudioPluginHost.h"
+#include "PluginType.h"
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <windows.h>
+
+// VST3 / CLAP プラグインを子プロセス (EAP2PluginWorker.exe) に読み込ませて操作するホスト。
+// 子プロセスが落ちたり応答しなくなったりしても本体は巻き込まれず、以後は入力をそのまま出力する。
+// 次の LoadPlugin で子プロセスを起動し直す。
+class SandboxHost : public IAudioPluginHost {
+  public:
+    SandboxHost(PluginType type, HINSTANCE hInstance);
+    ~SandboxHost() override;
+    bool LoadPlugin(const std::filesystem::path& path, double sampleRate, int32_t blockSize) override;
+    void ProcessAudio(const float* inL, const float* inR, float* outL, float* outR, int32_t numSamples, int32_t numChannels, int64_t currentSampleIndex, double bpm, int32_t tsNum, int32_t tsDenom, const std::vector<MidiEvent>& midiEvents) override;
+    void Reset(int64_t currentSampleIndex, double bpm, int32_t timeSigNum, int32_t timeSigDenom) override;
+    void ShowGui() override;
+    void HideGui() override;
+    std::string GetState() override;
+    bool SetState(const std::string& state_b64) override;
+    void Cleanup() override;
+    bool IsGuiVisible() const override;
+    std::filesystem::path GetPluginPath() const override;
+    void SetParameter(uint32_t paramId, float value) override;
+    int32_t GetLastTouchedParamID() override;
+    void SetSampleRate(double sampleRate) override;
+    double GetSampleRate() const override;
+    void SetOfflineMode(bool offline) override;
+    bool IsOfflineMode() const override;
+    void SetMainBusChannels(int32_t channels) override;
+    int32_t GetMainBusChannels() const override;
+    int32_t GetLatencySamples() override;
+    int32_t GetTailSamples() override;
+    uint64_t GetStateRevision() override;
+    int32_t GetParameterCount() override;
+    bool GetParameterInfo(int32_t index, ParameterInfo& info) override;
+    uint32_t GetParameterID(int32_t index) override;
+    // プラグインは子プロセスのメインスレッドで読み込まれるので、呼び出し側のスレッドは問わない
+    bool CanLoadOffMainThread() const override { return true; }
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
@@ -0,0 +1,144 @@
+﻿#pragma once
+#include "IAudioPluginHost.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// プラグインを子プロセス (EAP2PluginWorker.exe) で動かすときの共有メモリの配置と名前付け。
+// ホスト (SandboxHost) と子プロセスの両方がこのヘッダを使うので、共有する型は固定長でポインタを持たない。
+// 同期は名前付きイベントで行い、データの受け渡し自体はロックを取らない。
+namespace SandboxProtocol {
+constexpr uint32_t MAGIC = 0x53504145; // "EAPS"
+constexpr uint32_t VERSION = 5;
+
+// FilterHost の MAX_BLOCK_SIZE と揃える。長いブロックは SandboxHost が分割して積む
+constexpr int32_t MAX_FRAMES = 2048;
+constexpr uint32_t MAX_MIDI_EVENTS = 512;
+constexpr uint32_t BLOCK_SLOTS = 4;
+constexpr uint32_t PARAM_SLOTS = 256;
+// GetState / SetState / パラメータ一覧の受け渡し領域。これを超える状態は子プロセス経由では保存できない
+constexpr uint32_t PAYLOAD_BYTES = 16u << 20;
+constexpr uint32_t MAX_PARAMS = PAYLOAD_BYTES / sizeof(IAudioPluginHost::ParameterInfo) / 2;
+
+// 共有メモリ上の atomic はプロセスをまたいで使うため、ロックフリーでなければならない
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "sandbox rings need lock-free 32-bit atomics");
+static_assert(std::atomic<int32_t>::is_always_lock_free, "sandbox rings need lock-free 32-bit atomics");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "sandbox status needs lock-free 64-bit atomics");
+
+// 子プロセスが報告するレイテンシの上限 (192kHz で約 10 秒)。
+// 共有メモリは子プロセスが壊しうるので、ホストは読み戻した値をこの範囲に丸めてから使う
+constexpr int32_t MAX_LATENCY_SAMPLES = 1 << 21;
+
+// 子プロセスが何もしていない間も状態を書き戻す間隔
+constexpr uint32_t STATUS_INTERVAL_MS = 100;
+
+enum class Command : uint32_t {
+    None,
+    Load,
+    Reset,
+    ShowGui,
+    HideGui,
+    GetState,
+    SetState,
+    SetSampleRate,
+    SetOfflineMode,
+    SetMainBusChannels,
+    Quit,
+};
+
+// 1 ブロック分の入出力。子プロセスは in を読んで out に書き、completed を進める
+struct AudioBlock {
+    int32_t num_samples;
+    int32_t num_channels;
+    int64_t sample_index;
+    double bpm;
+    int32_t ts_num;
+    int32_t ts_denom;
+    uint32_t midi_count;
+    int32_t processed;
+    IAudioPluginHost::MidiEvent midi[MAX_MIDI_EVENTS];
+    float in[2][MAX_FRAMES];
+    float out[2][MAX_FRAMES];
+};
+
+struct ParamChange {
+    uint32_t id;
+    float value;
+};
+
+// 単一生産者・単一消費者のリング。添字は単調に増やし、容量での余りを位置にする
+template <typename T, uint32_t N>
+struct SpscRing {
+    static_assert((N & (N - 1)) == 0, "ring capacity must be a power of two");
+    std::atomic<uint32_t> head; // 生産者だけが書く
+    std::atomic<uint32_t> tail; // 消費者だけが書く
+    T items[N];
+
+    bool TryPush(const T& item) {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= N) return false;
+        items[h % N] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& item) {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        item = items[t % N];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+struct Shared {
+    uint32_t magic;
+    uint32_t version;
+
+    // 音声ブロックのリング。ホストが blocks[submitted % BLOCK_SLOTS] を埋めて submitted を進め、
+    // 子プロセスが処理して completed を進める。completed に追いつくまでホストはスロットを再利用しない
+    std::atomic<uint32_t> submitted;
+    std::atomic<uint32_t> completed;
+    AudioBlock blocks[BLOCK_SLOTS];
+
+    // ホストから子への SetParameter。次のブロックの処理前に取り出す
+    SpscRing<ParamChange, PARAM_SLOTS> params;
+
+    // 子から毎ブロック書き戻す値
+    std::atomic<int32_t> last_touched_param;
+    std::atomic<int32_t> gui_visible;
+    std::atomic<int32_t> latency_samples;
+    std::atomic<int32_t> tail_samples;
+    // プラグインの GetStateRevision。0 は追跡していないことを表す
+    std::atomic<uint64_t> state_revision;
+
+    // 制御コマンドは 1 度に 1 つ。ホストが command_seq を進め、子は完了後に command_done を同じ値にする
+    std::atomic<uint32_t> command_seq;
+    std::atomic<uint32_t> command_done;
+    Command command;
+    int32_t arg_int[2];
+    int64_t arg_int64;
+    double arg_double;
+    int32_t status;
+    uint32_t payload_size;
+    uint8_t payload[PAYLOAD_BYTES];
+};
+
+// Load の応答で payload の先頭に置く。続けて ParameterInfo と ID が param_count 個ずつ並ぶ
+struct LoadReply {
+    int32_t param_count;
+    int32_t latency_samples;
+};
+
+inline std::wstring ObjectName(const std::wstring& base, const wchar_t* suffix) {
+    return L"Local\\" + base + L"_" + suffix;
+}
+
+constexpr wchar_t MAPPING_SUFFIX[] = L"map";
+constexpr wchar_t WORK_EVENT_SUFFIX[] = L"work";
+constexpr wchar_t DONE_EVENT_SUFFIX[] = L"done";
+constexpr wchar_t COMMAND_EVENT_SUFFIX[] = L"cmd";
+constexpr wchar_t REPLY_EVENT_SUFFIX[] = L"reply";
+constexpr wchar_t WORKER_EXE_NAME[] = L"EAP2PluginWorker.exe";
+} // namespace SandboxProtocol
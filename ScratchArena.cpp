@@ -0,0 +1,64 @@
+﻿#include "ScratchArena.h"
+
+#include <algorithm>
+#include <new>
+
+namespace {
+    constexpr size_t RoundUp(size_t bytes, size_t unit) {
+        return (bytes + unit - 1) / unit * unit;
+    }
+
+    void* AlignedNew(size_t bytes) {
+        return ::operator new(bytes, std::align_val_t(ScratchArena::ALIGNMENT));
+    }
+
+    void AlignedDelete(void* p) {
+        ::operator delete(p, std::align_val_t(ScratchArena::ALIGNMENT));
+    }
+}
+
+ScratchArena::~ScratchArena() {
+    for (void* p : overflow_) AlignedDelete(p);
+    if (base_) AlignedDelete(base_);
+}
+
+ScratchArena& ScratchArena::Local() {
+    thread_local ScratchArena arena;
+    return arena;
+}
+
+void* ScratchArena::Allocate(size_t bytes) {
+    bytes = RoundUp((std::max)(bytes, size_t{ 1 }), ALIGNMENT);
+    void* p = nullptr;
+    if (capacity_ - offset_ >= bytes) {
+        p = base_ + offset_;
+        offset_ += bytes;
+    } else {
+        // 足りない分は一時的に別確保し、最外のスコープを抜けたときに本体へまとめる
+        p = AlignedNew(bytes);
+        overflow_.push_back(p);
+        overflow_sizes_.push_back(bytes);
+        overflow_bytes_ += bytes;
+    }
+    high_water_ = (std::max)(high_water_, offset_ + overflow_bytes_);
+    return p;
+}
+
+void ScratchArena::Release(const Marker& marker) {
+    while (overflow_.size() > marker.overflow_count) {
+        AlignedDelete(overflow_.back());
+        overflow_bytes_ -= overflow_sizes_.back();
+        overflow_.pop_back();
+        overflow_sizes_.pop_back();
+    }
+    offset_ = marker.offset;
+    if (depth_ == 0 && offset_ == 0 && high_water_ > capacity_) Rebuild(high_water_);
+}
+
+void ScratchArena::Rebuild(size_t bytes) {
+    // 少しずつ伸びるブロック長で毎回作り直さないよう 64KB 単位で確保する
+    const size_t new_capacity = RoundUp(bytes, 64 * 1024);
+    if (base_) AlignedDelete(base_);
+    base_ = static_cast<uint8_t*>(AlignedNew(new_capacity));
+    capacity_ = new_capacity;
+}
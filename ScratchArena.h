@@ -0,0 +1,85 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 音声スレッドごとの作業領域。各ツールの一時バッファをここから切り出し、コールバック終了時にまとめて返す。
+// 容量が足りない間だけ追加の領域を確保し、最外の ScratchScope を抜けた時点で最大使用量に合わせて作り直す。
+// 同じブロック長が続く限り、2回目以降の呼び出しではヒープ確保が起きない。
+class ScratchArena {
+  public:
+    static constexpr size_t ALIGNMENT = 64;
+
+    struct Marker {
+        size_t offset;
+        size_t overflow_count;
+    };
+
+    ScratchArena() = default;
+    ~ScratchArena();
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    static ScratchArena& Local();
+
+    // 未初期化の領域を返す。bytes が 0 でも有効なアドレスを返す
+    void* Allocate(size_t bytes);
+    Marker Mark() const { return { offset_, overflow_.size() }; }
+    void Release(const Marker& marker);
+
+    size_t capacity() const { return capacity_; }
+    size_t high_water() const { return high_water_; }
+
+  private:
+    void Rebuild(size_t bytes);
+
+    uint8_t* base_ = nullptr;
+    size_t capacity_ = 0;
+    size_t offset_ = 0;
+    size_t overflow_bytes_ = 0;
+    size_t high_water_ = 0;
+    std::vector<void*> overflow_;
+    std::vector<size_t> overflow_sizes_;
+    int32_t depth_ = 0;
+
+    friend class ScratchScope;
+};
+
+template <typename T>
+class ScratchSpan {
+  public:
+    ScratchSpan() = default;
+    ScratchSpan(T* data, size_t size) : data_(data), size_(size) {}
+
+    T* data() const { return data_; }
+    size_t size() const { return size_; }
+    T& operator[](size_t i) const { return data_[i]; }
+    T* begin() const { return data_; }
+    T* end() const { return data_ + size_; }
+
+  private:
+    T* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// 生成時点の位置を覚え、破棄時にそこまで巻き戻す。入れ子にしてよい
+class ScratchScope {
+  public:
+    ScratchScope() : arena_(ScratchArena::Local()), marker_(arena_.Mark()) { arena_.depth_++; }
+    ~ScratchScope() {
+        arena_.depth_--;
+        arena_.Release(marker_);
+    }
+    ScratchScope(const ScratchScope&) = delete;
+    ScratchScope& operator=(const ScratchScope&) = delete;
+
+    // 中身は不定。必要なら呼び出し側で初期化する
+    template <typename T = float>
+    ScratchSpan<T> Alloc(size_t count) {
+        return ScratchSpan<T>(static_cast<T*>(arena_.Allocate(count * sizeof(T))), count);
+    }
+
+  private:
+    ScratchArena& arena_;
+    ScratchArena::Marker marker_;
+};
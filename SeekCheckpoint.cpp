@@ -0,0 +1,119 @@
+﻿#include "SeekCheckpoint.h"
+#include "Avx2Utils.h"
+#include "EffectStateRegistry.h"
+
+#include <algorithm>
+
+void SeekCheckpoints::Validate(uint64_t signature) {
+    if (signature == signature_) return;
+    Clear();
+    signature_ = signature;
+}
+
+void SeekCheckpoints::Clear() {
+    checkpoints_.clear();
+    recording_ = false;
+}
+
+void SeekCheckpoints::Record(int64_t pos, int32_t count, const float* inL, const float* inR, bool record_input, int64_t interval, const LatencyCompensator* compensator) {
+    if (count <= 0 || interval <= 0) return;
+
+    auto it = recording_ ? checkpoints_.find(recording_start_) : checkpoints_.end();
+    const bool continues = it != checkpoints_.end() && it->second.end == pos;
+    if (!continues || pos - it->second.start >= interval) {
+        Checkpoint& checkpoint = checkpoints_[pos];
+        checkpoint.start = pos;
+        checkpoint.end = pos;
+        checkpoint.inputL.clear();
+        checkpoint.inputR.clear();
+        if (record_input) {
+            checkpoint.inputL.reserve(static_cast<size_t>(interval) + count);
+            checkpoint.inputR.reserve(static_cast<size_t>(interval) + count);
+        }
+        checkpoint.compensator = compensator ? std::make_unique<LatencyCompensator>(*compensator) : nullptr;
+        checkpoint.sequence = ++sequence_;
+        recording_ = true;
+        recording_start_ = pos;
+        it = checkpoints_.find(pos);
+    }
+
+    Checkpoint& current = it->second;
+    if (record_input) {
+        current.inputL.insert(current.inputL.end(), inL, inL + count);
+        current.inputR.insert(current.inputR.end(), inR, inR + count);
+    }
+    current.end += count;
+    Trim(current, record_input);
+    while (checkpoints_.size() > MAX_CHECKPOINTS) EvictOldest();
+}
+
+// 記録中の範囲と重なる古い記録を削る
+void SeekCheckpoints::Trim(const Checkpoint& current, bool record_input) {
+    auto next = checkpoints_.upper_bound(current.start);
+    while (next != checkpoints_.end() && next->first < current.end) next = checkpoints_.erase(next);
+
+    auto it = checkpoints_.find(current.start);
+    if (it == checkpoints_.begin()) return;
+    Checkpoint& previous = std::prev(it)->second;
+    if (previous.end <= current.start) return;
+    previous.end = current.start;
+    if (record_input) {
+        previous.inputL.resize(static_cast<size_t>(previous.end - previous.start));
+        previous.inputR.resize(static_cast<size_t>(previous.end - previous.start));
+    }
+}
+
+void SeekCheckpoints::EvictOldest() {
+    auto oldest = checkpoints_.end();
+    for (auto it = checkpoints_.begin(); it != checkpoints_.end(); ++it) {
+        if (recording_ && it->first == recording_start_) continue;
+        if (oldest == checkpoints_.end() || it->second.sequence < oldest->second.sequence) oldest = it;
+    }
+    if (oldest != checkpoints_.end()) checkpoints_.erase(oldest);
+}
+
+const SeekCheckpoints::Checkpoint* SeekCheckpoints::FindRestorePoint(int64_t pos, int64_t min_preroll) const {
+    auto it = checkpoints_.upper_bound(pos);
+    if (it == checkpoints_.begin()) return nullptr;
+    --it;
+    if (it->second.end < pos) return nullptr;
+
+    while (it->second.start > pos - min_preroll && it != checkpoints_.begin()) {
+        auto previous = std::prev(it);
+        if (previous->second.end != it->second.start) break;
+        it = previous;
+    }
+    return &it->second;
+}
+
+void SeekCheckpoints::CopyInput(int64_t pos, int32_t count, float* outL, float* outR) const {
+    while (count > 0) {
+        auto it = checkpoints_.upper_bound(pos);
+        if (it == checkpoints_.begin()) break;
+        const Checkpoint& checkpoint = std::prev(it)->second;
+        const int64_t offset = pos - checkpoint.start;
+        const int64_t available = static_cast<int64_t>(checkpoint.inputL.size()) - offset;
+        if (offset < 0 || available <= 0) break;
+
+        const int32_t n = static_cast<int32_t>((std::min)(available, static_cast<int64_t>(count)));
+        Avx2Utils::CopyBufferAVX2(outL, checkpoint.inputL.data() + offset, n);
+        Avx2Utils::CopyBufferAVX2(outR, checkpoint.inputR.data() + offset, n);
+        outL += n;
+        outR += n;
+        pos += n;
+        count -= n;
+    }
+    if (count > 0) {
+        Avx2Utils::FillBufferAVX2(outL, count, 0.0f);
+        Avx2Utils::FillBufferAVX2(outR, count, 0.0f);
+    }
+}
+
+size_t SeekCheckpoints::memory_usage() const {
+    size_t total = sizeof(*this);
+    for (const auto& [start, checkpoint] : checkpoints_) {
+        total += sizeof(checkpoint) + EffectStateMemory::VectorBytes(checkpoint.inputL, checkpoint.inputR);
+        if (checkpoint.compensator) total += checkpoint.compensator->memory_usage();
+    }
+    return total;
+}
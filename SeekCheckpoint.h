@@ -0,0 +1,49 @@
+﻿#pragma once
+#include "DelayLine.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+// シーク後にプラグインを冷えた状態から始めないためのチェックポイント。
+// 連続再生中に一定間隔で位置と遅延補正の履歴を残し、次のチェックポイントまでの入力を記録しておく。
+// シークしたら手前のチェックポイントからシーク先まで記録した入力で空回しして、残響や LFO の位相を作り直す。
+// プラグイン自身の状態は GetStateRevision で見分け、保存されている状態が変わったらチェックポイントを全て捨てる。
+class SeekCheckpoints {
+  public:
+    static constexpr size_t MAX_CHECKPOINTS = 32;
+
+    struct Checkpoint {
+        int64_t start = 0;
+        int64_t end = 0; // ここまで途切れずに記録できた
+        std::vector<float> inputL;
+        std::vector<float> inputR;
+        std::unique_ptr<LatencyCompensator> compensator;
+        uint64_t sequence = 0;
+    };
+
+    // 前提になる設定が変わっていたら全て捨てる
+    void Validate(uint64_t signature);
+    void Clear();
+    // 処理する直前に呼ぶ。前回の続きなら入力を書き足し、interval を超えたら pos に新しいチェックポイントを作る。
+    // record_input が false (入力が無音のメディアオブジェクト) なら入力は記録しない
+    void Record(int64_t pos, int32_t count, const float* inL, const float* inR, bool record_input, int64_t interval, const LatencyCompensator* compensator);
+    // pos まで途切れずに記録が続いているチェックポイントのうち、pos より min_preroll 以上手前で最も近いもの。
+    // そこまで遡れなければ遡れる範囲で最も古いもの。見つからなければ nullptr
+    const Checkpoint* FindRestorePoint(int64_t pos, int64_t min_preroll) const;
+    // [pos, pos + count) の記録した入力を書き出す。FindRestorePoint で見つけた範囲に限る
+    void CopyInput(int64_t pos, int32_t count, float* outL, float* outR) const;
+
+    size_t memory_usage() const;
+
+  private:
+    void Trim(const Checkpoint& current, bool record_input);
+    void EvictOldest();
+
+    std::map<int64_t, Checkpoint> checkpoints_;
+    uint64_t signature_ = 0;
+    uint64_t sequence_ = 0;
+    bool recording_ = false;
+    int64_t recording_start_ = 0;
+};
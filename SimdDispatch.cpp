@@ -0,0 +1,108 @@
+﻿#include "SimdKernels.h"
+
+#include <intrin.h>
+
+namespace Avx2Utils {
+std::atomic<const KernelTable*> g_kernels{ nullptr };
+
+namespace {
+    std::atomic<SimdLevel> g_level{ SimdLevel::Scalar };
+
+    struct KernelTables {
+        KernelTable tables[4] = {};
+        KernelTables() {
+            FillKernelTableScalar(tables[static_cast<int32_t>(SimdLevel::Scalar)]);
+            FillKernelTableSSE2(tables[static_cast<int32_t>(SimdLevel::SSE2)]);
+            FillKernelTableAVX2(tables[static_cast<int32_t>(SimdLevel::AVX2)]);
+            FillKernelTableAVX512(tables[static_cast<int32_t>(SimdLevel::AVX512)]);
+        }
+    };
+
+    const KernelTable& TableFor(SimdLevel level) {
+        static const KernelTables tables;
+        return tables.tables[static_cast<int32_t>(level)];
+    }
+
+    SimdLevel DetectOnce() {
+        int32_t info[4] = {};
+        __cpuid(info, 0);
+        const int32_t max_leaf = info[0];
+        __cpuid(info, 1);
+        const bool sse2 = (info[3] & (1 << 26)) != 0;
+        const bool fma = (info[2] & (1 << 12)) != 0;
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!sse2) return SimdLevel::Scalar;
+        if (!osxsave || !avx || !fma || max_leaf < 7) return SimdLevel::SSE2;
+
+        // OS が YMM/ZMM の状態を保存しない場合は命令があっても使えない
+        const unsigned long long xcr0 = _xgetbv(0);
+        if ((xcr0 & 0x6) != 0x6) return SimdLevel::SSE2;
+
+        __cpuidex(info, 7, 0);
+        const bool avx2 = (info[1] & (1 << 5)) != 0;
+        if (!avx2) return SimdLevel::SSE2;
+
+        // /arch:AVX512 は F/CD/BW/DQ/VL を前提にコードを生成する
+        const int32_t avx512_mask = (1 << 16) | (1 << 17) | (1 << 28) | (1 << 30) | (1 << 31);
+        const bool avx512 = (info[1] & avx512_mask) == avx512_mask;
+        if (!avx512 || (xcr0 & 0xE6) != 0xE6) return SimdLevel::AVX2;
+        return SimdLevel::AVX512;
+    }
+} // namespace
+
+SimdLevel DetectSimdLevel() {
+    static const SimdLevel detected = DetectOnce();
+    return detected;
+}
+
+SimdLevel SetSimdLevel(SimdLevel level) {
+    const SimdLevel supported = DetectSimdLevel();
+    if (level > supported) level = supported;
+    g_level.store(level, std::memory_order_relaxed);
+    g_kernels.store(&TableFor(level), std::memory_order_release);
+    return level;
+}
+
+SimdLevel GetSimdLevel() {
+    Kernels();
+    return g_level.load(std::memory_order_relaxed);
+}
+
+const KernelTable& InitKernels() {
+    // SetSimdLevel より先にカーネルが呼ばれた場合は自動選択で初期化する
+    const KernelTable* expected = nullptr;
+    const SimdLevel level = DetectSimdLevel();
+    const KernelTable* table = &TableFor(level);
+    if (g_kernels.compare_exchange_strong(expected, table, std::memory_order_acq_rel)) {
+        g_level.store(level, std::memory_order_relaxed);
+        return *table;
+    }
+    return *expected;
+}
+
+bool ParseSimdLevel(const std::wstring& name, SimdLevel& out) {
+    std::wstring lower;
+    for (wchar_t c : name) lower.push_back((c >= L'A' && c <= L'Z') ? static_cast<wchar_t>(c - L'A' + L'a') : c);
+    if (lower == L"auto") out = DetectSimdLevel();
+    else if (lower == L"scalar") out = SimdLevel::Scalar;
+    else if (lower == L"sse2") out = SimdLevel::SSE2;
+    else if (lower == L"avx2") out = SimdLevel::AVX2;
+    else if (lower == L"avx512") out = SimdLevel::AVX512;
+    else return false;
+    return true;
+}
+
+const wchar_t* SimdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SSE2:
+            return L"SSE2";
+        case SimdLevel::AVX2:
+            return L"AVX2";
+        case SimdLevel::AVX512:
+            return L"AVX512";
+        default:
+            return L"Scalar";
+    }
+}
+} // namespace Avx2Utils
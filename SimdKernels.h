@@ -0,0 +1,559 @@
+﻿#pragma once
+#include "Avx2Utils.h"
+#include "FastMath.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// SimdKernels*.cpp 専用。命令セットごとに Ops を差し替えて同じカーネルを実体化する。
+// 各 .cpp は異なる /arch でコンパイルされるため、リンカが別 ISA の実体を取り違えないよう
+// ここでの定義はすべて内部リンケージにし、std の inline 関数も使わない。
+namespace Avx2Utils {
+namespace {
+    struct ScalarOps {
+        using V = float;
+        static constexpr size_t W = 1;
+        static V Load(const float* p) { return *p; }
+        static void Store(float* p, V v) { *p = v; }
+        static V Set1(float x) { return x; }
+        static V Add(V a, V b) { return a + b; }
+        static V Sub(V a, V b) { return a - b; }
+        static V Mul(V a, V b) { return a * b; }
+        static V Div(V a, V b) { return a / b; }
+        static V MulAdd(V a, V b, V c) { return a * b + c; }
+        static V NegMulAdd(V a, V b, V c) { return c - a * b; }
+        static V Min(V a, V b) { return a < b ? a : b; }
+        static V Max(V a, V b) { return a > b ? a : b; }
+        static V Abs(V a) { return fabsf(a); }
+        static V Sqrt(V a) { return sqrtf(a); }
+        static V Floor(V a) { return floorf(a); }
+        // s が負 (-0 を含む) なら a の符号を反転する
+        static V MulSign(V a, V s) {
+            uint32_t ab, sb;
+            memcpy(&ab, &a, sizeof(ab));
+            memcpy(&sb, &s, sizeof(sb));
+            ab ^= sb & 0x80000000u;
+            memcpy(&a, &ab, sizeof(a));
+            return a;
+        }
+        static V SelectGT(V a, V b, V x, V y) { return a > b ? x : y; }
+        // 正の正規化数 a の指数部 (floor(log2(a))) と、指数を 0 にした仮数 ([1, 2))
+        static V Exponent(V a) {
+            uint32_t bits;
+            memcpy(&bits, &a, sizeof(bits));
+            return static_cast<float>(static_cast<int32_t>(bits >> 23) - 127);
+        }
+        static V Mantissa(V a) {
+            uint32_t bits;
+            memcpy(&bits, &a, sizeof(bits));
+            bits = (bits & 0x007fffffu) | 0x3f800000u;
+            memcpy(&a, &bits, sizeof(a));
+            return a;
+        }
+        // 整数値 n ([-126, 127]) に対する 2^n
+        static V Pow2i(V n) {
+            const uint32_t bits = static_cast<uint32_t>(static_cast<int32_t>(n) + 127) << 23;
+            float r;
+            memcpy(&r, &bits, sizeof(r));
+            return r;
+        }
+        static float ReduceMax(V a) { return a; }
+        static void Leave() {}
+    };
+
+    // 4 本ずつ展開したメインループ、1 本ずつのループ、スカラーの端数処理の順に f(ops, i) を呼ぶ
+    template <typename O, typename F>
+    void ForEachLane(size_t count, F&& f) {
+        size_t i = 0;
+        for (; i + O::W * 4 <= count; i += O::W * 4) {
+            f(O{}, i);
+            f(O{}, i + O::W);
+            f(O{}, i + O::W * 2);
+            f(O{}, i + O::W * 3);
+        }
+        for (; i + O::W <= count; i += O::W) f(O{}, i);
+        for (; i < count; ++i) f(ScalarOps{}, i);
+        O::Leave();
+    }
+
+    // FastMath.h の多項式のベクトル版。誤差の上限は FastMath.h を参照
+    template <typename O>
+    typename O::V FastLog2(typename O::V x) {
+        using namespace FastMath;
+        x = O::Max(x, O::Set1(MIN_NORMAL));
+        auto e = O::Exponent(x);
+        auto m = O::Mantissa(x);
+        e = O::SelectGT(m, O::Set1(SQRT2), O::Add(e, O::Set1(1.0f)), e);
+        m = O::SelectGT(m, O::Set1(SQRT2), O::Mul(m, O::Set1(0.5f)), m);
+        auto f = O::Add(m, O::Set1(-1.0f));
+        auto p = O::MulAdd(O::Set1(LOG2_C6), f, O::Set1(LOG2_C5));
+        p = O::MulAdd(p, f, O::Set1(LOG2_C4));
+        p = O::MulAdd(p, f, O::Set1(LOG2_C3));
+        p = O::MulAdd(p, f, O::Set1(LOG2_C2));
+        p = O::MulAdd(p, f, O::Set1(LOG2_C1));
+        p = O::MulAdd(p, f, O::Set1(LOG2_C0));
+        return O::MulAdd(p, f, e);
+    }
+
+    template <typename O>
+    typename O::V FastExp2(typename O::V x) {
+        using namespace FastMath;
+        x = O::Min(O::Max(x, O::Set1(-EXP2_LIMIT)), O::Set1(EXP2_LIMIT));
+        auto n = O::Floor(x);
+        auto f = O::Add(x, O::Mul(n, O::Set1(-1.0f)));
+        auto p = O::MulAdd(O::Set1(EXP2_C5), f, O::Set1(EXP2_C4));
+        p = O::MulAdd(p, f, O::Set1(EXP2_C3));
+        p = O::MulAdd(p, f, O::Set1(EXP2_C2));
+        p = O::MulAdd(p, f, O::Set1(EXP2_C1));
+        p = O::MulAdd(p, f, O::Set1(1.0f));
+        return O::Mul(p, O::Pow2i(n));
+    }
+
+    template <typename O>
+    typename O::V FastTanh(typename O::V x) {
+        using namespace FastMath;
+        x = O::Min(O::Max(x, O::Set1(-TANH_LIMIT)), O::Set1(TANH_LIMIT));
+        auto t = FastExp2<O>(O::Mul(x, O::Set1(TANH_TO_LOG2)));
+        return O::Div(O::Add(t, O::Set1(-1.0f)), O::Add(t, O::Set1(1.0f)));
+    }
+
+    template <typename O>
+    typename O::V FastAtan2(typename O::V y, typename O::V x) {
+        using namespace FastMath;
+        auto ax = O::Abs(x);
+        auto ay = O::Abs(y);
+        auto mx = O::Max(ax, ay);
+        auto a = O::Div(O::Min(ax, ay), O::Max(mx, O::Set1(MIN_NORMAL)));
+        auto s = O::Mul(a, a);
+        auto p = O::MulAdd(O::Set1(ATAN_C6), s, O::Set1(ATAN_C5));
+        p = O::MulAdd(p, s, O::Set1(ATAN_C4));
+        p = O::MulAdd(p, s, O::Set1(ATAN_C3));
+        p = O::MulAdd(p, s, O::Set1(ATAN_C2));
+        p = O::MulAdd(p, s, O::Set1(ATAN_C1));
+        p = O::MulAdd(p, s, O::Set1(ATAN_C0));
+        auto r = O::Mul(p, a);
+        r = O::SelectGT(ay, ax, O::Sub(O::Set1(HALF_PI), r), r);
+        r = O::SelectGT(O::Set1(0.0f), x, O::Sub(O::Set1(PI), r), r);
+        return O::MulSign(r, y);
+    }
+
+    template <typename O>
+    void FastSinCos(typename O::V x, typename O::V& sin_out, typename O::V& cos_out) {
+        using namespace FastMath;
+        auto k = O::Floor(O::MulAdd(x, O::Set1(INV_TWO_PI), O::Set1(0.5f)));
+        auto r = O::NegMulAdd(k, O::Set1(TWO_PI_LO), O::NegMulAdd(k, O::Set1(TWO_PI_HI), x));
+        // |r| > π/2 なら π - |r| に畳み、cos の符号を反転する
+        auto ar = O::Abs(r);
+        auto fold = O::MulSign(O::Sub(O::Set1(PI), ar), r);
+        auto cos_sign = O::SelectGT(ar, O::Set1(HALF_PI), O::Set1(-1.0f), O::Set1(1.0f));
+        r = O::SelectGT(ar, O::Set1(HALF_PI), fold, r);
+        auto s = O::Mul(r, r);
+        auto ps = O::MulAdd(O::Set1(SIN_C4), s, O::Set1(SIN_C3));
+        ps = O::MulAdd(ps, s, O::Set1(SIN_C2));
+        ps = O::MulAdd(ps, s, O::Set1(SIN_C1));
+        sin_out = O::Mul(O::MulAdd(ps, s, O::Set1(1.0f)), r);
+        auto pc = O::MulAdd(O::Set1(COS_C5), s, O::Set1(COS_C4));
+        pc = O::MulAdd(pc, s, O::Set1(COS_C3));
+        pc = O::MulAdd(pc, s, O::Set1(COS_C2));
+        pc = O::MulAdd(pc, s, O::Set1(COS_C1));
+        cos_out = O::Mul(O::MulAdd(pc, s, O::Set1(1.0f)), cos_sign);
+    }
+
+    template <typename O>
+    struct Kernel {
+        static void CopyBuffer(float* dst, const float* src, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(dst + i, P::Load(src + i));
+            });
+        }
+
+        static void FillBuffer(float* out, size_t count, float value) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(out + i, P::Set1(value));
+            });
+        }
+
+        static void ScaleBuffer(float* out, const float* in, size_t count, float scale) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(out + i, P::Mul(P::Load(in + i), P::Set1(scale)));
+            });
+        }
+
+        static void Accumulate(float* dst, const float* src, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(dst + i, P::Add(P::Load(dst + i), P::Load(src + i)));
+            });
+        }
+
+        static void AccumulateScaled(float* dst, const float* src, size_t count, float scale) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(dst + i, P::MulAdd(P::Load(src + i), P::Set1(scale), P::Load(dst + i)));
+            });
+        }
+
+        static void MultiplyBuffer(float* dst, const float* src, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(dst + i, P::Mul(P::Load(dst + i), P::Load(src + i)));
+            });
+        }
+
+        static void MultiplyBuffers(float* out, const float* src1, const float* src2, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(out + i, P::Mul(P::Load(src1 + i), P::Load(src2 + i)));
+            });
+        }
+
+        static void MixAudio(float* out, const float* in, size_t count, float wet, float dry, float vol) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                auto mix = P::MulAdd(P::Load(out + i), P::Set1(wet), P::Mul(P::Load(in + i), P::Set1(dry)));
+                P::Store(out + i, P::Mul(mix, P::Set1(vol)));
+            });
+        }
+
+        static void HardClip(float* buf, size_t count, float min_val, float max_val) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(buf + i, P::Min(P::Max(P::Load(buf + i), P::Set1(min_val)), P::Set1(max_val)));
+            });
+        }
+
+        static void SwapChannels(float* bufL, float* bufR, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                auto l = P::Load(bufL + i);
+                auto r = P::Load(bufR + i);
+                P::Store(bufL + i, r);
+                P::Store(bufR + i, l);
+            });
+        }
+
+        static void InvertBuffer(float* buf, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(buf + i, P::Mul(P::Load(buf + i), P::Set1(-1.0f)));
+            });
+        }
+
+        static void MatrixMixStereo(float* outL, float* outR, const float* inL, const float* inR, size_t count, float cLL, float cRL, float cLR, float cRR) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                auto l = P::Load(inL + i);
+                auto r = P::Load(inR + i);
+                P::Store(outL + i, P::MulAdd(l, P::Set1(cLL), P::Mul(r, P::Set1(cRL))));
+                P::Store(outR + i, P::MulAdd(l, P::Set1(cLR), P::Mul(r, P::Set1(cRR))));
+            });
+        }
+
+        static void SoftClipTanh(float* buf, size_t count, float drive_gain) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(buf + i, FastTanh<P>(P::Mul(P::Load(buf + i), P::Set1(drive_gain))));
+            });
+        }
+
+        static void FuzzShape(float* buf, size_t count, float drive) {
+            const float scale = 1.0f + drive * 10.0f;
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                auto x = P::Mul(P::Load(buf + i), P::Set1(scale));
+                P::Store(buf + i, P::Max(P::Min(x, P::Set1(0.8f)), P::Set1(-0.8f)));
+            });
+        }
+
+        static void Quantize(float* buf, size_t count, float step_size) {
+            const float inv_step = 1.0f / step_size;
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(buf + i, P::Mul(P::Floor(P::Mul(P::Load(buf + i), P::Set1(inv_step))), P::Set1(step_size)));
+            });
+        }
+
+        static float GetPeakAbs(const float* src, size_t count) {
+            size_t i = 0;
+            typename O::V m0 = O::Set1(0.0f), m1 = m0, m2 = m0, m3 = m0;
+            for (; i + O::W * 4 <= count; i += O::W * 4) {
+                m0 = O::Max(m0, O::Abs(O::Load(src + i)));
+                m1 = O::Max(m1, O::Abs(O::Load(src + i + O::W)));
+                m2 = O::Max(m2, O::Abs(O::Load(src + i + O::W * 2)));
+                m3 = O::Max(m3, O::Abs(O::Load(src + i + O::W * 3)));
+            }
+            typename O::V m = O::Max(O::Max(m0, m1), O::Max(m2, m3));
+            for (; i + O::W <= count; i += O::W) m = O::Max(m, O::Abs(O::Load(src + i)));
+
+            float max_val = O::ReduceMax(m);
+            for (; i < count; ++i) {
+                const float v = fabsf(src[i]);
+                if (v > max_val) max_val = v;
+            }
+            O::Leave();
+            return max_val;
+        }
+
+        static void EnvelopeFollower(float* envelope, const float* input, size_t count, float attack_coeff, float release_coeff) {
+            const float one_m_attack = 1.0f - attack_coeff;
+            const float one_m_release = 1.0f - release_coeff;
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                auto env = P::Load(envelope + i);
+                auto in = P::Load(input + i);
+                auto attack = P::MulAdd(env, P::Set1(attack_coeff), P::Mul(in, P::Set1(one_m_attack)));
+                auto release = P::MulAdd(env, P::Set1(release_coeff), P::Mul(in, P::Set1(one_m_release)));
+                P::Store(envelope + i, P::SelectGT(in, env, attack, release));
+            });
+        }
+
+        static void Abs(float* out, const float* in, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(out + i, P::Abs(P::Load(in + i)));
+            });
+        }
+
+        static void MaxBuffer(float* out, const float* src1, const float* src2, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(out + i, P::Max(P::Load(src1 + i), P::Load(src2 + i)));
+            });
+        }
+
+        static void Threshold(float* out, const float* in, size_t count, float threshold) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(out + i, P::SelectGT(P::Load(in + i), P::Set1(threshold), P::Set1(1.0f), P::Set1(0.0f)));
+            });
+        }
+
+        static void PeakDetectStereo(float* out_peak, const float* inL, const float* inR, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(out_peak + i, P::Max(P::Abs(P::Load(inL + i)), P::Abs(P::Load(inR + i))));
+            });
+        }
+
+        static void AllpassDiffuse(float* io, const float* delayed, float* s_out, size_t count, float g) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                auto d = P::Load(delayed + i);
+                auto s = P::MulAdd(P::Set1(g), d, P::Load(io + i));
+                P::Store(s_out + i, s);
+                P::Store(io + i, P::NegMulAdd(P::Set1(g), s, d));
+            });
+        }
+
+        static void Log2(float* out, const float* in, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(out + i, FastLog2<P>(P::Load(in + i)));
+            });
+        }
+
+        static void Exp2(float* out, const float* in, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(out + i, FastExp2<P>(P::Load(in + i)));
+            });
+        }
+
+        static void LinearToDb(float* out, const float* in, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(out + i, P::Mul(FastLog2<P>(P::Load(in + i)), P::Set1(FastMath::LOG2_TO_DB)));
+            });
+        }
+
+        static void DbToLinear(float* out, const float* in, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(out + i, FastExp2<P>(P::Mul(P::Load(in + i), P::Set1(FastMath::DB_TO_LOG2))));
+            });
+        }
+
+        static void Tanh(float* out, const float* in, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                P::Store(out + i, FastTanh<P>(P::Load(in + i)));
+            });
+        }
+
+        static void ToPolar(float* mag, float* phase, const float* re, const float* im, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                auto r = P::Load(re + i);
+                auto m = P::Load(im + i);
+                P::Store(mag + i, P::Sqrt(P::MulAdd(r, r, P::Mul(m, m))));
+                P::Store(phase + i, FastAtan2<P>(m, r));
+            });
+        }
+
+        static void FromPolar(float* re, float* im, const float* mag, const float* phase, size_t count) {
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                typename P::V s, c;
+                FastSinCos<P>(P::Load(phase + i), s, c);
+                auto m = P::Load(mag + i);
+                P::Store(re + i, P::Mul(m, c));
+                P::Store(im + i, P::Mul(m, s));
+            });
+        }
+
+        // 基数 2 の 1 段分。長さ half * 2 の各グループで x[j] ± w[j] * x[j + half] を計算する
+        static void FftPass(float* re, float* im, size_t n, size_t half, const float* wr, const float* wi) {
+            for (size_t base = 0; base < n; base += half * 2) {
+                float* r0 = re + base;
+                float* i0 = im + base;
+                float* r1 = r0 + half;
+                float* i1 = i0 + half;
+                ForEachLane<O>(half, [&](auto o, size_t j) {
+                    using P = decltype(o);
+                    auto xr = P::Load(r1 + j);
+                    auto xi = P::Load(i1 + j);
+                    auto c = P::Load(wr + j);
+                    auto s = P::Load(wi + j);
+                    auto vr = P::NegMulAdd(xi, s, P::Mul(xr, c));
+                    auto vi = P::MulAdd(xi, c, P::Mul(xr, s));
+                    auto ur = P::Load(r0 + j);
+                    auto ui = P::Load(i0 + j);
+                    P::Store(r0 + j, P::Add(ur, vr));
+                    P::Store(i0 + j, P::Add(ui, vi));
+                    P::Store(r1 + j, P::Sub(ur, vr));
+                    P::Store(i1 + j, P::Sub(ui, vi));
+                });
+            }
+        }
+
+        // dB への変換、閾値超過分への傾き適用、リニアへの戻しをすべて log2 領域で行う
+        static void CompressorGain(float* gain, const float* envelope, size_t count, float threshold_db, float slope, float makeup_db, float floor_lin) {
+            const float threshold = threshold_db * FastMath::DB_TO_LOG2;
+            const float makeup = makeup_db * FastMath::DB_TO_LOG2;
+            ForEachLane<O>(count, [&](auto o, size_t i) {
+                using P = decltype(o);
+                auto level = FastLog2<P>(P::Max(P::Load(envelope + i), P::Set1(floor_lin)));
+                auto over = P::Max(P::Add(level, P::Set1(-threshold)), P::Set1(0.0f));
+                P::Store(gain + i, FastExp2<P>(P::MulAdd(over, P::Set1(slope), P::Set1(makeup))));
+            });
+        }
+
+        static void ZeroUpper() {
+            O::Leave();
+        }
+
+        template <typename P>
+        static typename P::V ApplyStage(const FusedStage& s, typename P::V v, size_t i) {
+            switch (s.op) {
+                case FusedOp::Scale:
+                    return P::Mul(v, P::Set1(s.a));
+                case FusedOp::Add:
+                    return P::Add(v, P::Load(s.src + i));
+                case FusedOp::Multiply:
+                    return P::Mul(v, P::Load(s.src + i));
+                case FusedOp::Mix:
+                    return P::Mul(P::MulAdd(v, P::Set1(s.a), P::Mul(P::Load(s.src + i), P::Set1(s.b))), P::Set1(s.c));
+                case FusedOp::Clip:
+                    return P::Min(P::Max(v, P::Set1(s.a)), P::Set1(s.b));
+                case FusedOp::Abs:
+                    return P::Abs(v);
+                case FusedOp::Max:
+                    return P::Max(v, P::Load(s.src + i));
+                case FusedOp::Threshold:
+                    return P::SelectGT(v, P::Set1(s.a), P::Set1(1.0f), P::Set1(0.0f));
+                case FusedOp::FollowEnvelope: {
+                    auto env = s.src ? P::Load(s.src + i) : P::Set1(s.c);
+                    auto attack = P::MulAdd(env, P::Set1(s.a), P::Mul(v, P::Set1(1.0f - s.a)));
+                    auto release = P::MulAdd(env, P::Set1(s.b), P::Mul(v, P::Set1(1.0f - s.b)));
+                    return P::SelectGT(v, env, attack, release);
+                }
+                case FusedOp::SoftClipTanh:
+                    return FastTanh<P>(P::Mul(v, P::Set1(s.a)));
+            }
+            return v;
+        }
+
+        // 段ごとの分岐を 4 本分まとめて評価し、途中結果はレジスタに置いたまま次の段へ渡す
+        static void RunFused(float* out, const float* in, size_t count, const FusedStage* stages, size_t stage_count) {
+            size_t i = 0;
+            for (; i + O::W * 4 <= count; i += O::W * 4) {
+                typename O::V v0 = O::Load(in + i);
+                typename O::V v1 = O::Load(in + i + O::W);
+                typename O::V v2 = O::Load(in + i + O::W * 2);
+                typename O::V v3 = O::Load(in + i + O::W * 3);
+                for (size_t k = 0; k < stage_count; ++k) {
+                    const FusedStage& s = stages[k];
+                    v0 = ApplyStage<O>(s, v0, i);
+                    v1 = ApplyStage<O>(s, v1, i + O::W);
+                    v2 = ApplyStage<O>(s, v2, i + O::W * 2);
+                    v3 = ApplyStage<O>(s, v3, i + O::W * 3);
+                }
+                O::Store(out + i, v0);
+                O::Store(out + i + O::W, v1);
+                O::Store(out + i + O::W * 2, v2);
+                O::Store(out + i + O::W * 3, v3);
+            }
+            for (; i + O::W <= count; i += O::W) {
+                typename O::V v = O::Load(in + i);
+                for (size_t k = 0; k < stage_count; ++k) v = ApplyStage<O>(stages[k], v, i);
+                O::Store(out + i, v);
+            }
+            for (; i < count; ++i) {
+                float v = in[i];
+                for (size_t k = 0; k < stage_count; ++k) v = ApplyStage<ScalarOps>(stages[k], v, i);
+                out[i] = v;
+            }
+            O::Leave();
+        }
+    };
+
+    // 音声系カーネルを O で実体化して table に設定する。描画系はここでは触らない
+    template <typename O>
+    void FillAudioKernels(KernelTable& table) {
+        table.CopyBuffer = &Kernel<O>::CopyBuffer;
+        table.FillBuffer = &Kernel<O>::FillBuffer;
+        table.ScaleBuffer = &Kernel<O>::ScaleBuffer;
+        table.Accumulate = &Kernel<O>::Accumulate;
+        table.AccumulateScaled = &Kernel<O>::AccumulateScaled;
+        table.MultiplyBuffer = &Kernel<O>::MultiplyBuffer;
+        table.MultiplyBuffers = &Kernel<O>::MultiplyBuffers;
+        table.MixAudio = &Kernel<O>::MixAudio;
+        table.HardClip = &Kernel<O>::HardClip;
+        table.SwapChannels = &Kernel<O>::SwapChannels;
+        table.InvertBuffer = &Kernel<O>::InvertBuffer;
+        table.MatrixMixStereo = &Kernel<O>::MatrixMixStereo;
+        table.SoftClipTanh = &Kernel<O>::SoftClipTanh;
+        table.FuzzShape = &Kernel<O>::FuzzShape;
+        table.Quantize = &Kernel<O>::Quantize;
+        table.GetPeakAbs = &Kernel<O>::GetPeakAbs;
+        table.EnvelopeFollower = &Kernel<O>::EnvelopeFollower;
+        table.Abs = &Kernel<O>::Abs;
+        table.MaxBuffer = &Kernel<O>::MaxBuffer;
+        table.Threshold = &Kernel<O>::Threshold;
+        table.PeakDetectStereo = &Kernel<O>::PeakDetectStereo;
+        table.AllpassDiffuse = &Kernel<O>::AllpassDiffuse;
+        table.Log2 = &Kernel<O>::Log2;
+        table.Exp2 = &Kernel<O>::Exp2;
+        table.LinearToDb = &Kernel<O>::LinearToDb;
+        table.DbToLinear = &Kernel<O>::DbToLinear;
+        table.Tanh = &Kernel<O>::Tanh;
+        table.CompressorGain = &Kernel<O>::CompressorGain;
+        table.ToPolar = &Kernel<O>::ToPolar;
+        table.FromPolar = &Kernel<O>::FromPolar;
+        table.FftPass = &Kernel<O>::FftPass;
+        table.ZeroUpper = &Kernel<O>::ZeroUpper;
+        table.RunFused = &Kernel<O>::RunFused;
+    }
+} // namespace
+
+// 各 ISA の翻訳単位が提供するテーブル構築関数
+void FillKernelTableScalar(KernelTable& table);
+void FillKernelTableSSE2(KernelTable& table);
+void FillKernelTableAVX2(KernelTable& table);
+void FillKernelTableAVX512(KernelTable& table);
+} // namespace Avx2Utils
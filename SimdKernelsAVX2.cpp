@@ -0,0 +1,468 @@
+﻿#include <windows.h>
+#include "filter2.h"
+
+#include "SimdKernels.h"
+
+#include <immintrin.h>
+
+namespace Avx2Utils {
+namespace {
+    struct Avx2Ops {
+        using V = __m256;
+        static constexpr size_t W = 8;
+        static V Load(const float* p) { return _mm256_loadu_ps(p); }
+        static void Store(float* p, V v) { _mm256_storeu_ps(p, v); }
+        static V Set1(float x) { return _mm256_set1_ps(x); }
+        static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+        static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+        static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+        static V Div(V a, V b) { return _mm256_div_ps(a, b); }
+        static V MulAdd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+        static V NegMulAdd(V a, V b, V c) { return _mm256_fnmadd_ps(a, b, c); }
+        static V Min(V a, V b) { return _mm256_min_ps(a, b); }
+        static V Max(V a, V b) { return _mm256_max_ps(a, b); }
+        static V Abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+        static V Sqrt(V a) { return _mm256_sqrt_ps(a); }
+        static V MulSign(V a, V s) { return _mm256_xor_ps(a, _mm256_and_ps(s, _mm256_set1_ps(-0.0f))); }
+        static V Floor(V a) { return _mm256_floor_ps(a); }
+        static V SelectGT(V a, V b, V x, V y) { return _mm256_blendv_ps(y, x, _mm256_cmp_ps(a, b, _CMP_GT_OS)); }
+        static V Exponent(V a) {
+            const __m256i e = _mm256_srli_epi32(_mm256_castps_si256(a), 23);
+            return _mm256_cvtepi32_ps(_mm256_sub_epi32(e, _mm256_set1_epi32(127)));
+        }
+        static V Mantissa(V a) {
+            const __m256i m = _mm256_and_si256(_mm256_castps_si256(a), _mm256_set1_epi32(0x007fffff));
+            return _mm256_castsi256_ps(_mm256_or_si256(m, _mm256_set1_epi32(0x3f800000)));
+        }
+        static V Pow2i(V n) {
+            const __m256i e = _mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127));
+            return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+        }
+        static float ReduceMax(V a) {
+            __m128 m = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+            m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+            m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_cvtss_f32(m);
+        }
+        static void Leave() { _mm256_zeroupper(); }
+    };
+
+    template <typename T>
+    T MinOf(T a, T b) {
+        return b < a ? b : a;
+    }
+
+    int32_t ComputeParticleBatch(const ParticleBatchParams& p, float* out_x, float* out_y, float* out_age) {
+        __m256 v_gravity = _mm256_set1_ps(p.gravity);
+        __m256 v_life = _mm256_set1_ps(p.particleLife);
+        __m256 v_zero = _mm256_setzero_ps();
+        __m256 v_cx = _mm256_set1_ps(p.cx);
+        __m256 v_cy = _mm256_set1_ps(p.cy);
+        __m256i v_idx = _mm256_setr_epi32(p.start_idx, p.start_idx + 1, p.start_idx + 2, p.start_idx + 3, p.start_idx + 4, p.start_idx + 5, p.start_idx + 6, p.start_idx + 7);
+        __m256 v_idx_ps = _mm256_cvtepi32_ps(v_idx);
+        __m256 v_count_ps = _mm256_cvtepi32_ps(_mm256_set1_epi32(p.countPerStep));
+        __m256 v_k_rel_ps = _mm256_floor_ps(_mm256_div_ps(v_idx_ps, v_count_ps));
+        __m256i v_k_rel_i = _mm256_cvtps_epi32(v_k_rel_ps);
+        __m256i v_k_i = _mm256_add_epi32(_mm256_set1_epi32(p.k_min), v_k_rel_i);
+        __m256i v_count_i = _mm256_set1_epi32(p.countPerStep);
+        __m256i v_p_i = _mm256_sub_epi32(v_idx, _mm256_mullo_epi32(v_k_rel_i, v_count_i));
+        __m256 v_k_ps = _mm256_cvtepi32_ps(v_k_i);
+        __m256 v_emitTime = _mm256_mul_ps(v_k_ps, _mm256_set1_ps(p.emissionInterval));
+        __m256 v_age = _mm256_sub_ps(_mm256_set1_ps(p.timeSinceStart), v_emitTime);
+        __m256i v_baseSeed = _mm256_set1_epi32(p.baseSeed);
+        __m256i v_seed = _mm256_add_epi32(v_baseSeed, _mm256_mullo_epi32(v_k_i, _mm256_set1_epi32(7193)));
+        v_seed = _mm256_add_epi32(v_seed, _mm256_mullo_epi32(v_p_i, _mm256_set1_epi32(31337)));
+        v_seed = _mm256_xor_si256(v_seed, _mm256_slli_epi32(v_seed, 13));
+        v_seed = _mm256_xor_si256(v_seed, _mm256_srli_epi32(v_seed, 17));
+        v_seed = _mm256_xor_si256(v_seed, _mm256_slli_epi32(v_seed, 5));
+        __m256 v_rand1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(v_seed, _mm256_set1_epi32(0xFFFFFF))), _mm256_set1_ps(1.0f / 16777215.0f));
+        v_seed = _mm256_xor_si256(v_seed, _mm256_slli_epi32(v_seed, 13));
+        v_seed = _mm256_xor_si256(v_seed, _mm256_srli_epi32(v_seed, 17));
+        v_seed = _mm256_xor_si256(v_seed, _mm256_slli_epi32(v_seed, 5));
+        __m256 v_rand2 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(v_seed, _mm256_set1_epi32(0xFFFFFF))), _mm256_set1_ps(1.0f / 16777215.0f));
+        v_seed = _mm256_xor_si256(v_seed, _mm256_slli_epi32(v_seed, 13));
+        v_seed = _mm256_xor_si256(v_seed, _mm256_srli_epi32(v_seed, 17));
+        v_seed = _mm256_xor_si256(v_seed, _mm256_slli_epi32(v_seed, 5));
+        __m256 v_rand3 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(v_seed, _mm256_set1_epi32(0xFFFFFF))), _mm256_set1_ps(1.0f / 16777215.0f));
+        __m256 v_one = _mm256_set1_ps(1.0f);
+        __m256 v_two = _mm256_set1_ps(2.0f);
+        __m256 v_rx = _mm256_sub_ps(_mm256_mul_ps(v_rand1, v_two), v_one);
+        __m256 v_ry = _mm256_sub_ps(_mm256_mul_ps(v_rand2, v_two), v_one);
+        __m256 v_lenSq = _mm256_add_ps(_mm256_mul_ps(v_rx, v_rx), _mm256_mul_ps(v_ry, v_ry));
+        __m256 v_invLen = _mm256_rsqrt_ps(_mm256_add_ps(v_lenSq, _mm256_set1_ps(1e-6f)));
+        __m256 v_speed = _mm256_add_ps(_mm256_set1_ps(50.0f), _mm256_mul_ps(v_rand3, _mm256_set1_ps(250.0f)));
+        __m256 v_vx = _mm256_mul_ps(v_rx, _mm256_mul_ps(v_invLen, v_speed));
+        __m256 v_vy = _mm256_mul_ps(v_ry, _mm256_mul_ps(v_invLen, v_speed));
+        __m256 v_px = _mm256_add_ps(v_cx, _mm256_mul_ps(v_vx, v_age));
+        __m256 v_py = _mm256_add_ps(v_cy, _mm256_mul_ps(v_vy, v_age));
+        __m256 v_g_delta = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(v_gravity, _mm256_mul_ps(v_age, v_age)));
+        if (p.scrollMode == 3) v_py = _mm256_sub_ps(v_py, v_g_delta);
+        else v_py = _mm256_add_ps(v_py, v_g_delta);
+        __m256 v_mask = _mm256_and_ps(
+            _mm256_cmp_ps(v_age, v_zero, _CMP_GT_OQ),
+            _mm256_cmp_ps(v_age, v_life, _CMP_LT_OQ));
+        _mm256_storeu_ps(out_x, v_px);
+        _mm256_storeu_ps(out_y, v_py);
+        _mm256_storeu_ps(out_age, v_age);
+        _mm256_zeroupper();
+        return _mm256_movemask_ps(v_mask);
+    }
+
+    void FillBufferRGBA(PIXEL_RGBA* buf, size_t pixelCount, PIXEL_RGBA color) {
+        if (pixelCount <= 0) return;
+        uint32_t colorU32 = *reinterpret_cast<uint32_t*>(&color);
+        __m256i v_color = _mm256_setr_epi32(colorU32, colorU32, colorU32, colorU32, colorU32, colorU32, colorU32, colorU32);
+
+        size_t i = 0;
+        size_t aligned = pixelCount - (pixelCount % 8);
+        uint32_t* buf32 = reinterpret_cast<uint32_t*>(buf);
+
+        for (; i < aligned; i += 8) _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf32 + i), v_color);
+        for (; i < pixelCount; ++i) buf[i] = color;
+    }
+
+    void BlendPixelBatch(PIXEL_RGBA* buf, const int32_t* xs, const int32_t* ys, int32_t count, int32_t imgW, int32_t imgH, PIXEL_RGBA col) {
+        if (count <= 0 || col.a == 0) return;
+        __m256 v_alpha = _mm256_set1_ps(col.a / 255.0f);
+        __m256 v_invAlpha = _mm256_set1_ps(1.0f - col.a / 255.0f);
+        __m256 v_cr = _mm256_set1_ps(static_cast<float>(col.r));
+        __m256 v_cg = _mm256_set1_ps(static_cast<float>(col.g));
+        __m256 v_cb = _mm256_set1_ps(static_cast<float>(col.b));
+        __m256 v_ca = _mm256_set1_ps(static_cast<float>(col.a));
+
+        for (int32_t k = 0; k < count; ++k) {
+            int32_t x = xs[k];
+            int32_t y = ys[k];
+            if (x < 0 || y < 0 || x >= imgW || y >= imgH) continue;
+            int32_t idx = y * imgW + x;
+            if (col.a == 255) {
+                buf[idx] = col;
+            } else {
+                PIXEL_RGBA bg = buf[idx];
+                __m256 v_bgr = _mm256_set1_ps(static_cast<float>(bg.r));
+                __m256 v_bgg = _mm256_set1_ps(static_cast<float>(bg.g));
+                __m256 v_bgb = _mm256_set1_ps(static_cast<float>(bg.b));
+                __m256 v_bga = _mm256_set1_ps(static_cast<float>(bg.a));
+                __m256 v_outr = _mm256_add_ps(_mm256_mul_ps(v_cr, v_alpha), _mm256_mul_ps(v_bgr, v_invAlpha));
+                __m256 v_outg = _mm256_add_ps(_mm256_mul_ps(v_cg, v_alpha), _mm256_mul_ps(v_bgg, v_invAlpha));
+                __m256 v_outb = _mm256_add_ps(_mm256_mul_ps(v_cb, v_alpha), _mm256_mul_ps(v_bgb, v_invAlpha));
+                __m256 v_outa = _mm256_min_ps(_mm256_set1_ps(255.0f), _mm256_add_ps(v_bga, v_ca));
+                alignas(32) float outr[8], outg[8], outb[8], outa[8];
+                _mm256_store_ps(outr, v_outr);
+                _mm256_store_ps(outg, v_outg);
+                _mm256_store_ps(outb, v_outb);
+                _mm256_store_ps(outa, v_outa);
+                buf[idx].r = static_cast<uint8_t>(outr[0]);
+                buf[idx].g = static_cast<uint8_t>(outg[0]);
+                buf[idx].b = static_cast<uint8_t>(outb[0]);
+                buf[idx].a = static_cast<uint8_t>(outa[0]);
+            }
+        }
+        _mm256_zeroupper();
+    }
+
+    void BlendPoints(PIXEL_RGBA* img, int32_t imgW, int32_t imgH, const float* px, const float* py, const float* ages, int32_t count, PIXEL_RGBA color, float particleLife) {
+        if (count <= 0) return;
+        __m256 v_life = _mm256_set1_ps(particleLife);
+        __m256 v_zero = _mm256_setzero_ps();
+        __m256 v_one = _mm256_set1_ps(1.0f);
+        __m256 v_alpha_scale = _mm256_set1_ps(color.a / 255.0f);
+        __m256 v_px = _mm256_loadu_ps(px);
+        __m256 v_py = _mm256_loadu_ps(py);
+        __m256 v_age = _mm256_loadu_ps(ages);
+        __m256 v_valid_lo = _mm256_cmp_ps(v_age, v_zero, _CMP_GT_OQ);
+        __m256 v_valid_hi = _mm256_cmp_ps(v_age, v_life, _CMP_LT_OQ);
+        __m256 v_valid = _mm256_and_ps(v_valid_lo, v_valid_hi);
+        int32_t valid_mask = _mm256_movemask_ps(v_valid);
+        __m256 v_age_norm = _mm256_div_ps(v_age, v_life);
+        __m256 v_alpha = _mm256_mul_ps(_mm256_sub_ps(v_one, v_age_norm), v_alpha_scale);
+        __m256 v_cr = _mm256_set1_ps(static_cast<float>(color.r));
+        __m256 v_cg = _mm256_set1_ps(static_cast<float>(color.g));
+        __m256 v_cb = _mm256_set1_ps(static_cast<float>(color.b));
+        __m256 v_r = _mm256_mul_ps(v_cr, v_alpha);
+        __m256 v_g = _mm256_mul_ps(v_cg, v_alpha);
+        __m256 v_b = _mm256_mul_ps(v_cb, v_alpha);
+
+        alignas(32) float pxs[8], pys[8], rx[8], gx[8], bx[8], ax[8];
+        _mm256_store_ps(pxs, v_px);
+        _mm256_store_ps(pys, v_py);
+        _mm256_store_ps(rx, v_r);
+        _mm256_store_ps(gx, v_g);
+        _mm256_store_ps(bx, v_b);
+        _mm256_store_ps(ax, v_alpha);
+
+        for (int32_t k = 0; k < count; ++k) {
+            if (!((valid_mask >> k) & 1)) continue;
+            int32_t ix = static_cast<int32_t>(pxs[k]);
+            int32_t iy = static_cast<int32_t>(pys[k]);
+            if (ix < 0 || iy < 0 || ix >= imgW || iy >= imgH) continue;
+            float alpha = ax[k];
+            float lifeRatio = ages[k] / particleLife;
+            int32_t pSize = static_cast<int32_t>(3.0f * (1.0f - lifeRatio) + 1.0f);
+            if (pSize < 1) pSize = 1;
+            float invA = 1.0f - alpha;
+            for (int32_t dy = 0; dy < pSize; ++dy) {
+                int32_t yy = iy + dy;
+                if (yy >= imgH) break;
+                int32_t base = yy * imgW;
+                for (int32_t dx = 0; dx < pSize; ++dx) {
+                    int32_t xx = ix + dx;
+                    if (xx >= imgW) break;
+                    int32_t idx = base + xx;
+                    PIXEL_RGBA src = img[idx];
+                    PIXEL_RGBA out;
+                    out.r = static_cast<uint8_t>(rx[k] + src.r * invA);
+                    out.g = static_cast<uint8_t>(gx[k] + src.g * invA);
+                    out.b = static_cast<uint8_t>(bx[k] + src.b * invA);
+                    out.a = static_cast<uint8_t>(MinOf(255, static_cast<int32_t>(src.a + color.a * alpha)));
+                    img[idx] = out;
+                }
+            }
+        }
+        _mm256_zeroupper();
+    }
+
+    void ComputeRingAlphaMask(float* outAlpha, int32_t rectX, int32_t rectY, int32_t rectW, int32_t rectH, int32_t imgW, int32_t imgH, float cx, float cy, float radius, float thickness) {
+        if (rectW <= 0 || rectH <= 0) return;
+        float rOut = radius;
+        float rIn = (radius - thickness);
+        if (rIn < 0.0f) rIn = 0.0f;
+        float rOut2 = rOut * rOut;
+        float rIn2 = rIn * rIn;
+
+        const int32_t simdWidth = 8;
+        __m256 v_cx = _mm256_set1_ps(cx);
+        __m256 v_cy = _mm256_set1_ps(cy);
+        __m256 v_rOut2 = _mm256_set1_ps(rOut2);
+        __m256 v_rIn2 = _mm256_set1_ps(rIn2);
+        __m256 v_one = _mm256_set1_ps(1.0f);
+
+        for (int32_t yy = 0; yy < rectH; ++yy) {
+            int32_t y = rectY + yy;
+            float dy = static_cast<float>(y) - cy;
+            __m256 v_dy = _mm256_set1_ps(dy);
+            __m256 v_dy2 = _mm256_mul_ps(v_dy, v_dy);
+
+            int32_t xx = 0;
+            for (; xx <= rectW - simdWidth; xx += simdWidth) {
+                alignas(32) float xs[8];
+                for (int32_t k = 0; k < 8; ++k) xs[k] = static_cast<float>(rectX + xx + k);
+                __m256 v_x = _mm256_load_ps(xs);
+                __m256 v_dx = _mm256_sub_ps(v_x, v_cx);
+                __m256 v_dx2 = _mm256_mul_ps(v_dx, v_dx);
+                __m256 v_d2 = _mm256_add_ps(v_dx2, v_dy2);
+                __m256 v_ge_in = _mm256_cmp_ps(v_d2, v_rIn2, _CMP_GE_OS);
+                __m256 v_le_out = _mm256_cmp_ps(v_d2, v_rOut2, _CMP_LE_OS);
+                __m256 v_mask = _mm256_and_ps(v_ge_in, v_le_out);
+                __m256 v_distOut = _mm256_sub_ps(v_rOut2, v_d2);
+                __m256 v_distIn = _mm256_sub_ps(v_d2, v_rIn2);
+                __m256 v_alphaOut = _mm256_min_ps(v_one, _mm256_mul_ps(v_distOut, _mm256_set1_ps(0.25f)));
+                __m256 v_alphaIn = _mm256_min_ps(v_one, _mm256_mul_ps(v_distIn, _mm256_set1_ps(0.25f)));
+                __m256 v_alpha = _mm256_min_ps(v_alphaIn, v_alphaOut);
+                v_alpha = _mm256_and_ps(v_alpha, v_mask);
+
+                alignas(32) float outVals[8];
+                _mm256_store_ps(outVals, v_alpha);
+                for (int32_t k = 0; k < 8; ++k) outAlpha[yy * rectW + xx + k] = outVals[k];
+            }
+            for (; xx < rectW; ++xx) {
+                int32_t x = rectX + xx;
+                float dx = static_cast<float>(x) - cx;
+                float d2 = dx * dx + dy * dy;
+                float a = 0.0f;
+                if (d2 >= rIn2 && d2 <= rOut2) {
+                    float distOut = rOut2 - d2;
+                    float distIn = d2 - rIn2;
+                    float ao = MinOf(1.0f, distOut * 0.25f);
+                    float ai = MinOf(1.0f, distIn * 0.25f);
+                    a = MinOf(ao, ai);
+                }
+                outAlpha[yy * rectW + xx] = a;
+            }
+        }
+        _mm256_zeroupper();
+    }
+
+    void FillLineRGBA(PIXEL_RGBA* buf, int32_t startX, int32_t y, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color) {
+        if (lineLen <= 0 || y < 0 || y >= imgH) return;
+        int32_t endX = MinOf(startX + lineLen, imgW);
+        if (startX >= imgW || endX <= 0) return;
+        if (startX < 0) startX = 0;
+
+        int32_t pixIdx = y * imgW + startX;
+        int32_t remaining = endX - startX;
+        uint32_t colorU32 = *reinterpret_cast<uint32_t*>(&color);
+        __m256i v_color = _mm256_setr_epi32(colorU32, colorU32, colorU32, colorU32, colorU32, colorU32, colorU32, colorU32);
+
+        uint32_t* buf32 = reinterpret_cast<uint32_t*>(buf + pixIdx);
+        int32_t aligned = remaining - (remaining % 8);
+
+        for (int32_t i = 0; i < aligned; i += 8) _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf32 + i), v_color);
+        for (int32_t i = aligned; i < remaining; ++i) buf[pixIdx + i] = color;
+    }
+
+    void BlendLineRGBA(PIXEL_RGBA* buf, int32_t startX, int32_t y, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color) {
+        if (lineLen <= 0 || y < 0 || y >= imgH || color.a == 0) return;
+        if (color.a == 255) {
+            FillLineRGBA(buf, startX, y, lineLen, imgW, imgH, color);
+            return;
+        }
+
+        int32_t endX = MinOf(startX + lineLen, imgW);
+        if (startX >= imgW || endX <= 0) return;
+        if (startX < 0) startX = 0;
+
+        int32_t pixIdx = y * imgW + startX;
+        int32_t remaining = endX - startX;
+
+        __m256 v_alpha = _mm256_set1_ps(color.a / 255.0f);
+        __m256 v_invAlpha = _mm256_set1_ps(1.0f - color.a / 255.0f);
+        __m256 v_cr = _mm256_set1_ps(static_cast<float>(color.r));
+        __m256 v_cg = _mm256_set1_ps(static_cast<float>(color.g));
+        __m256 v_cb = _mm256_set1_ps(static_cast<float>(color.b));
+        __m256 v_ca = _mm256_set1_ps(static_cast<float>(color.a));
+        __m256 v_255 = _mm256_set1_ps(255.0f);
+
+        for (int32_t i = 0; i < remaining - 7; i += 8) {
+            __m256i bg_packed = _mm256_loadu_si256(reinterpret_cast<__m256i*>(buf + pixIdx + i));
+            alignas(32) uint32_t bgPackedArr[8];
+            _mm256_store_si256((__m256i*)bgPackedArr, bg_packed);
+
+            alignas(32) float bgr[8], bgg[8], bgb[8], bga[8];
+            for (int32_t j = 0; j < 8; ++j) {
+                uint32_t px = bgPackedArr[j];
+                bgr[j] = static_cast<float>(static_cast<uint8_t>(px & 0xFF));
+                bgg[j] = static_cast<float>(static_cast<uint8_t>((px >> 8) & 0xFF));
+                bgb[j] = static_cast<float>(static_cast<uint8_t>((px >> 16) & 0xFF));
+                bga[j] = static_cast<float>(static_cast<uint8_t>((px >> 24) & 0xFF));
+            }
+
+            __m256 v_bgr = _mm256_load_ps(bgr);
+            __m256 v_bgg = _mm256_load_ps(bgg);
+            __m256 v_bgb = _mm256_load_ps(bgb);
+            __m256 v_bga = _mm256_load_ps(bga);
+            __m256 v_outr = _mm256_add_ps(_mm256_mul_ps(v_cr, v_alpha), _mm256_mul_ps(v_bgr, v_invAlpha));
+            __m256 v_outg = _mm256_add_ps(_mm256_mul_ps(v_cg, v_alpha), _mm256_mul_ps(v_bgg, v_invAlpha));
+            __m256 v_outb = _mm256_add_ps(_mm256_mul_ps(v_cb, v_alpha), _mm256_mul_ps(v_bgb, v_invAlpha));
+            __m256 v_outa = _mm256_min_ps(v_255, _mm256_add_ps(v_bga, v_ca));
+
+            alignas(32) float outr[8], outg[8], outb[8], outa[8];
+            _mm256_store_ps(outr, v_outr);
+            _mm256_store_ps(outg, v_outg);
+            _mm256_store_ps(outb, v_outb);
+            _mm256_store_ps(outa, v_outa);
+
+            for (int32_t j = 0; j < 8; ++j) {
+                buf[pixIdx + i + j].r = static_cast<uint8_t>(outr[j]);
+                buf[pixIdx + i + j].g = static_cast<uint8_t>(outg[j]);
+                buf[pixIdx + i + j].b = static_cast<uint8_t>(outb[j]);
+                buf[pixIdx + i + j].a = static_cast<uint8_t>(outa[j]);
+            }
+        }
+
+        int32_t aligned = remaining - (remaining % 8);
+        for (int32_t i = aligned; i < remaining; ++i) {
+            PIXEL_RGBA bg = buf[pixIdx + i];
+            float alpha = color.a / 255.0f;
+            float invAlpha = 1.0f - alpha;
+            buf[pixIdx + i].r = static_cast<uint8_t>(color.r * alpha + bg.r * invAlpha);
+            buf[pixIdx + i].g = static_cast<uint8_t>(color.g * alpha + bg.g * invAlpha);
+            buf[pixIdx + i].b = static_cast<uint8_t>(color.b * alpha + bg.b * invAlpha);
+            buf[pixIdx + i].a = static_cast<uint8_t>(MinOf(255, static_cast<int32_t>(bg.a + color.a)));
+        }
+        _mm256_zeroupper();
+    }
+
+    void FillVerticalLineRGBA(PIXEL_RGBA* buf, int32_t x, int32_t startY, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color) {
+        if (lineLen <= 0 || x < 0 || x >= imgW) return;
+        int32_t endY = MinOf(startY + lineLen, imgH);
+        if (startY >= imgH || endY <= 0) return;
+        if (startY < 0) startY = 0;
+
+        int32_t remaining = endY - startY;
+        for (int32_t i = 0; i < remaining; ++i) buf[(startY + i) * imgW + x] = color;
+    }
+
+    void BlendVerticalLineRGBA(PIXEL_RGBA* buf, int32_t x, int32_t startY, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color) {
+        if (lineLen <= 0 || x < 0 || x >= imgW || color.a == 0) return;
+        if (color.a == 255) {
+            FillVerticalLineRGBA(buf, x, startY, lineLen, imgW, imgH, color);
+            return;
+        }
+
+        int32_t endY = MinOf(startY + lineLen, imgH);
+        if (startY >= imgH || endY <= 0) return;
+        if (startY < 0) startY = 0;
+
+        int32_t remaining = endY - startY;
+        float alpha = color.a / 255.0f;
+        float invAlpha = 1.0f - alpha;
+
+        for (int32_t i = 0; i < remaining - 7; i += 8) {
+            alignas(32) float pixr[8], pixg[8], pixb[8], pixa[8];
+
+            for (int32_t j = 0; j < 8; ++j) {
+                PIXEL_RGBA bg = buf[(startY + i + j) * imgW + x];
+                pixr[j] = static_cast<float>(bg.r);
+                pixg[j] = static_cast<float>(bg.g);
+                pixb[j] = static_cast<float>(bg.b);
+                pixa[j] = static_cast<float>(bg.a);
+            }
+
+            __m256 v_bgr = _mm256_load_ps(pixr);
+            __m256 v_bgg = _mm256_load_ps(pixg);
+            __m256 v_bgb = _mm256_load_ps(pixb);
+            __m256 v_bga = _mm256_load_ps(pixa);
+            __m256 v_alpha = _mm256_set1_ps(alpha);
+            __m256 v_invAlpha = _mm256_set1_ps(invAlpha);
+            __m256 v_cr = _mm256_set1_ps(static_cast<float>(color.r));
+            __m256 v_cg = _mm256_set1_ps(static_cast<float>(color.g));
+            __m256 v_cb = _mm256_set1_ps(static_cast<float>(color.b));
+            __m256 v_ca = _mm256_set1_ps(static_cast<float>(color.a));
+            __m256 v_255 = _mm256_set1_ps(255.0f);
+            __m256 v_outr = _mm256_add_ps(_mm256_mul_ps(v_cr, v_alpha), _mm256_mul_ps(v_bgr, v_invAlpha));
+            __m256 v_outg = _mm256_add_ps(_mm256_mul_ps(v_cg, v_alpha), _mm256_mul_ps(v_bgg, v_invAlpha));
+            __m256 v_outb = _mm256_add_ps(_mm256_mul_ps(v_cb, v_alpha), _mm256_mul_ps(v_bgb, v_invAlpha));
+            __m256 v_outa = _mm256_min_ps(v_255, _mm256_add_ps(v_bga, v_ca));
+
+            alignas(32) float outr[8], outg[8], outb[8], outa[8];
+            _mm256_store_ps(outr, v_outr);
+            _mm256_store_ps(outg, v_outg);
+            _mm256_store_ps(outb, v_outb);
+            _mm256_store_ps(outa, v_outa);
+
+            for (int32_t j = 0; j < 8; ++j) {
+                int32_t idx = (startY + i + j) * imgW + x;
+                buf[idx].r = static_cast<uint8_t>(outr[j]);
+                buf[idx].g = static_cast<uint8_t>(outg[j]);
+                buf[idx].b = static_cast<uint8_t>(outb[j]);
+                buf[idx].a = static_cast<uint8_t>(outa[j]);
+            }
+        }
+
+        int32_t aligned = remaining - (remaining % 8);
+        for (int32_t i = aligned; i < remaining; ++i) {
+            int32_t idx = (startY + i) * imgW + x;
+            PIXEL_RGBA bg = buf[idx];
+            buf[idx].r = static_cast<uint8_t>(color.r * alpha + bg.r * invAlpha);
+            buf[idx].g = static_cast<uint8_t>(color.g * alpha + bg.g * invAlpha);
+            buf[idx].b = static_cast<uint8_t>(color.b * alpha + bg.b * invAlpha);
+            buf[idx].a = static_cast<uint8_t>(MinOf(255, static_cast<int32_t>(bg.a + color.a)));
+        }
+        _mm256_zeroupper();
+    }
+} // namespace
+
+void FillKernelTableAVX2(KernelTable& table) {
+    FillAudioKernels<Avx2Ops>(table);
+    table.ComputeParticleBatch = &ComputeParticleBatch;
+    table.FillBufferRGBA = &FillBufferRGBA;
+    table.BlendPixelBatch = &BlendPixelBatch;
+    table.BlendPoints = &BlendPoints;
+    table.ComputeRingAlphaMask = &ComputeRingAlphaMask;
+    table.FillLineRGBA = &FillLineRGBA;
+    table.BlendLineRGBA = &BlendLineRGBA;
+    table.FillVerticalLineRGBA = &FillVerticalLineRGBA;
+    table.BlendVerticalLineRGBA = &BlendVerticalLineRGBA;
+}
+} // namespace Avx2Utils
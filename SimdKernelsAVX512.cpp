@@ -0,0 +1,54 @@
+﻿#include <windows.h>
+#include "filter2.h"
+
+#include "SimdKernels.h"
+
+#include <immintrin.h>
+
+namespace Avx2Utils {
+namespace {
+    struct Avx512Ops {
+        using V = __m512;
+        static constexpr size_t W = 16;
+        static V Load(const float* p) { return _mm512_loadu_ps(p); }
+        static void Store(float* p, V v) { _mm512_storeu_ps(p, v); }
+        static V Set1(float x) { return _mm512_set1_ps(x); }
+        static V Add(V a, V b) { return _mm512_add_ps(a, b); }
+        static V Sub(V a, V b) { return _mm512_sub_ps(a, b); }
+        static V Mul(V a, V b) { return _mm512_mul_ps(a, b); }
+        static V Div(V a, V b) { return _mm512_div_ps(a, b); }
+        static V MulAdd(V a, V b, V c) { return _mm512_fmadd_ps(a, b, c); }
+        static V NegMulAdd(V a, V b, V c) { return _mm512_fnmadd_ps(a, b, c); }
+        static V Min(V a, V b) { return _mm512_min_ps(a, b); }
+        static V Max(V a, V b) { return _mm512_max_ps(a, b); }
+        static V Abs(V a) { return _mm512_abs_ps(a); }
+        static V Sqrt(V a) { return _mm512_sqrt_ps(a); }
+        static V MulSign(V a, V s) {
+            const __m512i sign = _mm512_and_si512(_mm512_castps_si512(s), _mm512_set1_epi32(static_cast<int32_t>(0x80000000u)));
+            return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), sign));
+        }
+        static V Floor(V a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+        static V SelectGT(V a, V b, V x, V y) { return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(a, b, _CMP_GT_OS), y, x); }
+        static V Exponent(V a) {
+            const __m512i e = _mm512_srli_epi32(_mm512_castps_si512(a), 23);
+            return _mm512_cvtepi32_ps(_mm512_sub_epi32(e, _mm512_set1_epi32(127)));
+        }
+        static V Mantissa(V a) {
+            const __m512i m = _mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x007fffff));
+            return _mm512_castsi512_ps(_mm512_or_si512(m, _mm512_set1_epi32(0x3f800000)));
+        }
+        static V Pow2i(V n) {
+            const __m512i e = _mm512_add_epi32(_mm512_cvttps_epi32(n), _mm512_set1_epi32(127));
+            return _mm512_castsi512_ps(_mm512_slli_epi32(e, 23));
+        }
+        static float ReduceMax(V a) { return _mm512_reduce_max_ps(a); }
+        static void Leave() { _mm256_zeroupper(); }
+    };
+} // namespace
+
+// 描画系は 8 画素単位の処理なので AVX2 版を使う
+void FillKernelTableAVX512(KernelTable& table) {
+    FillKernelTableAVX2(table);
+    FillAudioKernels<Avx512Ops>(table);
+}
+} // namespace Avx2Utils
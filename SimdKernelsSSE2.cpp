@@ -0,0 +1,65 @@
+﻿#include <windows.h>
+#include "filter2.h"
+
+#include "SimdKernels.h"
+
+#include <emmintrin.h>
+
+namespace Avx2Utils {
+namespace {
+    struct Sse2Ops {
+        using V = __m128;
+        static constexpr size_t W = 4;
+        static V Load(const float* p) { return _mm_loadu_ps(p); }
+        static void Store(float* p, V v) { _mm_storeu_ps(p, v); }
+        static V Set1(float x) { return _mm_set1_ps(x); }
+        static V Add(V a, V b) { return _mm_add_ps(a, b); }
+        static V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+        static V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+        static V Div(V a, V b) { return _mm_div_ps(a, b); }
+        static V MulAdd(V a, V b, V c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+        static V NegMulAdd(V a, V b, V c) { return _mm_sub_ps(c, _mm_mul_ps(a, b)); }
+        static V Min(V a, V b) { return _mm_min_ps(a, b); }
+        static V Max(V a, V b) { return _mm_max_ps(a, b); }
+        static V Abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+        static V Sqrt(V a) { return _mm_sqrt_ps(a); }
+        static V MulSign(V a, V s) { return _mm_xor_ps(a, _mm_and_ps(s, _mm_set1_ps(-0.0f))); }
+        static V Floor(V a) {
+            // SSE2 には roundps が無いので切り捨て変換で代用する。|a| >= 2^23 は既に整数なのでそのまま返す
+            const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+            const __m128 adjust = _mm_and_ps(_mm_cmpgt_ps(truncated, a), _mm_set1_ps(1.0f));
+            const __m128 floored = _mm_sub_ps(truncated, adjust);
+            const __m128 is_small = _mm_cmplt_ps(Abs(a), _mm_set1_ps(8388608.0f));
+            return _mm_or_ps(_mm_and_ps(is_small, floored), _mm_andnot_ps(is_small, a));
+        }
+        static V SelectGT(V a, V b, V x, V y) {
+            const __m128 mask = _mm_cmpgt_ps(a, b);
+            return _mm_or_ps(_mm_and_ps(mask, x), _mm_andnot_ps(mask, y));
+        }
+        static V Exponent(V a) {
+            const __m128i e = _mm_srli_epi32(_mm_castps_si128(a), 23);
+            return _mm_cvtepi32_ps(_mm_sub_epi32(e, _mm_set1_epi32(127)));
+        }
+        static V Mantissa(V a) {
+            const __m128i m = _mm_and_si128(_mm_castps_si128(a), _mm_set1_epi32(0x007fffff));
+            return _mm_castsi128_ps(_mm_or_si128(m, _mm_set1_epi32(0x3f800000)));
+        }
+        static V Pow2i(V n) {
+            const __m128i e = _mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127));
+            return _mm_castsi128_ps(_mm_slli_epi32(e, 23));
+        }
+        static float ReduceMax(V a) {
+            a = _mm_max_ps(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 3, 2)));
+            a = _mm_max_ps(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_cvtss_f32(a);
+        }
+        static void Leave() {}
+    };
+} // namespace
+
+// 描画系は AVX2 未満ではスカラー版を使う
+void FillKernelTableSSE2(KernelTable& table) {
+    FillKernelTableScalar(table);
+    FillAudioKernels<Sse2Ops>(table);
+}
+} // namespace Avx2Utils
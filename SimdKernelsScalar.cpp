@@ -0,0 +1,195 @@
+﻿#include <windows.h>
+#include "filter2.h"
+
+#include "SimdKernels.h"
+
+namespace Avx2Utils {
+namespace {
+    template <typename T>
+    T MinOf(T a, T b) {
+        return b < a ? b : a;
+    }
+
+    uint32_t XorShift(uint32_t seed) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+    int32_t ComputeParticleBatch(const ParticleBatchParams& p, float* out_x, float* out_y, float* out_age) {
+        int32_t mask = 0;
+        for (int32_t k = 0; k < 8; ++k) {
+            const int32_t idx = p.start_idx + k;
+            const int32_t k_rel = static_cast<int32_t>(floorf(static_cast<float>(idx) / static_cast<float>(p.countPerStep)));
+            const int32_t k_i = p.k_min + k_rel;
+            const int32_t p_i = idx - k_rel * p.countPerStep;
+            const float age = p.timeSinceStart - static_cast<float>(k_i) * p.emissionInterval;
+
+            uint32_t seed = p.baseSeed + static_cast<uint32_t>(k_i) * 7193u + static_cast<uint32_t>(p_i) * 31337u;
+            seed = XorShift(seed);
+            const float rand1 = static_cast<float>(static_cast<int32_t>(seed & 0xFFFFFF)) * (1.0f / 16777215.0f);
+            seed = XorShift(seed);
+            const float rand2 = static_cast<float>(static_cast<int32_t>(seed & 0xFFFFFF)) * (1.0f / 16777215.0f);
+            seed = XorShift(seed);
+            const float rand3 = static_cast<float>(static_cast<int32_t>(seed & 0xFFFFFF)) * (1.0f / 16777215.0f);
+
+            const float rx = rand1 * 2.0f - 1.0f;
+            const float ry = rand2 * 2.0f - 1.0f;
+            const float inv_len = 1.0f / sqrtf(rx * rx + ry * ry + 1e-6f);
+            const float speed = 50.0f + rand3 * 250.0f;
+            const float vx = rx * (inv_len * speed);
+            const float vy = ry * (inv_len * speed);
+            const float g_delta = 0.5f * (p.gravity * (age * age));
+            out_x[k] = p.cx + vx * age;
+            out_y[k] = (p.scrollMode == 3) ? (p.cy + vy * age) - g_delta : (p.cy + vy * age) + g_delta;
+            out_age[k] = age;
+            if (age > 0.0f && age < p.particleLife) mask |= 1 << k;
+        }
+        return mask;
+    }
+
+    void FillBufferRGBA(PIXEL_RGBA* buf, size_t pixelCount, PIXEL_RGBA color) {
+        for (size_t i = 0; i < pixelCount; ++i) buf[i] = color;
+    }
+
+    void BlendPixel(PIXEL_RGBA& dst, PIXEL_RGBA color, float alpha, float invAlpha) {
+        PIXEL_RGBA bg = dst;
+        dst.r = static_cast<uint8_t>(color.r * alpha + bg.r * invAlpha);
+        dst.g = static_cast<uint8_t>(color.g * alpha + bg.g * invAlpha);
+        dst.b = static_cast<uint8_t>(color.b * alpha + bg.b * invAlpha);
+        dst.a = static_cast<uint8_t>(MinOf(255, static_cast<int32_t>(bg.a + color.a)));
+    }
+
+    void BlendPixelBatch(PIXEL_RGBA* buf, const int32_t* xs, const int32_t* ys, int32_t count, int32_t imgW, int32_t imgH, PIXEL_RGBA col) {
+        if (count <= 0 || col.a == 0) return;
+        const float alpha = col.a / 255.0f;
+        const float invAlpha = 1.0f - col.a / 255.0f;
+        for (int32_t k = 0; k < count; ++k) {
+            int32_t x = xs[k];
+            int32_t y = ys[k];
+            if (x < 0 || y < 0 || x >= imgW || y >= imgH) continue;
+            int32_t idx = y * imgW + x;
+            if (col.a == 255) buf[idx] = col;
+            else BlendPixel(buf[idx], col, alpha, invAlpha);
+        }
+    }
+
+    void BlendPoints(PIXEL_RGBA* img, int32_t imgW, int32_t imgH, const float* px, const float* py, const float* ages, int32_t count, PIXEL_RGBA color, float particleLife) {
+        const float alpha_scale = color.a / 255.0f;
+        for (int32_t k = 0; k < count; ++k) {
+            if (!(ages[k] > 0.0f && ages[k] < particleLife)) continue;
+            int32_t ix = static_cast<int32_t>(px[k]);
+            int32_t iy = static_cast<int32_t>(py[k]);
+            if (ix < 0 || iy < 0 || ix >= imgW || iy >= imgH) continue;
+            float lifeRatio = ages[k] / particleLife;
+            float alpha = (1.0f - lifeRatio) * alpha_scale;
+            float r = color.r * alpha, g = color.g * alpha, b = color.b * alpha;
+            int32_t pSize = static_cast<int32_t>(3.0f * (1.0f - lifeRatio) + 1.0f);
+            if (pSize < 1) pSize = 1;
+            float invA = 1.0f - alpha;
+            for (int32_t dy = 0; dy < pSize; ++dy) {
+                int32_t yy = iy + dy;
+                if (yy >= imgH) break;
+                int32_t base = yy * imgW;
+                for (int32_t dx = 0; dx < pSize; ++dx) {
+                    int32_t xx = ix + dx;
+                    if (xx >= imgW) break;
+                    int32_t idx = base + xx;
+                    PIXEL_RGBA src = img[idx];
+                    PIXEL_RGBA out;
+                    out.r = static_cast<uint8_t>(r + src.r * invA);
+                    out.g = static_cast<uint8_t>(g + src.g * invA);
+                    out.b = static_cast<uint8_t>(b + src.b * invA);
+                    out.a = static_cast<uint8_t>(MinOf(255, static_cast<int32_t>(src.a + color.a * alpha)));
+                    img[idx] = out;
+                }
+            }
+        }
+    }
+
+    void ComputeRingAlphaMask(float* outAlpha, int32_t rectX, int32_t rectY, int32_t rectW, int32_t rectH, int32_t, int32_t, float cx, float cy, float radius, float thickness) {
+        if (rectW <= 0 || rectH <= 0) return;
+        float rOut = radius;
+        float rIn = (radius - thickness);
+        if (rIn < 0.0f) rIn = 0.0f;
+        float rOut2 = rOut * rOut;
+        float rIn2 = rIn * rIn;
+
+        for (int32_t yy = 0; yy < rectH; ++yy) {
+            float dy = static_cast<float>(rectY + yy) - cy;
+            for (int32_t xx = 0; xx < rectW; ++xx) {
+                float dx = static_cast<float>(rectX + xx) - cx;
+                float d2 = dx * dx + dy * dy;
+                float a = 0.0f;
+                if (d2 >= rIn2 && d2 <= rOut2) {
+                    float ao = MinOf(1.0f, (rOut2 - d2) * 0.25f);
+                    float ai = MinOf(1.0f, (d2 - rIn2) * 0.25f);
+                    a = MinOf(ao, ai);
+                }
+                outAlpha[yy * rectW + xx] = a;
+            }
+        }
+    }
+
+    void FillLineRGBA(PIXEL_RGBA* buf, int32_t startX, int32_t y, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color) {
+        if (lineLen <= 0 || y < 0 || y >= imgH) return;
+        int32_t endX = MinOf(startX + lineLen, imgW);
+        if (startX >= imgW || endX <= 0) return;
+        if (startX < 0) startX = 0;
+        FillBufferRGBA(buf + y * imgW + startX, static_cast<size_t>(endX - startX), color);
+    }
+
+    void BlendLineRGBA(PIXEL_RGBA* buf, int32_t startX, int32_t y, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color) {
+        if (lineLen <= 0 || y < 0 || y >= imgH || color.a == 0) return;
+        if (color.a == 255) {
+            FillLineRGBA(buf, startX, y, lineLen, imgW, imgH, color);
+            return;
+        }
+        int32_t endX = MinOf(startX + lineLen, imgW);
+        if (startX >= imgW || endX <= 0) return;
+        if (startX < 0) startX = 0;
+
+        const float alpha = color.a / 255.0f;
+        const float invAlpha = 1.0f - alpha;
+        PIXEL_RGBA* row = buf + y * imgW;
+        for (int32_t x = startX; x < endX; ++x) BlendPixel(row[x], color, alpha, invAlpha);
+    }
+
+    void FillVerticalLineRGBA(PIXEL_RGBA* buf, int32_t x, int32_t startY, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color) {
+        if (lineLen <= 0 || x < 0 || x >= imgW) return;
+        int32_t endY = MinOf(startY + lineLen, imgH);
+        if (startY >= imgH || endY <= 0) return;
+        if (startY < 0) startY = 0;
+        for (int32_t yy = startY; yy < endY; ++yy) buf[yy * imgW + x] = color;
+    }
+
+    void BlendVerticalLineRGBA(PIXEL_RGBA* buf, int32_t x, int32_t startY, int32_t lineLen, int32_t imgW, int32_t imgH, PIXEL_RGBA color) {
+        if (lineLen <= 0 || x < 0 || x >= imgW || color.a == 0) return;
+        if (color.a == 255) {
+            FillVerticalLineRGBA(buf, x, startY, lineLen, imgW, imgH, color);
+            return;
+        }
+        int32_t endY = MinOf(startY + lineLen, imgH);
+        if (startY >= imgH || endY <= 0) return;
+        if (startY < 0) startY = 0;
+
+        const float alpha = color.a / 255.0f;
+        const float invAlpha = 1.0f - alpha;
+        for (int32_t yy = startY; yy < endY; ++yy) BlendPixel(buf[yy * imgW + x], color, alpha, invAlpha);
+    }
+} // namespace
+
+void FillKernelTableScalar(KernelTable& table) {
+    FillAudioKernels<ScalarOps>(table);
+    table.ComputeParticleBatch = &ComputeParticleBatch;
+    table.FillBufferRGBA = &FillBufferRGBA;
+    table.BlendPixelBatch = &BlendPixelBatch;
+    table.BlendPoints = &BlendPoints;
+    table.ComputeRingAlphaMask = &ComputeRingAlphaMask;
+    table.FillLineRGBA = &FillLineRGBA;
+    table.BlendLineRGBA = &BlendLineRGBA;
+    table.FillVerticalLineRGBA = &FillVerticalLineRGBA;
+    table.BlendVerticalLineRGBA = &BlendVerticalLineRGBA;
+}
+} // namespace Avx2Utils
@@ -0,0 +1,839 @@
+﻿#include "StateCodec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <utility>
+
+namespace StateCodec {
+namespace {
+constexpr uint8_t kMagic[8] = { 'E', 'A', 'P', '2', 'C', 'M', 'P', '2' };
+constexpr size_t kHeaderSize = 16;
+constexpr size_t kTrailerSize = 12;
+constexpr uint32_t kStoredFlag = 0x80000000u;
+constexpr uint32_t kMinBlockSize = 4 * 1024;
+constexpr uint32_t kMaxBlockSize = 16 * 1024 * 1024;
+
+void PutU32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int32_t i = 0; i < 4; ++i) out.push_back(static_cast<uint8_t>(v >> (i * 8)));
+}
+
+void PutU64(std::vector<uint8_t>& out, uint64_t v) {
+    for (int32_t i = 0; i < 8; ++i) out.push_back(static_cast<uint8_t>(v >> (i * 8)));
+}
+
+uint32_t GetU32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t GetU64(const uint8_t* p) {
+    return static_cast<uint64_t>(GetU32(p)) | (static_cast<uint64_t>(GetU32(p + 4)) << 32);
+}
+
+// CRC-32 (ISO-HDLC, zlib と同じ多項式)。Adler-32 は近くのバイトの入れ替えを見逃しやすいので使わない
+struct Crc32Table {
+    uint32_t entries[256];
+    Crc32Table() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int32_t k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[i] = c;
+        }
+    }
+};
+
+uint32_t Crc32(uint32_t crc, const uint8_t* p, size_t n) {
+    static const Crc32Table table;
+    crc = ~crc;
+    while (n--) crc = table.entries[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t Load32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// ---- Fast: LZ4 ブロック形式 ----
+constexpr int32_t kFastHashBits = 14;
+constexpr size_t kMinMatch = 4;
+// LZ4 の規則どおり末尾 5 バイトはリテラル、最後の一致は終端の 12 バイト手前までに始める
+constexpr size_t kLastLiterals = 5;
+constexpr size_t kMatchFindLimit = 12;
+constexpr size_t kMaxOffset = 65535;
+
+uint32_t FastHash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - kFastHashBits);
+}
+
+void PutLength(std::vector<uint8_t>& out, size_t len) {
+    while (len >= 255) {
+        out.push_back(255);
+        len -= 255;
+    }
+    out.push_back(static_cast<uint8_t>(len));
+}
+
+// match_len が 0 なら最後のリテラルだけのシーケンス
+void PutSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t lit_len, size_t offset, size_t match_len) {
+    const size_t ml = match_len ? match_len - kMinMatch : 0;
+    uint8_t token = static_cast<uint8_t>((std::min)(lit_len, static_cast<size_t>(15)) << 4);
+    if (match_len) token |= static_cast<uint8_t>((std::min)(ml, static_cast<size_t>(15)));
+    out.push_back(token);
+    if (lit_len >= 15) PutLength(out, lit_len - 15);
+    out.insert(out.end(), literals, literals + lit_len);
+    if (!match_len) return;
+    out.push_back(static_cast<uint8_t>(offset));
+    out.push_back(static_cast<uint8_t>(offset >> 8));
+    if (ml >= 15) PutLength(out, ml - 15);
+}
+
+void CompressFast(const uint8_t* src, size_t n, std::vector<uint32_t>& table, std::vector<uint8_t>& out) {
+    table.assign(static_cast<size_t>(1) << kFastHashBits, 0);
+    size_t anchor = 0;
+    if (n > kMatchFindLimit) {
+        const size_t match_limit = n - kMatchFindLimit;
+        const size_t end_limit = n - kLastLiterals;
+        size_t ip = 1;
+        // 一致が続かないほど探索の間隔を広げる
+        uint32_t skip = 1u << 6;
+        while (ip < match_limit) {
+            const uint32_t seq = Load32(src + ip);
+            const uint32_t h = FastHash(seq);
+            size_t ref = table[h];
+            table[h] = static_cast<uint32_t>(ip);
+            if (ref >= ip || ip - ref > kMaxOffset || Load32(src + ref) != seq) {
+                ip += skip++ >> 6;
+                continue;
+            }
+            size_t start = ip;
+            while (start > anchor && ref > 0 && src[start - 1] == src[ref - 1]) {
+                --start;
+                --ref;
+            }
+            size_t len = kMinMatch + (ip - start);
+            while (start + len < end_limit && src[start + len] == src[ref + len]) ++len;
+            PutSequence(out, src + anchor, start - anchor, start - ref, len);
+            ip = start + len;
+            anchor = ip;
+            skip = 1u << 6;
+            if (ip - 2 < match_limit) table[FastHash(Load32(src + ip - 2))] = static_cast<uint32_t>(ip - 2);
+        }
+    }
+    PutSequence(out, src + anchor, n - anchor, 0, 0);
+}
+
+bool GetLength(const uint8_t* src, size_t n, size_t& ip, size_t& len) {
+    for (;;) {
+        if (ip >= n) return false;
+        const uint8_t b = src[ip++];
+        len += b;
+        if (b != 255) return true;
+    }
+}
+
+bool DecompressFast(const uint8_t* src, size_t n, uint8_t* dst, size_t raw) {
+    size_t ip = 0;
+    size_t op = 0;
+    while (ip < n) {
+        const uint8_t token = src[ip++];
+        size_t lit = token >> 4;
+        if (lit == 15 && !GetLength(src, n, ip, lit)) return false;
+        if (lit > n - ip || lit > raw - op) return false;
+        std::memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == n) break;
+
+        if (n - ip < 2) return false;
+        const size_t offset = static_cast<size_t>(src[ip]) | (static_cast<size_t>(src[ip + 1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+        size_t len = token & 15;
+        if (len == 15 && !GetLength(src, n, ip, len)) return false;
+        len += kMinMatch;
+        if (len > raw - op) return false;
+        uint8_t* d = dst + op;
+        const uint8_t* s = d - offset;
+        if (offset >= len) {
+            std::memcpy(d, s, len);
+        } else {
+            for (size_t i = 0; i < len; ++i) d[i] = s[i];
+        }
+        op += len;
+    }
+    return op == raw;
+}
+
+// ---- High: raw DEFLATE ----
+constexpr int32_t kLitLenCodes = 286;
+constexpr int32_t kDistCodes = 30;
+constexpr int32_t kCodeLenCodes = 19;
+constexpr int32_t kMaxBits = 15;
+constexpr int32_t kMaxCodeLenBits = 7;
+constexpr size_t kWindowSize = 32768;
+constexpr size_t kMaxMatch = 258;
+constexpr int32_t kHighHashBits = 15;
+constexpr int32_t kMaxChain = 128;
+constexpr size_t kNiceMatch = 128;
+constexpr size_t kTokensPerBlock = 32768;
+
+constexpr uint16_t kLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+constexpr uint8_t kLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+constexpr uint16_t kDistBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+constexpr uint8_t kDistExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+constexpr uint8_t kCodeLenOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// 一致長 3 ～ 258 と距離 1 ～ 32768 から符号番号を引く表
+struct SymbolTables {
+    uint8_t length_code[kMaxMatch + 1] = {};
+    uint8_t dist_code_small[256] = {};
+    uint8_t dist_code_large[256] = {};
+    SymbolTables() {
+        for (int32_t code = 0; code < 29; ++code) {
+            const int32_t end = (code == 28) ? 259 : kLengthBase[code] + (1 << kLengthExtra[code]);
+            for (int32_t len = kLengthBase[code]; len < end && len <= static_cast<int32_t>(kMaxMatch); ++len) length_code[len] = static_cast<uint8_t>(code);
+        }
+        for (int32_t code = 0; code < kDistCodes; ++code) {
+            const int32_t end = kDistBase[code] + (1 << kDistExtra[code]);
+            for (int32_t d = kDistBase[code]; d < end; ++d) {
+                if (d - 1 < 256) dist_code_small[d - 1] = static_cast<uint8_t>(code);
+                else dist_code_large[(d - 1) >> 7] = static_cast<uint8_t>(code);
+            }
+        }
+    }
+    int32_t DistCode(size_t dist) const {
+        return (dist - 1 < 256) ? dist_code_small[dist - 1] : dist_code_large[(dist - 1) >> 7];
+    }
+};
+
+const SymbolTables& Symbols() {
+    static const SymbolTables tables;
+    return tables;
+}
+
+uint32_t ReverseBits(uint32_t code, int32_t len) {
+    uint32_t r = 0;
+    for (int32_t i = 0; i < len; ++i) {
+        r = (r << 1) | (code & 1);
+        code >>= 1;
+    }
+    return r;
+}
+
+// 頻度から符号長を求める。limit を超えたら頻度を半分にして作り直す。
+// 使う記号が 1 つ以下でも 2 つに補って、完全な符号にする
+void BuildLengths(const uint32_t* freq, int32_t count, int32_t limit, uint8_t* lengths) {
+    std::vector<uint32_t> f(freq, freq + count);
+    int32_t used = 0;
+    for (uint32_t v : f) used += v ? 1 : 0;
+    for (int32_t i = 0; i < count && used < 2; ++i) {
+        if (!f[i]) {
+            f[i] = 1;
+            ++used;
+        }
+    }
+
+    std::vector<int32_t> parent;
+    std::vector<int32_t> depth;
+    for (;;) {
+        using Item = std::pair<uint64_t, int32_t>;
+        std::priority_queue<Item, std::vector<Item>, std::greater<Item>> heap;
+        parent.assign(count, -1);
+        for (int32_t i = 0; i < count; ++i) {
+            if (f[i]) heap.emplace(f[i], i);
+        }
+        int32_t next = count;
+        while (heap.size() > 1) {
+            const Item a = heap.top();
+            heap.pop();
+            const Item b = heap.top();
+            heap.pop();
+            parent[a.second] = next;
+            parent[b.second] = next;
+            parent.push_back(-1);
+            heap.emplace(a.first + b.first, next++);
+        }
+        // 内部節点は子より後に作られるので、後ろから順に深さが決まる
+        depth.assign(next, 0);
+        for (int32_t i = next - 1; i >= 0; --i) {
+            if (parent[i] >= 0) depth[i] = depth[parent[i]] + 1;
+        }
+        int32_t max_depth = 0;
+        for (int32_t i = 0; i < count; ++i) {
+            lengths[i] = f[i] ? static_cast<uint8_t>(depth[i]) : 0;
+            max_depth = (std::max)(max_depth, static_cast<int32_t>(lengths[i]));
+        }
+        if (max_depth <= limit) return;
+        for (auto& v : f) {
+            if (v) v = (v + 1) >> 1;
+        }
+    }
+}
+
+void BuildCodes(const uint8_t* lengths, int32_t count, uint16_t* codes) {
+    uint32_t bl_count[kMaxBits + 1] = {};
+    for (int32_t i = 0; i < count; ++i) bl_count[lengths[i]]++;
+    bl_count[0] = 0;
+    uint32_t next[kMaxBits + 1] = {};
+    uint32_t code = 0;
+    for (int32_t bits = 1; bits <= kMaxBits; ++bits) {
+        code = (code + bl_count[bits - 1]) << 1;
+        next[bits] = code;
+    }
+    for (int32_t i = 0; i < count; ++i) {
+        codes[i] = lengths[i] ? static_cast<uint16_t>(ReverseBits(next[lengths[i]]++, lengths[i])) : 0;
+    }
+}
+
+class BitWriter {
+  public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+    void Put(uint32_t value, int32_t bits) {
+        buf_ |= static_cast<uint64_t>(value) << count_;
+        count_ += bits;
+        while (count_ >= 8) {
+            out_.push_back(static_cast<uint8_t>(buf_));
+            buf_ >>= 8;
+            count_ -= 8;
+        }
+    }
+    void Flush() {
+        if (count_ > 0) out_.push_back(static_cast<uint8_t>(buf_));
+        buf_ = 0;
+        count_ = 0;
+    }
+
+  private:
+    std::vector<uint8_t>& out_;
+    uint64_t buf_ = 0;
+    int32_t count_ = 0;
+};
+
+// dist が 0 ならリテラル
+struct Token {
+    uint16_t value;
+    uint16_t dist;
+};
+
+void PutDynamicBlock(BitWriter& bw, const Token* tokens, size_t count, bool final) {
+    const SymbolTables& sym = Symbols();
+    uint32_t lit_freq[kLitLenCodes] = {};
+    uint32_t dist_freq[kDistCodes] = {};
+    for (size_t i = 0; i < count; ++i) {
+        if (tokens[i].dist == 0) {
+            lit_freq[tokens[i].value]++;
+        } else {
+            lit_freq[257 + sym.length_code[tokens[i].value]]++;
+            dist_freq[sym.DistCode(tokens[i].dist)]++;
+        }
+    }
+    lit_freq[256] = 1;
+
+    uint8_t lit_len[kLitLenCodes];
+    uint8_t dist_len[kDistCodes];
+    BuildLengths(lit_freq, kLitLenCodes, kMaxBits, lit_len);
+    BuildLengths(dist_freq, kDistCodes, kMaxBits, dist_len);
+    int32_t hlit = kLitLenCodes;
+    while (hlit > 257 && !lit_len[hlit - 1]) --hlit;
+    int32_t hdist = kDistCodes;
+    while (hdist > 1 && !dist_len[hdist - 1]) --hdist;
+
+    // 符号長の並びを 16 (直前の繰り返し) / 17, 18 (0 の連続) でまとめる
+    uint8_t lens[kLitLenCodes + kDistCodes];
+    std::memcpy(lens, lit_len, hlit);
+    std::memcpy(lens + hlit, dist_len, hdist);
+    const int32_t total = hlit + hdist;
+    std::vector<std::pair<uint8_t, uint8_t>> rle;
+    for (int32_t i = 0; i < total;) {
+        const uint8_t len = lens[i];
+        int32_t run = 1;
+        while (i + run < total && lens[i + run] == len) ++run;
+        i += run;
+        if (len == 0) {
+            while (run >= 11) {
+                const int32_t r = (std::min)(run, 138);
+                rle.emplace_back(18, static_cast<uint8_t>(r - 11));
+                run -= r;
+            }
+            if (run >= 3) {
+                rle.emplace_back(17, static_cast<uint8_t>(run - 3));
+                run = 0;
+            }
+        } else {
+            rle.emplace_back(len, 0);
+            --run;
+            while (run >= 3) {
+                const int32_t r = (std::min)(run, 6);
+                rle.emplace_back(16, static_cast<uint8_t>(r - 3));
+                run -= r;
+            }
+        }
+        while (run-- > 0) rle.emplace_back(len, 0);
+    }
+
+    uint32_t cl_freq[kCodeLenCodes] = {};
+    for (const auto& item : rle) cl_freq[item.first]++;
+    uint8_t cl_len[kCodeLenCodes];
+    uint16_t cl_code[kCodeLenCodes];
+    BuildLengths(cl_freq, kCodeLenCodes, kMaxCodeLenBits, cl_len);
+    BuildCodes(cl_len, kCodeLenCodes, cl_code);
+    int32_t hclen = kCodeLenCodes;
+    while (hclen > 4 && !cl_len[kCodeLenOrder[hclen - 1]]) --hclen;
+
+    uint16_t lit_code[kLitLenCodes];
+    uint16_t dist_code[kDistCodes];
+    BuildCodes(lit_len, kLitLenCodes, lit_code);
+    BuildCodes(dist_len, kDistCodes, dist_code);
+
+    bw.Put(final ? 1 : 0, 1);
+    bw.Put(2, 2);
+    bw.Put(hlit - 257, 5);
+    bw.Put(hdist - 1, 5);
+    bw.Put(hclen - 4, 4);
+    for (int32_t i = 0; i < hclen; ++i) bw.Put(cl_len[kCodeLenOrder[i]], 3);
+    for (const auto& [s, extra] : rle) {
+        bw.Put(cl_code[s], cl_len[s]);
+        if (s == 16) bw.Put(extra, 2);
+        else if (s == 17) bw.Put(extra, 3);
+        else if (s == 18) bw.Put(extra, 7);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const Token& t = tokens[i];
+        if (t.dist == 0) {
+            bw.Put(lit_code[t.value], lit_len[t.value]);
+            continue;
+        }
+        const int32_t lc = sym.length_code[t.value];
+        bw.Put(lit_code[257 + lc], lit_len[257 + lc]);
+        bw.Put(t.value - kLengthBase[lc], kLengthExtra[lc]);
+        const int32_t dc = sym.DistCode(t.dist);
+        bw.Put(dist_code[dc], dist_len[dc]);
+        bw.Put(t.dist - kDistBase[dc], kDistExtra[dc]);
+    }
+    bw.Put(lit_code[256], lit_len[256]);
+}
+
+struct HighWork {
+    std::vector<int32_t> head;
+    std::vector<int32_t> prev;
+    std::vector<Token> tokens;
+};
+
+uint32_t HighHash(const uint8_t* p) {
+    const uint32_t v = static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16);
+    return (v * 2654435761u) >> (32 - kHighHashBits);
+}
+
+// ハッシュチェーンで一致を探し、1 つ先の位置の方が長ければそちらを使う (zlib の lazy matching と同じ考え方)
+void CompressHigh(const uint8_t* src, size_t n, HighWork& work, std::vector<uint8_t>& out) {
+    work.head.assign(static_cast<size_t>(1) << kHighHashBits, -1);
+    work.prev.resize(n);
+    work.tokens.clear();
+    auto insert = [&](size_t pos) {
+        if (pos + 3 > n) return;
+        const uint32_t h = HighHash(src + pos);
+        work.prev[pos] = work.head[h];
+        work.head[h] = static_cast<int32_t>(pos);
+    };
+    auto find = [&](size_t pos, size_t& dist) -> size_t {
+        if (pos + 3 > n) return 0;
+        const size_t max_len = (std::min)(kMaxMatch, n - pos);
+        const uint8_t* cur = src + pos;
+        size_t best = 2;
+        int32_t cand = work.head[HighHash(cur)];
+        for (int32_t chain = kMaxChain; cand >= 0 && chain > 0; --chain) {
+            if (pos - static_cast<size_t>(cand) > kWindowSize) break;
+            const uint8_t* ref = src + cand;
+            if (ref[best] == cur[best] && ref[0] == cur[0] && ref[1] == cur[1]) {
+                size_t len = 0;
+                while (len < max_len && ref[len] == cur[len]) ++len;
+                if (len > best) {
+                    best = len;
+                    dist = pos - static_cast<size_t>(cand);
+                    if (len >= kNiceMatch || len == max_len) break;
+                }
+            }
+            cand = work.prev[cand];
+        }
+        return best >= 3 ? best : 0;
+    };
+
+    size_t prev_len = 0;
+    size_t prev_dist = 0;
+    bool pending_literal = false;
+    for (size_t pos = 0; pos < n;) {
+        size_t dist = 0;
+        const size_t len = (prev_len >= kNiceMatch) ? 0 : find(pos, dist);
+        insert(pos);
+        if (prev_len >= 3 && len <= prev_len) {
+            work.tokens.push_back({ static_cast<uint16_t>(prev_len), static_cast<uint16_t>(prev_dist) });
+            const size_t end = pos - 1 + prev_len;
+            for (size_t k = pos + 1; k < end; ++k) insert(k);
+            pos = end;
+            prev_len = 0;
+            pending_literal = false;
+            continue;
+        }
+        if (pending_literal) work.tokens.push_back({ src[pos - 1], 0 });
+        prev_len = len;
+        prev_dist = dist;
+        pending_literal = true;
+        ++pos;
+    }
+    if (pending_literal) work.tokens.push_back({ src[n - 1], 0 });
+
+    BitWriter bw(out);
+    const size_t count = work.tokens.size();
+    for (size_t i = 0; i < count || i == 0; i += kTokensPerBlock) {
+        const size_t chunk = (std::min)(kTokensPerBlock, count - i);
+        PutDynamicBlock(bw, work.tokens.data() + i, chunk, i + chunk >= count);
+    }
+    bw.Flush();
+}
+
+class BitReader {
+  public:
+    BitReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+    uint32_t Peek(int32_t bits) {
+        if (count_ < bits) Refill();
+        return static_cast<uint32_t>(buf_ & ((1ull << bits) - 1));
+    }
+    void Drop(int32_t bits) {
+        buf_ >>= bits;
+        count_ -= bits;
+    }
+    uint32_t Get(int32_t bits) {
+        if (bits == 0) return 0;
+        const uint32_t v = Peek(bits);
+        Drop(bits);
+        return v;
+    }
+    void AlignToByte() { Drop(count_ & 7); }
+    // 終端より先 (0 で埋めた部分) まで読んだか
+    bool Overrun() const { return pos_ * 8 - static_cast<size_t>(count_) > size_ * 8; }
+
+  private:
+    void Refill() {
+        while (count_ <= 56) {
+            const uint8_t b = (pos_ < size_) ? data_[pos_] : 0;
+            ++pos_;
+            buf_ |= static_cast<uint64_t>(b) << count_;
+            count_ += 8;
+        }
+    }
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    uint64_t buf_ = 0;
+    int32_t count_ = 0;
+};
+
+// 最長の符号長のビット数で引く表。要素は (記号 << 4) | 符号長、0 は無効な符号
+class HuffmanTable {
+  public:
+    bool Build(const uint8_t* lengths, int32_t count) {
+        uint32_t bl_count[kMaxBits + 1] = {};
+        bits_ = 0;
+        for (int32_t i = 0; i < count; ++i) {
+            bl_count[lengths[i]]++;
+            bits_ = (std::max)(bits_, static_cast<int32_t>(lengths[i]));
+        }
+        if (bits_ == 0) return true;
+        int32_t left = 1;
+        for (int32_t len = 1; len <= kMaxBits; ++len) {
+            left = (left << 1) - static_cast<int32_t>(bl_count[len]);
+            if (left < 0) return false;
+        }
+        uint16_t codes[kLitLenCodes + 2];
+        BuildCodes(lengths, count, codes);
+        table_.assign(static_cast<size_t>(1) << bits_, 0);
+        for (int32_t i = 0; i < count; ++i) {
+            if (!lengths[i]) continue;
+            const uint16_t entry = static_cast<uint16_t>((i << 4) | lengths[i]);
+            for (size_t j = codes[i]; j < table_.size(); j += static_cast<size_t>(1) << lengths[i]) table_[j] = entry;
+        }
+        return true;
+    }
+    int32_t Decode(BitReader& br) const {
+        if (bits_ == 0) return -1;
+        const uint16_t entry = table_[br.Peek(bits_)];
+        if (!(entry & 15)) return -1;
+        br.Drop(entry & 15);
+        return entry >> 4;
+    }
+
+  private:
+    std::vector<uint16_t> table_;
+    int32_t bits_ = 0;
+};
+
+bool ReadDynamicTables(BitReader& br, HuffmanTable& lit, HuffmanTable& dist) {
+    const int32_t hlit = static_cast<int32_t>(br.Get(5)) + 257;
+    const int32_t hdist = static_cast<int32_t>(br.Get(5)) + 1;
+    const int32_t hclen = static_cast<int32_t>(br.Get(4)) + 4;
+    if (hlit > kLitLenCodes || hdist > kDistCodes) return false;
+    uint8_t cl_len[kCodeLenCodes] = {};
+    for (int32_t i = 0; i < hclen; ++i) cl_len[kCodeLenOrder[i]] = static_cast<uint8_t>(br.Get(3));
+    HuffmanTable cl;
+    if (!cl.Build(cl_len, kCodeLenCodes)) return false;
+
+    uint8_t lens[kLitLenCodes + kDistCodes] = {};
+    for (int32_t i = 0; i < hlit + hdist;) {
+        const int32_t s = cl.Decode(br);
+        if (s < 0) return false;
+        if (s < 16) {
+            lens[i++] = static_cast<uint8_t>(s);
+            continue;
+        }
+        uint8_t value = 0;
+        int32_t repeat = 0;
+        if (s == 16) {
+            if (i == 0) return false;
+            value = lens[i - 1];
+            repeat = 3 + static_cast<int32_t>(br.Get(2));
+        } else if (s == 17) {
+            repeat = 3 + static_cast<int32_t>(br.Get(3));
+        } else {
+            repeat = 11 + static_cast<int32_t>(br.Get(7));
+        }
+        if (i + repeat > hlit + hdist) return false;
+        while (repeat-- > 0) lens[i++] = value;
+    }
+    if (br.Overrun() || !lens[256]) return false;
+    return lit.Build(lens, hlit) && dist.Build(lens + hlit, hdist);
+}
+
+void BuildFixedTables(HuffmanTable& lit, HuffmanTable& dist) {
+    uint8_t lens[288];
+    std::fill(lens, lens + 144, static_cast<uint8_t>(8));
+    std::fill(lens + 144, lens + 256, static_cast<uint8_t>(9));
+    std::fill(lens + 256, lens + 280, static_cast<uint8_t>(7));
+    std::fill(lens + 280, lens + 288, static_cast<uint8_t>(8));
+    lit.Build(lens, 288);
+    uint8_t dist_lens[32];
+    std::fill(dist_lens, dist_lens + 32, static_cast<uint8_t>(5));
+    dist.Build(dist_lens, 32);
+}
+
+bool DecompressHigh(const uint8_t* src, size_t n, uint8_t* dst, size_t raw) {
+    BitReader br(src, n);
+    HuffmanTable lit;
+    HuffmanTable dist;
+    size_t op = 0;
+    bool final = false;
+    while (!final) {
+        final = br.Get(1) != 0;
+        const uint32_t type = br.Get(2);
+        if (type == 0) {
+            br.AlignToByte();
+            const uint32_t len = br.Get(16);
+            const uint32_t nlen = br.Get(16);
+            if ((len ^ 0xFFFF) != nlen || len > raw - op) return false;
+            for (uint32_t i = 0; i < len; ++i) dst[op++] = static_cast<uint8_t>(br.Get(8));
+            if (br.Overrun()) return false;
+            continue;
+        }
+        if (type == 1) {
+            BuildFixedTables(lit, dist);
+        } else if (type != 2 || !ReadDynamicTables(br, lit, dist)) {
+            return false;
+        }
+        for (;;) {
+            const int32_t s = lit.Decode(br);
+            if (s < 0 || br.Overrun()) return false;
+            if (s < 256) {
+                if (op >= raw) return false;
+                dst[op++] = static_cast<uint8_t>(s);
+                continue;
+            }
+            if (s == 256) break;
+            const int32_t lc = s - 257;
+            if (lc >= 29) return false;
+            const size_t len = kLengthBase[lc] + br.Get(kLengthExtra[lc]);
+            const int32_t dc = dist.Decode(br);
+            if (dc < 0 || dc >= kDistCodes) return false;
+            const size_t d = kDistBase[dc] + br.Get(kDistExtra[dc]);
+            if (d > op || len > raw - op) return false;
+            uint8_t* out = dst + op;
+            const uint8_t* from = out - d;
+            if (d >= len) {
+                std::memcpy(out, from, len);
+            } else {
+                for (size_t i = 0; i < len; ++i) out[i] = from[i];
+            }
+            op += len;
+        }
+    }
+    return !br.Overrun() && op == raw;
+}
+} // namespace
+
+struct Encoder::Work {
+    std::vector<uint32_t> fast_table;
+    HighWork high;
+    std::vector<uint8_t> packed;
+};
+
+Encoder::Encoder(Mode mode, std::vector<uint8_t>& out, uint32_t block_size)
+    : mode_(mode == Mode::High ? Mode::High : Mode::Fast),
+      out_(out),
+      block_size_((std::clamp)(block_size, kMinBlockSize, kMaxBlockSize)),
+      work_(std::make_unique<Work>()) {
+    out_.insert(out_.end(), kMagic, kMagic + sizeof(kMagic));
+    out_.push_back(static_cast<uint8_t>(mode_));
+    out_.insert(out_.end(), 3, 0);
+    PutU32(out_, block_size_);
+    pending_.reserve(block_size_);
+}
+
+Encoder::~Encoder() = default;
+
+void Encoder::Write(const void* data, size_t size) {
+    if (finished_) return;
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        const size_t take = (std::min)(size, block_size_ - pending_.size());
+        pending_.insert(pending_.end(), p, p + take);
+        p += take;
+        size -= take;
+        if (pending_.size() == block_size_) FlushBlock();
+    }
+}
+
+void Encoder::FlushBlock() {
+    if (pending_.empty()) return;
+    const size_t n = pending_.size();
+    total_ += n;
+    crc_ = Crc32(crc_, pending_.data(), n);
+
+    auto& packed = work_->packed;
+    packed.clear();
+    if (mode_ == Mode::High) CompressHigh(pending_.data(), n, work_->high, packed);
+    else CompressFast(pending_.data(), n, work_->fast_table, packed);
+
+    PutU32(out_, static_cast<uint32_t>(n));
+    if (packed.size() >= n) {
+        PutU32(out_, static_cast<uint32_t>(n) | kStoredFlag);
+        out_.insert(out_.end(), pending_.begin(), pending_.end());
+    } else {
+        PutU32(out_, static_cast<uint32_t>(packed.size()));
+        out_.insert(out_.end(), packed.begin(), packed.end());
+    }
+    pending_.clear();
+}
+
+void Encoder::Finish() {
+    if (finished_) return;
+    FlushBlock();
+    PutU32(out_, 0);
+    PutU64(out_, total_);
+    PutU32(out_, crc_);
+    finished_ = true;
+    work_.reset();
+    std::vector<uint8_t>().swap(pending_);
+}
+
+Decoder::Decoder(const uint8_t* data, size_t size, size_t max_output)
+    : data_(data), size_(size), max_output_(max_output) {
+    if (!IsFrame(data, size)) {
+        failed_ = true;
+        return;
+    }
+    mode_ = static_cast<Mode>(data[8]);
+    block_size_ = GetU32(data + 12);
+    pos_ = kHeaderSize;
+}
+
+bool Decoder::NextBlock() {
+    if (size_ - pos_ < 4) return false;
+    const uint32_t raw = GetU32(data_ + pos_);
+    pos_ += 4;
+    if (raw == 0) {
+        if (size_ - pos_ < kTrailerSize) return false;
+        const uint64_t total = GetU64(data_ + pos_);
+        const uint32_t crc = GetU32(data_ + pos_ + 8);
+        pos_ += kTrailerSize;
+        if (total != total_ || crc != crc_) return false;
+        done_ = true;
+        return true;
+    }
+    if (size_ - pos_ < 4 || raw > block_size_ || total_ + raw > max_output_) return false;
+    const uint32_t packed_field = GetU32(data_ + pos_);
+    pos_ += 4;
+    const bool stored = (packed_field & kStoredFlag) != 0;
+    const size_t packed = packed_field & ~kStoredFlag;
+    if (packed > size_ - pos_ || (stored && packed != raw)) return false;
+
+    block_.resize(raw);
+    const uint8_t* src = data_ + pos_;
+    bool ok = true;
+    if (stored) std::memcpy(block_.data(), src, raw);
+    else if (mode_ == Mode::High) ok = DecompressHigh(src, packed, block_.data(), raw);
+    else ok = DecompressFast(src, packed, block_.data(), raw);
+    if (!ok) return false;
+    pos_ += packed;
+    block_pos_ = 0;
+    total_ += raw;
+    crc_ = Crc32(crc_, block_.data(), raw);
+    return true;
+}
+
+int64_t Decoder::Read(void* out, size_t size) {
+    if (failed_) return -1;
+    uint8_t* dst = static_cast<uint8_t*>(out);
+    size_t written = 0;
+    while (written < size && !done_) {
+        if (block_pos_ == block_.size()) {
+            if (!NextBlock()) {
+                failed_ = true;
+                return -1;
+            }
+            continue;
+        }
+        const size_t take = (std::min)(size - written, block_.size() - block_pos_);
+        std::memcpy(dst + written, block_.data() + block_pos_, take);
+        block_pos_ += take;
+        written += take;
+    }
+    return static_cast<int64_t>(written);
+}
+
+bool IsFrame(const uint8_t* data, size_t size) {
+    if (!data || size < kHeaderSize + 4 + kTrailerSize) return false;
+    if (std::memcmp(data, kMagic, sizeof(kMagic)) != 0) return false;
+    const uint8_t mode = data[8];
+    const uint32_t block_size = GetU32(data + 12);
+    return (mode == static_cast<uint8_t>(Mode::Fast) || mode == static_cast<uint8_t>(Mode::High)) && block_size >= kMinBlockSize && block_size <= kMaxBlockSize;
+}
+
+void Compress(const uint8_t* data, size_t size, Mode mode, std::vector<uint8_t>& out) {
+    out.clear();
+    Encoder encoder(mode, out);
+    encoder.Write(data, size);
+    encoder.Finish();
+}
+
+bool Decompress(const uint8_t* data, size_t size, std::vector<uint8_t>& out, size_t max_output) {
+    out.clear();
+    if (!IsFrame(data, size)) return false;
+    // 全体のサイズは末尾にある。壊れたフレームで巨大な確保をしないよう、圧縮率の上限 (DEFLATE で約 1032 倍) で抑える
+    const uint64_t total = GetU64(data + size - kTrailerSize);
+    if (total > max_output) return false;
+    out.reserve(static_cast<size_t>((std::min)(total, static_cast<uint64_t>(size) * 1032)));
+    Decoder decoder(data, size, max_output);
+    uint8_t chunk[16 * 1024];
+    for (;;) {
+        const int64_t read = decoder.Read(chunk, sizeof(chunk));
+        if (read < 0) {
+            out.clear();
+            return false;
+        }
+        if (read == 0) return true;
+        out.insert(out.end(), chunk, chunk + read);
+    }
+}
+} // namespace StateCodec
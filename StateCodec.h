@@ -0,0 +1,80 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// プラグインの状態を圧縮するコーデック。Windows の API に依存しないので単体でも動かせる。
+// Fast は LZ4 ブロック形式、High は raw DEFLATE (RFC 1951) で、どちらも外部ライブラリを使わない自前実装。
+// 入力は block_size ごとに独立して圧縮するので、書き込みながら圧縮を進められ、展開もブロック単位で読み出せる。
+// フレーム形式 (数値はリトルエンディアン):
+//   "EAP2CMP2" / uint8 コーデック / 予約 3 バイト / uint32 block_size
+//   ブロック: uint32 元のサイズ / uint32 圧縮後のサイズ (最上位ビットは無圧縮で格納) / データ
+//   元のサイズ 0 のブロックで終わり、uint64 全体のサイズ / uint32 CRC-32 が続く
+namespace StateCodec {
+enum class Mode : int32_t {
+    None = 0,
+    Fast = 1,
+    High = 2,
+};
+
+inline constexpr uint32_t DEFAULT_BLOCK_SIZE = 256 * 1024;
+
+class Encoder {
+  public:
+    // out の末尾にフレームを書き足す
+    Encoder(Mode mode, std::vector<uint8_t>& out, uint32_t block_size = DEFAULT_BLOCK_SIZE);
+    ~Encoder();
+    Encoder(const Encoder&) = delete;
+    Encoder& operator=(const Encoder&) = delete;
+
+    // block_size に達した分から順に圧縮して out に書き出す
+    void Write(const void* data, size_t size);
+    // 残りを書き出して終端を付ける。以降の Write は無視する
+    void Finish();
+    uint64_t total_in() const { return total_; }
+
+  private:
+    struct Work;
+    void FlushBlock();
+
+    Mode mode_;
+    std::vector<uint8_t>& out_;
+    uint32_t block_size_;
+    std::vector<uint8_t> pending_;
+    std::unique_ptr<Work> work_;
+    uint64_t total_ = 0;
+    uint32_t crc_ = 0;
+    bool finished_ = false;
+};
+
+class Decoder {
+  public:
+    // data はフレーム全体。Decoder より長く生きていること
+    Decoder(const uint8_t* data, size_t size, size_t max_output = (std::numeric_limits<size_t>::max)());
+    // 最大 size バイトを展開する。0 は終端、-1 はフレームが壊れているか max_output を超えた
+    int64_t Read(void* out, size_t size);
+    bool failed() const { return failed_; }
+
+  private:
+    bool NextBlock();
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    size_t max_output_;
+    Mode mode_ = Mode::None;
+    uint32_t block_size_ = 0;
+    std::vector<uint8_t> block_;
+    size_t block_pos_ = 0;
+    uint64_t total_ = 0;
+    uint32_t crc_ = 0;
+    bool done_ = false;
+    bool failed_ = false;
+};
+
+bool IsFrame(const uint8_t* data, size_t size);
+void Compress(const uint8_t* data, size_t size, Mode mode, std::vector<uint8_t>& out);
+bool Decompress(const uint8_t* data, size_t size, std::vector<uint8_t>& out, size_t max_output = (std::numeric_limits<size_t>::max)());
+} // namespace StateCodec
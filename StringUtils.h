@@ -1,9 +1,12 @@
 ﻿#pragma once
+#include "StateCodec.h"
+
 #include <charconv>
 #include <compressapi.h>
 #include <cstdint>
 #include <cstring>
 #include <limits>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <string_view>
@@ -113,40 +116,8 @@ inline std::vector<BYTE> Base64Decode(const std::string& b64) {
     return v;
 }
 
-inline bool CompressBlob(const BYTE* data, size_t len, std::vector<BYTE>& out) {
-    out.clear();
-    if (!data || len == 0) return false;
-    if (len > (std::numeric_limits<size_t>::max)()) return false;
-
-    COMPRESSOR_HANDLE compressor = nullptr;
-    if (!CreateCompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, nullptr, &compressor)) return false;
-
-    size_t compressedSize = 0;
-    BOOL ok = Compress(compressor, data, static_cast<size_t>(len), nullptr, 0, &compressedSize);
-    if (!ok && GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
-        CloseCompressor(compressor);
-        return false;
-    }
-
-    out.resize(sizeof(CompressedBlobHeader) + compressedSize);
-    CompressedBlobHeader header{};
-    std::memcpy(header.magic, kCompressedBlobMagic, sizeof(kCompressedBlobMagic));
-    header.originalSize = static_cast<uint64_t>(len);
-    std::memcpy(out.data(), &header, sizeof(header));
-
-    size_t writtenSize = compressedSize;
-    ok = Compress(compressor, data, static_cast<size_t>(len), out.data() + sizeof(CompressedBlobHeader), compressedSize, &writtenSize);
-    CloseCompressor(compressor);
-    if (!ok) {
-        out.clear();
-        return false;
-    }
-
-    out.resize(sizeof(CompressedBlobHeader) + writtenSize);
-    return true;
-}
-
-inline bool DecompressBlob(const BYTE* data, size_t len, std::vector<BYTE>& out, size_t maxOutputSize = (std::numeric_limits<size_t>::max)()) {
+// 以前の保存形式 (EAP2CMP1, compressapi の XPRESS_HUFF) の展開。読み込みだけ残している
+inline bool DecompressLegacyBlob(const BYTE* data, size_t len, std::vector<BYTE>& out, size_t maxOutputSize) {
     out.clear();
     if (!data || len < sizeof(CompressedBlobHeader)) return false;
 
@@ -176,15 +147,57 @@ inline bool DecompressBlob(const BYTE* data, size_t len, std::vector<BYTE>& out,
     return true;
 }
 
-inline std::string EncodeCompressedStatePayload(std::string_view rawPrefix, std::string_view compressedPrefix, const BYTE* data, size_t len, bool enableCompression = true) {
-    if (!data || len == 0) return "";
+inline bool DecompressBlob(const BYTE* data, size_t len, std::vector<BYTE>& out, size_t maxOutputSize = (std::numeric_limits<size_t>::max)()) {
+    if (StateCodec::IsFrame(data, len)) return StateCodec::Decompress(data, len, out, maxOutputSize);
+    return DecompressLegacyBlob(data, len, out, maxOutputSize);
+}
+
+// プラグインが状態を書き出すそばから圧縮し、Finish で "PREFIX:base64" にする。
+// 圧縮しても小さくならなければ無圧縮の rawPrefix 形式で返す
+class StatePayloadWriter {
+  public:
+    StatePayloadWriter(std::string_view rawPrefix, std::string_view compressedPrefix, StateCodec::Mode mode)
+        : rawPrefix_(rawPrefix), compressedPrefix_(compressedPrefix) {
+        if (mode != StateCodec::Mode::None) encoder_ = std::make_unique<StateCodec::Encoder>(mode, frame_);
+    }
 
-    std::vector<BYTE> compressed;
-    if (enableCompression && CompressBlob(data, len, compressed) && compressed.size() < len) {
-        return std::string(compressedPrefix) + Base64Encode(compressed.data(), static_cast<DWORD>(compressed.size()));
+    void Write(const void* data, size_t len) {
+        if (!data || len == 0) return;
+        if (encoder_) {
+            encoder_->Write(data, len);
+        } else {
+            const BYTE* p = static_cast<const BYTE*>(data);
+            raw_.insert(raw_.end(), p, p + len);
+        }
+    }
+
+    std::string Finish() {
+        if (encoder_) {
+            encoder_->Finish();
+            const uint64_t total = encoder_->total_in();
+            encoder_.reset();
+            if (total == 0) return "";
+            if (frame_.size() < total) return std::string(compressedPrefix_) + Base64Encode(frame_.data(), static_cast<DWORD>(frame_.size()));
+            // 圧縮できないブロックは元のまま入っているので、展開はほぼコピーで済む
+            if (!StateCodec::Decompress(frame_.data(), frame_.size(), raw_)) return "";
+        }
+        if (raw_.empty()) return "";
+        return std::string(rawPrefix_) + Base64Encode(raw_.data(), static_cast<DWORD>(raw_.size()));
     }
 
-    return std::string(rawPrefix) + Base64Encode(data, static_cast<DWORD>(len));
+  private:
+    std::string rawPrefix_;
+    std::string compressedPrefix_;
+    std::unique_ptr<StateCodec::Encoder> encoder_;
+    std::vector<BYTE> frame_;
+    std::vector<BYTE> raw_;
+};
+
+inline std::string EncodeCompressedStatePayload(std::string_view rawPrefix, std::string_view compressedPrefix, const BYTE* data, size_t len, StateCodec::Mode mode = StateCodec::Mode::Fast) {
+    if (!data || len == 0) return "";
+    StatePayloadWriter writer(rawPrefix, compressedPrefix, mode);
+    writer.Write(data, len);
+    return writer.Finish();
 }
 
 inline bool DecodeStatePayload(const std::string& encodedState, std::string_view rawPrefix, std::string_view compressedPrefix, std::vector<BYTE>& decodedPayload, size_t maxDecodedSize = (std::numeric_limits<size_t>::max)()) {
@@ -0,0 +1,117 @@
+﻿#include "TaskPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace TaskPool {
+namespace {
+struct Batch {
+    const std::function<void(int32_t)>* func = nullptr;
+    int32_t count = 0;
+    std::atomic<int32_t> next{ 0 };
+    std::atomic<int32_t> remaining{ 0 };
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+// 番号が尽きるまで取って実行する
+void Drain(Batch& batch) {
+    for (;;) {
+        const int32_t index = batch.next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= batch.count) return;
+        (*batch.func)(index);
+        if (batch.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(batch.mutex);
+            batch.done.notify_all();
+        }
+    }
+}
+
+class Pool {
+  public:
+    ~Pool() { Stop(); }
+
+    void Run(int32_t count, const std::function<void(int32_t)>& func) {
+        auto batch = std::make_shared<Batch>();
+        batch->func = &func;
+        batch->count = count;
+        batch->remaining.store(count, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (threads_.empty()) {
+                stopping_ = false;
+                const int32_t thread_count = std::clamp(static_cast<int32_t>(std::thread::hardware_concurrency()) - 1, 1, 8);
+                for (int32_t i = 0; i < thread_count; ++i) threads_.emplace_back([this] { Work(); });
+            }
+            batches_.push_back(batch);
+        }
+        cv_.notify_all();
+
+        Drain(*batch);
+        Remove(batch);
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->done.wait(lock, [&] { return batch->remaining.load(std::memory_order_acquire) == 0; });
+    }
+
+    void Stop() {
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            threads.swap(threads_);
+        }
+        cv_.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+  private:
+    void Work() {
+        for (;;) {
+            std::shared_ptr<Batch> batch;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stopping_ || !batches_.empty(); });
+                if (stopping_) return;
+                batch = batches_.front();
+            }
+            Drain(*batch);
+            // 番号を配り終えたバッチは外す。実行中の仕事は取った側が最後まで進める
+            Remove(batch);
+        }
+    }
+
+    void Remove(const std::shared_ptr<Batch>& batch) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find(batches_.begin(), batches_.end(), batch);
+        if (it != batches_.end()) batches_.erase(it);
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::shared_ptr<Batch>> batches_;
+    std::vector<std::thread> threads_;
+    bool stopping_ = false;
+};
+
+Pool g_pool;
+} // namespace
+
+void ParallelFor(int32_t count, const std::function<void(int32_t)>& func) {
+    if (count <= 0) return;
+    if (count == 1) {
+        func(0);
+        return;
+    }
+    g_pool.Run(count, func);
+}
+
+void Shutdown() {
+    g_pool.Stop();
+}
+} // namespace TaskPool
@@ -0,0 +1,13 @@
+﻿#pragma once
+#include <cstdint>
+#include <functional>
+
+// 音声処理の中で互いに依存しない仕事をまとめて並列に実行するスレッドプール。
+// ParallelFor ごとに仕事の番号を 1 つのカウンタで配り、手の空いたスレッドが残りを取っていく。
+// 呼び出し元のスレッドも仕事を取るので、ワーカーが他の呼び出しで塞がっていても処理は止まらない。
+namespace TaskPool {
+// func(0) .. func(count - 1) を実行し、すべて終わるまで待つ。count が 1 以下なら呼び出し元で実行する
+void ParallelFor(int32_t count, const std::function<void(int32_t)>& func);
+// ワーカーを止める。UninitializePlugin から呼ぶ
+void Shutdown();
+} // namespace TaskPool
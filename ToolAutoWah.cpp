@@ -1,9 +1,10 @@
 ﻿#include "Avx2Utils.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
 #include <cmath>
-#include <map>
 
 constexpr auto TOOL_NAME = L"Auto Wah";
 
@@ -43,13 +44,14 @@ struct AutoWahState {
     float c_b0 = 0.0f, c_b1 = 0.0f, c_b2 = 0.0f, c_a1 = 0.0f, c_a2 = 0.0f;
 };
 
-static std::mutex g_wah_mutex;
-static std::map<int64_t, AutoWahState> g_wah_states;
+static EffectStateRegistry<AutoWahState> g_wah_states{ EffectStateReclaim::Allowed };
 
 const int32_t BLOCK_SIZE = 64;
 const int32_t CONTROL_RATE = 8;
 
 bool func_proc_audio_autowah(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
 
@@ -63,26 +65,20 @@ bool func_proc_audio_autowah(FILTER_PROC_AUDIO* audio) {
     float att_coeff = std::exp(-1.0f / (30.0f * 0.001f * static_cast<float>(sr)));
     float rel_coeff = std::exp(-1.0f / (150.0f * 0.001f * static_cast<float>(sr)));
 
-    AutoWahState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_wah_mutex);
-        state = &g_wah_states[audio->object->effect_id];
+    AutoWahState* state = &g_wah_states.Get(audio->object->effect_id);
 
-        if (state->last_sample_end != -1 && state->last_sample_end != audio->object->sample_index) {
-            state->filterL = AutoWahBiquad();
-            state->filterR = AutoWahBiquad();
-            state->envelope = 0.0f;
-            state->initialized = false;
-        }
-        state->initialized = true;
+    if (state->last_sample_end != -1 && state->last_sample_end != audio->object->sample_index) {
+        state->filterL = AutoWahBiquad();
+        state->filterR = AutoWahBiquad();
+        state->envelope = 0.0f;
+        state->initialized = false;
     }
+    state->initialized = true;
 
     int32_t channels = (std::min)(2, audio->object->channel_num);
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
     else Avx2Utils::CopyBufferAVX2(bufR.data(), bufL.data(), total_samples);
@@ -152,16 +148,13 @@ bool func_proc_audio_autowah(FILTER_PROC_AUDIO* audio) {
         Avx2Utils::MixAudioAVX2(pR, temp_wet_R, block_count, 1.0f - mix, mix, 1.0f);
     }
 
-    {
-        std::lock_guard<std::mutex> lock(g_wah_mutex);
-        state->envelope = current_env;
-        state->c_b0 = c_b0;
-        state->c_b1 = c_b1;
-        state->c_b2 = c_b2;
-        state->c_a1 = c_a1;
-        state->c_a2 = c_a2;
-        state->last_sample_end = audio->object->sample_index + total_samples;
-    }
+    state->envelope = current_env;
+    state->c_b0 = c_b0;
+    state->c_b1 = c_b1;
+    state->c_b2 = c_b2;
+    state->c_a1 = c_a1;
+    state->c_a2 = c_a2;
+    state->last_sample_end = audio->object->sample_index + total_samples;
 
     if (channels >= 1) audio->set_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->set_sample_data(bufR.data(), 1);
@@ -170,7 +163,7 @@ bool func_proc_audio_autowah(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupAutoWahResources() {
-    g_wah_states.clear();
+    g_wah_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_autowah = {
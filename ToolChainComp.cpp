@@ -1,10 +1,11 @@
 ﻿#include "Avx2Utils.h"
 #include "ChainManager.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
 #include <cmath>
-#include <map>
 #include <mutex>
 #include <vector>
 
@@ -34,11 +35,12 @@ struct ChainCompState {
     std::array<int32_t, ChainManager::MAX_PER_ID> missed_count = { 0 };
 };
 
-static std::mutex g_chain_state_mutex;
-static std::map<int64_t, ChainCompState> g_chain_states;
+static EffectStateRegistry<ChainCompState> g_chain_states;
 const int32_t BLOCK_SIZE = 64;
 
 bool func_proc_audio_chain_comp(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -53,27 +55,20 @@ bool func_proc_audio_chain_comp(FILTER_PROC_AUDIO* audio) {
     if (id_idx < 0 || id_idx >= ChainManager::MAX_ID) return true;
     if (comp_ratio == 1.0 && comp_makeup_db == 0.0) return true;
 
-    ChainCompState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_chain_state_mutex);
-        state = &g_chain_states[audio->object->effect_id];
-        if (state->last_sample_index != -1 &&
-            state->last_sample_index != audio->object->sample_index) {
-            state->comp_envelope = 0.0;
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    ChainCompState* state = &g_chain_states.Get(audio->object->effect_id);
+    if (state->last_sample_index != -1 &&
+        state->last_sample_index != audio->object->sample_index) {
+        state->comp_envelope = 0.0;
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
     double comp_att_coef = 1.0 - std::exp(-1.0 / ((std::max)(0.1, comp_att_ms) * 0.001 * Fs));
     double comp_rel_coef = 1.0 - std::exp(-1.0 / ((std::max)(0.1, comp_rel_ms) * 0.001 * Fs));
-    double makeup_lin = std::pow(10.0, comp_makeup_db / 20.0);
 
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
 
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
@@ -107,6 +102,7 @@ bool func_proc_audio_chain_comp(FILTER_PROC_AUDIO* audio) {
     double current_comp_env = state->comp_envelope;
     double trigger_abs = sidechain_input;
 
+    alignas(32) float temp_env[BLOCK_SIZE];
     alignas(32) float temp_gain[BLOCK_SIZE];
 
     for (int32_t i = 0; i < total_samples; i += BLOCK_SIZE) {
@@ -119,26 +115,17 @@ bool func_proc_audio_chain_comp(FILTER_PROC_AUDIO* audio) {
                 current_comp_env += comp_att_coef * (trigger_abs - current_comp_env);
             else
                 current_comp_env += comp_rel_coef * (trigger_abs - current_comp_env);
-
-            double env_db = (current_comp_env > 1.0e-6) ? 20.0 * std::log10(current_comp_env) : -120.0;
-            double gain_reduction_db = 0.0;
-            if (env_db > comp_th_db) {
-                gain_reduction_db = (env_db - comp_th_db) * (1.0 / comp_ratio - 1.0);
-            }
-            double comp_gain = std::pow(10.0, gain_reduction_db / 20.0);
-            comp_gain *= makeup_lin;
-
-            temp_gain[k] = static_cast<float>(comp_gain);
+            temp_env[k] = static_cast<float>(current_comp_env);
         }
 
+        Avx2Utils::CompressorGainAVX2(temp_gain, temp_env, block_count, static_cast<float>(comp_th_db),
+                                      static_cast<float>(1.0 / comp_ratio - 1.0), static_cast<float>(comp_makeup_db), 1.0e-6f);
+
         Avx2Utils::MultiplyBufferAVX2(pL, temp_gain, block_count);
         Avx2Utils::MultiplyBufferAVX2(pR, temp_gain, block_count);
     }
 
-    {
-        std::lock_guard<std::mutex> lock(g_chain_state_mutex);
-        state->comp_envelope = current_comp_env;
-    }
+    state->comp_envelope = current_comp_env;
 
     if (channels >= 1) audio->set_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->set_sample_data(bufR.data(), 1);
@@ -147,7 +134,7 @@ bool func_proc_audio_chain_comp(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupChainCompResources() {
-    g_chain_states.clear();
+    g_chain_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_chain_comp = {
@@ -1,9 +1,11 @@
 ﻿#include "Avx2Utils.h"
+#include "BiquadDesign.h"
 #include "ChainManager.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <cmath>
-#include <map>
 
 constexpr auto TOOL_NAME = L"Chain Dynamic EQ";
 
@@ -35,6 +37,7 @@ struct DynEqBiquad {
 
 struct DynEqState {
     DynEqBiquad filterL, filterR;
+    BiquadDesign::PeakingGain peak;
     double envelope = 0.0;
     int64_t last_sample_index = -1;
     std::array<uint32_t, ChainManager::MAX_PER_ID> last_update_count = { 0 };
@@ -42,13 +45,14 @@ struct DynEqState {
     float c_b0 = 1.0f, c_b1 = 0.0f, c_b2 = 0.0f, c_a1 = 0.0f, c_a2 = 0.0f;
 };
 
-static std::mutex g_dyneq_mutex;
-static std::map<int64_t, DynEqState> g_dyneq_states;
+static EffectStateRegistry<DynEqState> g_dyneq_states;
 
 const int32_t BLOCK_SIZE = 64;
 const int32_t CONTROL_RATE = 8;
 
 bool func_proc_audio_chain_dyn_eq(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
 
@@ -62,25 +66,18 @@ bool func_proc_audio_chain_dyn_eq(FILTER_PROC_AUDIO* audio) {
     double att_ms = deq_att.value;
     double rel_ms = deq_rel.value;
 
-    DynEqState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_dyneq_mutex);
-        state = &g_dyneq_states[audio->object->effect_id];
-        if (state->last_sample_index != -1 && state->last_sample_index != audio->object->sample_index) {
-            state->filterL = DynEqBiquad();
-            state->filterR = DynEqBiquad();
-            state->envelope = 0.0;
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    DynEqState* state = &g_dyneq_states.Get(audio->object->effect_id);
+    if (state->last_sample_index != -1 && state->last_sample_index != audio->object->sample_index) {
+        state->filterL = DynEqBiquad();
+        state->filterR = DynEqBiquad();
+        state->envelope = 0.0;
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
     double att_coef = 1.0 - std::exp(-1.0 / ((std::max)(0.1, att_ms) * 0.001 * Fs));
     double rel_coef = 1.0 - std::exp(-1.0 / ((std::max)(0.1, rel_ms) * 0.001 * Fs));
-    double omega = 2.0 * M_PI * freq / Fs;
-    double sn = std::sin(omega);
-    double cs = std::cos(omega);
-    double alpha = sn / (2.0 * q);
+    state->peak.Prepare(Fs, freq, q);
 
     double sidechain_input = 0.0;
     {
@@ -108,11 +105,9 @@ bool func_proc_audio_chain_dyn_eq(FILTER_PROC_AUDIO* audio) {
     }
 
     int32_t channels = (std::min)(2, audio->object->channel_num);
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
     else Avx2Utils::CopyBufferAVX2(bufR.data(), bufL.data(), total_samples);
@@ -144,15 +139,12 @@ bool func_proc_audio_chain_dyn_eq(FILTER_PROC_AUDIO* audio) {
                     current_gain_db = max_reduction_db * ratio;
                 }
 
-                double A = std::pow(10.0, current_gain_db * 0.025);
-                double norm = 1.0 + alpha / A;
-                double norm_inv = 1.0 / norm;
-
-                c_b0 = static_cast<float>((1.0 + alpha * A) * norm_inv);
-                c_b1 = static_cast<float>((-2.0 * cs) * norm_inv);
-                c_b2 = static_cast<float>((1.0 - alpha * A) * norm_inv);
-                c_a1 = static_cast<float>((-2.0 * cs) * norm_inv);
-                c_a2 = static_cast<float>((1.0 - alpha / A) * norm_inv);
+                const BiquadDesign::Coeffs& c = state->peak.At(current_gain_db);
+                c_b0 = static_cast<float>(c.b0);
+                c_b1 = static_cast<float>(c.b1);
+                c_b2 = static_cast<float>(c.b2);
+                c_a1 = static_cast<float>(c.a1);
+                c_a2 = static_cast<float>(c.a2);
             }
 
             state->filterL.process(pL[k], c_b0, c_b1, c_b2, c_a1, c_a2);
@@ -160,15 +152,12 @@ bool func_proc_audio_chain_dyn_eq(FILTER_PROC_AUDIO* audio) {
         }
     }
 
-    {
-        std::lock_guard<std::mutex> lock(g_dyneq_mutex);
-        state->envelope = current_env;
-        state->c_b0 = c_b0;
-        state->c_b1 = c_b1;
-        state->c_b2 = c_b2;
-        state->c_a1 = c_a1;
-        state->c_a2 = c_a2;
-    }
+    state->envelope = current_env;
+    state->c_b0 = c_b0;
+    state->c_b1 = c_b1;
+    state->c_b2 = c_b2;
+    state->c_a1 = c_a1;
+    state->c_a2 = c_a2;
 
     if (channels >= 1) audio->set_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->set_sample_data(bufR.data(), 1);
@@ -177,7 +166,7 @@ bool func_proc_audio_chain_dyn_eq(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupChainDynEQResources() {
-    g_dyneq_states.clear();
+    g_dyneq_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_chain_dyn_eq = {
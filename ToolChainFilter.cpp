@@ -1,9 +1,10 @@
 ﻿#include "Avx2Utils.h"
 #include "ChainManager.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <cmath>
-#include <map>
 
 constexpr auto TOOL_NAME = L"Chain Filter";
 
@@ -47,13 +48,14 @@ struct ChainFilterState {
     float c_b0 = 1.0f, c_b1 = 0.0f, c_b2 = 0.0f, c_a1 = 0.0f, c_a2 = 0.0f;
 };
 
-static std::mutex g_cfilt_mutex;
-static std::map<int64_t, ChainFilterState> g_cfilt_states;
+static EffectStateRegistry<ChainFilterState> g_cfilt_states;
 
 const int32_t BLOCK_SIZE = 64;
 const int32_t CONTROL_RATE = 8;
 
 bool func_proc_audio_chain_filter(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
 
@@ -66,17 +68,13 @@ bool func_proc_audio_chain_filter(FILTER_PROC_AUDIO* audio) {
     double att_ms = cfilt_att.value;
     double rel_ms = cfilt_rel.value;
 
-    ChainFilterState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_cfilt_mutex);
-        state = &g_cfilt_states[audio->object->effect_id];
-        if (state->last_sample_index != -1 && state->last_sample_index != audio->object->sample_index) {
-            state->filterL = ChainFilterBiquad();
-            state->filterR = ChainFilterBiquad();
-            state->envelope = 0.0;
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    ChainFilterState* state = &g_cfilt_states.Get(audio->object->effect_id);
+    if (state->last_sample_index != -1 && state->last_sample_index != audio->object->sample_index) {
+        state->filterL = ChainFilterBiquad();
+        state->filterR = ChainFilterBiquad();
+        state->envelope = 0.0;
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
     double att_coef = 1.0 - std::exp(-1.0 / ((std::max)(0.1, att_ms) * 0.001 * Fs));
@@ -108,11 +106,9 @@ bool func_proc_audio_chain_filter(FILTER_PROC_AUDIO* audio) {
     }
 
     int32_t channels = (std::min)(2, audio->object->channel_num);
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
     else Avx2Utils::CopyBufferAVX2(bufR.data(), bufL.data(), total_samples);
@@ -157,15 +153,12 @@ bool func_proc_audio_chain_filter(FILTER_PROC_AUDIO* audio) {
             state->filterR.process(pR[k], c_b0, c_b1, c_b2, c_a1, c_a2);
         }
     }
-    {
-        std::lock_guard<std::mutex> lock(g_cfilt_mutex);
-        state->envelope = current_env;
-        state->c_b0 = c_b0;
-        state->c_b1 = c_b1;
-        state->c_b2 = c_b2;
-        state->c_a1 = c_a1;
-        state->c_a2 = c_a2;
-    }
+    state->envelope = current_env;
+    state->c_b0 = c_b0;
+    state->c_b1 = c_b1;
+    state->c_b2 = c_b2;
+    state->c_a1 = c_a1;
+    state->c_a2 = c_a2;
 
     if (channels >= 1) audio->set_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->set_sample_data(bufR.data(), 1);
@@ -174,7 +167,7 @@ bool func_proc_audio_chain_filter(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupChainFilterResources() {
-    g_cfilt_states.clear();
+    g_cfilt_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_chain_filter = {
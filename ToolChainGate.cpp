@@ -1,10 +1,11 @@
 ﻿#include "Avx2Utils.h"
 #include "ChainManager.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
 #include <cmath>
-#include <map>
 #include <mutex>
 #include <vector>
 
@@ -32,11 +33,12 @@ struct ChaingateState {
     std::array<int32_t, ChainManager::MAX_PER_ID> missed_count = { 0 };
 };
 
-static std::mutex g_chain_state_mutex;
-static std::map<int64_t, ChaingateState> g_chain_states;
+static EffectStateRegistry<ChaingateState> g_chain_states;
 const int32_t BLOCK_SIZE = 64;
 
 bool func_proc_audio_chain_gate(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -50,27 +52,21 @@ bool func_proc_audio_chain_gate(FILTER_PROC_AUDIO* audio) {
     if (id_idx < 0 || id_idx >= ChainManager::MAX_ID) return true;
     if (gate_ratio == 1.0) return true;
 
-    ChaingateState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_chain_state_mutex);
-        state = &g_chain_states[audio->object->effect_id];
-        if (state->last_sample_index != -1 &&
-            state->last_sample_index != audio->object->sample_index) {
-            state->gate_envelope = 0.0;
-            state->missed_count.fill(0);
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    ChaingateState* state = &g_chain_states.Get(audio->object->effect_id);
+    if (state->last_sample_index != -1 &&
+        state->last_sample_index != audio->object->sample_index) {
+        state->gate_envelope = 0.0;
+        state->missed_count.fill(0);
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
     double gate_att_coef = 1.0 - std::exp(-1.0 / ((std::max)(0.1, gate_att_ms) * 0.001 * Fs));
     double gate_rel_coef = 1.0 - std::exp(-1.0 / ((std::max)(0.1, gate_rel_ms) * 0.001 * Fs));
 
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
 
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
@@ -130,10 +126,7 @@ bool func_proc_audio_chain_gate(FILTER_PROC_AUDIO* audio) {
         Avx2Utils::MultiplyBufferAVX2(pR, temp_gain, block_count);
     }
 
-    {
-        std::lock_guard<std::mutex> lock(g_chain_state_mutex);
-        state->gate_envelope = current_gate_env;
-    }
+    state->gate_envelope = current_gate_env;
 
     if (channels >= 1) audio->set_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->set_sample_data(bufR.data(), 1);
@@ -142,7 +135,7 @@ bool func_proc_audio_chain_gate(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupChainGateResources() {
-    g_chain_states.clear();
+    g_chain_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_chain_gate = {
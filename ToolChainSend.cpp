@@ -1,6 +1,7 @@
 ﻿#include "Avx2Utils.h"
 #include "ChainManager.h"
 #include "Eap2Common.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
 #include <vector>
@@ -21,6 +22,8 @@ void* filter_items_chain_send[] = {
 };
 
 bool func_proc_audio_chain_send(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -44,11 +47,9 @@ bool func_proc_audio_chain_send(FILTER_PROC_AUDIO* audio) {
         std::clamp(valid_end - chunk_start, INT64_C(0), static_cast<int64_t>(total_samples)));
     const int32_t valid_samples = end - skip;
     if (valid_samples <= 0) return true;
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
 
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
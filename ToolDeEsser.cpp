@@ -1,8 +1,10 @@
 ﻿#include "Avx2Utils.h"
+#include "BiquadDesign.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <cmath>
-#include <map>
 
 constexpr auto TOOL_NAME = L"DeEsser";
 
@@ -35,19 +37,21 @@ struct DeesserBiquad {
 struct DeesserState {
     DeesserBiquad scFilterL, scFilterR;
     DeesserBiquad mainFilterL, mainFilterR;
+    BiquadDesign::PeakingGain peak;
     float envelope = 0.0f;
     bool initialized = false;
     int64_t last_sample_index = -1;
     float cur_b0 = 1.0f, cur_b1 = 0.0f, cur_b2 = 0.0f, cur_a1 = 0.0f, cur_a2 = 0.0f;
 };
 
-static std::mutex g_deess_mutex;
-static std::map<int64_t, DeesserState> g_deess_states;
+static EffectStateRegistry<DeesserState> g_deess_states{ EffectStateReclaim::Allowed };
 
 const int32_t BLOCK_SIZE = 64;
 const int32_t CONTROL_RATE = 8;
 
 bool func_proc_audio_deesser(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
 
@@ -61,45 +65,32 @@ bool func_proc_audio_deesser(FILTER_PROC_AUDIO* audio) {
     float att_coeff = std::exp(-1.0f / (5.0f * 0.001f * static_cast<float>(sr)));
     float rel_coeff = std::exp(-1.0f / (50.0f * 0.001f * static_cast<float>(sr)));
 
-    DeesserState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_deess_mutex);
-        state = &g_deess_states[audio->object->effect_id];
-        if (state->last_sample_index != -1 && state->last_sample_index != audio->object->sample_index) {
-            state->scFilterL = DeesserBiquad();
-            state->scFilterR = DeesserBiquad();
-            state->mainFilterL = DeesserBiquad();
-            state->mainFilterR = DeesserBiquad();
-            state->envelope = 0.0f;
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
-        state->initialized = true;
+    DeesserState* state = &g_deess_states.Get(audio->object->effect_id);
+    if (state->last_sample_index != -1 && state->last_sample_index != audio->object->sample_index) {
+        state->scFilterL = DeesserBiquad();
+        state->scFilterR = DeesserBiquad();
+        state->mainFilterL = DeesserBiquad();
+        state->mainFilterR = DeesserBiquad();
+        state->envelope = 0.0f;
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
+    state->initialized = true;
 
     int32_t channels = (std::min)(2, audio->object->channel_num);
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
     else Avx2Utils::CopyBufferAVX2(bufR.data(), bufL.data(), total_samples);
 
-    float omega_sc = 2.0f * static_cast<float>(M_PI) * freq / static_cast<float>(sr);
-    float sn_sc = std::sin(omega_sc);
-    float cs_sc = std::cos(omega_sc);
-    float alpha_sc = sn_sc / (2.0f * 0.707f);
-    float norm_sc_inv = 1.0f / (1.0f + alpha_sc);
-    float b0_sc = ((1.0f + cs_sc) * 0.5f) * norm_sc_inv;
-    float b1_sc = -(1.0f + cs_sc) * norm_sc_inv;
-    float b2_sc = b0_sc;
-    float a1_sc = (-2.0f * cs_sc) * norm_sc_inv;
-    float a2_sc = (1.0f - alpha_sc) * norm_sc_inv;
-    float omega = 2.0f * static_cast<float>(M_PI) * freq / static_cast<float>(sr);
-    float sn = std::sin(omega);
-    float cs = std::cos(omega);
-    float alpha = sn / (2.0f * q);
+    const BiquadDesign::Coeffs sc = BiquadDesign::Design({ BiquadDesign::Type::HighPass, sr, freq, 0.707, 0.0 });
+    float b0_sc = static_cast<float>(sc.b0);
+    float b1_sc = static_cast<float>(sc.b1);
+    float b2_sc = static_cast<float>(sc.b2);
+    float a1_sc = static_cast<float>(sc.a1);
+    float a2_sc = static_cast<float>(sc.a2);
+    state->peak.Prepare(sr, freq, q);
 
     float c_b0 = state->cur_b0;
     float c_b1 = state->cur_b1;
@@ -130,15 +121,12 @@ bool func_proc_audio_deesser(FILTER_PROC_AUDIO* audio) {
                     gain_db = max_cut * ratio;
                 }
 
-                float A = std::pow(10.0f, gain_db * 0.025f);
-                float norm = 1.0f + alpha / A;
-                float norm_inv = 1.0f / norm;
-
-                c_b0 = (1.0f + alpha * A) * norm_inv;
-                c_b1 = (-2.0f * cs) * norm_inv;
-                c_b2 = (1.0f - alpha * A) * norm_inv;
-                c_a1 = (-2.0f * cs) * norm_inv;
-                c_a2 = (1.0f - alpha / A) * norm_inv;
+                const BiquadDesign::Coeffs& c = state->peak.At(gain_db);
+                c_b0 = static_cast<float>(c.b0);
+                c_b1 = static_cast<float>(c.b1);
+                c_b2 = static_cast<float>(c.b2);
+                c_a1 = static_cast<float>(c.a1);
+                c_a2 = static_cast<float>(c.a2);
             }
 
             pL[k] = state->mainFilterL.process_ret(pL[k], c_b0, c_b1, c_b2, c_a1, c_a2);
@@ -159,7 +147,7 @@ bool func_proc_audio_deesser(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupDeEsserResources() {
-    g_deess_states.clear();
+    g_deess_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_deesser = {
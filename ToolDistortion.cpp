@@ -1,10 +1,10 @@
 ﻿#include "Avx2Utils.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
 #include <cmath>
-#include <map>
-#include <mutex>
 #include <vector>
 
 constexpr auto TOOL_NAME = L"Distortion";
@@ -64,11 +64,12 @@ struct DistortionState {
     }
 };
 
-static std::mutex g_dist_state_mutex;
-static std::map<int64_t, DistortionState> g_dist_states;
+static EffectStateRegistry<DistortionState> g_dist_states{ EffectStateReclaim::Allowed };
 const int32_t BLOCK_SIZE = 64;
 
 bool func_proc_audio_distortion(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -87,17 +88,13 @@ bool func_proc_audio_distortion(FILTER_PROC_AUDIO* audio) {
 
     if (mix == 0.0f) return true;
 
-    DistortionState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_dist_state_mutex);
-        state = &g_dist_states[audio->object->effect_id];
-        if (!state->initialized) state->init();
-        if (state->last_sample_index != -1 &&
-            state->last_sample_index != audio->object->sample_index) {
-            state->clear();
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    DistortionState* state = &g_dist_states.Get(audio->object->effect_id);
+    if (!state->initialized) state->init();
+    if (state->last_sample_index != -1 &&
+        state->last_sample_index != audio->object->sample_index) {
+        state->clear();
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
     float alpha = static_cast<float>(2.0 * M_PI * tone_freq / Fs);
@@ -110,11 +107,9 @@ bool func_proc_audio_distortion(FILTER_PROC_AUDIO* audio) {
     bool ds_active = (ds_factor > 1);
     bool quant_active = (bits < 24.0f);
 
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
 
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
@@ -190,7 +185,7 @@ bool func_proc_audio_distortion(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupDistortionResources() {
-    g_dist_states.clear();
+    g_dist_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_distortion = {
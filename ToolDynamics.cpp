@@ -1,10 +1,10 @@
 ﻿#include "Avx2Utils.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
 #include <cmath>
-#include <map>
-#include <mutex>
 #include <vector>
 
 constexpr auto TOOL_NAME = L"Dynamics";
@@ -42,11 +42,12 @@ struct DynamicsState {
     int64_t last_sample_index = -1;
 };
 
-static std::mutex g_dyn_state_mutex;
-static std::map<int64_t, DynamicsState> g_dyn_states;
+static EffectStateRegistry<DynamicsState> g_dyn_states{ EffectStateReclaim::Allowed };
 const int32_t BLOCK_SIZE = 64;
 
 bool func_proc_audio_dynamics(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -65,17 +66,13 @@ bool func_proc_audio_dynamics(FILTER_PROC_AUDIO* audio) {
         return true;
     }
 
-    DynamicsState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_dyn_state_mutex);
-        state = &g_dyn_states[audio->object->effect_id];
-        if (state->last_sample_index != -1 &&
-            state->last_sample_index != audio->object->sample_index) {
-            state->gate_gain = 1.0;
-            state->comp_envelope = 0.0;
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    DynamicsState* state = &g_dyn_states.Get(audio->object->effect_id);
+    if (state->last_sample_index != -1 &&
+        state->last_sample_index != audio->object->sample_index) {
+        state->gate_gain = 1.0;
+        state->comp_envelope = 0.0;
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
 
@@ -86,20 +83,16 @@ bool func_proc_audio_dynamics(FILTER_PROC_AUDIO* audio) {
     double comp_att_coef = 1.0 - std::exp(-1.0 / ((std::max)(0.1, comp_att_ms) * 0.001 * Fs));
     double comp_rel_coef = 1.0 - std::exp(-1.0 / ((std::max)(0.1, comp_rel_ms) * 0.001 * Fs));
 
-    double makeup_lin = std::pow(10.0, comp_makeup_db / 20.0);
     bool use_comp = (comp_ratio > 1.0 || comp_makeup_db > 0.0);
 
     float lim_lin = static_cast<float>(std::pow(10.0, lim_db / 20.0));
 
-    thread_local std::vector<float> bufL, bufR;
-    thread_local std::vector<float> peak_buf, gate_target_buf, comp_gain_buf;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-        peak_buf.resize(total_samples);
-        gate_target_buf.resize(total_samples);
-        comp_gain_buf.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
+    auto peak_buf = scratch.Alloc(total_samples);
+    auto gate_target_buf = scratch.Alloc(total_samples);
+    auto comp_gain_buf = scratch.Alloc(total_samples);
 
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
@@ -111,6 +104,7 @@ bool func_proc_audio_dynamics(FILTER_PROC_AUDIO* audio) {
     Avx2Utils::ThresholdAVX2(gate_target_buf.data(), peak_buf.data(), total_samples, static_cast<float>(gate_th_lin));
 
     alignas(32) float temp_gain[BLOCK_SIZE];
+    alignas(32) float temp_env[BLOCK_SIZE];
 
     for (int32_t i = 0; i < total_samples; i += BLOCK_SIZE) {
         int32_t block_count = (std::min)(BLOCK_SIZE, total_samples - i);
@@ -126,34 +120,31 @@ bool func_proc_audio_dynamics(FILTER_PROC_AUDIO* audio) {
             else
                 current_gate_gain += gate_rel_coef * (gate_target - current_gate_gain);
 
-            double gated_abs = p_peak[k] * current_gate_gain;
-
-            double comp_gain = 1.0;
             if (use_comp) {
+                double gated_abs = p_peak[k] * current_gate_gain;
                 if (gated_abs > current_comp_env)
                     current_comp_env += comp_att_coef * (gated_abs - current_comp_env);
                 else
                     current_comp_env += comp_rel_coef * (gated_abs - current_comp_env);
-
-                double env_db = (current_comp_env > 1.0e-6) ? 20.0 * std::log10(current_comp_env) : -120.0;
-                double gain_reduction_db = 0.0;
-
-                if (env_db > comp_th_db) {
-                    gain_reduction_db = (env_db - comp_th_db) * (1.0 / comp_ratio - 1.0);
-                }
-                comp_gain = std::pow(10.0, gain_reduction_db / 20.0);
-                comp_gain *= makeup_lin;
+                temp_env[k] = static_cast<float>(current_comp_env);
             }
 
-            temp_gain[k] = static_cast<float>(current_gate_gain * comp_gain);
+            temp_gain[k] = static_cast<float>(current_gate_gain);
         }
 
-        Avx2Utils::MultiplyBufferAVX2(pL, temp_gain, block_count);
-        Avx2Utils::MultiplyBufferAVX2(pR, temp_gain, block_count);
+        // エンベロープは逐次計算が必要だが、ゲインカーブはブロックごとにまとめてベクトルで求める
+        if (use_comp) {
+            Avx2Utils::CompressorGainAVX2(temp_env, temp_env, block_count, static_cast<float>(comp_th_db),
+                                          static_cast<float>(1.0 / comp_ratio - 1.0), static_cast<float>(comp_makeup_db), 1.0e-6f);
+            Avx2Utils::MultiplyBufferAVX2(temp_gain, temp_env, block_count);
+        }
 
         if (lim_db < 0.0) {
-            Avx2Utils::HardClipAVX2(pL, block_count, -lim_lin, lim_lin);
-            Avx2Utils::HardClipAVX2(pR, block_count, -lim_lin, lim_lin);
+            Avx2Utils::FusedPipeline(pL).Multiply(temp_gain).Clip(-lim_lin, lim_lin).Run(pL, block_count);
+            Avx2Utils::FusedPipeline(pR).Multiply(temp_gain).Clip(-lim_lin, lim_lin).Run(pR, block_count);
+        } else {
+            Avx2Utils::MultiplyBufferAVX2(pL, temp_gain, block_count);
+            Avx2Utils::MultiplyBufferAVX2(pR, temp_gain, block_count);
         }
     }
 
@@ -167,7 +158,7 @@ bool func_proc_audio_dynamics(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupDynamicsResources() {
-    g_dyn_states.clear();
+    g_dyn_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_dynamics = {
@@ -1,9 +1,10 @@
 ﻿#include "Avx2Utils.h"
+#include "BiquadDesign.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <cmath>
-#include <map>
-#include <mutex>
 #include <vector>
 
 constexpr auto TOOL_NAME = L"EQ";
@@ -45,14 +46,6 @@ struct Biquad {
     double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
     double x1 = 0.0, x2 = 0.0, y1 = 0.0, y2 = 0.0;
 
-    void setPassThrough() {
-        b0 = 1.0;
-        b1 = 0.0;
-        b2 = 0.0;
-        a1 = 0.0;
-        a2 = 0.0;
-    }
-
     void resetState() {
         x1 = 0.0;
         x2 = 0.0;
@@ -70,111 +63,30 @@ struct Biquad {
         return static_cast<float>(out);
     }
 
-    void copyCoeffsFrom(const Biquad& other) {
-        b0 = other.b0;
-        b1 = other.b1;
-        b2 = other.b2;
-        a1 = other.a1;
-        a2 = other.a2;
-    }
-
-    void calcHPF(double Fs, double f0) {
-        if (f0 <= 0.0) {
-            setPassThrough();
-            return;
-        }
-        double w0 = 2.0 * M_PI * f0 / Fs;
-        double alpha = sin(w0) / (2.0 * 0.7071);
-        double cosw0 = cos(w0);
-        double a0 = 1.0 + alpha;
-        b0 = (1.0 + cosw0) / 2.0 / a0;
-        b1 = -(1.0 + cosw0) / a0;
-        b2 = (1.0 + cosw0) / 2.0 / a0;
-        a1 = -2.0 * cosw0 / a0;
-        a2 = (1.0 - alpha) / a0;
-    }
-
-    void calcLPF(double Fs, double f0) {
-        if (f0 >= Fs * 0.49) {
-            setPassThrough();
-            return;
-        }
-        double w0 = 2.0 * M_PI * f0 / Fs;
-        double alpha = sin(w0) / (2.0 * 0.7071);
-        double cosw0 = cos(w0);
-        double a0 = 1.0 + alpha;
-        b0 = (1.0 - cosw0) / 2.0 / a0;
-        b1 = (1.0 - cosw0) / a0;
-        b2 = (1.0 - cosw0) / 2.0 / a0;
-        a1 = -2.0 * cosw0 / a0;
-        a2 = (1.0 - alpha) / a0;
-    }
-
-    void calcLowShelf(double Fs, double f0, double dB_gain) {
-        if (fabs(dB_gain) < 0.001) {
-            setPassThrough();
-            return;
-        }
-        double A = pow(10.0, dB_gain / 40.0);
-        double w0 = 2.0 * M_PI * f0 / Fs;
-        double alpha = sin(w0) / 2.0 * sqrt((A + 1 / A) * (1 / 0.707 - 1) + 2);
-        double cosw0 = cos(w0);
-        double a0 = (A + 1) + (A - 1) * cosw0 + 2 * sqrt(A) * alpha;
-        b0 = A * ((A + 1) - (A - 1) * cosw0 + 2 * sqrt(A) * alpha) / a0;
-        b1 = 2 * A * ((A - 1) - (A + 1) * cosw0) / a0;
-        b2 = A * ((A + 1) - (A - 1) * cosw0 - 2 * sqrt(A) * alpha) / a0;
-        a1 = -2 * ((A - 1) + (A + 1) * cosw0) / a0;
-        a2 = ((A + 1) + (A - 1) * cosw0 - 2 * sqrt(A) * alpha) / a0;
-    }
-
-    void calcHighShelf(double Fs, double f0, double dB_gain) {
-        if (fabs(dB_gain) < 0.001) {
-            setPassThrough();
-            return;
-        }
-        double A = pow(10.0, dB_gain / 40.0);
-        double w0 = 2.0 * M_PI * f0 / Fs;
-        double alpha = sin(w0) / 2.0 * sqrt((A + 1 / A) * (1 / 0.707 - 1) + 2);
-        double cosw0 = cos(w0);
-        double a0 = (A + 1) - (A - 1) * cosw0 + 2 * sqrt(A) * alpha;
-        b0 = A * ((A + 1) + (A - 1) * cosw0 + 2 * sqrt(A) * alpha) / a0;
-        b1 = -2 * A * ((A - 1) + (A + 1) * cosw0) / a0;
-        b2 = A * ((A + 1) + (A - 1) * cosw0 - 2 * sqrt(A) * alpha) / a0;
-        a1 = 2 * ((A - 1) - (A + 1) * cosw0) / a0;
-        a2 = ((A + 1) - (A - 1) * cosw0 - 2 * sqrt(A) * alpha) / a0;
-    }
-
-    void calcPeaking(double Fs, double f0, double dB_gain, double Q) {
-        if (fabs(dB_gain) < 0.001) {
-            setPassThrough();
-            return;
-        }
-        double A = pow(10.0, dB_gain / 40.0);
-        double w0 = 2.0 * M_PI * f0 / Fs;
-        double alpha = sin(w0) / (2.0 * Q);
-        double cosw0 = cos(w0);
-        double a0 = 1.0 + alpha / A;
-        b0 = (1.0 + alpha * A) / a0;
-        b1 = (-2.0 * cosw0) / a0;
-        b2 = (1.0 - alpha * A) / a0;
-        a1 = (-2.0 * cosw0) / a0;
-        a2 = (1.0 - alpha / A) / a0;
+    void setCoeffs(const BiquadDesign::Coeffs& c) {
+        b0 = c.b0;
+        b1 = c.b1;
+        b2 = c.b2;
+        a1 = c.a1;
+        a2 = c.a2;
     }
 };
 
 static const int32_t FILTER_STAGES = 7;
 
 struct EQState {
+    BiquadDesign::Band bands[FILTER_STAGES];
     Biquad filtersL[FILTER_STAGES];
     Biquad filtersR[FILTER_STAGES];
     int64_t last_sample_index = -1;
 };
 
-static std::mutex g_eq_state_mutex;
-static std::map<int64_t, EQState> g_eq_states;
+static EffectStateRegistry<EQState> g_eq_states{ EffectStateReclaim::Allowed };
 const int32_t BLOCK_SIZE = 256;
 
 bool func_proc_audio_eq(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -198,43 +110,48 @@ bool func_proc_audio_eq(FILTER_PROC_AUDIO* audio) {
         return true;
     }
 
-    EQState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_eq_state_mutex);
-        state = &g_eq_states[audio->object->effect_id];
-        if (state->last_sample_index != -1 &&
-            state->last_sample_index != audio->object->sample_index) {
-            for (int32_t i = 0; i < FILTER_STAGES; ++i) {
-                state->filtersL[i].resetState();
-                state->filtersR[i].resetState();
-            }
+    EQState* state = &g_eq_states.Get(audio->object->effect_id);
+    bool discontinuous = state->last_sample_index != -1 &&
+                         state->last_sample_index != audio->object->sample_index;
+    if (discontinuous) {
+        for (int32_t i = 0; i < FILTER_STAGES; ++i) {
+            state->filtersL[i].resetState();
+            state->filtersR[i].resetState();
         }
-        state->last_sample_index = audio->object->sample_index + total_samples;
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
 
-    state->filtersL[0].calcHPF(Fs, val_hpf);
-    state->filtersR[0].copyCoeffsFrom(state->filtersL[0]);
-    state->filtersL[1].calcLPF(Fs, val_lpf);
-    state->filtersR[1].copyCoeffsFrom(state->filtersL[1]);
-    state->filtersL[2].calcLowShelf(Fs, val_low_freq, val_low);
-    state->filtersR[2].copyCoeffsFrom(state->filtersL[2]);
-    state->filtersL[3].calcPeaking(Fs, val_ml_freq, val_ml, 1.0);
-    state->filtersR[3].copyCoeffsFrom(state->filtersL[3]);
-    state->filtersL[4].calcPeaking(Fs, val_mid_freq, val_mid, 1.0);
-    state->filtersR[4].copyCoeffsFrom(state->filtersL[4]);
-    state->filtersL[5].calcPeaking(Fs, val_mh_freq, val_mh, 1.0);
-    state->filtersR[5].copyCoeffsFrom(state->filtersL[5]);
-    state->filtersL[6].calcHighShelf(Fs, val_high_freq, val_high);
-    state->filtersR[6].copyCoeffsFrom(state->filtersL[6]);
-
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
+    using BiquadDesign::Type;
+    const BiquadDesign::Params params[FILTER_STAGES] = {
+        { Type::HighPass, Fs, val_hpf, 0.7071, 0.0 },
+        { Type::LowPass, Fs, val_lpf, 0.7071, 0.0 },
+        { Type::LowShelf, Fs, val_low_freq, 0.707, val_low },
+        { Type::Peaking, Fs, val_ml_freq, 1.0, val_ml },
+        { Type::Peaking, Fs, val_mid_freq, 1.0, val_mid },
+        { Type::Peaking, Fs, val_mh_freq, 1.0, val_mh },
+        { Type::HighShelf, Fs, val_high_freq, 0.707, val_high },
+    };
+
+    // 係数の設計はパラメータが動いたバンドだけ行い、動いたバンドはこのコールバック内でブロックごとに補間する
+    bool moving = false;
+    for (int32_t s = 0; s < FILTER_STAGES; ++s) {
+        BiquadDesign::Band& band = state->bands[s];
+        band.SetTarget(params[s]);
+        if (discontinuous) band.Snap();
+        if (band.IsMoving()) {
+            moving = true;
+        } else {
+            state->filtersL[s].setCoeffs(band.Target());
+            state->filtersR[s].setCoeffs(band.Target());
+        }
     }
 
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
+
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
     else if (channels == 1) Avx2Utils::CopyBufferAVX2(bufR.data(), bufL.data(), total_samples);
@@ -244,6 +161,16 @@ bool func_proc_audio_eq(FILTER_PROC_AUDIO* audio) {
         float* pL = bufL.data() + i;
         float* pR = bufR.data() + i;
 
+        if (moving) {
+            double t = static_cast<double>(i + block_count) / total_samples;
+            for (int32_t s = 0; s < FILTER_STAGES; ++s) {
+                if (!state->bands[s].IsMoving()) continue;
+                BiquadDesign::Coeffs c = state->bands[s].At(t);
+                state->filtersL[s].setCoeffs(c);
+                state->filtersR[s].setCoeffs(c);
+            }
+        }
+
         for (int32_t k = 0; k < block_count; ++k) {
             float l = pL[k];
             float r = pR[k];
@@ -264,7 +191,7 @@ bool func_proc_audio_eq(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupEQResources() {
-    g_eq_states.clear();
+    g_eq_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_eq = {
@@ -1,13 +1,13 @@
 ﻿#include "Avx2Utils.h"
 #include "Eap2Common.h"
 #include "Eap2Config.h"
+#include "EffectStateRegistry.h"
 #include "PluginManager.h"
+#include "ScratchArena.h"
 #include "StringUtils.h"
 
 #include <algorithm>
 #include <cmath>
-#include <map>
-#include <mutex>
 #include <random>
 #include <string>
 #include <vector>
@@ -56,8 +56,7 @@ struct GeneratorState {
     }
 };
 
-static std::mutex g_gen_state_mutex;
-static std::map<int64_t, GeneratorState> g_gen_states;
+static EffectStateRegistry<GeneratorState> g_gen_states;
 
 static std::mt19937 g_rng(12345);
 static std::uniform_real_distribution<float> g_dist(-1.0f, 1.0f);
@@ -134,6 +133,8 @@ static void func_proc_check_and_rename(void* param, EDIT_SECTION* edit) {
 }
 
 bool func_proc_audio_generator(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -175,27 +176,21 @@ bool func_proc_audio_generator(FILTER_PROC_AUDIO* audio) {
 
         gen_data.value->last_type = type;
     }
-    GeneratorState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_gen_state_mutex);
-        state = &g_gen_states[audio->object->effect_id];
-        if (!state->initialized) state->init();
-        if (state->last_sample_index != -1 &&
-            std::abs(state->last_sample_index - audio->object->sample_index) > 100) {
-            state->clear();
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    GeneratorState* state = &g_gen_states.Get(audio->object->effect_id);
+    if (!state->initialized) state->init();
+    if (state->last_sample_index != -1 &&
+        std::abs(state->last_sample_index - audio->object->sample_index) > 100) {
+        state->clear();
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
     double phase_inc = (2.0 * M_PI * freq) / Fs;
     double current_phase = state->phase;
 
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
 
     alignas(32) float temp_gen[BLOCK_SIZE];
 
@@ -254,8 +249,7 @@ bool func_proc_audio_generator(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupGeneratorResources() {
-    std::lock_guard<std::mutex> lock(g_gen_state_mutex);
-    g_gen_states.clear();
+    g_gen_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_generator = {
@@ -1,10 +1,10 @@
 ﻿#include "Avx2Utils.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 #include "SynthCommon.h"
 
 #include <cmath>
-#include <map>
-#include <mutex>
 
 constexpr auto TOOL_NAME = L"Generator";
 
@@ -50,10 +50,11 @@ struct GeneratorObjState {
     int64_t last_sample_index = -1;
 };
 
-static std::mutex g_gen_mutex;
-static std::map<int64_t, GeneratorObjState> g_gen_states;
+static EffectStateRegistry<GeneratorObjState> g_gen_states;
 
 bool func_proc_audio_generator2(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -77,30 +78,24 @@ bool func_proc_audio_generator2(FILTER_PROC_AUDIO* audio) {
                               ? gen_duration.value
                               : (total_duration_sec - offset_sec);
     double sound_end_sec = offset_sec + duration_sec;
-    VoiceState* voiceState = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_gen_mutex);
-        GeneratorObjState& state = g_gen_states[audio->object->effect_id];
-        double block_start_sec = current_obj_sample_index / Fs;
-        double block_end_sec = (current_obj_sample_index + total_samples) / Fs;
-        bool needs_reset =
-            !state.initialized ||
-            state.last_sample_index == -1 ||
-            state.last_sample_index != current_obj_sample_index ||
-            (block_start_sec < offset_sec && block_end_sec >= offset_sec);
-        if (needs_reset) {
-            state.voice.init();
-            state.initialized = true;
-        }
-        state.last_sample_index = current_obj_sample_index + total_samples;
-        voiceState = &state.voice;
+    GeneratorObjState& state = g_gen_states.Get(audio->object->effect_id);
+    double block_start_sec = current_obj_sample_index / Fs;
+    double block_end_sec = (current_obj_sample_index + total_samples) / Fs;
+    bool needs_reset =
+        !state.initialized ||
+        state.last_sample_index == -1 ||
+        state.last_sample_index != current_obj_sample_index ||
+        (block_start_sec < offset_sec && block_end_sec >= offset_sec);
+    if (needs_reset) {
+        state.voice.init();
+        state.initialized = true;
     }
+    state.last_sample_index = current_obj_sample_index + total_samples;
+    VoiceState* voiceState = &state.voice;
 
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
     alignas(32) float temp_genL[BLOCK_SIZE];
     alignas(32) float temp_genR[BLOCK_SIZE];
 
@@ -129,8 +124,7 @@ bool func_proc_audio_generator2(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupGeneratorResources2() {
-    std::lock_guard<std::mutex> lock(g_gen_mutex);
-    g_gen_states.clear();
+    g_gen_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_generator2 = {
@@ -1,10 +1,10 @@
 ﻿#include "Avx2Utils.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
 #include <cmath>
-#include <map>
-#include <mutex>
 #include <vector>
 
 constexpr auto TOOL_NAME = L"Maximizer";
@@ -49,12 +49,17 @@ struct MaximizerState {
             envelope = 0.0;
         }
     }
+
+    size_t memory_usage() const {
+        return sizeof(*this) + EffectStateMemory::VectorBytes(bufferL, bufferR);
+    }
 };
 
-static std::mutex g_max_state_mutex;
-static std::map<int64_t, MaximizerState> g_max_states;
+static EffectStateRegistry<MaximizerState> g_max_states{ EffectStateReclaim::Allowed };
 
 bool func_proc_maximizer(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -66,17 +71,13 @@ bool func_proc_maximizer(FILTER_PROC_AUDIO* audio) {
 
     if (threshold_db >= 0.0 && ceiling_db >= 0.0) return true;
 
-    MaximizerState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_max_state_mutex);
-        state = &g_max_states[audio->object->effect_id];
-        if (!state->initialized) state->init();
-        if (state->last_sample_index != -1 &&
-            state->last_sample_index != audio->object->sample_index) {
-            state->clear();
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    MaximizerState* state = &g_max_states.Get(audio->object->effect_id);
+    if (!state->initialized) state->init();
+    if (state->last_sample_index != -1 &&
+        state->last_sample_index != audio->object->sample_index) {
+        state->clear();
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
     float makeup_gain = static_cast<float>(std::pow(10.0, -threshold_db / 20.0));
@@ -86,11 +87,9 @@ bool func_proc_maximizer(FILTER_PROC_AUDIO* audio) {
     int32_t lookahead_samples = static_cast<int32_t>(lookahead_ms * 0.001 * Fs);
     if (lookahead_samples >= MAX_LOOKAHEAD_BUFFER) lookahead_samples = MAX_LOOKAHEAD_BUFFER - 1;
 
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
 
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
@@ -100,11 +99,8 @@ bool func_proc_maximizer(FILTER_PROC_AUDIO* audio) {
     double current_env = state->envelope;
     const int32_t buf_size = MAX_LOOKAHEAD_BUFFER;
 
-    thread_local std::vector<float> peak_buf, gain_buf;
-    if (peak_buf.size() < static_cast<size_t>(total_samples)) {
-        peak_buf.resize(total_samples);
-        gain_buf.resize(total_samples);
-    }
+    auto peak_buf = scratch.Alloc(total_samples);
+    auto gain_buf = scratch.Alloc(total_samples);
 
     alignas(32) float temp_out_L[BLOCK_SIZE];
     alignas(32) float temp_out_R[BLOCK_SIZE];
@@ -159,7 +155,7 @@ bool func_proc_maximizer(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupMaximizerResources() {
-    g_max_states.clear();
+    g_max_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_maximizer = {
@@ -1,5 +1,7 @@
 ﻿#include "Eap2Common.h"
+#include "EffectStateRegistry.h"
 #include "MidiParser.h"
+#include "ScratchArena.h"
 #include "SynthCommon.h"
 
 #define TSF_IMPLEMENTATION
@@ -452,6 +454,7 @@ class MidiPlayer {
     int64_t last_sample_pos = -1;
     size_t next_event_index = 0;
     double current_Fs = 44100.0;
+    std::mutex load_mutex;
 
     MidiPlayer() = default;
     bool Load(const std::filesystem::path& path) {
@@ -573,10 +576,11 @@ class MidiPlayer {
     }
 };
 
-static std::mutex g_midi_mutex;
-static std::map<int64_t, MidiPlayer> g_midi_players;
+static EffectStateRegistry<MidiPlayer> g_midi_players;
 
 bool func_proc_audio_midi(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int64_t current_obj_sample_index = audio->object->sample_index;
@@ -608,14 +612,12 @@ bool func_proc_audio_midi(FILTER_PROC_AUDIO* audio) {
     int32_t sync_mode = midi_sync_mode.value;
     double global_bpm = g_shared_bpm.load();
 
-    MidiPlayer* player = nullptr;
+    MidiPlayer* player = &g_midi_players.Get(audio->object->effect_id);
     bool seek_detected = false;
     bool renderer_dirty = false;
 
     {
-        std::lock_guard<std::mutex> lock(g_midi_mutex);
-        player = &g_midi_players[audio->object->effect_id];
-
+        std::lock_guard<std::mutex> lock(player->load_mutex);
         if (!player->Load(midi_path)) return true;
 
         if (player->current_Fs != Fs) {
@@ -684,11 +686,9 @@ bool func_proc_audio_midi(FILTER_PROC_AUDIO* audio) {
         player->PreRoll(t0, TimeToTick);
     }
 
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
     std::fill(bufL.begin(), bufL.begin() + total_samples, 0.0f);
     std::fill(bufR.begin(), bufR.begin() + total_samples, 0.0f);
     const auto& events = player->parser.GetEvents();
@@ -712,8 +712,7 @@ bool func_proc_audio_midi(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupMidiGeneratorResources() {
-    std::lock_guard<std::mutex> lock(g_midi_mutex);
-    g_midi_players.clear();
+    g_midi_players.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_midi_gen = {
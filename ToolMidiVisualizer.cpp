@@ -1,6 +1,7 @@
 ﻿#include "Avx2Utils.h"
 #include "Eap2Common.h"
 #include "Eap2Config.h"
+#include "EffectStateRegistry.h"
 #include "MidiParser.h"
 #include "PluginManager.h"
 #include "StringUtils.h"
@@ -8,7 +9,6 @@
 #include <algorithm>
 #include <cmath>
 #include <filesystem>
-#include <map>
 #include <string>
 #include <vector>
 
@@ -76,7 +76,7 @@ struct VisualizerData {
     std::vector<PIXEL_RGBA> imgBuf;
 };
 
-static std::map<int64_t, VisualizerData> g_dataMap;
+static EffectStateRegistry<VisualizerData> g_dataMap;
 
 PIXEL_RGBA HsvToRgb(double h, double s, double v, uint8_t a = 255) {
     double r = 0, g = 0, b = 0;
@@ -453,9 +453,10 @@ static void func_proc_check_and_rename(void* param, EDIT_SECTION* edit) {
 }
 
 bool func_proc_video_midi_visualizer(FILTER_PROC_VIDEO* video) {
+    EffectStateRegistryBase::ReadScope state_scope;
     std::string midi_visualizer_id;
     int64_t objId = video->object->id;
-    VisualizerData& data = g_dataMap[objId];
+    VisualizerData& data = g_dataMap.Get(objId);
     std::filesystem::path currentPath = track_file.value;
     if (midi_visualizer_data_param.value->uuid[0] != '\0') {
         midi_visualizer_id = midi_visualizer_data_param.value->uuid;
@@ -1047,7 +1048,7 @@ bool func_proc_video_midi_visualizer(FILTER_PROC_VIDEO* video) {
 }
 
 void CleanupMidiVisualizerResources() {
-    g_dataMap.clear();
+    g_dataMap.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_midi_visualizer = {
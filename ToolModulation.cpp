@@ -1,10 +1,10 @@
 ﻿#include "Avx2Utils.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
 #include <cmath>
-#include <map>
-#include <mutex>
 #include <vector>
 
 constexpr auto TOOL_NAME = L"Modulation";
@@ -66,10 +66,13 @@ struct ModulationState {
             phase = 0.0;
         }
     }
+
+    size_t memory_usage() const {
+        return sizeof(*this) + EffectStateMemory::VectorBytes(bufferL, bufferR);
+    }
 };
 
-static std::mutex g_mod_state_mutex;
-static std::map<int64_t, ModulationState> g_mod_states;
+static EffectStateRegistry<ModulationState> g_mod_states{ EffectStateReclaim::Allowed };
 
 inline float interpolate(const float* buffer, double index, int32_t size) {
     int32_t i = static_cast<int32_t>(index);
@@ -81,6 +84,8 @@ inline float interpolate(const float* buffer, double index, int32_t size) {
 }
 
 bool func_proc_audio_modulation(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -99,26 +104,20 @@ bool func_proc_audio_modulation(FILTER_PROC_AUDIO* audio) {
 
     if (!is_delay_mod && !is_tremolo) return true;
 
-    ModulationState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_mod_state_mutex);
-        state = &g_mod_states[audio->object->effect_id];
-        if (!state->initialized) state->init();
-        if (state->last_sample_index != -1 &&
-            state->last_sample_index != audio->object->sample_index) {
-            state->clear();
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    ModulationState* state = &g_mod_states.Get(audio->object->effect_id);
+    if (!state->initialized) state->init();
+    if (state->last_sample_index != -1 &&
+        state->last_sample_index != audio->object->sample_index) {
+        state->clear();
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
     double lfo_inc = (2.0 * M_PI * rate) / Fs;
 
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
 
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
@@ -219,7 +218,7 @@ bool func_proc_audio_modulation(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupModulationResources() {
-    g_mod_states.clear();
+    g_mod_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_modulation = {
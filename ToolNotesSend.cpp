@@ -223,6 +223,8 @@ static void func_proc_check_and_rename(void* param, EDIT_SECTION* edit) {
 }
 
 bool func_proc_audio_notes_send(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t id_idx = static_cast<int32_t>(notes_send_id.value) - 1;
     int32_t note_num = static_cast<uint8_t>(notes_send_note.value);
     int32_t display_id = id_idx + 1;
@@ -1,10 +1,10 @@
 ﻿#include "Avx2Utils.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
 #include <cmath>
-#include <map>
-#include <mutex>
 #include <vector>
 
 constexpr auto TOOL_NAME = L"Phaser";
@@ -76,11 +76,12 @@ struct PhaserState {
     }
 };
 
-static std::mutex g_ph_state_mutex;
-static std::map<int64_t, PhaserState> g_ph_states;
+static EffectStateRegistry<PhaserState> g_ph_states{ EffectStateReclaim::Allowed };
 const int32_t BLOCK_SIZE = 64;
 
 bool func_proc_audio_phaser(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -93,17 +94,13 @@ bool func_proc_audio_phaser(FILTER_PROC_AUDIO* audio) {
 
     if (mix_val == 0.0f) return true;
 
-    PhaserState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_ph_state_mutex);
-        state = &g_ph_states[audio->object->effect_id];
-        if (!state->initialized) state->init();
-        if (state->last_sample_index != -1 &&
-            state->last_sample_index != audio->object->sample_index) {
-            state->clear();
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    PhaserState* state = &g_ph_states.Get(audio->object->effect_id);
+    if (!state->initialized) state->init();
+    if (state->last_sample_index != -1 &&
+        state->last_sample_index != audio->object->sample_index) {
+        state->clear();
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
     double lfo_inc = (2.0 * M_PI * rate) / Fs;
@@ -111,11 +108,9 @@ bool func_proc_audio_phaser(FILTER_PROC_AUDIO* audio) {
     float min_freq = 200.0f;
     float max_freq = 2000.0f;
 
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
 
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
@@ -170,7 +165,7 @@ bool func_proc_audio_phaser(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupPhaserResources() {
-    g_ph_states.clear();
+    g_ph_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_phaser = {
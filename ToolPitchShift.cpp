@@ -1,12 +1,12 @@
 ﻿#include "Avx2Utils.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "RealFft.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
 #include <cmath>
-#include <complex>
-#include <map>
 #include <memory>
-#include <mutex>
 #include <vector>
 
 constexpr auto TOOL_NAME = L"Pitch Shift";
@@ -38,6 +38,7 @@ struct IPitchShiftState {
     virtual ~IPitchShiftState() = default;
     virtual void process(float* bufL, float* bufR, int32_t total_samples, float pitch_rate, float mix) = 0;
     virtual void clear() = 0;
+    virtual size_t memory_usage() const = 0;
 };
 
 struct GranularState : public IPitchShiftState {
@@ -60,6 +61,10 @@ struct GranularState : public IPitchShiftState {
         read_pos_a = 0.0;
     }
 
+    size_t memory_usage() const override {
+        return sizeof(*this) + EffectStateMemory::VectorBytes(bufferL, bufferR);
+    }
+
     void process(float* dryL, float* dryR, int32_t total_samples, float pitch_rate, float mix) override {
         const double dt = (1.0 - static_cast<double>(pitch_rate)) / WINDOW_SIZE;
         const double win_size = static_cast<double>(WINDOW_SIZE);
@@ -106,33 +111,6 @@ struct GranularState : public IPitchShiftState {
     }
 };
 
-static void fft_inplace(std::complex<float>* data, int32_t n, bool inverse) {
-    for (int32_t i = 1, j = 0; i < n; ++i) {
-        int32_t bit = n >> 1;
-        for (; j & bit; bit >>= 1) j ^= bit;
-        j ^= bit;
-        if (i < j) std::swap(data[i], data[j]);
-    }
-    for (int32_t len = 2; len <= n; len <<= 1) {
-        const float ang = static_cast<float>((inverse ? M_PI * 2 : M_PI * -2) / len);
-        const std::complex<float> wlen(std::cos(ang), std::sin(ang));
-        for (int32_t i = 0; i < n; i += len) {
-            std::complex<float> w(1.0f, 0.0f);
-            for (int32_t j = 0; j < (len >> 1); ++j) {
-                auto u = data[i + j];
-                auto v = data[i + j + (len >> 1)] * w;
-                data[i + j] = u + v;
-                data[i + j + (len >> 1)] = u - v;
-                w *= wlen;
-            }
-        }
-    }
-    if (inverse) {
-        const float inv_n = 1.0f / static_cast<float>(n);
-        for (int32_t i = 0; i < n; ++i) data[i] *= inv_n;
-    }
-}
-
 static inline float wrap_phase(float p) {
     while (p > M_PI) p -= static_cast<float>(M_PI * 2);
     while (p < -M_PI) p += static_cast<float>(M_PI * 2);
@@ -156,7 +134,8 @@ struct PhaseVocoderState : public IPitchShiftState {
     int32_t out_write_pos = 0;
     int32_t out_available = 0;
     std::vector<float> hann;
-    std::vector<std::complex<float>> fft_buf;
+    const RealFft* fft = RealFft::Get(FFT_SIZE);
+    std::vector<float> frame, spec_re, spec_im, phase, fft_work;
     std::vector<float> mag, ifreq, out_mag, out_ifreq;
     std::vector<int32_t> peak_owner;
     std::vector<float> pass1_syn_phase;
@@ -177,7 +156,11 @@ struct PhaseVocoderState : public IPitchShiftState {
         syn_phase_R.assign(NUM_BINS, 0.0f);
         hann.resize(FFT_SIZE);
         for (int32_t i = 0; i < FFT_SIZE; ++i) hann[i] = 0.5f - 0.5f * static_cast<float>(std::cos(M_PI * 2 * i / FFT_SIZE));
-        fft_buf.resize(FFT_SIZE);
+        frame.resize(FFT_SIZE);
+        spec_re.resize(NUM_BINS);
+        spec_im.resize(NUM_BINS);
+        phase.resize(NUM_BINS);
+        fft_work.resize(fft->work_size());
         mag.resize(NUM_BINS);
         ifreq.resize(NUM_BINS);
         out_mag.resize(NUM_BINS);
@@ -195,9 +178,19 @@ struct PhaseVocoderState : public IPitchShiftState {
         init_buffers();
     }
 
+    size_t memory_usage() const override {
+        return sizeof(*this) + EffectStateMemory::VectorBytes(in_L, in_R, ana_phase_L, ana_phase_R, syn_phase_L, syn_phase_R, out_L, out_R, hann, frame) +
+               EffectStateMemory::VectorBytes(spec_re, spec_im, phase, fft_work) +
+               EffectStateMemory::VectorBytes(mag, ifreq, out_mag, out_ifreq, peak_owner, pass1_syn_phase, peaks_buf);
+    }
+
     void process_frame(float pitch_rate) {
-        if (static_cast<int32_t>(fft_buf.size()) != FFT_SIZE) {
-            fft_buf.resize(FFT_SIZE);
+        if (static_cast<int32_t>(frame.size()) != FFT_SIZE) {
+            frame.resize(FFT_SIZE);
+            spec_re.resize(NUM_BINS);
+            spec_im.resize(NUM_BINS);
+            phase.resize(NUM_BINS);
+            fft_work.resize(fft->work_size());
             mag.resize(NUM_BINS);
             ifreq.resize(NUM_BINS);
             out_mag.resize(NUM_BINS);
@@ -212,13 +205,12 @@ struct PhaseVocoderState : public IPitchShiftState {
 
         auto do_channel = [&](const std::vector<float>& in_buf, std::vector<float>& ana_phase, std::vector<float>& syn_phase, std::vector<float>& out_buf) {
             const int32_t frame_start = (in_write - FFT_SIZE + IN_SIZE) % IN_SIZE;
-            for (int32_t j = 0; j < FFT_SIZE; ++j) fft_buf[j] = { in_buf[(frame_start + j) % IN_SIZE] * hann[j], 0.0f };
-            fft_inplace(fft_buf.data(), FFT_SIZE, false);
+            for (int32_t j = 0; j < FFT_SIZE; ++j) frame[j] = in_buf[(frame_start + j) % IN_SIZE] * hann[j];
+            fft->Forward(frame.data(), spec_re.data(), spec_im.data(), fft_work.data());
+            Avx2Utils::ToPolarAVX2(mag.data(), phase.data(), spec_re.data(), spec_im.data(), NUM_BINS);
             for (int32_t k = 0; k < NUM_BINS; ++k) {
-                const float phase = std::arg(fft_buf[k]);
-                mag[k] = std::abs(fft_buf[k]);
-                const float delta = wrap_phase(phase - ana_phase[k] - static_cast<float>(k) * freq_per_bin);
-                ana_phase[k] = phase;
+                const float delta = wrap_phase(phase[k] - ana_phase[k] - static_cast<float>(k) * freq_per_bin);
+                ana_phase[k] = phase[k];
                 ifreq[k] = static_cast<float>(k) + delta / freq_per_bin;
             }
             {
@@ -259,12 +251,11 @@ struct PhaseVocoderState : public IPitchShiftState {
                 const float rel_phase = ana_phase[in_k0] - ana_phase[in_peak];
                 syn_phase[out_k] = wrap_phase(pass1_syn_phase[out_peak] + rel_phase);
             }
-            for (int32_t k = 0; k < NUM_BINS; ++k) fft_buf[k] = std::polar(out_mag[k], syn_phase[k]);
-            for (int32_t k = NUM_BINS; k < FFT_SIZE; ++k) fft_buf[k] = std::conj(fft_buf[FFT_SIZE - k]);
-            fft_inplace(fft_buf.data(), FFT_SIZE, true);
+            Avx2Utils::FromPolarAVX2(spec_re.data(), spec_im.data(), out_mag.data(), syn_phase.data(), NUM_BINS);
+            fft->Inverse(spec_re.data(), spec_im.data(), frame.data(), fft_work.data());
             for (int32_t j = 0; j < FFT_SIZE; ++j) {
                 const int32_t p = (out_write_pos + j) % OUT_SIZE;
-                out_buf[p] += fft_buf[j].real() * hann[j] * ola_gain;
+                out_buf[p] += frame[j] * hann[j] * ola_gain;
             }
         };
         do_channel(in_L, ana_phase_L, syn_phase_L, out_L);
@@ -302,12 +293,17 @@ struct PhaseVocoderState : public IPitchShiftState {
 struct PitchShiftHandle {
     std::unique_ptr<IPitchShiftState> state;
     int64_t last_sample_index = -1;
+
+    size_t memory_usage() const {
+        return sizeof(*this) + (state ? state->memory_usage() : 0);
+    }
 };
 
-static std::mutex g_ps_state_mutex;
-static std::map<int64_t, std::shared_ptr<PitchShiftHandle>> g_ps_handles;
+static EffectStateRegistry<std::shared_ptr<PitchShiftHandle>> g_ps_handles{ EffectStateReclaim::Allowed };
 
 bool func_proc_audio_pitch_shift(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     const int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     const int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -321,23 +317,21 @@ bool func_proc_audio_pitch_shift(FILTER_PROC_AUDIO* audio) {
     if (mix <= 1e-6f || std::abs(pitch_total) < 1e-6f) return true;
     const float pitch_rate = std::pow(2.0f, pitch_total / 12.0f);
 
-    std::shared_ptr<PitchShiftHandle> handle;
-    {
-        std::lock_guard<std::mutex> lock(g_ps_state_mutex);
-        auto& h = g_ps_handles[audio->object->effect_id];
-        if (!h) h = std::make_shared<PitchShiftHandle>();
-        if (!h->state || h->state->algo_id != algo) {
-            if (algo == 0) h->state = std::make_unique<GranularState>();
-            else h->state = std::make_unique<PhaseVocoderState>();
-            h->state->algo_id = algo;
-            h->last_sample_index = -1;
-        }
-        if (h->last_sample_index != -1 && h->last_sample_index != audio->object->sample_index) h->state->clear();
-        h->last_sample_index = audio->object->sample_index + total_samples;
-        handle = h;
+    auto& h = g_ps_handles.Get(audio->object->effect_id);
+    if (!h) h = std::make_shared<PitchShiftHandle>();
+    if (!h->state || h->state->algo_id != algo) {
+        if (algo == 0) h->state = std::make_unique<GranularState>();
+        else h->state = std::make_unique<PhaseVocoderState>();
+        h->state->algo_id = algo;
+        h->last_sample_index = -1;
     }
+    if (h->last_sample_index != -1 && h->last_sample_index != audio->object->sample_index) h->state->clear();
+    h->last_sample_index = audio->object->sample_index + total_samples;
+    std::shared_ptr<PitchShiftHandle> handle = h;
 
-    std::vector<float> bufL(total_samples), bufR(total_samples);
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
 
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
@@ -352,8 +346,7 @@ bool func_proc_audio_pitch_shift(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupPitchShiftResources() {
-    std::lock_guard<std::mutex> lock(g_ps_state_mutex);
-    g_ps_handles.clear();
+    g_ps_handles.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_pitch_shift = {
@@ -1,9 +1,9 @@
 ﻿#include "Avx2Utils.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
-#include <map>
-#include <mutex>
 #include <vector>
 
 constexpr auto TOOL_NAME = L"Reverb";
@@ -175,10 +175,16 @@ struct ReverbState {
         Avx2Utils::FillBufferAVX2(pre_delay_bufR.data(), pre_delay_bufR.size(), 0.0f);
         pre_delay_write_pos = 0;
     }
+
+    size_t memory_usage() const {
+        size_t bytes = sizeof(*this) + EffectStateMemory::VectorBytes(pre_delay_bufL, pre_delay_bufR);
+        for (int32_t i = 0; i < NUM_COMBS; ++i) bytes += EffectStateMemory::VectorBytes(combsL[i].buffer, combsR[i].buffer);
+        for (int32_t i = 0; i < NUM_ALLPASS; ++i) bytes += EffectStateMemory::VectorBytes(allpassL[i].buffer, allpassR[i].buffer);
+        return bytes;
+    }
 };
 
-static std::mutex g_rev_state_mutex;
-static std::map<int64_t, ReverbState> g_rev_states;
+static EffectStateRegistry<ReverbState> g_rev_states{ EffectStateReclaim::Allowed };
 
 inline void ProcessPreDelayBlock(
     float* out, const float* in,
@@ -200,6 +206,8 @@ inline void ProcessPreDelayBlock(
 }
 
 bool func_proc_audio_reverb(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -215,31 +223,26 @@ bool func_proc_audio_reverb(FILTER_PROC_AUDIO* audio) {
     ReverbState* state = nullptr;
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
 
-    {
-        std::lock_guard<std::mutex> lock(g_rev_state_mutex);
-        state = &g_rev_states[audio->object->effect_id];
+    state = &g_rev_states.Get(audio->object->effect_id);
 
-        if (!state->initialized) {
-            state->init(Fs);
-        }
+    if (!state->initialized) {
+        state->init(Fs);
+    }
 
-        if (state->last_sample_index != -1 &&
-            state->last_sample_index != audio->object->sample_index) {
-            state->clear();
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    if (state->last_sample_index != -1 &&
+        state->last_sample_index != audio->object->sample_index) {
+        state->clear();
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     state->update_params(room_size, damping);
 
     int32_t pre_delay_samples = static_cast<int32_t>(pre_delay_ms * 0.001 * Fs);
     if (pre_delay_samples >= MAX_BUFFER_SIZE) pre_delay_samples = MAX_BUFFER_SIZE - 1;
 
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
 
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
@@ -308,7 +311,7 @@ bool func_proc_audio_reverb(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupReverbResources() {
-    g_rev_states.clear();
+    g_rev_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_reverb = {
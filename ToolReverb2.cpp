@@ -1,10 +1,10 @@
 ﻿#include "Avx2Utils.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
 #include <cmath>
-#include <map>
-#include <mutex>
 #include <vector>
 
 constexpr auto TOOL_NAME = L"Reverb";
@@ -202,6 +202,13 @@ struct ReverbState2 {
         inputLPF.store = 0.0f;
     }
 
+    size_t memory_usage() const {
+        size_t bytes = sizeof(*this) + EffectStateMemory::VectorBytes(pre_delay_buf);
+        for (const auto& d : diffusers) bytes += EffectStateMemory::VectorBytes(d.delay.buffer);
+        bytes += EffectStateMemory::VectorBytes(delayL.buffer, delayR.buffer, tankAP_L.delay.buffer, tankAP_R.delay.buffer, postDelayL.buffer, postDelayR.buffer);
+        return bytes;
+    }
+
     void process_diffusers_block(float* io, int32_t count, float total_scale, float diff_scale, float g) {
         alignas(32) float del[4][PROCESS_BLOCK_SIZE];
         alignas(32) float s_buf[PROCESS_BLOCK_SIZE];
@@ -210,22 +217,8 @@ struct ReverbState2 {
             for (int32_t n = 0; n < count; ++n)
                 del[k][n] = diffusers[k].delay.read_at_future_wpos(n, dlen);
         }
-        const __m256 vg = _mm256_set1_ps(g);
         for (int32_t k = 0; k < 4; ++k) {
-            int32_t n = 0;
-            for (; n + 8 <= count; n += 8) {
-                __m256 x_v = _mm256_load_ps(io + n);
-                __m256 d_v = _mm256_load_ps(del[k] + n);
-                __m256 s_v = _mm256_fmadd_ps(vg, d_v, x_v);
-                __m256 y_v = _mm256_fnmadd_ps(vg, s_v, d_v);
-                _mm256_store_ps(s_buf + n, s_v);
-                _mm256_store_ps(io + n, y_v);
-            }
-            for (; n < count; ++n) {
-                float s = io[n] + g * del[k][n];
-                io[n] = del[k][n] - g * s;
-                s_buf[n] = s;
-            }
+            Avx2Utils::AllpassDiffuseAVX2(io, del[k], s_buf, count, g);
             diffusers[k].delay.bulk_write(s_buf, count);
         }
     }
@@ -308,10 +301,11 @@ struct ReverbState2 {
     }
 };
 
-static std::mutex g_rev_state_mutex;
-static std::map<int64_t, ReverbState2> g_rev_states;
+static EffectStateRegistry<ReverbState2> g_rev_states{ EffectStateReclaim::Allowed };
 
 bool func_proc_audio_reverb2(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -332,19 +326,18 @@ bool func_proc_audio_reverb2(FILTER_PROC_AUDIO* audio) {
     ReverbState2* state = nullptr;
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
 
-    {
-        std::lock_guard<std::mutex> lock(g_rev_state_mutex);
-        state = &g_rev_states[audio->object->effect_id];
+    state = &g_rev_states.Get(audio->object->effect_id);
 
-        if (!state->initialized || state->current_sr != Fs) state->init(Fs);
-        if (state->last_sample_index != -1 &&
-            state->last_sample_index != audio->object->sample_index) {
-            state->clear();
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    if (!state->initialized || state->current_sr != Fs) state->init(Fs);
+    if (state->last_sample_index != -1 &&
+        state->last_sample_index != audio->object->sample_index) {
+        state->clear();
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
-    std::vector<float> bufL(total_samples), bufR(total_samples);
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
     else if (channels == 1) Avx2Utils::CopyBufferAVX2(bufR.data(), bufL.data(), total_samples);
@@ -370,7 +363,7 @@ bool func_proc_audio_reverb2(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupReverbResources2() {
-    g_rev_states.clear();
+    g_rev_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_reverb2 = {
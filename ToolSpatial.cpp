@@ -1,9 +1,9 @@
 ﻿#include "Avx2Utils.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
-#include <map>
-#include <mutex>
 #include <vector>
 
 constexpr auto TOOL_NAME = L"Spatial";
@@ -41,10 +41,13 @@ struct SpatialState {
             write_pos = 0;
         }
     }
+
+    size_t memory_usage() const {
+        return sizeof(*this) + EffectStateMemory::VectorBytes(bufferL, bufferR);
+    }
 };
 
-static std::mutex g_sp_state_mutex;
-static std::map<int64_t, SpatialState> g_sp_states;
+static EffectStateRegistry<SpatialState> g_sp_states{ EffectStateReclaim::Allowed };
 
 inline void ReadRingBufferBlock(
     float* out, const std::vector<float>& buf,
@@ -75,6 +78,8 @@ inline void WriteRingBufferBlock(
 }
 
 bool func_proc_audio_spatial(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
     int32_t channels = (std::min)(2, audio->object->channel_num);
@@ -86,17 +91,13 @@ bool func_proc_audio_spatial(FILTER_PROC_AUDIO* audio) {
 
     if (d_time == 0.0f && p_width == 0.0f) return true;
 
-    SpatialState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_sp_state_mutex);
-        state = &g_sp_states[audio->object->effect_id];
-        if (!state->initialized) state->init();
-        if (state->last_sample_index != -1 &&
-            state->last_sample_index != audio->object->sample_index) {
-            state->clear();
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    SpatialState* state = &g_sp_states.Get(audio->object->effect_id);
+    if (!state->initialized) state->init();
+    if (state->last_sample_index != -1 &&
+        state->last_sample_index != audio->object->sample_index) {
+        state->clear();
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     double Fs = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
     int32_t delay_samples = static_cast<int32_t>(d_time * 0.001 * Fs);
@@ -109,11 +110,9 @@ bool func_proc_audio_spatial(FILTER_PROC_AUDIO* audio) {
     float wet_ratio = d_mix / 100.0f;
     float dry_ratio = 1.0f - wet_ratio;
 
-    thread_local std::vector<float> bufL, bufR;
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
 
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
@@ -182,7 +181,7 @@ bool func_proc_audio_spatial(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupSpatialResources() {
-    g_sp_states.clear();
+    g_sp_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_spatial = {
@@ -1,10 +1,11 @@
 ﻿#include "Avx2Utils.h"
+#include "BiquadDesign.h"
 #include "Eap2Common.h"
+#include "EffectStateRegistry.h"
+#include "ScratchArena.h"
 
 #include <algorithm>
 #include <cmath>
-#include <map>
-#include <mutex>
 
 constexpr auto TOOL_NAME = L"Spectral Gate";
 
@@ -25,15 +26,12 @@ struct HighpassFilter {
     float x1 = 0.0f, y1 = 0.0f;
     float a1 = 0.0f, b0 = 0.0f, b1 = 0.0f;
 
+    // 2 次のハイパス係数から 1 次分だけを使う
     void design(float cutoff_freq, double sample_rate) {
-        float omega = 2.0f * static_cast<float>(M_PI) * cutoff_freq / static_cast<float>(sample_rate);
-        float sin_omega = std::sin(omega);
-        float cos_omega = std::cos(omega);
-        float alpha = sin_omega / (2.0f * 0.707107f);
-        float denom = 1.0f + alpha;
-        b0 = (1.0f + cos_omega) / (2.0f * denom);
-        b1 = -(1.0f + cos_omega) / denom;
-        a1 = (-2.0f * cos_omega) / denom;
+        const BiquadDesign::Coeffs c = BiquadDesign::Design({ BiquadDesign::Type::HighPass, sample_rate, cutoff_freq, 0.707107, 0.0 });
+        b0 = static_cast<float>(c.b0);
+        b1 = static_cast<float>(c.b1);
+        a1 = static_cast<float>(c.a1);
     }
 
     float process(float input) {
@@ -52,12 +50,13 @@ struct SpectralGateState {
     int64_t last_sample_index = -1;
 };
 
-static std::mutex g_spectral_gate_mutex;
-static std::map<int64_t, SpectralGateState> g_spectral_gate_states;
+static EffectStateRegistry<SpectralGateState> g_spectral_gate_states{ EffectStateReclaim::Allowed };
 
 const int32_t BLOCK_SIZE = 64;
 
 bool func_proc_audio_spectral_gate(FILTER_PROC_AUDIO* audio) {
+    EAP2_PROFILE_AUDIO(TOOL_NAME, audio);
+    DenormalGuard denormal_guard;
     int32_t total_samples = audio->object->sample_num;
     if (total_samples <= 0) return true;
 
@@ -68,75 +67,50 @@ bool func_proc_audio_spectral_gate(FILTER_PROC_AUDIO* audio) {
 
     double sr = (audio->scene->sample_rate > 0) ? audio->scene->sample_rate : 44100.0;
 
-    SpectralGateState* state = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(g_spectral_gate_mutex);
-        state = &g_spectral_gate_states[audio->object->effect_id];
+    SpectralGateState* state = &g_spectral_gate_states.Get(audio->object->effect_id);
 
-        if (!state->initialized || state->last_sample_index != audio->object->sample_index) {
-            state->hpL.design(100.0f, sr);
-            state->hpR.design(100.0f, sr);
-            state->initialized = true;
-        }
-        state->last_sample_index = audio->object->sample_index + total_samples;
+    if (!state->initialized || state->last_sample_index != audio->object->sample_index) {
+        state->hpL.design(100.0f, sr);
+        state->hpR.design(100.0f, sr);
+        state->initialized = true;
     }
+    state->last_sample_index = audio->object->sample_index + total_samples;
 
     float threshold_linear = std::pow(10.0f, threshold_db / 20.0f);
     float attack_coeff = std::exp(-1.0f / (attack_ms * static_cast<float>(sr) / 1000.0f + 1.0f));
     float release_coeff = std::exp(-1.0f / (release_ms * static_cast<float>(sr) / 1000.0f + 1.0f));
 
     int32_t channels = (std::min)(2, audio->object->channel_num);
-    thread_local std::vector<float> bufL, bufR;
-    thread_local std::vector<float> envL_buf, envR_buf, max_env_buf, gate_envelope;
-
-    if (bufL.size() < static_cast<size_t>(total_samples)) {
-        bufL.resize(total_samples);
-        bufR.resize(total_samples);
-        envL_buf.resize(total_samples);
-        envR_buf.resize(total_samples);
-        max_env_buf.resize(total_samples);
-        gate_envelope.resize(total_samples);
-    }
+    ScratchScope scratch;
+    auto bufL = scratch.Alloc(total_samples);
+    auto bufR = scratch.Alloc(total_samples);
+    auto envL_buf = scratch.Alloc(total_samples);
+    auto envR_buf = scratch.Alloc(total_samples);
+    auto gate_envelope = scratch.Alloc(total_samples);
     if (channels >= 1) audio->get_sample_data(bufL.data(), 0);
     if (channels >= 2) audio->get_sample_data(bufR.data(), 1);
     else if (channels == 1) Avx2Utils::FillBufferAVX2(bufR.data(), bufR.size(), 0.0f);
 
-    {
-        std::lock_guard<std::mutex> lock(g_spectral_gate_mutex);
-        for (int32_t i = 0; i < total_samples; ++i) {
-            envL_buf[i] = std::abs(state->hpL.process(bufL[i]));
-            if (channels >= 2) {
-                envR_buf[i] = std::abs(state->hpR.process(bufR[i]));
-            }
+    for (int32_t i = 0; i < total_samples; ++i) {
+        envL_buf[i] = std::abs(state->hpL.process(bufL[i]));
+        if (channels >= 2) {
+            envR_buf[i] = std::abs(state->hpR.process(bufR[i]));
         }
     }
 
-    if (channels >= 2) {
-        Avx2Utils::MaxBufferAVX2(max_env_buf.data(), envL_buf.data(), envR_buf.data(), total_samples);
-    } else {
-        Avx2Utils::CopyBufferAVX2(max_env_buf.data(), envL_buf.data(), total_samples);
-    }
-
-    Avx2Utils::FillBufferAVX2(gate_envelope.data(), total_samples, state->envelope);
-    Avx2Utils::EnvelopeFollowerAVX2(gate_envelope.data(), max_env_buf.data(), total_samples, attack_coeff, release_coeff);
+    // 左右の最大値 → エンベロープ追従までを 1 パスで計算する
+    Avx2Utils::FusedPipeline envelope(envL_buf.data());
+    if (channels >= 2) envelope.Max(envR_buf.data());
+    envelope.FollowEnvelope(state->envelope, attack_coeff, release_coeff).Run(gate_envelope.data(), total_samples);
 
     state->envelope = gate_envelope[total_samples - 1];
 
-    Avx2Utils::ThresholdAVX2(max_env_buf.data(), gate_envelope.data(), total_samples, threshold_linear);
-
-    std::vector<float> temp_wet_L(bufL.begin(), bufL.end());
-    std::vector<float> temp_wet_R(bufR.begin(), bufR.end());
-
-    Avx2Utils::MultiplyBufferAVX2(temp_wet_L.data(), temp_wet_L.data(), max_env_buf.data(), total_samples);
-    if (channels >= 2) {
-        Avx2Utils::MultiplyBufferAVX2(temp_wet_R.data(), temp_wet_R.data(), max_env_buf.data(), total_samples);
-    }
-
+    // ゲート判定 → 乗算 → ドライとのミックスを 1 パスで行う
     if (channels >= 1) {
-        Avx2Utils::MixAudioAVX2(bufL.data(), temp_wet_L.data(), total_samples, mix, 1.0f - mix, 1.0f);
+        Avx2Utils::FusedPipeline(gate_envelope.data()).Threshold(threshold_linear).Multiply(bufL.data()).Mix(bufL.data(), 1.0f - mix, mix, 1.0f).Run(bufL.data(), total_samples);
     }
     if (channels >= 2) {
-        Avx2Utils::MixAudioAVX2(bufR.data(), temp_wet_R.data(), total_samples, mix, 1.0f - mix, 1.0f);
+        Avx2Utils::FusedPipeline(gate_envelope.data()).Threshold(threshold_linear).Multiply(bufR.data()).Mix(bufR.data(), 1.0f - mix, mix, 1.0f).Run(bufR.data(), total_samples);
     }
 
     if (channels >= 1) audio->set_sample_data(bufL.data(), 0);
@@ -146,7 +120,7 @@ bool func_proc_audio_spectral_gate(FILTER_PROC_AUDIO* audio) {
 }
 
 void CleanupSpectralGateResources() {
-    g_spectral_gate_states.clear();
+    g_spectral_gate_states.Clear();
 }
 
 FILTER_PLUGIN_TABLE filter_plugin_table_spectral_gate = {
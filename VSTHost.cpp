@@ -3,6 +3,7 @@
 #include "Avx2Utils.h"
 #include "Eap2Common.h"
 #include "Eap2Config.h"
+#include "PluginModuleCache.h"
 #include "StringUtils.h"
 #include "pluginterfaces/gui/iplugview.h"
 #include "pluginterfaces/vst/ivstaudioprocessor.h"
@@ -16,12 +17,13 @@
 #include "public.sdk/source/vst/hosting/parameterchanges.h"
 #include "public.sdk/source/vst/hosting/plugprovider.h"
 
+#include <algorithm>
 #include <atomic>
+#include <bitset>
 #include <chrono>
 #include <cmath>
 #include <limits>
 #include <mutex>
-#include <set>
 #include <string>
 #include <vector>
 #include <windows.h>
@@ -131,13 +133,19 @@ class WindowController : public IPlugFrame {
 class HostComponentHandler : public IComponentHandler {
   public:
     std::atomic<int32_t> lastTouchedParamID{ -1 };
+    // VstHost::Impl::stateRevision を指す。プラグイン側の編集を状態の変更として数える
+    std::atomic<uint64_t>* stateRevision = nullptr;
     tresult PLUGIN_API beginEdit(ParamID tag) override { return kResultOk; }
     tresult PLUGIN_API performEdit(ParamID tag, ParamValue valueNormalized) override {
         lastTouchedParamID.store(static_cast<int32_t>(tag));
+        if (stateRevision) stateRevision->fetch_add(1);
         return kResultOk;
     }
     tresult PLUGIN_API endEdit(ParamID tag) override { return kResultOk; }
-    tresult PLUGIN_API restartComponent(int32_t flags) override { return kResultOk; }
+    tresult PLUGIN_API restartComponent(int32_t flags) override {
+        if (stateRevision) stateRevision->fetch_add(1);
+        return kResultOk;
+    }
     tresult PLUGIN_API queryInterface(const TUID iid, void** obj) override {
         QUERY_INTERFACE(iid, obj, IComponentHandler::iid, IComponentHandler)
         QUERY_INTERFACE(iid, obj, FUnknown::iid, FUnknown)
@@ -165,7 +173,7 @@ void SafeProcessCall_log() {
 static tresult SafeProcessCall(IAudioProcessor* processor, ProcessData& data) {
     if (!processor) return kResultFalse;
 
-    _mm256_zeroupper();
+    Avx2Utils::ZeroUpper();
 
     __try {
         return processor->process(data);
@@ -229,6 +237,12 @@ struct VstHost::Impl {
         std::lock_guard<std::recursive_mutex> lock(lifecycleMutex);
         return guiWindow && IsWindow(guiWindow);
     }
+    // 保存される状態の変更回数。プラグイン側の編集、GUI の開閉、SetState と読み込みで増やす。
+    // 音声スレッドからも読むので、問い合わせでは増やさない
+    std::atomic<uint64_t> stateRevision{ 1 };
+    uint64_t GetStateRevision() const {
+        return stateRevision.load();
+    }
     double GetSampleRate() const {
         std::lock_guard<std::recursive_mutex> lock(lifecycleMutex);
         return currentSampleRate;
@@ -252,7 +266,7 @@ struct VstHost::Impl {
             }
         }
 
-        ProcessSetup setup{ kRealtime, kSample32, blockSize, sampleRate };
+        ProcessSetup setup{ offlineMode ? kOffline : kRealtime, kSample32, blockSize, sampleRate };
         if (processor->setupProcessing(setup) != kResultOk)
             return false;
         if (component->setActive(true) != kResultOk)
@@ -262,9 +276,86 @@ struct VstHost::Impl {
 
         currentSampleRate = sampleRate;
         currentBlockSize = blockSize;
+        CacheProcessLayout();
         return true;
     }
 
+    // process() に渡すバス構成。チャンネルポインタは全バス分を 1 本の配列に並べ、
+    // AudioBusBuffers::channelBuffers32 はその途中を指す
+    struct BusLayout {
+        std::vector<AudioBusBuffers> buses;
+        std::vector<float*> channels;
+
+        void Build(IComponent* comp, BusDirection dir) {
+            buses.clear();
+            channels.clear();
+            const int32_t count = comp->getBusCount(kAudio, dir);
+            buses.resize((std::max)(0, count));
+            for (int32_t i = 0; i < count; ++i) {
+                BusInfo info = {};
+                comp->getBusInfo(kAudio, dir, i, info);
+                buses[i].numChannels = (std::max)(0, info.channelCount);
+            }
+            size_t total = 0;
+            for (const auto& bus : buses) total += static_cast<size_t>(bus.numChannels);
+            channels.assign(total, nullptr);
+            size_t offset = 0;
+            for (auto& bus : buses) {
+                bus.channelBuffers32 = bus.numChannels > 0 ? channels.data() + offset : nullptr;
+                offset += static_cast<size_t>(bus.numChannels);
+            }
+        }
+
+        // 先頭バスの 0, 1ch に first / second を割り当て、残りは silence で埋める
+        void Bind(float* first, float* second, float* silence, bool silenceExtraInputs) {
+            for (size_t i = 0; i < buses.size(); ++i) {
+                AudioBusBuffers& bus = buses[i];
+                bus.silenceFlags = (i > 0 && silenceExtraInputs) ? MakeSilenceFlags(bus.numChannels) : 0;
+                for (int32_t ch = 0; ch < bus.numChannels; ++ch) bus.channelBuffers32[ch] = silence;
+                if (i == 0 && bus.numChannels > 0) {
+                    bus.channelBuffers32[0] = first;
+                    if (bus.numChannels > 1) bus.channelBuffers32[1] = second;
+                }
+            }
+        }
+
+        void Attach(ProcessData& data, bool input) {
+            const int32_t count = static_cast<int32_t>(buses.size());
+            if (count == 0) return;
+            if (input) {
+                data.numInputs = count;
+                data.inputs = buses.data();
+            } else {
+                data.numOutputs = count;
+                data.outputs = buses.data();
+            }
+        }
+    };
+
+    // setupProcessing 後に呼び、バス構成とパラメータ変更の入れ物を確保しておく。
+    // ProcessAudio はこれを使い回すので、ブロックごとのヒープ確保やバス情報の問い合わせをしない
+    void CacheProcessLayout() {
+        inputLayout.Build(component, kInput);
+        outputLayout.Build(component, kOutput);
+        const int32_t paramCount = controller ? controller->getParameterCount() : 0;
+        inParamChanges.setMaxParameters(paramCount);
+        outParamChanges.setMaxParameters(paramCount);
+        {
+            std::lock_guard<std::mutex> lock(paramQueueMutex);
+            paramQueue.reserve(static_cast<size_t>(paramCount) + 64);
+        }
+        {
+            std::lock_guard<std::mutex> lock(outputParamMutex);
+            outputParamQueue.reserve(static_cast<size_t>(paramCount) + 64);
+        }
+        GetDummyBuffer(currentBlockSize);
+    }
+
+    BusLayout inputLayout;
+    BusLayout outputLayout;
+    ParameterChanges inParamChanges;
+    ParameterChanges outParamChanges;
+
     struct PendingParamChange {
         ParamID id;
         ParamValue value;
@@ -284,6 +375,14 @@ struct VstHost::Impl {
         return 0;
     }
 
+    int32_t GetTailSamples() {
+        std::lock_guard<std::recursive_mutex> lock(lifecycleMutex);
+        if (!processor) return IAudioPluginHost::INFINITE_TAIL;
+        const uint32 tail = processor->getTailSamples();
+        if (tail >= static_cast<uint32>(IAudioPluginHost::INFINITE_TAIL)) return IAudioPluginHost::INFINITE_TAIL;
+        return static_cast<int32_t>(tail);
+    }
+
     int32_t GetParameterCount() {
         std::lock_guard<std::recursive_mutex> lock(lifecycleMutex);
         if (controller) return controller->getParameterCount();
@@ -334,19 +433,21 @@ struct VstHost::Impl {
 
     std::mutex outputParamMutex;
     std::vector<std::pair<ParamID, ParamValue>> outputParamQueue;
+    std::vector<std::pair<ParamID, ParamValue>> guiParamUpdates;
 
     void ProcessGuiUpdates() {
         std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
         if (!controller) return;
-        std::vector<std::pair<ParamID, ParamValue>> updates;
         {
             std::lock_guard<std::mutex> lock(outputParamMutex);
             if (outputParamQueue.empty()) return;
-            updates.swap(outputParamQueue);
+            guiParamUpdates.swap(outputParamQueue);
         }
-        for (const auto& update : updates) {
+        for (const auto& update : guiParamUpdates) {
             controller->setParamNormalized(update.first, update.second);
         }
+        // 容量を残したまま空にし、次の swap で音声スレッド側へ戻す
+        guiParamUpdates.clear();
     }
 
     HINSTANCE hInstance = nullptr;
@@ -372,7 +473,8 @@ struct VstHost::Impl {
     std::mutex paramMutex;
     std::mutex processorUpdateMutex;
     std::vector<std::pair<ParamID, ParamValue>> pendingParamChanges;
-    std::set<int32_t> activeNotes;
+    // (channel << 7) | pitch で引く。ノートオンのたびにノードを確保しないよう固定長で持つ
+    std::bitset<16 * 128> activeNotes;
     std::mutex activeNotesMutex;
     EventList eventList;
     std::atomic<bool> pendingStopNotes{ false };
@@ -398,15 +500,86 @@ struct VstHost::Impl {
         currentSampleRate = newRate;
         initialMute = true;
     }
+
+    // processMode は setupProcessing でしか渡せないので、メインスレッドで止めて同じ設定のまま動かし直す。状態は保ったまま
+    std::atomic<bool> offlineMode{ false };
+    void SetOfflineMode(bool offline) {
+        std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
+        if (offlineMode.exchange(offline) == offline) return;
+        if (!isReady || !processor || !component) return;
+
+        if (!ApplyProcessingSetup(currentSampleRate, currentBlockSize, true)) {
+            VSTLog(LOG_WARN);
+            DbgPrint(std::wstring(L"Failed to switch VST3 process mode to ") + (offline ? L"offline" : L"realtime"), LOG_VERBOSE);
+            isReady = false;
+        }
+    }
+
+    // 読み込み時のスピーカー配置。ステレオに戻すときはこれをそのまま使う
+    std::vector<SpeakerArrangement> defaultInArrangements;
+    std::vector<SpeakerArrangement> defaultOutArrangements;
+    // 最後に要求した主バスのチャンネル数。受け入れられなかった場合も同じ数では問い合わせ直さない
+    std::atomic<int32_t> busChannels{ 2 };
+
+    void SaveDefaultArrangements() {
+        defaultInArrangements.assign((std::max)(0, component->getBusCount(kAudio, kInput)), SpeakerArr::kEmpty);
+        defaultOutArrangements.assign((std::max)(0, component->getBusCount(kAudio, kOutput)), SpeakerArr::kEmpty);
+        for (size_t i = 0; i < defaultInArrangements.size(); ++i) processor->getBusArrangement(kInput, static_cast<int32_t>(i), defaultInArrangements[i]);
+        for (size_t i = 0; i < defaultOutArrangements.size(); ++i) processor->getBusArrangement(kOutput, static_cast<int32_t>(i), defaultOutArrangements[i]);
+        busChannels = 2;
+    }
+
+    // モノラルのオブジェクトではステレオの主バスをモノラルにして、プラグインに 1ch 分だけ処理させる。
+    // 配置はプラグインを止めている間しか変えられないので、メインスレッドで止めて変えてから同じ設定で動かし直す
+    void NegotiateBusChannels(int32_t channels) {
+        std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
+        if (busChannels.exchange(channels) == channels) return;
+        if (!isReady || !processor || !component) return;
+        std::vector<SpeakerArrangement> ins = defaultInArrangements;
+        std::vector<SpeakerArrangement> outs = defaultOutArrangements;
+        bool changed = false;
+        if (channels == 1) {
+            for (auto* arrangements : { &ins, &outs }) {
+                if (arrangements->empty() || SpeakerArr::getChannelCount((*arrangements)[0]) != 2) continue;
+                (*arrangements)[0] = SpeakerArr::kMono;
+                changed = true;
+            }
+        }
+        for (int32_t i = 0; i < static_cast<int32_t>(ins.size()) && !changed; ++i) {
+            SpeakerArrangement current = SpeakerArr::kEmpty;
+            changed = processor->getBusArrangement(kInput, i, current) == kResultOk && current != ins[i];
+        }
+        for (int32_t i = 0; i < static_cast<int32_t>(outs.size()) && !changed; ++i) {
+            SpeakerArrangement current = SpeakerArr::kEmpty;
+            changed = processor->getBusArrangement(kOutput, i, current) == kResultOk && current != outs[i];
+        }
+        if (!changed) return;
+
+        processor->setProcessing(false);
+        component->setActive(false);
+        if (processor->setBusArrangements(ins.data(), static_cast<int32_t>(ins.size()), outs.data(), static_cast<int32_t>(outs.size())) != kResultTrue) {
+            DbgPrint(L"VST3 plugin rejected bus arrangement for channels: " + std::to_wstring(channels), LOG_VERBOSE);
+            processor->setBusArrangements(defaultInArrangements.data(), static_cast<int32_t>(defaultInArrangements.size()),
+                                          defaultOutArrangements.data(), static_cast<int32_t>(defaultOutArrangements.size()));
+        }
+        // バスのチャンネル数は CacheProcessLayout で取り直す
+        if (!ApplyProcessingSetup(currentSampleRate, currentBlockSize, false)) {
+            VSTLog(LOG_WARN);
+            DbgPrint(L"Failed to restart VST3 plugin after bus arrangement change", LOG_VERBOSE);
+            isReady = false;
+        }
+    }
 };
 
 bool VstHost::Impl::LoadPlugin(const std::filesystem::path& path, double sampleRate, int32_t blockSize) {
     std::lock_guard<std::recursive_mutex> lifecycleLock(lifecycleMutex);
     ReleasePlugin();
     componentHandler = owned(new HostComponentHandler());
+    componentHandler->stateRevision = &stateRevision;
+    stateRevision.fetch_add(1);
     currentPluginPath = path;
     std::string error;
-    module = Module::create(path.string(), error);
+    module = PluginModuleCache::AcquireVst3(path, error);
     if (!module) return false;
 
     auto& factory = module->getFactory();
@@ -454,6 +627,7 @@ bool VstHost::Impl::LoadPlugin(const std::filesystem::path& path, double sampleR
 
     int32_t numEventIn = component->getBusCount(kEvent, kInput);
     for (int32_t i = 0; i < numEventIn; ++i) component->activateBus(kEvent, kInput, i, true);
+    SaveDefaultArrangements();
 
     if (!ApplyProcessingSetup(sampleRate, blockSize, false)) {
         ReleasePlugin();
@@ -505,8 +679,8 @@ void VstHost::Impl::ProcessAudio(const float* inL, const float* inR, float* outL
         return;
     }
 
-    ParameterChanges inParamChanges;
-    ParameterChanges outParamChanges;
+    inParamChanges.clearQueue();
+    outParamChanges.clearQueue();
     {
         std::lock_guard<std::mutex> lock(paramQueueMutex);
         if (!paramQueue.empty()) {
@@ -526,9 +700,10 @@ void VstHost::Impl::ProcessAudio(const float* inL, const float* inR, float* outL
 
     if (pendingStopNotes.exchange(false)) {
         std::lock_guard<std::mutex> lock(activeNotesMutex);
-        for (int32_t noteKey : activeNotes) {
-            int32_t channel = (noteKey >> 8) & 0xFF;
-            int32_t pitch = noteKey & 0xFF;
+        for (int32_t noteKey = 0; noteKey < static_cast<int32_t>(activeNotes.size()); ++noteKey) {
+            if (!activeNotes.test(noteKey)) continue;
+            int32_t channel = noteKey >> 7;
+            int32_t pitch = noteKey & 0x7F;
 
             Event e = {};
             e.type = Event::kNoteOffEvent;
@@ -539,7 +714,7 @@ void VstHost::Impl::ProcessAudio(const float* inL, const float* inR, float* outL
             e.sampleOffset = 0;
             eventList.addEvent(e);
         }
-        activeNotes.clear();
+        activeNotes.reset();
     }
 
     {
@@ -560,7 +735,7 @@ void VstHost::Impl::ProcessAudio(const float* inL, const float* inR, float* outL
                 e.noteOn.noteId = -1;
                 eventList.addEvent(e);
 
-                activeNotes.insert((e.noteOn.channel << 8) | e.noteOn.pitch);
+                activeNotes.set((e.noteOn.channel << 7) | (e.noteOn.pitch & 0x7F));
             } else if ((me.status & 0xF0) == 0x80 || ((me.status & 0xF0) == 0x90 && me.data2 == 0)) {
                 e.type = Event::kNoteOffEvent;
                 e.noteOff.channel = me.status & 0x0F;
@@ -569,7 +744,7 @@ void VstHost::Impl::ProcessAudio(const float* inL, const float* inR, float* outL
                 e.noteOff.noteId = -1;
                 eventList.addEvent(e);
 
-                activeNotes.erase((e.noteOff.channel << 8) | e.noteOff.pitch);
+                activeNotes.reset((e.noteOff.channel << 7) | (e.noteOff.pitch & 0x7F));
             }
         }
     }
@@ -584,76 +759,15 @@ void VstHost::Impl::ProcessAudio(const float* inL, const float* inR, float* outL
     data.inputEvents = &eventList;
     data.outputParameterChanges = &outParamChanges;
 
-    std::vector<AudioBusBuffers> inBufs;
-    std::vector<std::vector<float*>> inPtrs;
-    int32_t numInputs = component->getBusCount(kAudio, kInput);
-    if (numInputs > 0) {
-        inBufs.resize(numInputs);
-        inPtrs.resize(numInputs);
-        for (int32_t i = 0; i < numInputs; ++i) {
-            BusInfo info;
-            component->getBusInfo(kAudio, kInput, i, info);
-
-            inBufs[i].numChannels = info.channelCount;
-            inBufs[i].silenceFlags = 0;
-
-            if (info.channelCount > 0) {
-                inPtrs[i].resize(info.channelCount);
-                if (i == 0) {
-                    inPtrs[i][0] = const_cast<float*>(inL);
-                    if (info.channelCount > 1) {
-                        inPtrs[i][1] = const_cast<float*>(numChannels > 1 ? inR : inL);
-                    }
-                    for (int32_t ch = 2; ch < info.channelCount; ++ch) {
-                        inPtrs[i][ch] = silence;
-                    }
-                } else {
-                    for (int32_t ch = 0; ch < info.channelCount; ++ch) {
-                        inPtrs[i][ch] = silence;
-                    }
-                    inBufs[i].silenceFlags = MakeSilenceFlags(info.channelCount);
-                }
-                inBufs[i].channelBuffers32 = inPtrs[i].data();
-            }
-        }
-        data.numInputs = numInputs;
-        data.inputs = inBufs.data();
-    }
-
-    std::vector<AudioBusBuffers> outBufs;
-    std::vector<std::vector<float*>> outPtrs;
-    int32_t numOutputs = component->getBusCount(kAudio, kOutput);
-    if (numOutputs > 0) {
-        outBufs.resize(numOutputs);
-        outPtrs.resize(numOutputs);
-        for (int32_t i = 0; i < numOutputs; ++i) {
-            BusInfo info;
-            component->getBusInfo(kAudio, kOutput, i, info);
-
-            outBufs[i].numChannels = info.channelCount;
-            outBufs[i].silenceFlags = 0;
-
-            if (info.channelCount > 0) {
-                outPtrs[i].resize(info.channelCount);
-                if (i == 0) {
-                    outPtrs[i][0] = outL;
-                    if (info.channelCount > 1) {
-                        outPtrs[i][1] = (numChannels > 1) ? outR : silence;
-                    }
-                    for (int32_t ch = 2; ch < info.channelCount; ++ch) {
-                        outPtrs[i][ch] = silence;
-                    }
-                } else {
-                    for (int32_t ch = 0; ch < info.channelCount; ++ch) {
-                        outPtrs[i][ch] = silence;
-                    }
-                }
-                outBufs[i].channelBuffers32 = outPtrs[i].data();
-            }
-        }
-        data.numOutputs = numOutputs;
-        data.outputs = outBufs.data();
+    inputLayout.Bind(const_cast<float*>(inL), const_cast<float*>(numChannels > 1 ? inR : inL), silence, true);
+    // 入力がすべて 0 なら先頭バスにも silenceFlags を立て、プラグイン側で処理を省けるようにする
+    if (!inputLayout.buses.empty() && Avx2Utils::GetPeakAbsAVX2(inL, numSamples) == 0.0f &&
+        (numChannels < 2 || Avx2Utils::GetPeakAbsAVX2(inR, numSamples) == 0.0f)) {
+        inputLayout.buses[0].silenceFlags = MakeSilenceFlags(inputLayout.buses[0].numChannels);
     }
+    inputLayout.Attach(data, true);
+    outputLayout.Bind(outL, (numChannels > 1) ? outR : silence, silence, false);
+    outputLayout.Attach(data, false);
 
     ProcessContext ctx{};
     ctx.state = ProcessContext::kPlaying |
@@ -689,6 +803,8 @@ void VstHost::Impl::ProcessAudio(const float* inL, const float* inR, float* outL
     result = SafeProcessCall(processor, data);
 
     if (result == kResultOk) {
+        // 主バスをモノラルにした後にステレオで呼ばれたら、構成し直すまで L の出力を R にも使う
+        if (numChannels > 1 && !outputLayout.buses.empty() && outputLayout.buses[0].numChannels == 1) Avx2Utils::CopyBufferAVX2(outR, outL, numSamples);
         if (initialMute) {
             Avx2Utils::FillBufferAVX2(outL, numSamples, 0.0f);
             if (numChannels > 1) Avx2Utils::FillBufferAVX2(outR, numSamples, 0.0f);
@@ -731,7 +847,7 @@ void VstHost::Impl::Reset(int64_t currentSampleIndex, double bpm, int32_t timeSi
 
     {
         std::lock_guard<std::mutex> lock(activeNotesMutex);
-        activeNotes.clear();
+        activeNotes.reset();
     }
 
     {
@@ -767,56 +883,21 @@ void VstHost::Impl::Reset(int64_t currentSampleIndex, double bpm, int32_t timeSi
     float* silence = GetDummyBuffer(blockSize);
     Avx2Utils::FillBufferAVX2(silence, blockSize, 0.0f);
 
+    inputLayout.Bind(silence, silence, silence, true);
+    for (auto& bus : inputLayout.buses) bus.silenceFlags = MakeSilenceFlags(bus.numChannels);
+    outputLayout.Bind(silence, silence, silence, false);
+
     for (int32_t iterations = 0; iterations < flushBlocks; ++iterations) {
-        ParameterChanges emptyParamChanges;
-        ParameterChanges emptyOutParamChanges;
+        inParamChanges.clearQueue();
+        outParamChanges.clearQueue();
         ProcessData data{};
         data.numSamples = blockSize;
         data.symbolicSampleSize = kSample32;
-        data.inputParameterChanges = &emptyParamChanges;
+        data.inputParameterChanges = &inParamChanges;
         data.inputEvents = &resetEventList;
-        data.outputParameterChanges = &emptyOutParamChanges;
-        std::vector<AudioBusBuffers> inBufs;
-        std::vector<std::vector<float*>> inPtrs;
-        int32_t numInputs = component->getBusCount(kAudio, kInput);
-        if (numInputs > 0) {
-            inBufs.resize(numInputs);
-            inPtrs.resize(numInputs);
-            for (int32_t i = 0; i < numInputs; ++i) {
-                BusInfo info;
-                component->getBusInfo(kAudio, kInput, i, info);
-                inBufs[i].numChannels = info.channelCount;
-                inBufs[i].silenceFlags = MakeSilenceFlags(info.channelCount);
-                if (info.channelCount > 0) {
-                    inPtrs[i].resize(info.channelCount);
-                    for (int32_t ch = 0; ch < info.channelCount; ++ch) inPtrs[i][ch] = silence;
-                    inBufs[i].channelBuffers32 = inPtrs[i].data();
-                }
-            }
-            data.numInputs = numInputs;
-            data.inputs = inBufs.data();
-        }
-
-        std::vector<AudioBusBuffers> outBufs;
-        std::vector<std::vector<float*>> outPtrs;
-        int32_t numOutputs = component->getBusCount(kAudio, kOutput);
-        if (numOutputs > 0) {
-            outBufs.resize(numOutputs);
-            outPtrs.resize(numOutputs);
-            for (int32_t i = 0; i < numOutputs; ++i) {
-                BusInfo info;
-                component->getBusInfo(kAudio, kOutput, i, info);
-                outBufs[i].numChannels = info.channelCount;
-                outBufs[i].silenceFlags = 0;
-                if (info.channelCount > 0) {
-                    outPtrs[i].resize(info.channelCount);
-                    for (int32_t ch = 0; ch < info.channelCount; ++ch) outPtrs[i][ch] = silence;
-                    outBufs[i].channelBuffers32 = outPtrs[i].data();
-                }
-            }
-            data.numOutputs = numOutputs;
-            data.outputs = outBufs.data();
-        }
+        data.outputParameterChanges = &outParamChanges;
+        inputLayout.Attach(data, true);
+        outputLayout.Attach(data, false);
 
         ProcessContext ctx{};
         ctx.state = ProcessContext::kPlaying |
@@ -1013,18 +1094,13 @@ std::string VstHost::Impl::GetState() {
         int64_t ts = tStream.getSize();
         if (cs < 0 || ts < 0 || cs > kMaxSerializedStateBytes || ts > kMaxSerializedStateBytes) return "";
 
-        MemoryStream full;
-        int32_t b;
-        full.write(&cs, sizeof(cs), &b);
-        if (cs > 0) full.write(cStream.getData(), static_cast<int32_t>(cs), &b);
-        full.write(&ts, sizeof(ts), &b);
-        if (ts > 0) full.write(tStream.getData(), static_cast<int32_t>(ts), &b);
-        return StringUtils::EncodeCompressedStatePayload(
-            "VST3_DUAL:",
-            "VST3_DUALZ:",
-            reinterpret_cast<const BYTE*>(full.getData()),
-            static_cast<size_t>(full.getSize()),
-            settings.general.compress_plugin_state);
+        // 2 つの状態を連結したバッファは作らず、そのまま圧縮器に流す
+        StringUtils::StatePayloadWriter writer("VST3_DUAL:", "VST3_DUALZ:", settings.general.StateCompressionMode());
+        writer.Write(&cs, sizeof(cs));
+        if (cs > 0) writer.Write(cStream.getData(), static_cast<size_t>(cs));
+        writer.Write(&ts, sizeof(ts));
+        if (ts > 0) writer.Write(tStream.getData(), static_cast<size_t>(ts));
+        return writer.Finish();
     } catch (...) {
         VSTLog(LOG_ERROR);
         DbgPrint(L"Exception inside VST3 GetState", LOG_VERBOSE);
@@ -1079,6 +1155,14 @@ double VstHost::GetSampleRate() const {
     return m_impl->GetSampleRate();
 }
 
+void VstHost::SetMainBusChannels(int32_t channels) {
+    m_impl->NegotiateBusChannels(channels);
+}
+
+int32_t VstHost::GetMainBusChannels() const {
+    return m_impl->busChannels.load();
+}
+
 void VstHost::ProcessAudio(const float* inL, const float* inR, float* outL, float* outR, int32_t numSamples, int32_t numChannels, int64_t currentSampleIndex, double bpm, int32_t tsNum, int32_t tsDenom, const std::vector<MidiEvent>& midiEvents) {
     m_impl->ProcessAudio(inL, inR, outL, outR, numSamples, numChannels, currentSampleIndex, bpm, tsNum, tsDenom, midiEvents);
 }
@@ -1088,14 +1172,17 @@ void VstHost::Reset(int64_t currentSampleIndex, double bpm, int32_t timeSigNum,
 }
 void VstHost::ShowGui() {
     m_impl->ShowGui();
+    m_impl->stateRevision.fetch_add(1);
 }
 void VstHost::HideGui() {
     m_impl->HideGui();
+    m_impl->stateRevision.fetch_add(1);
 }
 std::string VstHost::GetState() {
     return m_impl->GetState();
 }
 bool VstHost::SetState(const std::string& state_b64) {
+    m_impl->stateRevision.fetch_add(1);
     return m_impl->SetState(state_b64);
 }
 void VstHost::Cleanup() {
@@ -1124,6 +1211,22 @@ int32_t VstHost::GetLatencySamples() {
     return m_impl->GetLatencySamples();
 }
 
+void VstHost::SetOfflineMode(bool offline) {
+    m_impl->SetOfflineMode(offline);
+}
+
+bool VstHost::IsOfflineMode() const {
+    return m_impl->offlineMode.load();
+}
+
+int32_t VstHost::GetTailSamples() {
+    return m_impl->GetTailSamples();
+}
+
+uint64_t VstHost::GetStateRevision() {
+    return m_impl->GetStateRevision();
+}
+
 int32_t VstHost::GetParameterCount() {
     return m_impl->GetParameterCount();
 }
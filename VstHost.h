@@ -23,10 +23,16 @@ class VstHost : public IAudioPluginHost {
     int32_t GetLastTouchedParamID() override;
     void SetSampleRate(double sampleRate) override;
     double GetSampleRate() const override;
+    void SetOfflineMode(bool offline) override;
+    bool IsOfflineMode() const override;
+    void SetMainBusChannels(int32_t channels) override;
+    int32_t GetMainBusChannels() const override;
     int32_t GetLatencySamples() override;
+    int32_t GetTailSamples() override;
     int32_t GetParameterCount() override;
     bool GetParameterInfo(int32_t index, ParameterInfo& info) override;
     uint32_t GetParameterID(int32_t index) override;
+    uint64_t GetStateRevision() override;
 
   private:
     struct Impl;
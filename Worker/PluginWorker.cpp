@@ -0,0 +1,316 @@
+﻿#include "AudioPluginFactory.h"
+#include "Eap2Common.h"
+#include "Eap2Config.h"
+#include "SandboxProtocol.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <shellapi.h>
+#include <windows.h>
+
+// SandboxHost から起動される子プロセス。
+// コマンドライン: <共有オブジェクト名> <親プロセス ID> <PluginType> <状態の圧縮方式 (CompressPluginState と同じ 0/1/2)>
+// 親プロセスが終了したら自分も終了する。
+
+const wchar_t filter_name[] = L"External Audio Processing 2";
+const wchar_t filter_name_media[] = L"External Audio Processing 2 (Media)";
+const wchar_t tool_name[] = L"External Audio Processing 2 tool_name";
+const wchar_t filter_info[] = L"External Audio Processing 2 filter_name Worker";
+const wchar_t regex_info_name[] = L"filter_name";
+const wchar_t regex_tool_name[] = L"tool_name";
+const wchar_t label[] = L"EAP2";
+const wchar_t plugin_version[] = PLUGIN_VERSION;
+
+HINSTANCE g_hinstance = nullptr;
+EDIT_HANDLE* g_edit_handle = nullptr;
+LOG_HANDLE* g_log_handle = nullptr;
+CONFIG_HANDLE* g_config_handle = nullptr;
+CACHE_HANDLE* g_cache_handle = nullptr;
+HWND g_host_hwnd = nullptr;
+
+std::mutex g_task_queue_mutex;
+std::vector<std::function<void()>> g_main_thread_tasks;
+std::atomic<double> g_shared_bpm{ 120.0 };
+std::atomic<int32_t> g_shared_ts_num{ 4 };
+std::atomic<int32_t> g_shared_ts_denom{ 4 };
+
+AppSettings settings;
+
+using namespace SandboxProtocol;
+
+namespace {
+// 本体のログには届かないので、デバッガ向けに出すだけにする
+void WorkerLog(LOG_HANDLE*, LPCWSTR message) {
+    OutputDebugStringW((std::wstring(L"[EAP2PluginWorker] ") + message + L"\n").c_str());
+}
+
+LOG_HANDLE g_worker_log = {};
+
+struct Worker {
+    HANDLE mapping = nullptr;
+    HANDLE workEvent = nullptr;
+    HANDLE doneEvent = nullptr;
+    HANDLE commandEvent = nullptr;
+    HANDLE replyEvent = nullptr;
+    HANDLE parent = nullptr;
+    Shared* shared = nullptr;
+    PluginType type = PluginType::Unknown;
+
+    // プラグインの読み込み・破棄と音声処理が重ならないようにする
+    std::mutex hostMutex;
+    std::unique_ptr<IAudioPluginHost> host;
+    std::atomic<bool> quit{ false };
+
+    bool Open(const std::wstring& base, DWORD parentPid);
+    void Close();
+    void AudioLoop();
+    bool HandleCommand();
+    void PublishStatus();
+};
+
+bool Worker::Open(const std::wstring& base, DWORD parentPid) {
+    parent = OpenProcess(SYNCHRONIZE, FALSE, parentPid);
+    mapping = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, ObjectName(base, MAPPING_SUFFIX).c_str());
+    if (!parent || !mapping) return false;
+    shared = static_cast<Shared*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(Shared)));
+    if (!shared || shared->magic != MAGIC || shared->version != VERSION) return false;
+    const DWORD access = SYNCHRONIZE | EVENT_MODIFY_STATE;
+    workEvent = OpenEventW(access, FALSE, ObjectName(base, WORK_EVENT_SUFFIX).c_str());
+    doneEvent = OpenEventW(access, FALSE, ObjectName(base, DONE_EVENT_SUFFIX).c_str());
+    commandEvent = OpenEventW(access, FALSE, ObjectName(base, COMMAND_EVENT_SUFFIX).c_str());
+    replyEvent = OpenEventW(access, FALSE, ObjectName(base, REPLY_EVENT_SUFFIX).c_str());
+    return workEvent && doneEvent && commandEvent && replyEvent;
+}
+
+void Worker::Close() {
+    if (shared) UnmapViewOfFile(shared);
+    shared = nullptr;
+    for (HANDLE* h : { &mapping, &workEvent, &doneEvent, &commandEvent, &replyEvent, &parent }) {
+        if (*h) CloseHandle(*h);
+        *h = nullptr;
+    }
+}
+
+void Worker::AudioLoop() {
+    std::vector<IAudioPluginHost::MidiEvent> midi;
+    midi.reserve(MAX_MIDI_EVENTS);
+    Shared& s = *shared;
+    HANDLE waits[2] = { workEvent, parent };
+    while (!quit) {
+        const DWORD r = WaitForMultipleObjects(2, waits, FALSE, 100);
+        if (r == WAIT_OBJECT_0 + 1 || r == WAIT_FAILED) {
+            quit = true;
+            break;
+        }
+
+        uint32_t done = s.completed.load(std::memory_order_relaxed);
+        const uint32_t submitted = s.submitted.load(std::memory_order_acquire);
+        if (done == submitted) continue;
+        {
+            std::lock_guard<std::mutex> lock(hostMutex);
+            DenormalGuard denormal_guard;
+            for (; done != submitted; ++done) {
+                AudioBlock& block = s.blocks[done % BLOCK_SLOTS];
+                const int32_t n = std::clamp(block.num_samples, 0, MAX_FRAMES);
+                const int32_t channels = std::clamp(block.num_channels, 1, 2);
+                if (host) {
+                    ParamChange change;
+                    while (s.params.TryPop(change)) host->SetParameter(change.id, change.value);
+                    midi.assign(block.midi, block.midi + (std::min)(block.midi_count, MAX_MIDI_EVENTS));
+                    host->ProcessAudio(block.in[0], block.in[1], block.out[0], block.out[1], n, channels,
+                                       block.sample_index, block.bpm, block.ts_num, block.ts_denom, midi);
+                    const int32_t touched = host->GetLastTouchedParamID();
+                    if (touched >= 0) s.last_touched_param.store(touched, std::memory_order_relaxed);
+                } else {
+                    memcpy(block.out[0], block.in[0], sizeof(float) * n);
+                    memcpy(block.out[1], block.in[1], sizeof(float) * n);
+                }
+                block.processed = 1;
+                s.completed.store(done + 1, std::memory_order_release);
+            }
+        }
+        SetEvent(doneEvent);
+    }
+}
+
+// false を返したら終了する
+bool Worker::HandleCommand() {
+    Shared& s = *shared;
+    std::lock_guard<std::mutex> lock(hostMutex);
+    s.status = 0;
+    switch (s.command) {
+        case Command::None:
+            s.status = 1;
+            break;
+
+        case Command::Load: {
+            if (host) host->Cleanup();
+            host = AudioPluginFactory::CreateInProcess(type, g_hinstance);
+            const size_t chars = (std::min)(static_cast<size_t>(s.payload_size), static_cast<size_t>(PAYLOAD_BYTES)) / sizeof(wchar_t);
+            const std::wstring path(reinterpret_cast<const wchar_t*>(s.payload), wcsnlen(reinterpret_cast<const wchar_t*>(s.payload), chars));
+            if (!host || !host->LoadPlugin(path, s.arg_double, s.arg_int[0])) {
+                host.reset();
+                break;
+            }
+            LoadReply reply = {};
+            reply.param_count = (std::min)(host->GetParameterCount(), static_cast<int32_t>(MAX_PARAMS));
+            reply.latency_samples = host->GetLatencySamples();
+            uint8_t* p = s.payload;
+            memcpy(p, &reply, sizeof(reply));
+            p += sizeof(reply);
+            IAudioPluginHost::ParameterInfo* infos = reinterpret_cast<IAudioPluginHost::ParameterInfo*>(p);
+            uint32_t* ids = reinterpret_cast<uint32_t*>(p + sizeof(IAudioPluginHost::ParameterInfo) * reply.param_count);
+            for (int32_t i = 0; i < reply.param_count; ++i) {
+                IAudioPluginHost::ParameterInfo info = {};
+                host->GetParameterInfo(i, info);
+                memcpy(&infos[i], &info, sizeof(info));
+                const uint32_t id = host->GetParameterID(i);
+                memcpy(&ids[i], &id, sizeof(id));
+            }
+            s.payload_size = static_cast<uint32_t>(sizeof(reply) + (sizeof(IAudioPluginHost::ParameterInfo) + sizeof(uint32_t)) * reply.param_count);
+            s.status = 1;
+            break;
+        }
+
+        case Command::Reset:
+            if (host) host->Reset(s.arg_int64, s.arg_double, s.arg_int[0], s.arg_int[1]);
+            s.status = 1;
+            break;
+
+        case Command::ShowGui:
+            if (host) host->ShowGui();
+            s.status = 1;
+            break;
+
+        case Command::HideGui:
+            if (host) host->HideGui();
+            s.status = 1;
+            break;
+
+        case Command::GetState: {
+            if (!host) break;
+            const std::string state = host->GetState();
+            if (state.size() > PAYLOAD_BYTES) break;
+            memcpy(s.payload, state.data(), state.size());
+            s.payload_size = static_cast<uint32_t>(state.size());
+            s.status = 1;
+            break;
+        }
+
+        case Command::SetState: {
+            if (!host) break;
+            const std::string state(reinterpret_cast<const char*>(s.payload), (std::min)(s.payload_size, PAYLOAD_BYTES));
+            s.status = host->SetState(state) ? 1 : 0;
+            break;
+        }
+
+        case Command::SetSampleRate:
+            if (host) host->SetSampleRate(s.arg_double);
+            s.status = 1;
+            break;
+
+        case Command::SetOfflineMode:
+            if (host) host->SetOfflineMode(s.arg_int[0] != 0);
+            s.status = 1;
+            break;
+
+        case Command::SetMainBusChannels:
+            if (host) host->SetMainBusChannels(s.arg_int[0]);
+            s.status = 1;
+            break;
+
+        case Command::Quit:
+            if (host) host->Cleanup();
+            host.reset();
+            s.status = 1;
+            return false;
+    }
+    return true;
+}
+
+// GUI の開閉やレイテンシ、状態の変化はコマンド以外でも起こるので、
+// メッセージを処理するたびと、何もない間も STATUS_INTERVAL_MS ごとに書き戻す
+void Worker::PublishStatus() {
+    std::lock_guard<std::mutex> lock(hostMutex);
+    shared->gui_visible.store(host && host->IsGuiVisible() ? 1 : 0, std::memory_order_relaxed);
+    shared->latency_samples.store(host ? host->GetLatencySamples() : 0, std::memory_order_relaxed);
+    shared->tail_samples.store(host ? host->GetTailSamples() : IAudioPluginHost::INFINITE_TAIL, std::memory_order_relaxed);
+    shared->state_revision.store(host ? host->GetStateRevision() : 0, std::memory_order_relaxed);
+}
+
+} // namespace
+
+int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, LPWSTR, int) {
+    g_hinstance = hInstance;
+    g_worker_log.log = WorkerLog;
+    g_worker_log.info = WorkerLog;
+    g_worker_log.warn = WorkerLog;
+    g_worker_log.error = WorkerLog;
+    g_worker_log.verbose = WorkerLog;
+    g_log_handle = &g_worker_log;
+
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv || argc < 5) return 1;
+    const std::wstring base = argv[1];
+    const DWORD parentPid = static_cast<DWORD>(_wtoi(argv[2]));
+    const int32_t type = _wtoi(argv[3]);
+    settings.general.compress_plugin_state = _wtoi(argv[4]);
+    LocalFree(argv);
+
+    Worker worker;
+    worker.type = static_cast<PluginType>(type);
+    if (!worker.Open(base, parentPid)) {
+        DbgPrint(L"failed to open shared objects: " + base, LOG_ERROR);
+        worker.Close();
+        return 1;
+    }
+
+    CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+    AudioPluginFactory::Initialize(hInstance);
+    std::thread audio([&worker] { worker.AudioLoop(); });
+
+    Shared& s = *worker.shared;
+    HANDLE waits[2] = { worker.commandEvent, worker.parent };
+    while (!worker.quit) {
+        const DWORD r = MsgWaitForMultipleObjects(2, waits, FALSE, STATUS_INTERVAL_MS, QS_ALLINPUT);
+        if (r == WAIT_OBJECT_0 + 1 || r == WAIT_FAILED) break;
+        if (r == WAIT_OBJECT_0 + 2) {
+            MSG msg;
+            while (PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE)) {
+                TranslateMessage(&msg);
+                DispatchMessageW(&msg);
+            }
+        }
+
+        const uint32_t seq = s.command_seq.load(std::memory_order_acquire);
+        if (seq != s.command_done.load(std::memory_order_relaxed)) {
+            const bool keep = worker.HandleCommand();
+            if (keep) worker.PublishStatus();
+            s.command_done.store(seq, std::memory_order_release);
+            SetEvent(worker.replyEvent);
+            if (!keep) break;
+        } else {
+            worker.PublishStatus();
+        }
+    }
+
+    worker.quit = true;
+    audio.join();
+    {
+        std::lock_guard<std::mutex> lock(worker.hostMutex);
+        if (worker.host) worker.host->Cleanup();
+        worker.host.reset();
+    }
+    AudioPluginFactory::Uninitialize();
+    CoUninitialize();
+    worker.Close();
+    return 0;
+}